@@ -1302,12 +1302,19 @@ static void deal_with_unplugged_cpus(void)
  * elsewhere.
  */
 
+/* set in a forked child, whose vCPU threads adopt the old TCG contexts */
+static bool tcg_vcpus_forked;
+
 static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
 {
     CPUState *cpu = arg;
 
     rcu_register_thread();
-    tcg_register_thread();
+    if (tcg_vcpus_forked) {
+        tcg_reregister_thread(0);
+    } else {
+        tcg_register_thread();
+    }
 
     qemu_mutex_lock_iothread();
     qemu_thread_get_self(cpu->thread);
@@ -1455,7 +1462,11 @@ static void *qemu_tcg_cpu_thread_fn(void *arg)
     g_assert(!use_icount);
 
     rcu_register_thread();
-    tcg_register_thread();
+    if (tcg_vcpus_forked) {
+        tcg_reregister_thread(cpu->cpu_index);
+    } else {
+        tcg_register_thread();
+    }
 
     qemu_mutex_lock_iothread();
     qemu_thread_get_self(cpu->thread);
@@ -1716,6 +1727,58 @@ static void qemu_tcg_init_vcpu(CPUState *cpu)
     }
 }
 
+/*
+ * Only the forking thread survives fork(). Re-create the TCG vCPU threads
+ * in a child that was forked with all vCPUs stopped. The old halt conds
+ * may have phantom waiters so they are not reused.
+ */
+void qemu_tcg_vcpus_after_fork(void)
+{
+    char thread_name[VCPU_THREAD_NAME_SIZE];
+    QemuThread *thread = NULL;
+    QemuCond *halt_cond = NULL;
+    CPUState *cpu;
+
+    g_assert(tcg_enabled() && !runstate_is_running());
+
+    tcg_vcpus_forked = true;
+
+    CPU_FOREACH(cpu) {
+        cpu->created = false;
+    }
+
+    CPU_FOREACH(cpu) {
+        if (thread && !qemu_tcg_mttcg_enabled()) {
+            /* round robin thread already marked every vCPU created */
+            cpu->thread = thread;
+            cpu->halt_cond = halt_cond;
+            continue;
+        }
+
+        thread = g_malloc0(sizeof(QemuThread));
+        halt_cond = g_malloc0(sizeof(QemuCond));
+        qemu_cond_init(halt_cond);
+        cpu->thread = thread;
+        cpu->halt_cond = halt_cond;
+
+        if (qemu_tcg_mttcg_enabled()) {
+            snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/TCG",
+                     cpu->cpu_index);
+            qemu_thread_create(thread, thread_name, qemu_tcg_cpu_thread_fn,
+                               cpu, QEMU_THREAD_JOINABLE);
+        } else {
+            snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "ALL CPUs/TCG");
+            qemu_thread_create(thread, thread_name,
+                               qemu_tcg_rr_cpu_thread_fn,
+                               cpu, QEMU_THREAD_JOINABLE);
+        }
+
+        while (!cpu->created) {
+            qemu_cond_wait(&qemu_cpu_cond, &qemu_global_mutex);
+        }
+    }
+}
+
 static void qemu_hax_start_vcpu(CPUState *cpu)
 {
     char thread_name[VCPU_THREAD_NAME_SIZE];
@@ -5,4 +5,5 @@ CONFIG_OPENCORES_ETH=y
 CONFIG_PFLASH_CFI01=y
 CONFIG_SSP=y
 CONFIG_DW_DMA_DSP=y
+CONFIG_HDA_DMA_DSP=y
 CONFIG_ADSP_DSP=y
@@ -0,0 +1,74 @@
+/* IPC doorbell between host and audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/main-loop.h"
+
+#include "qemu/io-bridge.h"
+#include "hw/adsp/doorbell.h"
+
+/* peer rang the doorbell */
+static void doorbell_read(void *opaque)
+{
+    struct adsp_doorbell *db = opaque;
+
+    if (event_notifier_test_and_clear(&db->notifier))
+        db->ring(db->opaque);
+}
+
+/* called by the bridge thread when the peer (dis)connects */
+static void doorbell_bind(void *data, int fd)
+{
+    struct adsp_doorbell *db = data;
+    bool locked = qemu_mutex_iothread_locked();
+
+    if (!locked)
+        qemu_mutex_lock_iothread();
+
+    if (db->bound) {
+        qemu_set_fd_handler(event_notifier_get_fd(&db->notifier),
+            NULL, NULL, NULL);
+        event_notifier_cleanup(&db->notifier);
+        db->bound = false;
+    }
+
+    if (fd >= 0) {
+        event_notifier_init_fd(&db->notifier, fd);
+        qemu_set_fd_handler(fd, doorbell_read, NULL, db);
+        db->bound = true;
+    }
+
+    if (!locked)
+        qemu_mutex_unlock_iothread();
+}
+
+void adsp_doorbell_init(struct adsp_doorbell *db,
+    void (*ring)(void *opaque), void *opaque)
+{
+    int err;
+
+    db->ring = ring;
+    db->opaque = opaque;
+
+    err = qemu_io_register_doorbell(doorbell_bind, db);
+    if (err < 0)
+        fprintf(stderr, "error: cant register doorbell %d\n", err);
+}
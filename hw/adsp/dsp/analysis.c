@@ -0,0 +1,120 @@
+/* Audio analysis reporting for audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * -machine audio-analysis=<hz>[,audio-analysis-file=<json>] measures
+ * every SSP stream against a <hz> tone, e.g. the sine capture source
+ * looped through the firmware. Results are read with
+ * query-adsp-audio-analysis and written to <json> when QEMU exits.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu-common.h"
+#include "qemu/cutils.h"
+#include "qemu/option.h"
+#include "sysemu/sysemu.h"
+#include "qapi/qobject-output-visitor.h"
+#include "qapi/qmp/qjson.h"
+#include "qapi-visit.h"
+#include "qmp-commands.h"
+
+#include "hw/audio/adsp-dev.h"
+#include "hw/ssi/ssp.h"
+
+#define ANALYSIS_FREQ		1000
+
+static struct {
+    bool enabled;
+    char *file;
+} analysis;
+
+static void analysis_exit(Notifier *n, void *data)
+{
+    AdspAudioAnalysis *info;
+    QObject *obj;
+    QString *json;
+    Visitor *v;
+    FILE *f;
+
+    if (analysis.file == NULL)
+        return;
+
+    info = ssp_analysis_query(false);
+    v = qobject_output_visitor_new(&obj);
+    visit_type_AdspAudioAnalysis(v, NULL, &info, &error_abort);
+    visit_complete(v, &obj);
+    visit_free(v);
+    qapi_free_AdspAudioAnalysis(info);
+
+    json = qobject_to_json_pretty(obj);
+    qobject_decref(obj);
+
+    f = fopen(analysis.file, "w");
+    if (f == NULL) {
+        fprintf(stderr, "error: analysis: cant open %s %d\n",
+            analysis.file, -errno);
+    } else {
+        fprintf(f, "%s\n", qstring_get_str(json));
+        fclose(f);
+        printf(" ** audio analysis written to %s\n", analysis.file);
+    }
+    QDECREF(json);
+}
+
+static Notifier analysis_exit_notifier = {
+    .notify = analysis_exit,
+};
+
+AdspAudioAnalysis *qmp_query_adsp_audio_analysis(bool has_reset, bool reset,
+                                                 Error **errp)
+{
+    if (!analysis.enabled) {
+        error_setg(errp, "audio analysis is not enabled, "
+            "use -machine audio-analysis=<hz>");
+        return NULL;
+    }
+
+    return ssp_analysis_query(has_reset && reset);
+}
+
+void adsp_analysis_init(struct adsp_dev *adsp)
+{
+    const char *opt = qemu_opt_get(adsp->machine_opts, "audio-analysis");
+    uint64_t freq = ANALYSIS_FREQ;
+
+    if (opt == NULL)
+        return;
+
+    if (qemu_strtou64(opt, NULL, 0, &freq) < 0 || freq == 0 ||
+        freq > 96000) {
+        fprintf(stderr, "error: analysis: invalid freq %s\n", opt);
+        freq = ANALYSIS_FREQ;
+    }
+
+    analysis.file = g_strdup(qemu_opt_get(adsp->machine_opts,
+        "audio-analysis-file"));
+
+    ssp_analysis_enable(freq);
+    analysis.enabled = true;
+    qemu_add_exit_notifier(&analysis_exit_notifier);
+
+    printf(" ** audio analysis at %u Hz\n", (uint32_t)freq);
+}
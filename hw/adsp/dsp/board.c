@@ -0,0 +1,442 @@
+/* Board descriptor overrides for audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The built in board tables describe one SKU. A faster or slower part is
+ * modelled by loading a key file with -machine board-file=<file>, e.g.
+ *
+ *   [timing]
+ *   dma-bandwidth=96000000
+ *   irq-latency-ns=500
+ *   [dram0]
+ *   load-cycles=4
+ *
+ * and single timing values can then be swept with the dma-bandwidth,
+ * dma-burst-ns, ssp-fifo-depth, ext-clk-khz, irq-latency-ns and
+ * cl-bandwidth machine properties which are applied last.
+ *
+ * The other DSP options are machine properties of the DSP machines only,
+ * devices read them back from the machine QemuOpts or the machine object.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "qemu-common.h"
+#include "qemu/cutils.h"
+#include "qemu/option.h"
+#include "hw/boards.h"
+#include "qemu/io-bridge.h"
+
+#include "hw/adsp/hw.h"
+#include "hw/dma/dw-dma.h"
+#include "hw/dma/hda-dma.h"
+#include "hw/ssi/ssp.h"
+
+static int parse_u64(const char *name, const char *str, uint64_t max,
+    uint64_t *val)
+{
+    uint64_t v;
+
+    if (qemu_strtou64(str, NULL, 0, &v) < 0 || v > max) {
+        fprintf(stderr, "error: board: invalid %s %s\n", name, str);
+        return -EINVAL;
+    }
+
+    *val = v;
+    return 0;
+}
+
+static void key_u64(GKeyFile *kf, const char *group, const char *key,
+    uint64_t max, uint64_t *val)
+{
+    char *str;
+
+    str = g_key_file_get_string(kf, group, key, NULL);
+    if (str == NULL)
+        return;
+
+    parse_u64(key, str, max, val);
+    g_free(str);
+}
+
+static void key_u32(GKeyFile *kf, const char *group, const char *key,
+    uint32_t *val)
+{
+    uint64_t v = *val;
+
+    key_u64(kf, group, key, UINT32_MAX, &v);
+    *val = v;
+}
+
+static void load_mem(GKeyFile *kf, const char *group,
+    struct adsp_mem_desc *mem)
+{
+    if (!g_key_file_has_group(kf, group))
+        return;
+
+    /* only timing, the memory map is shared with the host SHM */
+    key_u32(kf, group, "load-cycles", &mem->load_cycles);
+    key_u32(kf, group, "store-cycles", &mem->store_cycles);
+    if (g_key_file_has_key(kf, group, "cached", NULL))
+        mem->cached = g_key_file_get_boolean(kf, group, "cached", NULL);
+}
+
+static void load_file(struct adsp_desc *board, const char *file)
+{
+    struct adsp_io_timing *t = &board->io_timing;
+    GError *err = NULL;
+    GKeyFile *kf;
+
+    kf = g_key_file_new();
+    if (!g_key_file_load_from_file(kf, file, G_KEY_FILE_NONE, &err)) {
+        fprintf(stderr, "error: board: cant load %s: %s\n", file,
+            err->message);
+        g_error_free(err);
+        g_key_file_free(kf);
+        return;
+    }
+
+    load_mem(kf, "iram", &board->iram);
+    load_mem(kf, "dram0", &board->dram0);
+    load_mem(kf, "lp-sram", &board->lp_sram);
+    load_mem(kf, "rom", &board->rom);
+
+    key_u32(kf, "cache", "size", &board->cache.size);
+    key_u32(kf, "cache", "line-size", &board->cache.line_size);
+    key_u32(kf, "cache", "ways", &board->cache.ways);
+    key_u32(kf, "cache", "miss-cycles", &board->cache.miss_cycles);
+
+    key_u32(kf, "timing", "dma-m2m-burst-ns", &t->dma_m2m_burst_ns);
+    key_u32(kf, "timing", "dma-m2p-burst-ns", &t->dma_m2p_burst_ns);
+    key_u32(kf, "timing", "dma-p2m-burst-ns", &t->dma_p2m_burst_ns);
+    key_u32(kf, "timing", "dma-bandwidth", &t->dma_bandwidth);
+    key_u32(kf, "timing", "ssp-fifo-depth", &t->ssp_fifo_depth);
+    key_u32(kf, "timing", "ext-clk-khz", &t->ext_clk_kHz);
+    key_u32(kf, "timing", "irq-latency-ns", &t->irq_latency_ns);
+    key_u32(kf, "timing", "cl-bandwidth", &t->cl_bandwidth);
+
+    g_key_file_free(kf);
+    printf(" ** board descriptor loaded from %s\n", file);
+}
+
+/* "<ns>" for all bursts or "m2m=<ns>:m2p=<ns>:p2m=<ns>" */
+static void parse_burst(struct adsp_io_timing *t, const char *str)
+{
+    char **opts, **o, *val;
+    uint64_t ns;
+
+    opts = g_strsplit(str, ":", 0);
+    for (o = opts; *o != NULL; o++) {
+
+        val = strchr(*o, '=');
+        if (val)
+            *val++ = 0;
+
+        if (parse_u64("dma-burst-ns", val ? val : *o, UINT32_MAX, &ns) < 0)
+            continue;
+
+        if (val == NULL) {
+            t->dma_m2m_burst_ns = ns;
+            t->dma_m2p_burst_ns = ns;
+            t->dma_p2m_burst_ns = ns;
+        } else if (!strcmp(*o, "m2m"))
+            t->dma_m2m_burst_ns = ns;
+        else if (!strcmp(*o, "m2p"))
+            t->dma_m2p_burst_ns = ns;
+        else if (!strcmp(*o, "p2m"))
+            t->dma_p2m_burst_ns = ns;
+        else
+            fprintf(stderr, "error: board: unknown DMA burst %s\n", *o);
+    }
+    g_strfreev(opts);
+}
+
+/* timing machine properties, applied over the table when it is loaded */
+static const struct board_prop {
+    const char *name;
+    const char *desc;
+    size_t offset;
+} board_props[] = {
+    {"dma-bandwidth", "Audio DSP DMA bandwidth in bytes per second",
+        offsetof(struct adsp_io_timing, dma_bandwidth)},
+    {"ssp-fifo-depth", "Audio DSP SSP FIFO depth in words",
+        offsetof(struct adsp_io_timing, ssp_fifo_depth)},
+    {"ext-clk-khz", "Audio DSP external timer clock in kHz",
+        offsetof(struct adsp_io_timing, ext_clk_kHz)},
+    {"irq-latency-ns", "Audio DSP interrupt latency in ns",
+        offsetof(struct adsp_io_timing, irq_latency_ns)},
+    {"cl-bandwidth", "Audio DSP ROM code loader bytes per second",
+        offsetof(struct adsp_io_timing, cl_bandwidth)},
+};
+
+/* other DSP machine options */
+static const struct board_opt {
+    const char *name;
+    const char *desc;
+    bool is_bool;
+    void (*set)(const char *value);	/* applied as soon as it is set */
+} board_opts[] = {
+    {"timing", "Xtensa cycle approximate timing model", true},
+    {"bridge-id", "Audio DSP IO bridge instance suffix", false,
+        qemu_io_set_instance},
+    {"fork-server", "Audio DSP fork server UNIX socket path"},
+    {"fw-trace", "Audio DSP firmware trace file or chardev:<id>"},
+    {"fw-trace-rotate", "Audio DSP firmware trace file rotation size"},
+    {"sync-quantum", "Audio DSP and host virtual time sync quantum in ns"},
+    {"pmc-latency", "Audio DSP PMC command latency in ns, or <cmd>=<ns>:..."},
+    {"board-file", "Audio DSP board descriptor key file"},
+    {"dma-burst-ns",
+        "Audio DSP DMA burst period in ns, or m2m|m2p|p2m=<ns>:..."},
+    {"ssp-capture", "Audio DSP SSP capture source, or <port>=<source>;..."},
+    {"dump-dir", "Audio DSP stream dump directory"},
+    {"dump-format", "Audio DSP stream dump format, wav or raw"},
+    {"dump-streams", "Audio DSP streams to dump, <glob>:..."},
+    {"audio-analysis", "Audio DSP SSP analysis tone in Hz"},
+    {"audio-analysis-file", "Audio DSP SSP analysis JSON written at exit"},
+    {"fw-auth", "Audio DSP firmware authentication off|warn|enforce"},
+    {"fw-auth-cache", "Audio DSP firmware authentication cache dir, or off"},
+    {"fw-auth-key", "Audio DSP firmware signing key modulus SHA-256"},
+    {"lazy-modules", "Audio DSP firmware modules are loaded on first access",
+        true},
+    {"sram-poison", "Audio DSP SRAM poison fill lazy|eager|off"},
+    {"rom-share",
+        "Audio DSP ROM image mapped read-only and shared by all instances",
+        true},
+};
+
+struct board_class;
+
+struct board_opt_val {
+    const struct board_opt *opt;
+    char *str;
+    bool val;
+};
+
+struct board_prop_val {
+    struct board_class *bc;
+    const struct board_prop *prop;
+    bool set;
+    uint32_t val;
+};
+
+/* property values of each DSP machine class, only one is instantiated */
+struct board_class {
+    MachineClass *mc;
+    const struct adsp_desc *desc;	/* built in table */
+    struct adsp_desc *board;		/* table in use once loaded */
+    struct board_prop_val val[ARRAY_SIZE(board_props)];
+    struct board_opt_val opt[ARRAY_SIZE(board_opts)];
+};
+
+static GSList *board_classes;
+
+static void timing_defaults(struct adsp_io_timing *t)
+{
+    if (t->dma_m2m_burst_ns == 0)
+        t->dma_m2m_burst_ns = DW_DMA_M2M_BURST_NS;
+    if (t->dma_m2p_burst_ns == 0)
+        t->dma_m2p_burst_ns = DW_DMA_M2P_BURST_NS;
+    if (t->dma_p2m_burst_ns == 0)
+        t->dma_p2m_burst_ns = DW_DMA_P2M_BURST_NS;
+    if (t->ssp_fifo_depth == 0)
+        t->ssp_fifo_depth = SSP_FIFO_DEPTH;
+    if (t->cl_bandwidth == 0)
+        t->cl_bandwidth = HDA_CL_BANDWIDTH;
+}
+
+/* the value in use, or what would be used if the machine started now */
+static void board_prop_get(Object *obj, Visitor *v, const char *name,
+    void *opaque, Error **errp)
+{
+    struct board_prop_val *pv = opaque;
+    struct board_class *bc = pv->bc;
+    struct adsp_io_timing t;
+    uint32_t val;
+
+    if (bc->board)
+        t = bc->board->io_timing;
+    else {
+        t = bc->desc->io_timing;
+        timing_defaults(&t);
+    }
+
+    if (bc->board == NULL && pv->set)
+        val = pv->val;
+    else
+        val = *(uint32_t *)((uint8_t *)&t + pv->prop->offset);
+
+    visit_type_uint32(v, name, &val, errp);
+}
+
+static void board_prop_set(Object *obj, Visitor *v, const char *name,
+    void *opaque, Error **errp)
+{
+    struct board_prop_val *pv = opaque;
+    Error *local_err = NULL;
+    uint32_t val;
+
+    visit_type_uint32(v, name, &val, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+
+    pv->val = val;
+    pv->set = true;
+}
+
+static void board_opt_get(Object *obj, Visitor *v, const char *name,
+    void *opaque, Error **errp)
+{
+    struct board_opt_val *ov = opaque;
+    char *str;
+
+    if (ov->opt->is_bool) {
+        visit_type_bool(v, name, &ov->val, errp);
+        return;
+    }
+
+    str = g_strdup(ov->str);
+    visit_type_str(v, name, &str, errp);
+    g_free(str);
+}
+
+static void board_opt_set(Object *obj, Visitor *v, const char *name,
+    void *opaque, Error **errp)
+{
+    struct board_opt_val *ov = opaque;
+    Error *local_err = NULL;
+    char *str;
+    bool val;
+
+    if (ov->opt->is_bool) {
+        visit_type_bool(v, name, &val, &local_err);
+        if (local_err) {
+            error_propagate(errp, local_err);
+            return;
+        }
+        ov->val = val;
+        return;
+    }
+
+    visit_type_str(v, name, &str, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+
+    g_free(ov->str);
+    ov->str = str;
+    if (ov->opt->set)
+        ov->opt->set(str);
+}
+
+/* add the DSP properties for board table desc to a DSP machine class */
+void adsp_board_class_init(MachineClass *mc, const struct adsp_desc *desc)
+{
+    ObjectClass *oc = OBJECT_CLASS(mc);
+    struct board_class *bc;
+    struct board_prop_val *pv;
+    struct board_opt_val *ov;
+    int i;
+
+    bc = g_new0(struct board_class, 1);
+    bc->mc = mc;
+    bc->desc = desc;
+    board_classes = g_slist_prepend(board_classes, bc);
+
+    for (i = 0; i < ARRAY_SIZE(board_props); i++) {
+        pv = &bc->val[i];
+        pv->bc = bc;
+        pv->prop = &board_props[i];
+        object_class_property_add(oc, pv->prop->name, "uint32",
+            board_prop_get, board_prop_set, NULL, pv, &error_abort);
+        object_class_property_set_description(oc, pv->prop->name,
+            pv->prop->desc, &error_abort);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(board_opts); i++) {
+        ov = &bc->opt[i];
+        ov->opt = &board_opts[i];
+        object_class_property_add(oc, ov->opt->name,
+            ov->opt->is_bool ? "bool" : "string",
+            board_opt_get, board_opt_set, NULL, ov, &error_abort);
+        object_class_property_set_description(oc, ov->opt->name,
+            ov->opt->desc, &error_abort);
+    }
+}
+
+static struct board_class *board_class_find(MachineClass *mc)
+{
+    GSList *l;
+
+    for (l = board_classes; l != NULL; l = l->next) {
+        if (((struct board_class *)l->data)->mc == mc)
+            return l->data;
+    }
+    return NULL;
+}
+
+struct adsp_desc *adsp_board_load(const struct adsp_desc *desc,
+    QemuOpts *opts)
+{
+    struct board_class *bc;
+    struct adsp_desc *board = g_memdup(desc, sizeof(*desc));
+    struct adsp_io_timing *t = &board->io_timing;
+    uint32_t ext_clk_kHz = t->ext_clk_kHz;
+    struct board_prop_val *pv;
+    const char *str;
+    int i;
+
+    bc = board_class_find(MACHINE_GET_CLASS(qdev_get_machine()));
+
+    str = qemu_opt_get(opts, "board-file");
+    if (str)
+        load_file(board, str);
+
+    for (i = 0; bc != NULL && i < ARRAY_SIZE(board_props); i++) {
+        pv = &bc->val[i];
+        if (pv->set)
+            *(uint32_t *)((uint8_t *)t + pv->prop->offset) = pv->val;
+    }
+    str = qemu_opt_get(opts, "dma-burst-ns");
+    if (str)
+        parse_burst(t, str);
+
+    /* model defaults */
+    timing_defaults(t);
+
+    if (t->ssp_fifo_depth > SSP_FIFO_MAX) {
+        fprintf(stderr, "error: board: SSP FIFO depth %u > %u\n",
+            t->ssp_fifo_depth, SSP_FIFO_MAX);
+        t->ssp_fifo_depth = SSP_FIFO_MAX;
+    }
+
+    /* ext timer rate divides, cant be switched off */
+    if (ext_clk_kHz && t->ext_clk_kHz == 0) {
+        fprintf(stderr, "error: board: ext clock cant be 0\n");
+        t->ext_clk_kHz = ext_clk_kHz;
+    }
+
+    if (bc != NULL)
+        bc->board = board;
+    return board;
+}
@@ -0,0 +1,490 @@
+/* Firmware manifest authentication for Broxton audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks a signed image the way the ROM does before it boots it :-
+ *
+ *  1) CSS RSA-2048 PKCS#1 v1.5 signature over the CSS header and the
+ *     signed package and partition info extensions.
+ *  2) signed package and partition info hashes of the ADSP meta extension.
+ *  3) ADSP meta extension hash of the image from MAN_DESC_OFFSET.
+ *  4) module hashes of each module text and rodata.
+ *
+ * -machine fw-auth=warn|enforce[,fw-auth-cache=<dir>|off]
+ *          [,fw-auth-key=<sha256>]
+ *
+ * warn reports failures and boots anyway, enforce refuses to boot the
+ * image. fw-auth-key pins the SHA-256 of the CSS public key modulus like
+ * the key hash fused into real parts. In warn mode results are kept in
+ * <dir>, by default the user cache dir, under the SHA-256 of the whole
+ * image so booting the same image again only costs one hash pass. Anyone
+ * able to write <dir> could mark an image as good, so enforce never uses
+ * the cache and verifies the signature on every boot.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu-common.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
+#include "qemu/option.h"
+#include "crypto/hash.h"
+
+#include "hw/audio/adsp-dev.h"
+#include "bxt.h"
+#include "broxton.h"
+
+#define AUTH_SHA256_LEN		32
+#define AUTH_CACHE_DIR		"qemu-adsp-auth"
+#define AUTH_CACHE_VERSION	1
+
+#define RSA_WORDS		(MAN_RSA_KEY_MODULUS_LEN / 4)
+
+/* DER DigestInfo prefix of a SHA-256 hash in a PKCS#1 v1.5 signature */
+static const uint8_t rsa_sha256_info[] = {
+    0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+    0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20,
+};
+
+enum auth_mode {
+    AUTH_OFF = 0,
+    AUTH_WARN,
+    AUTH_ENFORCE,
+};
+
+struct auth_opts {
+    enum auth_mode mode;
+    char *cache;
+    char *key;
+};
+
+/* SHA-256 via the crypto backend, which uses the CPU hash extensions */
+static int auth_sha256v(const struct iovec *iov, size_t niov, uint8_t *digest)
+{
+    uint8_t *result = NULL;
+    size_t len = 0;
+    Error *err = NULL;
+
+    if (qcrypto_hash_bytesv(QCRYPTO_HASH_ALG_SHA256, iov, niov,
+        &result, &len, &err) < 0) {
+        fprintf(stderr, "error: auth: %s\n", error_get_pretty(err));
+        error_free(err);
+        return -EINVAL;
+    }
+
+    memcpy(digest, result, AUTH_SHA256_LEN);
+    g_free(result);
+    return 0;
+}
+
+static int auth_sha256(const void *data, size_t size, uint8_t *digest)
+{
+    struct iovec iov = {.iov_base = (void *)data, .iov_len = size};
+
+    return auth_sha256v(&iov, 1, digest);
+}
+
+static bool auth_hash_ok(const void *data, size_t size, const uint8_t *hash)
+{
+    uint8_t digest[AUTH_SHA256_LEN];
+
+    if (auth_sha256(data, size, digest) < 0)
+        return false;
+    return !memcmp(digest, hash, AUTH_SHA256_LEN);
+}
+
+static void auth_hex(const uint8_t *digest, char *hex)
+{
+    int i;
+
+    for (i = 0; i < AUTH_SHA256_LEN; i++)
+        sprintf(hex + i * 2, "%2.2x", digest[i]);
+}
+
+static int rsa_cmp(const uint32_t *a, const uint32_t *b)
+{
+    int i;
+
+    for (i = RSA_WORDS - 1; i >= 0; i--) {
+        if (a[i] != b[i])
+            return a[i] > b[i] ? 1 : -1;
+    }
+    return 0;
+}
+
+/* a -= b, returns the borrow */
+static uint32_t rsa_sub(uint32_t *a, const uint32_t *b)
+{
+    uint64_t borrow = 0, d;
+    int i;
+
+    for (i = 0; i < RSA_WORDS; i++) {
+        d = (uint64_t)a[i] - b[i] - borrow;
+        a[i] = d;
+        borrow = (d >> 32) & 1;
+    }
+    return borrow;
+}
+
+/* r = a * b / 2^2048 mod n, CIOS Montgomery multiplication */
+static void rsa_mont_mul(uint32_t *r, const uint32_t *a, const uint32_t *b,
+    const uint32_t *n, uint32_t n0inv)
+{
+    uint32_t t[RSA_WORDS + 2];
+    uint64_t c;
+    uint32_t m;
+    int i, j;
+
+    memset(t, 0, sizeof(t));
+
+    for (i = 0; i < RSA_WORDS; i++) {
+
+        c = 0;
+        for (j = 0; j < RSA_WORDS; j++) {
+            c += (uint64_t)a[j] * b[i] + t[j];
+            t[j] = c;
+            c >>= 32;
+        }
+        c += t[RSA_WORDS];
+        t[RSA_WORDS] = c;
+        t[RSA_WORDS + 1] = c >> 32;
+
+        m = t[0] * n0inv;
+        c = ((uint64_t)m * n[0] + t[0]) >> 32;
+        for (j = 1; j < RSA_WORDS; j++) {
+            c += (uint64_t)m * n[j] + t[j];
+            t[j - 1] = c;
+            c >>= 32;
+        }
+        c += t[RSA_WORDS];
+        t[RSA_WORDS - 1] = c;
+        t[RSA_WORDS] = t[RSA_WORDS + 1] + (c >> 32);
+    }
+
+    if (t[RSA_WORDS] || rsa_cmp(t, n) >= 0)
+        rsa_sub(t, n);
+    memcpy(r, t, RSA_WORDS * sizeof(uint32_t));
+}
+
+/* r = s^e mod n, n must be odd and s < n */
+static void rsa_exp(uint32_t *r, const uint32_t *s, uint32_t e,
+    const uint32_t *n)
+{
+    uint32_t rr[RSA_WORDS], sm[RSA_WORDS], one[RSA_WORDS];
+    uint32_t x = 1, top;
+    int i, bit;
+
+    /* -1 / n mod 2^32 by Newton iteration */
+    for (i = 0; i < 5; i++)
+        x *= 2 - n[0] * x;
+
+    /* 2^4096 mod n by doubling, converts into the Montgomery domain */
+    memset(rr, 0, sizeof(rr));
+    rr[0] = 1;
+    for (i = 0; i < 2 * RSA_WORDS * 32; i++) {
+        top = rr[RSA_WORDS - 1] >> 31;
+        for (bit = RSA_WORDS - 1; bit > 0; bit--)
+            rr[bit] = (rr[bit] << 1) | (rr[bit - 1] >> 31);
+        rr[0] <<= 1;
+        if (top || rsa_cmp(rr, n) >= 0)
+            rsa_sub(rr, n);
+    }
+
+    rsa_mont_mul(sm, s, rr, n, -x);
+    memcpy(r, sm, sizeof(sm));
+
+    for (bit = 31 - clz32(e) - 1; bit >= 0; bit--) {
+        rsa_mont_mul(r, r, r, n, -x);
+        if (e & (1U << bit))
+            rsa_mont_mul(r, r, sm, n, -x);
+    }
+
+    memset(one, 0, sizeof(one));
+    one[0] = 1;
+    rsa_mont_mul(r, r, one, n, -x);
+}
+
+/* modulus and signature are stored little endian in the CSS header */
+static bool auth_rsa_ok(const struct css_header *css, const uint8_t *hash)
+{
+    uint32_t n[RSA_WORDS], s[RSA_WORDS], m[RSA_WORDS];
+    uint8_t em[MAN_RSA_KEY_MODULUS_LEN];
+    uint32_t e = ldl_le_p(css->exponent);
+    size_t pad;
+    int i;
+
+    for (i = 0; i < RSA_WORDS; i++) {
+        n[i] = ldl_le_p(css->modulus + i * 4);
+        s[i] = ldl_le_p(css->signature + i * 4);
+    }
+
+    if (!(n[0] & 1) || e < 3 || rsa_cmp(s, n) >= 0)
+        return false;
+
+    rsa_exp(m, s, e, n);
+
+    /* big endian encoded message */
+    for (i = 0; i < RSA_WORDS; i++)
+        stl_be_p(em + MAN_RSA_KEY_MODULUS_LEN - (i + 1) * 4, m[i]);
+
+    /* 00 01 ff .. ff 00 DigestInfo hash */
+    pad = MAN_RSA_KEY_MODULUS_LEN - sizeof(rsa_sha256_info) -
+        AUTH_SHA256_LEN - 3;
+    if (em[0] != 0x00 || em[1] != 0x01 || em[pad + 2] != 0x00)
+        return false;
+    for (i = 0; i < pad; i++) {
+        if (em[i + 2] != 0xff)
+            return false;
+    }
+
+    return !memcmp(em + pad + 3, rsa_sha256_info, sizeof(rsa_sha256_info)) &&
+        !memcmp(em + pad + 3 + sizeof(rsa_sha256_info), hash,
+        AUTH_SHA256_LEN);
+}
+
+/* full verification, returns NULL or why the image failed */
+static const char *auth_verify(const struct fw_image_manifest *man,
+    size_t size)
+{
+    static const uint8_t css_id[] = MAN_CSS_HDR_ID;
+    const struct css_header *css = &man->css;
+    const struct adsp_fw_header *hdr = &man->desc.header;
+    const struct component_desc *comp = &man->adsp_file_ext.comp_desc[0];
+    const struct segment_desc *seg;
+    uint8_t digest[AUTH_SHA256_LEN];
+    struct iovec iov[2];
+    size_t signed_size, offset, len;
+    int i;
+
+    /* CSS header */
+    if (memcmp(css->header_id, css_id, sizeof(css_id)) ||
+        css->header_len != MAN_CSS_HDR_SIZE ||
+        css->modulus_size != MAN_CSS_MOD_SIZE ||
+        css->exponent_size != MAN_CSS_EXP_SIZE ||
+        css->size <= css->header_len)
+        return "bad CSS header";
+
+    signed_size = (size_t)(css->size - css->header_len) * 4;
+    if (signed_size > size - MAN_SIG_PKG_OFFSET)
+        return "CSS size beyond image";
+
+    /* signature covers the header up to the key and the extensions */
+    iov[0].iov_base = (void *)css;
+    iov[0].iov_len = offsetof(struct css_header, modulus);
+    iov[1].iov_base = (uint8_t *)man + MAN_SIG_PKG_OFFSET;
+    iov[1].iov_len = signed_size;
+    if (auth_sha256v(iov, 2, digest) < 0 || !auth_rsa_ok(css, digest))
+        return "CSS signature mismatch";
+
+    /* signed package and partition info hold the meta extension hash */
+    if (auth_sha256(&man->adsp_file_ext, sizeof(man->adsp_file_ext),
+        digest) < 0)
+        return "hash failed";
+    if (memcmp(man->signed_pkg.module[0].hash, digest, AUTH_SHA256_LEN))
+        return "signed package hash mismatch";
+    if (memcmp(man->partition_info.module[0].hash, digest, AUTH_SHA256_LEN))
+        return "partition info hash mismatch";
+
+    /* meta extension holds the image hash, limit excludes ext manifests */
+    len = size - MAN_DESC_OFFSET;
+    if (comp->limit_offset > comp->base_offset &&
+        comp->limit_offset - comp->base_offset <= len)
+        len = comp->limit_offset - comp->base_offset;
+    if (!auth_hash_ok((const uint8_t *)man + MAN_DESC_OFFSET, len,
+        comp->hash))
+        return "image hash mismatch";
+
+    /* module descriptors hold text and rodata hashes */
+    if (MAN_DESC_OFFSET + sizeof(*hdr) +
+        (size_t)hdr->num_module_entries * sizeof(struct module) > size)
+        return "bad module count";
+
+    for (i = 0; i < hdr->num_module_entries; i++) {
+        seg = man->desc.module[i].segment;
+
+        offset = seg[MAN_SEGMENT_TEXT].file_offset;
+        len = (size_t)(seg[MAN_SEGMENT_TEXT].flags.r.length +
+            seg[MAN_SEGMENT_RODATA].flags.r.length) * MAN_PAGE_SIZE;
+        if (offset > size || len > size - offset)
+            return "module beyond image";
+
+        if (!auth_hash_ok((const uint8_t *)man + offset, len,
+            man->desc.module[i].hash))
+            return "module hash mismatch";
+    }
+
+    return NULL;
+}
+
+static char *auth_cache_file(const struct auth_opts *opts, const char *hex)
+{
+    if (opts->mode == AUTH_ENFORCE)
+        return NULL;
+    if (opts->cache && !strcmp(opts->cache, "off"))
+        return NULL;
+
+    if (opts->cache)
+        return g_strdup_printf("%s/%s", opts->cache, hex);
+
+    return g_strdup_printf("%s/%s/%s", g_get_user_cache_dir(),
+        AUTH_CACHE_DIR, hex);
+}
+
+/* returns true and the cached reason, NULL for a pass, on a hit */
+static bool auth_cache_get(const char *file, char **reason)
+{
+    char *contents, *nl;
+    int version;
+
+    if (file == NULL || !g_file_get_contents(file, &contents, NULL, NULL))
+        return false;
+
+    nl = strchr(contents, '\n');
+    if (nl)
+        *nl = 0;
+
+    *reason = NULL;
+    if (sscanf(contents, "%d", &version) != 1 ||
+        version != AUTH_CACHE_VERSION) {
+        g_free(contents);
+        return false;
+    }
+
+    nl = strchr(contents, ' ');
+    if (nl && strcmp(nl + 1, "ok"))
+        *reason = g_strdup(nl + 1);
+    g_free(contents);
+    return true;
+}
+
+static void auth_cache_put(const char *file, const char *reason)
+{
+    char *dir, *contents;
+
+    if (file == NULL)
+        return;
+
+    dir = g_path_get_dirname(file);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    contents = g_strdup_printf("%d %s\n", AUTH_CACHE_VERSION,
+        reason ? reason : "ok");
+    if (!g_file_set_contents(file, contents, -1, NULL))
+        fprintf(stderr, "error: auth: cant write %s\n", file);
+    g_free(contents);
+}
+
+/* a mistyped mode fails closed */
+static void auth_parse(struct adsp_dev *adsp, struct auth_opts *opts)
+{
+    const char *opt = qemu_opt_get(adsp->machine_opts, "fw-auth");
+
+    if (opt == NULL || !strcmp(opt, "off"))
+        opts->mode = AUTH_OFF;
+    else if (!strcmp(opt, "warn"))
+        opts->mode = AUTH_WARN;
+    else if (!strcmp(opt, "enforce"))
+        opts->mode = AUTH_ENFORCE;
+    else {
+        fprintf(stderr, "error: auth: unknown mode %s, enforcing\n", opt);
+        opts->mode = AUTH_ENFORCE;
+    }
+
+    opts->cache = g_strdup(qemu_opt_get(adsp->machine_opts,
+        "fw-auth-cache"));
+    opt = qemu_opt_get(adsp->machine_opts, "fw-auth-key");
+    if (opt)
+        opts->key = g_ascii_strdown(opt, -1);
+}
+
+/*
+ * Authenticate the firmware image before its segments are copied. Returns
+ * 0 when the image may boot, -EACCES when fw-auth=enforce rejects it.
+ */
+int adsp_bxt_auth(struct adsp_dev *adsp, const void *image, size_t size)
+{
+    const struct fw_image_manifest *man = image;
+    struct auth_opts opts = {.mode = AUTH_OFF};
+    uint8_t digest[AUTH_SHA256_LEN];
+    char hex[AUTH_SHA256_LEN * 2 + 1];
+    char *file = NULL, *reason = NULL;
+    const char *why;
+    bool cached = false;
+    int ret = 0;
+
+    auth_parse(adsp, &opts);
+    if (opts.mode == AUTH_OFF)
+        goto out;
+
+    if (size < sizeof(*man)) {
+        reason = g_strdup("image smaller than manifest");
+        goto report;
+    }
+
+    /* the key pin is not part of the cached result */
+    if (opts.key) {
+        if (auth_sha256(man->css.modulus, sizeof(man->css.modulus),
+            digest) < 0) {
+            reason = g_strdup("hash failed");
+            goto report;
+        }
+        auth_hex(digest, hex);
+        if (strcmp(hex, opts.key)) {
+            reason = g_strdup_printf("key %s not trusted", hex);
+            goto report;
+        }
+    }
+
+    if (auth_sha256(image, size, digest) < 0) {
+        reason = g_strdup("hash failed");
+        goto report;
+    }
+    auth_hex(digest, hex);
+
+    file = auth_cache_file(&opts, hex);
+    cached = auth_cache_get(file, &reason);
+    if (!cached) {
+        why = auth_verify(man, size);
+        reason = g_strdup(why);
+        auth_cache_put(file, why);
+    }
+
+report:
+    if (reason == NULL) {
+        printf(" ** firmware authenticated%s\n", cached ? " (cached)" : "");
+        goto out;
+    }
+
+    if (opts.mode == AUTH_ENFORCE) {
+        fprintf(stderr, "error: auth: firmware rejected: %s%s\n", reason,
+            cached ? " (cached)" : "");
+        ret = -EACCES;
+    } else
+        printf(" ** firmware authentication failed: %s%s\n", reason,
+            cached ? " (cached)" : "");
+
+out:
+    g_free(reason);
+    g_free(file);
+    g_free(opts.cache);
+    g_free(opts.key);
+    return ret;
+}
@@ -0,0 +1,181 @@
+/* ROM code loader for Broxton audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Without -kernel the ROM waits for the driver to download firmware. The
+ * driver sets up a host out stream with the image, sends a purge request
+ * with the stream tag in IPCXH and polls the ROM status in the mailbox :-
+ *
+ *  purge IPC	ROM_INIT, the IPC is acked
+ *  stream run	image is streamed from the BDL at the cl-bandwidth rate
+ *  manifest	FW_MANIFEST_LOADED
+ *  image	FW_FW_LOADED, then authenticated and copied to SRAM
+ *  boot	FW_ENTERED, the core restarts through the ROM into firmware
+ *
+ * The download runs on the virtual clock so driver boot times and large
+ * library loads can be measured. Drivers that write SRAM directly still
+ * work, the ROM only acts on purge requests.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/timer.h"
+#include "qemu/atomic.h"
+
+#include "qemu/io-bridge.h"
+#include "hw/audio/adsp-dev.h"
+#include "hw/adsp/shim.h"
+#include "hw/adsp/log.h"
+#include "hw/adsp/bxt.h"
+#include "hw/dma/hda-dma.h"
+#include "bxt.h"
+#include "broxton.h"
+#include "common.h"
+
+static struct {
+    struct adsp_dev *adsp;
+    bool waiting;		/* for a purge request */
+    bool manifest;		/* manifest has been downloaded */
+    uint8_t *image;
+    uint32_t size;
+    int64_t start_ns;
+} rom;
+
+static void rom_status(uint32_t status, uint32_t err)
+{
+    struct adsp_dev *adsp = rom.adsp;
+
+    atomic_set(&adsp->mbox_io[ADSP_BXT_ROM_ERROR >> 2], err);
+    atomic_mb_set(&adsp->mbox_io[ADSP_BXT_ROM_STATUS >> 2], status);
+
+    log_text(adsp->log, LOG_CPU_RESET, "rom: status 0x%x error 0x%x\n",
+        status, err);
+}
+
+/* ack the purge request like firmware replying to an IPC */
+static void rom_ipc_done(struct adsp_dev *adsp, uint32_t ipcx)
+{
+    shim_io_update(adsp->shim_io, SHIM_ISRD, SHIM_ISRD_BUSY, 0);
+    shim_io_write(adsp->shim_io, SHIM_IPCXH,
+        (ipcx & ~SHIM_IPCX_BUSY) | SHIM_IPCX_DONE);
+    shim_io_update(adsp->shim_io, SHIM_ISRX,
+        SHIM_ISRX_DONE | SHIM_ISRX_BUSY, SHIM_ISRX_DONE);
+    qemu_io_send_irq(0);
+}
+
+/* called from the HDA timer with BQL held */
+static void rom_cl_progress(void *opaque, uint32_t bytes, int err)
+{
+    struct adsp_dev *adsp = opaque;
+    int64_t us;
+
+    if (err < 0) {
+        fprintf(stderr, "error: rom: code loader failed at 0x%x %d\n",
+            bytes, err);
+        rom_status(ADSP_BXT_ROM_INIT, ADSP_BXT_ROM_ERR_DMA);
+        rom.waiting = true;
+        return;
+    }
+
+    if (!rom.manifest && bytes >= MAN_DESC_OFFSET +
+        sizeof(struct adsp_fw_desc)) {
+        rom.manifest = true;
+        rom_status(ADSP_BXT_ROM_FW_MANIFEST_LOADED, 0);
+    }
+
+    if (bytes < rom.size)
+        return;
+
+    us = (qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - rom.start_ns) / 1000;
+    printf(" ** code loader: 0x%x bytes in %" PRId64 " us\n", bytes, us);
+
+    rom_status(ADSP_BXT_ROM_FW_FW_LOADED, 0);
+    if (adsp_bxt_boot(adsp, rom.image, rom.size) < 0) {
+        rom_status(ADSP_BXT_ROM_FW_FW_LOADED, ADSP_BXT_ROM_ERR_AUTH);
+        rom.waiting = true;
+        return;
+    }
+
+    rom_status(ADSP_BXT_ROM_FW_ENTERED, 0);
+
+    /* the ROM jumps into the new firmware, a stalled core waits for host */
+    if (!adsp->in_reset) {
+        log_text(adsp->log, LOG_CPU_RESET, "cpu: rom entering firmware\n");
+        cpu_reset(CPU(adsp->xtensa[0]->cpu));
+    }
+}
+
+/*
+ * Host IPC while the ROM runs, called with BQL held. Returns true when
+ * the ROM consumed it as a purge request.
+ */
+bool adsp_bxt_rom_ipc(struct adsp_dev *adsp)
+{
+    uint32_t ipcx = shim_io_read(adsp->shim_io, SHIM_IPCXH);
+    uint32_t cmd = ipcx & ~(SHIM_IPCX_BUSY | SHIM_IPCX_DONE);
+    int tag, size;
+
+    if (!rom.waiting || !(ipcx & SHIM_IPCX_BUSY) ||
+        (cmd & ~ADSP_BXT_IPC_PURGE_TAG_MASK) != ADSP_BXT_IPC_PURGE_FW)
+        return false;
+
+    tag = ((cmd & ADSP_BXT_IPC_PURGE_TAG_MASK) >>
+        ADSP_BXT_IPC_PURGE_TAG_SHIFT) + 1;
+
+    size = adsp_hda_dma_load(adsp->hda, tag, rom.image,
+        adsp->desc->iram.size, rom_cl_progress, adsp);
+    if (size < 0) {
+        rom_status(ADSP_BXT_ROM_INIT, ADSP_BXT_ROM_ERR_DMA);
+        rom_ipc_done(adsp, ipcx);
+        return true;
+    }
+
+    log_text(adsp->log, LOG_CPU_RESET,
+        "rom: purge request, stream tag %d image 0x%x\n", tag, size);
+
+    rom.waiting = false;
+    rom.manifest = false;
+    rom.size = size;
+    rom.start_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    rom_status(ADSP_BXT_ROM_INIT, 0);
+    rom_ipc_done(adsp, ipcx);
+    return true;
+}
+
+/* core put back into reset, the driver downloads firmware again */
+void adsp_bxt_rom_reset(struct adsp_dev *adsp)
+{
+    if (rom.adsp != adsp)
+        return;
+
+    rom.waiting = true;
+    rom.manifest = false;
+}
+
+void adsp_bxt_rom_init(struct adsp_dev *adsp)
+{
+    if (adsp->hda == NULL)
+        return;
+
+    rom.adsp = adsp;
+    rom.image = g_malloc(adsp->desc->iram.size);
+    rom.waiting = true;
+}
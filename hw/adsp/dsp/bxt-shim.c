@@ -37,24 +37,22 @@
 
 static void rearm_ext_timer(struct adsp_dev *adsp)
 {
-    uint32_t wake = adsp->shim_io[SHIM_EXT_TIMER_CNTLL >> 2];
+    uint32_t wake = shim_io_read(adsp->shim_io, SHIM_EXT_TIMER_CNTLL);
 
-    adsp->shim_io[SHIM_EXT_TIMER_STAT >> 2] =
+    shim_io_write(adsp->shim_io, SHIM_EXT_TIMER_STAT,
         (qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - adsp->ext_timer_start) /
-        (1000000 / adsp->ext_clk_kHz);
+        (1000000 / adsp->ext_clk_kHz));
 
     timer_mod(adsp->ext_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
-            muldiv64(wake - adsp->shim_io[SHIM_EXT_TIMER_STAT >> 2],
+            muldiv64(wake - shim_io_read(adsp->shim_io, SHIM_EXT_TIMER_STAT),
                 1000000, adsp->ext_clk_kHz));
 }
 
 void bxt_ext_timer_cb(void *opaque)
 {
     struct adsp_dev *adsp = opaque;
-    uint32_t pisr = adsp->shim_io[SHIM_PISR >> 2];
 
-    pisr |= SHIM_PISR_EXTT;
-    adsp->shim_io[SHIM_PISR >> 2] = pisr;
+    shim_io_set(adsp->shim_io, SHIM_PISR, SHIM_PISR_EXTT);
     adsp_set_irq(adsp, adsp->desc->ext_timer_irq, 1);
 }
 
@@ -73,9 +71,9 @@ static uint64_t shim_read(void *opaque, hwaddr addr,
     struct adsp_dev *adsp = opaque;
 
     log_read(adsp->log, &adsp->desc->shim_dev, addr, size,
-        adsp->shim_io[addr >> 2]);
+        shim_io_read(adsp->shim_io, addr));
 
-    return adsp->shim_io[addr >> 2];
+    return shim_io_read(adsp->shim_io, addr);
 }
 
 /* SHIM IO from ADSP */
@@ -84,18 +82,17 @@ static void shim_write(void *opaque, hwaddr addr,
 {
     struct adsp_dev *adsp = opaque;
     struct qemu_io_msg_reg32 reg32;
-    struct qemu_io_msg_irq irq;
     uint32_t active, isrx;
 
     log_write(adsp->log, &adsp->desc->shim_dev, addr, val, size,
-        adsp->shim_io[addr >> 2]);
+        shim_io_read(adsp->shim_io, addr));
 
     /* special case registers */
     switch (addr) {
     case SHIM_IPCDL:
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* reset the CPU and halt if we are dead to ease debugging */
         if ((val & 0xffff0000) == 0xdead0000) {
@@ -112,13 +109,13 @@ static void shim_write(void *opaque, hwaddr addr,
         /* DSP to host IPC command */
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* set/clear status bit */
-        isrx = adsp->shim_io[SHIM_ISRX >> 2] & ~(SHIM_ISRX_DONE | SHIM_ISRX_BUSY);
-        isrx |= val & SHIM_IPCD_BUSY ? SHIM_ISRX_BUSY : 0;
+        isrx = val & SHIM_IPCD_BUSY ? SHIM_ISRX_BUSY : 0;
         isrx |= val & SHIM_IPCD_DONE ? SHIM_ISRX_DONE : 0;
-        adsp->shim_io[SHIM_ISRX >> 2] = isrx;
+        shim_io_update(adsp->shim_io, SHIM_ISRX,
+            SHIM_ISRX_DONE | SHIM_ISRX_BUSY, isrx);
 
         /* do we need to send an IRQ ? */
         if (val & SHIM_IPCD_BUSY) {
@@ -127,25 +124,20 @@ static void shim_write(void *opaque, hwaddr addr,
                 "irq: send busy interrupt 0x%8.8lx\n", val);
 
             /* send IRQ to parent */
-            irq.hdr.type = QEMU_IO_TYPE_IRQ;
-            irq.hdr.msg = QEMU_IO_MSG_IRQ;
-            irq.hdr.size = sizeof(irq);
-            irq.irq = 0;
-
-            qemu_io_send_msg(&irq.hdr);
+            qemu_io_send_irq(0);
         }
         break;
     case SHIM_IPCXH:
         /* DSP to host IPC notify */
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* set/clear status bit */
-        isrx = adsp->shim_io[SHIM_ISRX >> 2] & ~(SHIM_ISRX_DONE | SHIM_ISRX_BUSY);
-        isrx |= val & SHIM_IPCX_BUSY ? SHIM_ISRX_BUSY : 0;
+        isrx = val & SHIM_IPCX_BUSY ? SHIM_ISRX_BUSY : 0;
         isrx |= val & SHIM_IPCX_DONE ? SHIM_ISRX_DONE : 0;
-        adsp->shim_io[SHIM_ISRX >> 2] = isrx;
+        shim_io_update(adsp->shim_io, SHIM_ISRX,
+            SHIM_ISRX_DONE | SHIM_ISRX_BUSY, isrx);
 
         /* do we need to send an IRQ ? */
         if (val & SHIM_IPCX_DONE) {
@@ -154,26 +146,22 @@ static void shim_write(void *opaque, hwaddr addr,
                 "irq: send done interrupt 0x%8.8lx\n", val);
 
             /* send IRQ to parent */
-            irq.hdr.type = QEMU_IO_TYPE_IRQ;
-            irq.hdr.msg = QEMU_IO_MSG_IRQ;
-            irq.hdr.size = sizeof(irq);
-            irq.irq = 0;
-
-            qemu_io_send_msg(&irq.hdr);
+            qemu_io_send_irq(0);
         }
         break;
     case SHIM_IMRD:
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* DSP IPC interrupt mask */
-        active = adsp->shim_io[SHIM_ISRD >> 2] & ~(adsp->shim_io[SHIM_IMRD >> 2]);
+        active = shim_io_read(adsp->shim_io, SHIM_ISRD) &
+            ~shim_io_read(adsp->shim_io, SHIM_IMRD);
 
         log_text(adsp->log, LOG_IRQ_ACTIVE,
             "irq: IMRD masking %x mask %x active %x\n",
-            adsp->shim_io[SHIM_ISRD >> 2],
-            adsp->shim_io[SHIM_IMRD >> 2], active);
+            shim_io_read(adsp->shim_io, SHIM_ISRD),
+            shim_io_read(adsp->shim_io, SHIM_IMRD), active);
 
         if (!active) {
             adsp_set_irq(adsp, adsp->desc->ia_irq, 0);
@@ -183,7 +171,7 @@ static void shim_write(void *opaque, hwaddr addr,
     case SHIM_CSR:
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* now send msg to HOST VM to notify register write */
         reg32.hdr.type = QEMU_IO_TYPE_REG;
@@ -195,30 +183,31 @@ static void shim_write(void *opaque, hwaddr addr,
         break;
     case SHIM_EXT_TIMER_CNTLL:
         /* set the timer timeout value via SHM */
-        adsp->shim_io[addr >> 2] = val;
-        if (adsp->shim_io[SHIM_EXT_TIMER_CNTLH >> 2] & SHIM_EXT_TIMER_RUN)
+        shim_io_write(adsp->shim_io, addr, val);
+        if (shim_io_read(adsp->shim_io, SHIM_EXT_TIMER_CNTLH) &
+            SHIM_EXT_TIMER_RUN)
             rearm_ext_timer(adsp);
         break;
     case SHIM_EXT_TIMER_CNTLH:
 
         /* enable the timer ? */
         if (val & SHIM_EXT_TIMER_RUN &&
-            !(adsp->shim_io[addr >> 2] & SHIM_EXT_TIMER_RUN)) {
+            !(shim_io_read(adsp->shim_io, addr) & SHIM_EXT_TIMER_RUN)) {
                 adsp->ext_timer_start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
                 rearm_ext_timer(adsp);
         }
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* set/clear ext timer */
         if (val & SHIM_EXT_TIMER_CLEAR)
-            adsp->shim_io[SHIM_EXT_TIMER_STAT >> 2] = 0;
+            shim_io_write(adsp->shim_io, SHIM_EXT_TIMER_STAT, 0);
 
         break;
     case SHIM_EXT_TIMER_STAT:
         /* set status value via SHM - should not be written to ? */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
         rearm_ext_timer(adsp);
         break;
     default:
@@ -241,6 +230,7 @@ static void do_shim32(struct adsp_dev *adsp, struct qemu_io_msg *msg)
             cpu_reset(CPU(adsp->xtensa[0]->cpu));
             //vm_stop(RUN_STATE_SHUTDOWN); TODO: fix, causes hang
             adsp->in_reset = 1;
+            adsp_bxt_rom_reset(adsp);
 
         } else if (adsp->in_reset && !(m->val & SHIM_CSR_STALL)) {
 
@@ -271,6 +261,7 @@ static void do_shim64(struct adsp_dev *adsp, struct qemu_io_msg *msg)
             cpu_reset(CPU(adsp->xtensa[0]->cpu));
             //vm_stop(RUN_STATE_SHUTDOWN); TODO: fix, causes hang
             adsp->in_reset = 1;
+            adsp_bxt_rom_reset(adsp);
 
         } else if (adsp->in_reset && !(m->val & SHIM_CSR_STALL)) {
 
@@ -305,23 +296,26 @@ void adsp_bxt_shim_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg)
     }
 }
 
+/* called with BQL held, msg is NULL for doorbells */
 void adsp_bxt_irq_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg)
 {
     uint32_t active;
 
-    active = adsp->shim_io[SHIM_ISRD >> 2] & ~(adsp->shim_io[SHIM_IMRD >> 2]);
+    /* purge requests are handled by the ROM code loader */
+    if (adsp_bxt_rom_ipc(adsp))
+        return;
+
+    active = shim_io_read(adsp->shim_io, SHIM_ISRD) &
+        ~shim_io_read(adsp->shim_io, SHIM_IMRD);
 
     log_text(adsp->log, LOG_IRQ_ACTIVE,
         "IRQ: from HOST status %x mask %x active %x cmd %x\n",
-        adsp->shim_io[SHIM_ISRD >> 2],
-        adsp->shim_io[SHIM_IMRD >> 2], active,
-        adsp->shim_io[SHIM_IPCX >> 2]);
+        shim_io_read(adsp->shim_io, SHIM_ISRD),
+        shim_io_read(adsp->shim_io, SHIM_IMRD), active,
+        shim_io_read(adsp->shim_io, SHIM_IPCX));
 
-    if (active) {
-        qemu_mutex_lock_iothread();
+    if (active)
         adsp_set_irq(adsp, adsp->desc->ia_irq, 1);
-        qemu_mutex_unlock_iothread();
-    }
 }
 
 static const MemoryRegionOps shim_ops = {
@@ -34,15 +34,60 @@
 
 #include "hw/audio/adsp-dev.h"
 #include "hw/adsp/shim.h"
+#include "hw/adsp/time-sync.h"
+#include "hw/adsp/gdb.h"
 #include "hw/adsp/log.h"
 #include "hw/ssi/ssp.h"
 #include "hw/dma/dw-dma.h"
+#include "hw/dma/hda-dma.h"
 #include "hw/adsp/bxt.h"
 #include "mbox.h"
 #include "bxt.h"
 #include "broxton.h"
 #include "common.h"
 
+/* gateway blocks, host streams map onto the x86 stream descriptors */
+static const struct hda_stream_desc bxt_hda_streams[] = {
+    {
+        .name = "hda-host-out", .type = HDA_HOST_OUT,
+        .count = ADSP_BXT_HDA_OUT_STREAMS,
+        .base = ADSP_BXT_DSP_GTW_HOST_OUT_STREAM_BASE(0),
+        .stride = ADSP_BXT_DSP_GTW_HOST_OUT_STREAM_BASE(1) -
+            ADSP_BXT_DSP_GTW_HOST_OUT_STREAM_BASE(0),
+        .sd = ADSP_BXT_HDA_IN_STREAMS,
+    },
+    {
+        .name = "hda-host-in", .type = HDA_HOST_IN,
+        .count = ADSP_BXT_HDA_IN_STREAMS,
+        .base = ADSP_BXT_DSP_GTW_HOST_IN_STREAM_BASE(0),
+        .stride = ADSP_BXT_DSP_GTW_HOST_IN_STREAM_BASE(1) -
+            ADSP_BXT_DSP_GTW_HOST_IN_STREAM_BASE(0),
+        .sd = 0,
+    },
+    {
+        .name = "hda-link-out", .type = HDA_LINK_OUT,
+        .count = ADSP_BXT_HDA_OUT_STREAMS,
+        .base = ADSP_BXT_DSP_GTW_LINK_OUT_STREAM_BASE(0),
+        .stride = ADSP_BXT_DSP_GTW_LINK_OUT_STREAM_SIZE,
+    },
+    {
+        .name = "hda-link-in", .type = HDA_LINK_IN,
+        .count = ADSP_BXT_HDA_IN_STREAMS,
+        .base = ADSP_BXT_DSP_GTW_LINK_IN_STREAM_BASE(0),
+        .stride = ADSP_BXT_DSP_GTW_LINK_IN_STREAM_SIZE,
+    },
+    {
+        /* stream descriptor is picked by tag at download */
+        .name = "hda-code-ldr", .type = HDA_CODE_LDR,
+        .count = 1,
+        .base = ADSP_BXT_DSP_GTW_CODE_LDR_BASE,
+        .stride = ADSP_BXT_DSP_GTW_CODE_LDR_SIZE,
+    },
+};
+
+/* ROM pages come from the ROM file and are never reloaded */
+static bool rom_shared;
+
 static void adsp_reset(void *opaque)
 {
 }
@@ -74,14 +119,65 @@ static const MemoryRegionOps io_ops = {
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
+/*
+ * -machine rom-share=on maps the ROM image file copy on write so every
+ * instance on the host uses the same page cache pages, the tail past the
+ * end of the file is anonymous zero pages. Returns NULL to use a SHM copy.
+ */
+static void *rom_map_shared(struct adsp_dev *adsp, size_t size)
+{
+    struct stat st;
+    void *ptr;
+    int fd;
+
+    if (!object_property_get_bool(qdev_get_machine(), "rom-share", NULL))
+        return NULL;
+
+    if (adsp->rom_filename == NULL) {
+        fprintf(stderr, "error: rom-share needs -machine rom=<file>\n");
+        return NULL;
+    }
+
+    fd = open(adsp->rom_filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "error: cant open ROM %s %d\n",
+            adsp->rom_filename, -errno);
+        return NULL;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0 || (size_t)st.st_size > size) {
+        fprintf(stderr, "error: ROM %s cant be shared, max size 0x%zx\n",
+            adsp->rom_filename, size);
+        close(fd);
+        return NULL;
+    }
+
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED ||
+        mmap(ptr, st.st_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        fprintf(stderr, "error: cant map ROM %s %d\n",
+            adsp->rom_filename, -errno);
+        if (ptr != MAP_FAILED)
+            munmap(ptr, size);
+        close(fd);
+        return NULL;
+    }
+
+    close(fd);
+    rom_shared = true;
+    printf(" ** ROM %s shared read-only\n", adsp->rom_filename);
+    return ptr;
+}
+
 static void init_memory(struct adsp_dev *adsp, const char *name)
 {
     MemoryRegion *iram, *dram0, *lp_sram, *rom, *io;
     const struct adsp_desc *board = adsp->desc;
     void *ptr = NULL;
     char shm_name[32];
-    int err, i;
-    uint32_t *uptr;
+    int err;
 
     /* SRAM -shared via SHM (not shared on real HW) */
     sprintf(shm_name, "%s-l2-sram", name);
@@ -96,9 +192,7 @@ static void init_memory(struct adsp_dev *adsp, const char *name)
         board->iram.base, iram);
 
     /* set memory to non zero values */
-    uptr = ptr;
-    for (i = 0; i < board->iram.size >> 2; i++)
-        uptr[i] = 0x5a5a5a5a;
+    adsp_sram_poison(adsp, ptr, board->iram.size, 0x5a5a5a5a);
 
     /* HP SRAM - shared via SHM (not shared on real HW) */
     sprintf(shm_name, "%s-hp-sram", name);
@@ -113,9 +207,7 @@ static void init_memory(struct adsp_dev *adsp, const char *name)
         board->dram0.base, dram0);
 
     /* set memory to non zero values */
-    uptr = ptr;
-    for (i = 0; i < board->dram0.size >> 2; i++)
-        uptr[i] = 0x6b6b6b6b;
+    adsp_sram_poison(adsp, ptr, board->dram0.size, 0x6b6b6b6b);
 
     /* LP SRAM - shared via SHM (not shared on real HW) */
     sprintf(shm_name, "%s-lp-sram", name);
@@ -129,28 +221,30 @@ static void init_memory(struct adsp_dev *adsp, const char *name)
     memory_region_add_subregion(adsp->system_memory,
         board->lp_sram.base, lp_sram);
 
-   /* set memory to non zero values */
-    uptr = ptr;
-    for (i = 0; i < board->lp_sram.size >> 2; i++)
-        uptr[i] = 0x7c7c7c7c;
+    /* set memory to non zero values */
+    adsp_sram_poison(adsp, ptr, board->lp_sram.size, 0x7c7c7c7c);
 
-    /* ROM - shared via SHM (not shared on real HW) */
-    sprintf(shm_name, "%s-rom", name);
-    err = qemu_io_register_shm(shm_name, ADSP_IO_SHM_ROM,
-        board->rom.size, &ptr);
-    if (err < 0)
-        fprintf(stderr, "error: cant alloc ROM SHM %d\n", err);
+    /* ROM - file pages shared by all instances or private SHM */
     rom = g_malloc(sizeof(*rom));
-    memory_region_init_ram_ptr(rom, NULL, "lpe.rom", board->rom.size, ptr);
+    ptr = rom_map_shared(adsp, board->rom.size);
+    if (ptr) {
+        memory_region_init_ram_ptr(rom, NULL, "lpe.rom", board->rom.size,
+            ptr);
+        memory_region_set_readonly(rom, true);
+    } else {
+        sprintf(shm_name, "%s-rom", name);
+        err = qemu_io_register_shm(shm_name, ADSP_IO_SHM_ROM,
+            board->rom.size, &ptr);
+        if (err < 0)
+            fprintf(stderr, "error: cant alloc ROM SHM %d\n", err);
+        memory_region_init_ram_ptr(rom, NULL, "lpe.rom", board->rom.size,
+            ptr);
+        adsp_sram_poison(adsp, ptr, board->rom.size, 0);
+    }
     vmstate_register_ram_global(rom);
     memory_region_add_subregion(adsp->system_memory,
         board->rom.base, rom);
 
-   /* set memory to non zero values */
-    uptr = ptr;
-    for (i = 0; i < board->rom.size >> 2; i++)
-        uptr[i] = 0;
-
     /* SHIM and all IO  - shared via SHM */
     io = g_malloc(sizeof(*io));
 
@@ -167,10 +261,6 @@ static void init_memory(struct adsp_dev *adsp, const char *name)
         board->io_dev.desc.base, io);
 }
 
-static void adsp_pm_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg)
-{
-}
-
 static int bridge_cb(void *data, struct qemu_io_msg *msg)
 {
     struct adsp_dev *adsp = (struct adsp_dev *)data;
@@ -181,7 +271,9 @@ static int bridge_cb(void *data, struct qemu_io_msg *msg)
         adsp_bxt_shim_msg(adsp, msg);
         break;
     case QEMU_IO_TYPE_IRQ:
+        qemu_mutex_lock_iothread();
         adsp_bxt_irq_msg(adsp, msg);
+        qemu_mutex_unlock_iothread();
         break;
     case QEMU_IO_TYPE_PM:
         adsp_pm_msg(adsp, msg);
@@ -189,6 +281,15 @@ static int bridge_cb(void *data, struct qemu_io_msg *msg)
     case QEMU_IO_TYPE_DMA:
         dw_dma_msg(msg);
         break;
+    case QEMU_IO_TYPE_GDB:
+        adsp_gdb_msg(msg);
+        break;
+    case QEMU_IO_TYPE_TIME:
+        adsp_time_sync_msg(msg);
+        break;
+    case QEMU_IO_TYPE_VM:
+        adsp_snapshot_msg(adsp, msg);
+        break;
     case QEMU_IO_TYPE_MEM:
     default:
         break;
@@ -197,94 +298,52 @@ static int bridge_cb(void *data, struct qemu_io_msg *msg)
     return 0;
 }
 
-static struct adsp_dev *adsp_init(const struct adsp_desc *board,
-    MachineState *machine, const char *name)
+/*
+ * ROM boot of a firmware image from -kernel or the code loader. Loads the
+ * ROM, authenticates the image and copies its segments to SRAM.
+ */
+int adsp_bxt_boot(struct adsp_dev *adsp, void *image, size_t size)
 {
-    struct adsp_dev *adsp;
-    struct fw_image_manifest *man;
+    const struct adsp_desc *board = adsp->desc;
+    struct fw_image_manifest *man = image;
     struct module *mod;
     struct adsp_fw_header *hdr;
     unsigned long foffset, soffset, ssize;
-    int n, i, j;
+    int i, j;
     void *rom;
 
-    adsp = g_malloc(sizeof(*adsp));
-    adsp->log = log_init(NULL);    /* TODO: add log name to cmd line */
-    adsp->desc = board;
-    adsp->system_memory = get_system_memory();
-    adsp->machine_opts = qemu_get_machine_opts();
-    adsp->cpu_model = machine->cpu_model;
-    adsp->kernel_filename = qemu_opt_get(adsp->machine_opts, "kernel");
-    adsp->rom_filename = qemu_opt_get(adsp->machine_opts, "rom");
-
-    /* initialise CPU */
-    if (!adsp->cpu_model) {
-        adsp->cpu_model = XTENSA_DEFAULT_CPU_MODEL;
-    }
-
-    for (n = 0; n < smp_cpus; n++) {
-
-        adsp->xtensa[n] = g_malloc(sizeof(struct adsp_xtensa));
-        adsp->xtensa[n]->cpu = XTENSA_CPU(cpu_create(machine->cpu_type));
-
-        if (adsp->xtensa[n]->cpu == NULL) {
-            error_report("unable to find CPU definition '%s'",
-                adsp->cpu_model);
-            exit(EXIT_FAILURE);
-        }
-
-        adsp->xtensa[n]->env = &adsp->xtensa[n]->cpu->env;
-        adsp->xtensa[n]->env->sregs[PRID] = n;
-
-        qemu_register_reset(adsp_reset, adsp->xtensa[n]->cpu);
-
-        /* Need MMU initialized prior to ELF loading,
-        * so that ELF gets loaded into virtual addresses
-        */
-        cpu_reset(CPU(adsp->xtensa[n]->cpu));
-
+    /* load ROM image and copy to ROM, a shared ROM maps the file */
+    if (adsp->rom_filename && !rom_shared) {
+        rom = g_malloc(ADSP_BXT_DSP_ROM_SIZE);
+        load_image_size(adsp->rom_filename, rom,
+            ADSP_BXT_DSP_ROM_SIZE);
+        cpu_physical_memory_write(board->rom.base, rom,
+            ADSP_BXT_DSP_ROM_SIZE);
+        g_free(rom);
     }
 
-    init_memory(adsp, name);
-
-    /* init peripherals */
-    adsp_bxt_shim_init(adsp, name);
-    adsp_mbox_init(adsp, name);
-    dw_dma_init_dev(adsp, adsp->system_memory, board->gp_dmac_dev, 2);
-    adsp_ssp_init(adsp->system_memory, board->ssp_dev, 2);
-
-    /* reset all devices to init state */
-    qemu_devices_reset();
-
-    /* initialise bridge to x86 host driver */
-    qemu_io_register_child(name, &bridge_cb, (void*)adsp);
-
-    /* load binary file if one is specified on cmd line otherwise finish */
-    if (adsp->kernel_filename == NULL) {
-        printf(" ** Broxton Xtensa HiFi3 DSP initialised.\n"
-            " ** Waiting for host to load firmware...\n");
-        return adsp;
+    /* optional ROM style authentication of the signed image */
+    if (adsp_bxt_auth(adsp, man, size) < 0) {
+        printf(" ** Broxton firmware not authenticated, not booting.\n");
+        return -EACCES;
     }
 
-
-    printf("now loading:\n kernel %s\n ROM %s\n",
-        adsp->kernel_filename, adsp->rom_filename);
-
-    /* load ROM image and copy to ROM */
-    rom = g_malloc(ADSP_BXT_DSP_ROM_SIZE);
-    load_image_size(adsp->rom_filename, rom,
-        ADSP_BXT_DSP_ROM_SIZE);
-    cpu_physical_memory_write(board->rom.base, rom, ADSP_BXT_DSP_ROM_SIZE);
-
-    /* load the binary image and copy to SRAM */
-    man = g_malloc(board->iram.size);
-    load_image_size(adsp->kernel_filename, man,
-        board->iram.size);
-
     // HACK for ext manifest
     //man = (void*)man + 0x708; // HACK for ext manifest
 
+    /* the image comes from the guest driver, check it all before copying */
+    if (size < sizeof(*man)) {
+        fprintf(stderr, "error: bxt: image size 0x%zx smaller than manifest\n",
+            size);
+        return -EINVAL;
+    }
+
     hdr = &man->desc.header;
+    if (hdr->num_module_entries > MAN_BXT_NUM_MODULES) {
+        fprintf(stderr, "error: bxt: %u modules, max %d\n",
+            hdr->num_module_entries, MAN_BXT_NUM_MODULES);
+        return -EINVAL;
+    }
 
     /* copy module to SRAM */
    for (i = 0; i < hdr->num_module_entries; i++) {
@@ -299,11 +358,18 @@ static struct adsp_dev *adsp_init(const struct adsp_desc *board,
 
             foffset = mod->segment[j].file_offset;
             ssize = mod->segment[j].flags.r.length * 4096;
+            if (foffset > size || ssize > size - foffset) {
+                fprintf(stderr, "error: bxt: module %d segment %d beyond "
+                    "image\n", i, j);
+                return -EINVAL;
+            }
 
             /* L2 cache */
             if (mod->segment[j].v_base_addr >= ADSP_BXT_DSP_SRAM_BASE &&
                 mod->segment[j].v_base_addr < ADSP_BXT_DSP_SRAM_BASE + ADSP_BXT_DSP_SRAM_SIZE) {
 	    	soffset = mod->segment[j].v_base_addr - ADSP_BXT_DSP_SRAM_BASE;
+                if (ssize > ADSP_BXT_DSP_SRAM_SIZE - soffset)
+                    goto overflow;
  
                 printf(" L2 segment %d file offset 0x%lx SRAM addr 0x%x offset 0x%lx size 0x%lx\n",
                     j, foffset, mod->segment[j].v_base_addr, soffset, ssize);
@@ -318,6 +384,8 @@ static struct adsp_dev *adsp_init(const struct adsp_desc *board,
             if (mod->segment[j].v_base_addr >= ADSP_BXT_DSP_HP_SRAM_BASE &&
                 mod->segment[j].v_base_addr < ADSP_BXT_DSP_HP_SRAM_BASE + ADSP_BXT_DSP_HP_SRAM_SIZE) {
 	    	soffset = mod->segment[j].v_base_addr - ADSP_BXT_DSP_HP_SRAM_BASE;
+                if (ssize > ADSP_BXT_DSP_HP_SRAM_SIZE - soffset)
+                    goto overflow;
  
                 printf(" HP segment %d file offset 0x%lx SRAM addr 0x%x offset 0x%lx size 0x%lx\n",
                     j, foffset, mod->segment[j].v_base_addr, soffset, ssize);
@@ -332,6 +400,8 @@ static struct adsp_dev *adsp_init(const struct adsp_desc *board,
             if (mod->segment[j].v_base_addr >= ADSP_BXT_DSP_LP_SRAM_BASE &&
                 mod->segment[j].v_base_addr < ADSP_BXT_DSP_LP_SRAM_BASE + ADSP_BXT_DSP_LP_SRAM_SIZE) {
 	    	soffset = mod->segment[j].v_base_addr - ADSP_BXT_DSP_LP_SRAM_BASE;
+                if (ssize > ADSP_BXT_DSP_LP_SRAM_SIZE - soffset)
+                    goto overflow;
  
                 printf(" LP segment %d file offset 0x%lx SRAM addr 0x%x offset 0x%lx size 0x%lx\n",
                     j, foffset, mod->segment[j].v_base_addr, soffset, ssize);
@@ -345,6 +415,116 @@ static struct adsp_dev *adsp_init(const struct adsp_desc *board,
         }
     }
 
+    return 0;
+
+overflow:
+    fprintf(stderr, "error: bxt: module %d segment %d at 0x%x size 0x%lx "
+        "overflows SRAM\n", i, j, mod->segment[j].v_base_addr, ssize);
+    return -EINVAL;
+}
+
+/* host rang the IPC doorbell */
+static void doorbell_ring(void *opaque)
+{
+    adsp_bxt_irq_msg(opaque, NULL);
+}
+
+static struct adsp_dev *adsp_init(const struct adsp_desc *board,
+    MachineState *machine, const char *name)
+{
+    struct adsp_dev *adsp;
+    void *man;
+    ssize_t size;
+    int n;
+
+    adsp = g_malloc0(sizeof(*adsp));
+    adsp->log = log_init(NULL);    /* TODO: add log name to cmd line */
+    adsp->system_memory = get_system_memory();
+    adsp->machine_opts = qemu_get_machine_opts();
+    adsp->desc = board = adsp_board_load(board, adsp->machine_opts);
+    adsp->cpu_model = machine->cpu_model;
+    adsp->kernel_filename = qemu_opt_get(adsp->machine_opts, "kernel");
+    adsp->rom_filename = qemu_opt_get(adsp->machine_opts, "rom");
+
+    /* initialise CPU */
+    if (!adsp->cpu_model) {
+        adsp->cpu_model = XTENSA_DEFAULT_CPU_MODEL;
+    }
+
+    for (n = 0; n < smp_cpus; n++) {
+
+        adsp->xtensa[n] = g_malloc(sizeof(struct adsp_xtensa));
+        adsp->xtensa[n]->cpu = XTENSA_CPU(cpu_create(machine->cpu_type));
+
+        if (adsp->xtensa[n]->cpu == NULL) {
+            error_report("unable to find CPU definition '%s'",
+                adsp->cpu_model);
+            exit(EXIT_FAILURE);
+        }
+
+        adsp->xtensa[n]->env = &adsp->xtensa[n]->cpu->env;
+        adsp->xtensa[n]->env->sregs[PRID] = n;
+
+        qemu_register_reset(adsp_reset, adsp->xtensa[n]->cpu);
+
+        /* Need MMU initialized prior to ELF loading,
+        * so that ELF gets loaded into virtual addresses
+        */
+        cpu_reset(CPU(adsp->xtensa[n]->cpu));
+
+    }
+
+    init_memory(adsp, name);
+
+    /* init peripherals */
+    adsp_bxt_shim_init(adsp, name);
+    adsp_mbox_init(adsp, name);
+    adsp_trace_init(adsp, name);
+    dw_dma_init_dev(adsp, adsp->system_memory, board->gp_dmac_dev, 2);
+    adsp_hda_dma_init(adsp, name, bxt_hda_streams,
+        ARRAY_SIZE(bxt_hda_streams));
+    adsp_ssp_init(adsp->system_memory, board->ssp_dev, 2,
+        board->io_timing.ssp_fifo_depth);
+    adsp_heatmap_init(adsp);
+    adsp_analysis_init(adsp);
+    adsp_snapshot_init(adsp);
+    adsp_pm_init(adsp);
+    adsp_gdb_init("host");
+    adsp_fork_server_init(adsp);
+
+    /* optional cycle approximate timing model */
+    adsp_timing_init(adsp);
+
+    /* reset all devices to init state */
+    qemu_devices_reset();
+
+    /* initialise bridge to x86 host driver */
+    qemu_io_register_child(name, &bridge_cb, (void*)adsp);
+    adsp_time_sync_init(qemu_opt_get(adsp->machine_opts, "sync-quantum"));
+    adsp_doorbell_init(&adsp->doorbell, doorbell_ring, adsp);
+
+    /* load binary file if one is specified on cmd line otherwise finish */
+    if (adsp->kernel_filename == NULL) {
+        adsp_bxt_rom_init(adsp);
+        printf(" ** Broxton Xtensa HiFi3 DSP initialised.\n"
+            " ** Waiting for host to load firmware...\n");
+        return adsp;
+    }
+
+
+    printf("now loading:\n kernel %s\n ROM %s\n",
+        adsp->kernel_filename, adsp->rom_filename);
+
+    /* load the binary image and boot it */
+    man = g_malloc(board->iram.size);
+    size = load_image_size(adsp->kernel_filename, man,
+        board->iram.size);
+    if (size < 0) {
+        fprintf(stderr, "error: cant load %s\n", adsp->kernel_filename);
+        return adsp;
+    }
+
+    adsp_bxt_boot(adsp, man, size);
     return adsp;
 }
 
@@ -354,12 +534,22 @@ static const struct adsp_desc bxt_dsp_desc = {
     .ext_timer_irq = IRQ_NUM_EXT_TIMER,
     .pmc_irq = IRQ_NUM_EXT_PMC,
 
+    .io_timing = {.ext_clk_kHz = 2500},
+
     .num_ssp = 3,
     .num_dmac = 2,
-    .iram = {.base = ADSP_BXT_DSP_SRAM_BASE, .size = ADSP_BXT_DSP_SRAM_SIZE},
-    .dram0 = {.base = ADSP_BXT_DSP_HP_SRAM_BASE, .size = ADSP_BXT_DSP_HP_SRAM_SIZE},
-    .lp_sram = {.base = ADSP_BXT_DSP_LP_SRAM_BASE, .size = ADSP_BXT_DSP_LP_SRAM_SIZE},
-    .rom = {.base = ADSP_BXT_DSP_ROM_BASE, .size = ADSP_BXT_DSP_ROM_SIZE},
+    .iram = {.base = ADSP_BXT_DSP_SRAM_BASE, .size = ADSP_BXT_DSP_SRAM_SIZE,
+        .load_cycles = 6, .store_cycles = 4, .cached = true},
+    .dram0 = {.base = ADSP_BXT_DSP_HP_SRAM_BASE, .size = ADSP_BXT_DSP_HP_SRAM_SIZE,
+        .load_cycles = 6, .store_cycles = 4, .cached = true},
+    .lp_sram = {.base = ADSP_BXT_DSP_LP_SRAM_BASE, .size = ADSP_BXT_DSP_LP_SRAM_SIZE,
+        .load_cycles = 12, .store_cycles = 8},
+    .rom = {.base = ADSP_BXT_DSP_ROM_BASE, .size = ADSP_BXT_DSP_ROM_SIZE,
+        .load_cycles = 8, .store_cycles = 8, .cached = true},
+    .hda = {.size = ADSP_BXT_HDA_SIZE},
+
+    /* unified L1 cache in front of L2 SRAM, charged for fetches and data */
+    .cache = {.size = 48 * 1024, .line_size = 64, .ways = 4, .miss_cycles = 10},
 
     .mbox_dev = {
         .name = "mbox",
@@ -420,7 +610,7 @@ static void bxt_adsp_init(MachineState *machine)
     adsp = adsp_init(&bxt_dsp_desc, machine, "bxt");
 
     adsp->ext_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, &bxt_ext_timer_cb, adsp);
-    adsp->ext_clk_kHz = 2500;
+    adsp->ext_clk_kHz = adsp->desc->io_timing.ext_clk_kHz;
 }
 
 static void xtensa_bxt_machine_init(MachineClass *mc)
@@ -430,6 +620,7 @@ static void xtensa_bxt_machine_init(MachineClass *mc)
     mc->init = bxt_adsp_init;
     mc->max_cpus = 2;
     mc->default_cpu_type = XTENSA_DEFAULT_CPU_TYPE;
+    adsp_board_class_init(mc, &bxt_dsp_desc);
 }
 
 DEFINE_MACHINE("adsp_bxt", xtensa_bxt_machine_init)
@@ -48,5 +48,10 @@ void adsp_bxt_shim_init(struct adsp_dev *adsp, const char *name);
 void adsp_bxt_shim_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg);
 void adsp_bxt_irq_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg);
 void bxt_ext_timer_cb(void *opaque);
+int adsp_bxt_auth(struct adsp_dev *adsp, const void *image, size_t size);
+int adsp_bxt_boot(struct adsp_dev *adsp, void *image, size_t size);
+void adsp_bxt_rom_init(struct adsp_dev *adsp);
+bool adsp_bxt_rom_ipc(struct adsp_dev *adsp);
+void adsp_bxt_rom_reset(struct adsp_dev *adsp);
 
 #endif
@@ -0,0 +1,227 @@
+/* PMC/SCU model for Baytrail audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The PMC (SCU on CHT) serves one LPE request at a time. A request is
+ * latched when the DSP sets BUSY in IPCLPESCH, it completes after the
+ * command latency on the virtual clock by setting DONE and raising the
+ * PMC IRQ. DDR link down and up bracket the firmware power gating of its
+ * path to DRAM (D0ix). Only the LPE clock change has an effect, DDR link
+ * and SSP clock requests are acknowledged and otherwise status only, DMA
+ * and SSP timing do not depend on them. All of it runs with the BQL held.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/cutils.h"
+#include "qemu/timer.h"
+#include "sysemu/sysemu.h"
+#include "migration/vmstate.h"
+
+#include "hw/audio/adsp-dev.h"
+#include "hw/adsp/shim.h"
+#include "hw/adsp/log.h"
+#include "byt.h"
+
+/* what the old PMC worker thread slept for */
+#define PMC_DEFAULT_LATENCY_NS	50000
+
+struct pmc_cmd_desc {
+    uint32_t cmd;
+    const char *name;
+};
+
+static const struct pmc_cmd_desc pmc_cmds[] = {
+    {PMC_DDR_LINK_UP, "ddr-up"},
+    {PMC_DDR_LINK_DOWN, "ddr-down"},
+    {PMC_SET_LPECLK, "lpeclk"},
+    {PMC_SET_SSP_19M2, "ssp-19m2"},
+    {PMC_SET_SSP_25M, "ssp-25m"},
+};
+
+#define PMC_NUM_CMDS	ARRAY_SIZE(pmc_cmds)
+
+static struct byt_pmc {
+    struct adsp_dev *adsp;
+    QEMUTimer *timer;
+    int64_t latency[PMC_NUM_CMDS];
+    int64_t default_latency;
+
+    /* request in flight, 0 when idle */
+    uint32_t cmd;
+    int64_t start;
+} pmc;
+
+/* request in flight is carried in snapshots with its completion timer */
+static const VMStateDescription vmstate_pmc = {
+    .name = "adsp-pmc",
+    .version_id = 2,
+    .minimum_version_id = 2,
+    .fields = (VMStateField[]) {
+        VMSTATE_TIMER_PTR(timer, struct byt_pmc),
+        VMSTATE_UINT32(cmd, struct byt_pmc),
+        VMSTATE_INT64(start, struct byt_pmc),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static int pmc_cmd_index(uint32_t cmd)
+{
+    int i;
+
+    for (i = 0; i < PMC_NUM_CMDS; i++) {
+        if (pmc_cmds[i].cmd == cmd)
+            return i;
+    }
+    return -1;
+}
+
+static int64_t pmc_cmd_latency(uint32_t cmd)
+{
+    int i = pmc_cmd_index(cmd);
+
+    return i < 0 ? pmc.default_latency : pmc.latency[i];
+}
+
+static void pmc_complete(void *opaque)
+{
+    struct adsp_dev *adsp = pmc.adsp;
+    uint32_t *io = adsp->shim_io;
+
+    switch (pmc.cmd) {
+    case PMC_SET_LPECLK:
+        /* switch to the requested clock then ack the change */
+        shim_io_update(io, SHIM_CLKCTL, SHIM_FR_LAT_CLK_MASK,
+            shim_io_read(io, SHIM_FR_LAT_REQ));
+        shim_io_update(io, SHIM_CLKCTL,
+            SHIM_CLKCTL_FRCHNGGO | SHIM_CLKCTL_FRCHNGACK,
+            SHIM_CLKCTL_FRCHNGACK);
+        break;
+    default:
+        break;
+    }
+
+    log_text(adsp->log, LOG_IRQ_BUSY,
+        "irq: SC send done interrupt 0x%x after %" PRId64 " ns\n", pmc.cmd,
+        qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - pmc.start);
+
+    pmc.cmd = 0;
+
+    /* now send IRQ to DSP from SC completion */
+    shim_io_update(io, SHIM_IPCLPESCH,
+        SHIM_IPCLPESCH_BUSY | SHIM_IPCLPESCH_DONE, SHIM_IPCLPESCH_DONE);
+    shim_io_update(io, SHIM_ISRLPESC,
+        SHIM_ISRLPESC_BUSY | SHIM_ISRLPESC_DONE, SHIM_ISRLPESC_DONE);
+
+    adsp_set_irq(adsp, adsp->desc->pmc_irq, 1);
+}
+
+/* DSP set BUSY in IPCLPESCH, called from SHIM write */
+void adsp_byt_pmc_request(struct adsp_dev *adsp, uint32_t cmd)
+{
+    /* firmware waits for DONE, a new request replaces the old one */
+    if (pmc.cmd)
+        log_text(adsp->log, LOG_IRQ_BUSY,
+            "irq: SC cmd 0x%x while 0x%x in flight\n", cmd, pmc.cmd);
+
+    /* perform any action prior to completion */
+    switch (cmd) {
+    case PMC_SET_LPECLK:
+        shim_io_update(adsp->shim_io, SHIM_CLKCTL,
+            SHIM_CLKCTL_FRCHNGGO | SHIM_CLKCTL_FRCHNGACK,
+            SHIM_CLKCTL_FRCHNGGO);
+        break;
+    default:
+        break;
+    }
+
+    pmc.cmd = cmd;
+    pmc.start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    timer_mod(pmc.timer, pmc.start + pmc_cmd_latency(cmd));
+}
+
+static void pmc_reset(void *opaque)
+{
+    timer_del(pmc.timer);
+    pmc.cmd = 0;
+}
+
+/*
+ * "<ns>" for every command or "<cmd>=<ns>:...", ',' would end the option
+ * in -machine.
+ */
+static void pmc_parse_latency(const char *opt)
+{
+    char **opts, **o, *val;
+    uint64_t ns;
+    int i;
+
+    opts = g_strsplit(opt, ":", 0);
+    for (o = opts; *o != NULL; o++) {
+
+        val = strchr(*o, '=');
+        if (val)
+            *val++ = 0;
+
+        if (qemu_strtou64(val ? val : *o, NULL, 0, &ns) < 0 ||
+            ns > INT64_MAX) {
+            fprintf(stderr, "error: pmc: invalid latency %s\n", *o);
+            continue;
+        }
+
+        if (val == NULL) {
+            pmc.default_latency = ns;
+            for (i = 0; i < PMC_NUM_CMDS; i++)
+                pmc.latency[i] = ns;
+            continue;
+        }
+
+        for (i = 0; i < PMC_NUM_CMDS; i++) {
+            if (!strcmp(pmc_cmds[i].name, *o))
+                break;
+        }
+
+        if (i == PMC_NUM_CMDS)
+            fprintf(stderr, "error: pmc: unknown command %s\n", *o);
+        else
+            pmc.latency[i] = ns;
+    }
+    g_strfreev(opts);
+}
+
+void adsp_byt_pmc_init(struct adsp_dev *adsp)
+{
+    const char *opt;
+    int i;
+
+    pmc.adsp = adsp;
+    pmc.default_latency = PMC_DEFAULT_LATENCY_NS;
+    for (i = 0; i < PMC_NUM_CMDS; i++)
+        pmc.latency[i] = PMC_DEFAULT_LATENCY_NS;
+
+    opt = qemu_opt_get(adsp->machine_opts, "pmc-latency");
+    if (opt)
+        pmc_parse_latency(opt);
+
+    pmc.timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, pmc_complete, NULL);
+    pmc_reset(NULL);
+    qemu_register_reset(pmc_reset, NULL);
+    vmstate_register(NULL, 0, &vmstate_pmc, &pmc);
+}
@@ -37,66 +37,22 @@
 
 static void rearm_ext_timer(struct adsp_dev *adsp)
 {
-    uint32_t wake = adsp->shim_io[SHIM_EXT_TIMER_CNTLL >> 2];
+    uint32_t wake = shim_io_read(adsp->shim_io, SHIM_EXT_TIMER_CNTLL);
 
-    adsp->shim_io[SHIM_EXT_TIMER_STAT >> 2] =
+    shim_io_write(adsp->shim_io, SHIM_EXT_TIMER_STAT,
         (qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - adsp->ext_timer_start) /
-        (1000000 / adsp->ext_clk_kHz);
+        (1000000 / adsp->ext_clk_kHz));
 
     timer_mod(adsp->ext_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
-            muldiv64(wake - adsp->shim_io[SHIM_EXT_TIMER_STAT >> 2],
+            muldiv64(wake - shim_io_read(adsp->shim_io, SHIM_EXT_TIMER_STAT),
                 1000000, adsp->ext_clk_kHz));
 }
 
-static void *pmc_work(void *data)
-{
-    struct adsp_dev *adsp = data;
-
-    /* delay for PMC to do the work */
-    usleep(50);
-
-    /* perform any action after IRQ - ideally we should do this in thread*/
-    switch (adsp->pmc_cmd) {
-    case PMC_SET_LPECLK:
-
-        /* set the clock bits */
-        adsp->shim_io[SHIM_CLKCTL >> 2] &= ~SHIM_FR_LAT_CLK_MASK;
-        adsp->shim_io[SHIM_CLKCTL >> 2] |=
-            adsp->shim_io[SHIM_FR_LAT_REQ >> 2] & SHIM_FR_LAT_CLK_MASK;
-
-        /* tell the DSP clock has been updated */
-        adsp->shim_io[SHIM_CLKCTL >> 2] &= ~SHIM_CLKCTL_FRCHNGGO;
-        adsp->shim_io[SHIM_CLKCTL >> 2] |= SHIM_CLKCTL_FRCHNGACK;
-
-        break;
-    default:
-        break;
-    }
-
-    log_text(adsp->log, LOG_IRQ_BUSY,
-        "irq: SC send busy interrupt 0x%x\n", adsp->pmc_cmd);
-
-    /* now send IRQ to DSP from SC completion */
-    adsp->shim_io[SHIM_IPCLPESCH >> 2] &= ~SHIM_IPCLPESCH_BUSY;
-    adsp->shim_io[SHIM_IPCLPESCH >> 2] |= SHIM_IPCLPESCH_DONE;
-
-    adsp->shim_io[SHIM_ISRLPESC >> 2] &= ~SHIM_ISRLPESC_BUSY;
-    adsp->shim_io[SHIM_ISRLPESC >> 2] |= SHIM_ISRLPESC_DONE;
-
-    qemu_mutex_lock_iothread();
-    adsp_set_irq(adsp, adsp->desc->pmc_irq, 1);
-    qemu_mutex_unlock_iothread();
-    return NULL;
-}
-
-
 void byt_ext_timer_cb(void *opaque)
 {
     struct adsp_dev *adsp = opaque;
-    uint32_t pisr = adsp->shim_io[SHIM_PISR >> 2];
 
-    pisr |= SHIM_PISR_EXTT;
-    adsp->shim_io[SHIM_PISR >> 2] = pisr;
+    shim_io_set(adsp->shim_io, SHIM_PISR, SHIM_PISR_EXTT);
     adsp_set_irq(adsp, adsp->desc->ext_timer_irq, 1);
 }
 
@@ -116,21 +72,21 @@ static uint64_t shim_read(void *opaque, hwaddr addr,
 
     switch (addr) {
     case SHIM_EXT_TIMER_STAT:
-        adsp->shim_io[addr >> 2] =
+        shim_io_write(adsp->shim_io, addr,
         (qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - adsp->ext_timer_start) /
-            (1000000 / adsp->ext_clk_kHz);
+            (1000000 / adsp->ext_clk_kHz));
         break;
     case SHIM_PISR:
-        adsp->shim_io[addr >> 2] = 0;
+        shim_io_write(adsp->shim_io, addr, 0);
         break;
     default:
         break;
     }
 
     log_read(adsp->log, &adsp->desc->shim_dev, addr, size,
-        adsp->shim_io[addr >> 2]);
+        shim_io_read(adsp->shim_io, addr));
 
-    return adsp->shim_io[addr >> 2];
+    return shim_io_read(adsp->shim_io, addr);
 }
 
 /* SHIM IO from ADSP */
@@ -139,18 +95,17 @@ static void shim_write(void *opaque, hwaddr addr,
 {
     struct adsp_dev *adsp = opaque;
     struct qemu_io_msg_reg32 reg32;
-    struct qemu_io_msg_irq irq;
     uint32_t active, isrx, isrlpesc;
 
     log_write(adsp->log, &adsp->desc->shim_dev, addr, val, size,
-        adsp->shim_io[addr >> 2]);
+        shim_io_read(adsp->shim_io, addr));
 
     /* special case registers */
     switch (addr) {
     case SHIM_IPCDL:
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* reset the CPU and halt if we are dead to ease debugging */
         if ((val & 0xffff0000) == 0xdead0000) {
@@ -167,13 +122,13 @@ static void shim_write(void *opaque, hwaddr addr,
         /* DSP to host IPC command */
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* set/clear status bit */
-        isrx = adsp->shim_io[SHIM_ISRX >> 2] & ~(SHIM_ISRX_DONE | SHIM_ISRX_BUSY);
-        isrx |= val & SHIM_IPCD_BUSY ? SHIM_ISRX_BUSY : 0;
+        isrx = val & SHIM_IPCD_BUSY ? SHIM_ISRX_BUSY : 0;
         isrx |= val & SHIM_IPCD_DONE ? SHIM_ISRX_DONE : 0;
-        adsp->shim_io[SHIM_ISRX >> 2] = isrx;
+        shim_io_update(adsp->shim_io, SHIM_ISRX,
+            SHIM_ISRX_DONE | SHIM_ISRX_BUSY, isrx);
 
         /* do we need to send an IRQ ? */
         if (val & SHIM_IPCD_BUSY) {
@@ -182,25 +137,20 @@ static void shim_write(void *opaque, hwaddr addr,
                 "irq: send busy interrupt 0x%8.8lx\n", val);
 
             /* send IRQ to parent */
-            irq.hdr.type = QEMU_IO_TYPE_IRQ;
-            irq.hdr.msg = QEMU_IO_MSG_IRQ;
-            irq.hdr.size = sizeof(irq);
-            irq.irq = 0;
-
-            qemu_io_send_msg(&irq.hdr);
+            qemu_io_send_irq(0);
         }
         break;
     case SHIM_IPCXH:
         /* DSP to host IPC notify */
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* set/clear status bit */
-        isrx = adsp->shim_io[SHIM_ISRX >> 2] & ~(SHIM_ISRX_DONE | SHIM_ISRX_BUSY);
-        isrx |= val & SHIM_IPCX_BUSY ? SHIM_ISRX_BUSY : 0;
+        isrx = val & SHIM_IPCX_BUSY ? SHIM_ISRX_BUSY : 0;
         isrx |= val & SHIM_IPCX_DONE ? SHIM_ISRX_DONE : 0;
-        adsp->shim_io[SHIM_ISRX >> 2] = isrx;
+        shim_io_update(adsp->shim_io, SHIM_ISRX,
+            SHIM_ISRX_DONE | SHIM_ISRX_BUSY, isrx);
 
         /* do we need to send an IRQ ? */
         if (val & SHIM_IPCX_DONE) {
@@ -209,26 +159,22 @@ static void shim_write(void *opaque, hwaddr addr,
                 "irq: send done interrupt 0x%8.8lx\n", val);
 
             /* send IRQ to parent */
-            irq.hdr.type = QEMU_IO_TYPE_IRQ;
-            irq.hdr.msg = QEMU_IO_MSG_IRQ;
-            irq.hdr.size = sizeof(irq);
-            irq.irq = 0;
-
-            qemu_io_send_msg(&irq.hdr);
+            qemu_io_send_irq(0);
         }
         break;
     case SHIM_IMRD:
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* DSP IPC interrupt mask */
-        active = adsp->shim_io[SHIM_ISRD >> 2] & ~(adsp->shim_io[SHIM_IMRD >> 2]);
+        active = shim_io_read(adsp->shim_io, SHIM_ISRD) &
+            ~shim_io_read(adsp->shim_io, SHIM_IMRD);
 
         log_text(adsp->log, LOG_IRQ_ACTIVE,
             "irq: IMRD masking %x mask %x active %x\n",
-            adsp->shim_io[SHIM_ISRD >> 2],
-            adsp->shim_io[SHIM_IMRD >> 2], active);
+            shim_io_read(adsp->shim_io, SHIM_ISRD),
+            shim_io_read(adsp->shim_io, SHIM_IMRD), active);
 
         if (!active) {
             adsp_set_irq(adsp, adsp->desc->ia_irq, 0);
@@ -238,7 +184,7 @@ static void shim_write(void *opaque, hwaddr addr,
     case SHIM_CSR:
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* now send msg to HOST VM to notify register write */
         reg32.hdr.type = QEMU_IO_TYPE_REG;
@@ -251,7 +197,7 @@ static void shim_write(void *opaque, hwaddr addr,
     case SHIM_PISR:
         /* write 1 to clear bits */
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] &= ~val;
+        shim_io_clear(adsp->shim_io, addr, val);
 
         if (val & SHIM_PISR_EXTT) {
             adsp_set_irq(adsp, adsp->desc->ext_timer_irq, 0);
@@ -261,15 +207,16 @@ static void shim_write(void *opaque, hwaddr addr,
     case SHIM_PIMR:
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* DSP IO interrupt mask */
-        active = adsp->shim_io[SHIM_PISR >> 2] & ~(adsp->shim_io[SHIM_PIMR >> 2]);
+        active = shim_io_read(adsp->shim_io, SHIM_PISR) &
+            ~shim_io_read(adsp->shim_io, SHIM_PIMR);
 
         log_text(adsp->log, LOG_IRQ_ACTIVE,
             "irq: PIMR masking %x mask %x active %x\n",
-            adsp->shim_io[SHIM_PISR >> 2],
-            adsp->shim_io[SHIM_PIMR >> 2], active);
+            shim_io_read(adsp->shim_io, SHIM_PISR),
+            shim_io_read(adsp->shim_io, SHIM_PIMR), active);
 
         if (!(active & SHIM_PISR_EXTT)) {
             adsp_set_irq(adsp, adsp->desc->ext_timer_irq, 0);
@@ -277,76 +224,65 @@ static void shim_write(void *opaque, hwaddr addr,
         break;
     case SHIM_EXT_TIMER_CNTLL:
         /* set the timer timeout value via SHM */
-        adsp->shim_io[addr >> 2] = val;
-        if (adsp->shim_io[SHIM_EXT_TIMER_CNTLH >> 2] & SHIM_EXT_TIMER_RUN)
+        shim_io_write(adsp->shim_io, addr, val);
+        if (shim_io_read(adsp->shim_io, SHIM_EXT_TIMER_CNTLH) &
+            SHIM_EXT_TIMER_RUN)
             rearm_ext_timer(adsp);
         break;
     case SHIM_EXT_TIMER_CNTLH:
 
         /* enable the timer ? */
         if (val & SHIM_EXT_TIMER_RUN &&
-            !(adsp->shim_io[addr >> 2] & SHIM_EXT_TIMER_RUN)) {
+            !(shim_io_read(adsp->shim_io, addr) & SHIM_EXT_TIMER_RUN)) {
                 adsp->ext_timer_start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
                 rearm_ext_timer(adsp);
         }
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* set/clear ext timer */
         if (val & SHIM_EXT_TIMER_CLEAR)
-            adsp->shim_io[SHIM_EXT_TIMER_STAT >> 2] = 0;
+            shim_io_write(adsp->shim_io, SHIM_EXT_TIMER_STAT, 0);
 
         break;
     case SHIM_EXT_TIMER_STAT:
         /* set status value via SHM - should not be written to ? */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
         rearm_ext_timer(adsp);
         break;
     case SHIM_IPCLPESCH:
         /* DSP to SCU IPC command */
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* set/clear status bit */
-        isrlpesc = adsp->shim_io[SHIM_ISRLPESC >> 2] &
-            ~(SHIM_ISRLPESC_DONE | SHIM_ISRLPESC_BUSY);
-        isrlpesc |= val & SHIM_IPCLPESCH_BUSY ? SHIM_ISRLPESC_BUSY : 0;
+        isrlpesc = val & SHIM_IPCLPESCH_BUSY ? SHIM_ISRLPESC_BUSY : 0;
         isrlpesc |= val & SHIM_IPCLPESCH_DONE ? SHIM_ISRLPESC_DONE : 0;
-        adsp->shim_io[SHIM_ISRLPESC >> 2] = isrlpesc;
+        shim_io_update(adsp->shim_io, SHIM_ISRLPESC,
+            SHIM_ISRLPESC_DONE | SHIM_ISRLPESC_BUSY, isrlpesc);
 
         /* do we need to send an IRQ ? */
         if (val & SHIM_IPCLPESCH_BUSY) {
 
-            adsp->pmc_cmd = val & 0xff;
-
-            /* perform any action prior to IRQ */
-            switch (adsp->pmc_cmd) {
-            case PMC_SET_LPECLK:
-                adsp->shim_io[SHIM_CLKCTL >> 2] |= SHIM_CLKCTL_FRCHNGGO;
-                adsp->shim_io[SHIM_CLKCTL >> 2] &= ~SHIM_CLKCTL_FRCHNGACK;
-                break;
-            default:
-                break;
-            }
-
-            qemu_thread_create(&adsp->pmc_thread, "pmc",
-                pmc_work, adsp, QEMU_THREAD_DETACHED);
+            /* completes later from the PMC timer */
+            adsp_byt_pmc_request(adsp, val & 0xff);
         }
         break;
     case SHIM_IMRLPESC:
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* DSP IPC interrupt mask */
-        active = adsp->shim_io[SHIM_ISRLPESC >> 2] & ~(adsp->shim_io[SHIM_IMRLPESC >> 2]);
+        active = shim_io_read(adsp->shim_io, SHIM_ISRLPESC) &
+            ~shim_io_read(adsp->shim_io, SHIM_IMRLPESC);
 
         log_text(adsp->log, LOG_IRQ_ACTIVE,
             "irq: SHIM_IMRLPESC masking %x mask %x active %x\n",
-            adsp->shim_io[SHIM_ISRLPESC >> 2],
-            adsp->shim_io[SHIM_IMRLPESC >> 2], active);
+            shim_io_read(adsp->shim_io, SHIM_ISRLPESC),
+            shim_io_read(adsp->shim_io, SHIM_IMRLPESC), active);
 
 
         if (!active) {
@@ -438,23 +374,25 @@ void adsp_byt_shim_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg)
     }
 }
 
+/* called with BQL held, msg is NULL for doorbells */
 void adsp_byt_irq_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg)
 {
     uint32_t active;
 
-    active = adsp->shim_io[SHIM_ISRD >> 2] & ~(adsp->shim_io[SHIM_IMRD >> 2]);
+    active = shim_io_read(adsp->shim_io, SHIM_ISRD) &
+        ~shim_io_read(adsp->shim_io, SHIM_IMRD);
 
     log_text(adsp->log, LOG_IRQ_ACTIVE,
         "IRQ: from HOST status %x mask %x active %x cmd %x\n",
-        adsp->shim_io[SHIM_ISRD >> 2],
-        adsp->shim_io[SHIM_IMRD >> 2], active,
-        adsp->shim_io[SHIM_IPCX >> 2]);
+        shim_io_read(adsp->shim_io, SHIM_ISRD),
+        shim_io_read(adsp->shim_io, SHIM_IMRD), active,
+        shim_io_read(adsp->shim_io, SHIM_IPCX));
 
-    if (active) {
-        qemu_mutex_lock_iothread();
+    /* load library requests page in deferred modules before firmware */
+    adsp_lazy_ipc(adsp);
+
+    if (active)
         adsp_set_irq(adsp, adsp->desc->ia_irq, 1);
-        qemu_mutex_unlock_iothread();
-    }
 }
 
 static const MemoryRegionOps shim_ops = {
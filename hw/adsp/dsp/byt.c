@@ -34,6 +34,8 @@
 
 #include "hw/audio/adsp-dev.h"
 #include "hw/adsp/shim.h"
+#include "hw/adsp/time-sync.h"
+#include "hw/adsp/gdb.h"
 #include "hw/adsp/log.h"
 #include "hw/adsp/byt.h"
 #include "hw/ssi/ssp.h"
@@ -53,8 +55,7 @@ static void init_memory(struct adsp_dev *adsp, const char *name)
     const struct adsp_desc *board = adsp->desc;
     void *ptr = NULL;
     char shm_name[32];
-    int err, i;
-    uint32_t *uptr;
+    int err;
 
     /* IRAM -shared via SHM */
     sprintf(shm_name, "%s-iram", name);
@@ -69,9 +70,7 @@ static void init_memory(struct adsp_dev *adsp, const char *name)
         board->iram.base, iram);
 
     /* set memory to non zero values */
-    uptr = ptr;
-    for (i = 0; i < board->iram.size >> 2; i++)
-        uptr[i] = 0x5a5a5a5a;
+    adsp_sram_poison(adsp, ptr, board->iram.size, 0x5a5a5a5a);
 
     /* DRAM0 - shared via SHM */
     sprintf(shm_name, "%s-dram", name);
@@ -86,13 +85,7 @@ static void init_memory(struct adsp_dev *adsp, const char *name)
         board->dram0.base, dram0);
 
     /* set memory to non zero values */
-    uptr = ptr;
-    for (i = 0; i < board->dram0.size >> 2; i++)
-        uptr[i] = 0x6b6b6b6b;
-}
-
-static void adsp_pm_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg)
-{
+    adsp_sram_poison(adsp, ptr, board->dram0.size, 0x6b6b6b6b);
 }
 
 static int bridge_cb(void *data, struct qemu_io_msg *msg)
@@ -109,7 +102,9 @@ static int bridge_cb(void *data, struct qemu_io_msg *msg)
         adsp_byt_shim_msg(adsp, msg);
         break;
     case QEMU_IO_TYPE_IRQ:
+        qemu_mutex_lock_iothread();
         adsp_byt_irq_msg(adsp, msg);
+        qemu_mutex_unlock_iothread();
         break;
     case QEMU_IO_TYPE_PM:
         adsp_pm_msg(adsp, msg);
@@ -117,6 +112,15 @@ static int bridge_cb(void *data, struct qemu_io_msg *msg)
     case QEMU_IO_TYPE_DMA:
         dw_dma_msg(msg);
         break;
+    case QEMU_IO_TYPE_GDB:
+        adsp_gdb_msg(msg);
+        break;
+    case QEMU_IO_TYPE_TIME:
+        adsp_time_sync_msg(msg);
+        break;
+    case QEMU_IO_TYPE_VM:
+        adsp_snapshot_msg(adsp, msg);
+        break;
     case QEMU_IO_TYPE_MEM:
     default:
         break;
@@ -125,6 +129,12 @@ static int bridge_cb(void *data, struct qemu_io_msg *msg)
     return 0;
 }
 
+/* host rang the IPC doorbell */
+static void doorbell_ring(void *opaque)
+{
+    adsp_byt_irq_msg(opaque, NULL);
+}
+
 static struct adsp_dev *adsp_init(const struct adsp_desc *board,
     MachineState *machine, const char *name)
 {
@@ -133,11 +143,11 @@ static struct adsp_dev *adsp_init(const struct adsp_desc *board,
     size_t lsize;
     int n;
 
-    adsp = g_malloc(sizeof(*adsp));
+    adsp = g_malloc0(sizeof(*adsp));
     adsp->log = log_init(NULL);    /* TODO: add log name to cmd line */
-    adsp->desc = board;
     adsp->system_memory = get_system_memory();
     adsp->machine_opts = qemu_get_machine_opts();
+    adsp->desc = board = adsp_board_load(board, adsp->machine_opts);
     adsp->cpu_model = machine->cpu_model;
     adsp->kernel_filename = qemu_opt_get(adsp->machine_opts, "kernel");
 
@@ -171,15 +181,29 @@ static struct adsp_dev *adsp_init(const struct adsp_desc *board,
 
     /* init peripherals */
     adsp_byt_shim_init(adsp, name);
+    adsp_byt_pmc_init(adsp);
     adsp_mbox_init(adsp, name);
+    adsp_trace_init(adsp, name);
     dw_dma_init_dev(adsp, adsp->system_memory, board->gp_dmac_dev, board->num_dmac);
-    adsp_ssp_init(adsp->system_memory, board->ssp_dev, board->num_ssp);
+    adsp_ssp_init(adsp->system_memory, board->ssp_dev, board->num_ssp,
+        board->io_timing.ssp_fifo_depth);
+    adsp_heatmap_init(adsp);
+    adsp_analysis_init(adsp);
+    adsp_snapshot_init(adsp);
+    adsp_pm_init(adsp);
+    adsp_gdb_init("host");
+    adsp_fork_server_init(adsp);
+
+    /* optional cycle approximate timing model */
+    adsp_timing_init(adsp);
 
     /* reset all devices to init state */
     qemu_devices_reset();
 
     /* initialise bridge to x86 host driver */
     qemu_io_register_child(name, &bridge_cb, (void*)adsp);
+    adsp_time_sync_init(qemu_opt_get(adsp->machine_opts, "sync-quantum"));
+    adsp_doorbell_init(&adsp->doorbell, doorbell_ring, adsp);
 
     /* load binary file if one is specified on cmd line otherwise finish */
     if (adsp->kernel_filename == NULL) {
@@ -204,6 +228,8 @@ static const struct adsp_desc byt_dsp_desc = {
     .ext_timer_irq = IRQ_NUM_EXT_TIMER,
     .pmc_irq = IRQ_NUM_EXT_PMC,
 
+    .io_timing = {.ext_clk_kHz = 2500},
+
     .num_ssp = 3,
     .num_dmac = 2,
     .iram = {.base = ADSP_BYT_DSP_IRAM_BASE, .size = ADSP_BYT_IRAM_SIZE},
@@ -275,7 +301,7 @@ static void byt_adsp_init(MachineState *machine)
     adsp = adsp_init(&byt_dsp_desc, machine, "byt");
 
     adsp->ext_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, &byt_ext_timer_cb, adsp);
-    adsp->ext_clk_kHz = 2500;
+    adsp->ext_clk_kHz = adsp->desc->io_timing.ext_clk_kHz;
 }
 
 static void cht_adsp_init(MachineState *machine)
@@ -285,7 +311,7 @@ static void cht_adsp_init(MachineState *machine)
     adsp = adsp_init(&byt_dsp_desc, machine, "cht");
 
     adsp->ext_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, &byt_ext_timer_cb, adsp);
-    adsp->ext_clk_kHz = 2500;
+    adsp->ext_clk_kHz = adsp->desc->io_timing.ext_clk_kHz;
 }
 
 static void xtensa_byt_machine_init(MachineClass *mc)
@@ -295,6 +321,7 @@ static void xtensa_byt_machine_init(MachineClass *mc)
     mc->init = byt_adsp_init;
     mc->max_cpus = 1;
     mc->default_cpu_type = XTENSA_DEFAULT_CPU_TYPE;
+    adsp_board_class_init(mc, &byt_dsp_desc);
 }
 
 DEFINE_MACHINE("adsp_byt", xtensa_byt_machine_init)
@@ -306,6 +333,7 @@ static void xtensa_cht_machine_init(MachineClass *mc)
     mc->init = cht_adsp_init;
     mc->max_cpus = 1;
     mc->default_cpu_type = XTENSA_DEFAULT_CPU_TYPE;
+    adsp_board_class_init(mc, &byt_dsp_desc);
 }
 
 DEFINE_MACHINE("adsp_cht", xtensa_cht_machine_init)
@@ -49,4 +49,8 @@ void adsp_byt_shim_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg);
 void adsp_byt_irq_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg);
 void byt_ext_timer_cb(void *opaque);
 
+/* PMC/SCU requests from the DSP */
+void adsp_byt_pmc_init(struct adsp_dev *adsp);
+void adsp_byt_pmc_request(struct adsp_dev *adsp, uint32_t cmd);
+
 #endif
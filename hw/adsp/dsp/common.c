@@ -21,6 +21,7 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu-common.h"
+#include "qemu/timer.h"
 #include "sysemu/sysemu.h"
 #include "hw/boards.h"
 #include "hw/loader.h"
@@ -34,21 +35,91 @@
 #include "hw/adsp/log.h"
 #include "common.h"
 
+static void irq_latency_cb(void *opaque)
+{
+    struct adsp_dev *adsp = opaque;
+    CPUXtensaState *env = adsp->xtensa[0]->env;
+
+    env->sregs[INTSET] |= adsp->irq_pending;
+    adsp->irq_pending = 0;
+    check_interrupts(env);
+}
+
 void adsp_set_irq(struct adsp_dev *adsp, int irq, int active)
 {
     /* TODO: allow interrupts other cores than core 0 */
     CPUXtensaState *env = adsp->xtensa[0]->env;
+    uint32_t latency = adsp->desc->io_timing.irq_latency_ns;
     uint32_t irq_bit = 1 << irq;
 
+    /* assert reaches the core after the board IRQ latency */
+    if (active && latency) {
+        if (adsp->irq_timer == NULL)
+            adsp->irq_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                irq_latency_cb, adsp);
+        if (adsp->irq_pending == 0)
+            timer_mod(adsp->irq_timer,
+                qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + latency);
+        adsp->irq_pending |= irq_bit;
+        return;
+    }
+
     if (active) {
         env->sregs[INTSET] |= irq_bit;
     } else if (env->config->interrupt[irq].inttype == INTTYPE_LEVEL) {
+        adsp->irq_pending &= ~irq_bit;
         env->sregs[INTSET] &= ~irq_bit;
     }
 
     check_interrupts(env);
 }
 
+static void timing_add_region(CPUXtensaState *env,
+    const struct adsp_mem_desc *mem)
+{
+    if (mem->size == 0)
+        return;
+
+    if (xtensa_timing_add_region(env, mem->base, mem->size,
+        mem->load_cycles, mem->store_cycles, mem->cached) < 0)
+        fprintf(stderr, "error: no timing region for 0x%lx\n",
+            (unsigned long)mem->base);
+}
+
+/* enable cycle approximate timing model on all cores if requested */
+void adsp_timing_init(struct adsp_dev *adsp)
+{
+    const struct adsp_desc *board = adsp->desc;
+    XtensaTimingCache *cache = NULL;
+    CPUXtensaState *env;
+    int n;
+
+    if (!object_property_get_bool(qdev_get_machine(), "timing", NULL))
+        return;
+
+    /* cache is shared by all cores */
+    if (board->cache.size) {
+        cache = xtensa_timing_cache_new(board->cache.size,
+            board->cache.line_size, board->cache.ways,
+            board->cache.miss_cycles);
+        if (cache == NULL)
+            fprintf(stderr, "error: invalid timing cache descriptor\n");
+    }
+
+    for (n = 0; n < smp_cpus; n++) {
+        env = adsp->xtensa[n]->env;
+
+        timing_add_region(env, &board->iram);
+        timing_add_region(env, &board->dram0);
+        timing_add_region(env, &board->lp_sram);
+        timing_add_region(env, &board->rom);
+        xtensa_timing_set_cache(env, cache);
+        xtensa_timing_enable(env, true);
+    }
+
+    printf(" ** cycle approximate timing model enabled\n");
+}
+
 #define SND_SOF_FW_SIG_SIZE	4
 #define SND_SOF_FW_ABI		1
 #define SND_SOF_FW_SIG		"Reef"
@@ -138,9 +209,23 @@ struct snd_sst_fw_module_header {
 } __attribute__((packed));
 
 
+/* loadable modules can be deferred until first use */
+static void sof_block_write(struct adsp_dev *adsp,
+	struct snd_sof_mod_hdr *module, int index, hwaddr addr,
+	struct snd_sof_blk_hdr *block)
+{
+	void *data = (void *)block + sizeof(*block);
+
+	if (module->type == SOF_FW_MODULE &&
+	    adsp_lazy_add_block(adsp, index, addr, data, block->size) == 0)
+		return;
+
+	cpu_physical_memory_write(addr, data, block->size);
+}
+
 /* generic module parser for mmaped DSPs */
 static int sof_module_memcpy(struct adsp_dev *adsp,
-				struct snd_sof_mod_hdr *module)
+				struct snd_sof_mod_hdr *module, int index)
 {
 	const struct adsp_desc *board = adsp->desc;
 	struct snd_sof_blk_hdr *block;
@@ -171,15 +256,17 @@ static int sof_module_memcpy(struct adsp_dev *adsp,
 			fprintf(stdout, "text: 0x%lx size 0x%x\n",
 				board->iram.base + block->offset - board->host_iram_offset,
 				block->size);
-			cpu_physical_memory_write(board->iram.base + block->offset - board->host_iram_offset,
-				(void *)block + sizeof(*block), block->size);
+			sof_block_write(adsp, module, index,
+				board->iram.base + block->offset - board->host_iram_offset,
+				block);
 			break;
 		case SOF_BLK_DATA:
 			fprintf(stdout, "data: 0x%lx size 0x%x\n",
 				board->iram.base + block->offset - board->host_dram_offset,
 				block->size);
-			cpu_physical_memory_write(board->dram0.base + block->offset - board->host_dram_offset,
-				(void *)block + sizeof(*block), block->size);
+			sof_block_write(adsp, module, index,
+				board->dram0.base + block->offset - board->host_dram_offset,
+				block);
 			break;
 		default:
 			fprintf(stderr, "error: bad type 0x%x for block 0x%x\n",
@@ -312,7 +399,7 @@ static int sof_load_modules(struct adsp_dev *adsp, void *fw,
 	module = fw + sizeof(*header);
 	for (count = 0; count < header->num_modules; count++) {
 		/* module */
-		ret = sof_module_memcpy(adsp, module);
+		ret = sof_module_memcpy(adsp, module, count);
 		if (ret < 0) {
 			fprintf(stderr, "error: invalid module %d\n", count);
 			return ret;
@@ -0,0 +1,191 @@
+/* Copy on write fork server for audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Boot the firmware once, then connect to the fork server socket and write
+ * an instance id terminated by a newline. The first request parks the DSP,
+ * every request forks a child that shares all guest RAM copy on write and
+ * re-homes the IO bridge as <board>-<id>. The server replies with the child
+ * pid, a host started with -machine bridge-id=<id> pairs with that child.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu-common.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qemu/sockets.h"
+#include "qemu/error-report.h"
+#include "sysemu/sysemu.h"
+#include "sysemu/cpus.h"
+#include "exec/cpu-common.h"
+
+#include "qemu/io-bridge.h"
+#include "hw/audio/adsp-dev.h"
+#include "hw/adsp/shim.h"
+
+#define FORK_ID_SIZE	32
+
+/* SRAM and ROM are private to each child, device IO is shared with host */
+#define FORK_PRIVATE_REGIONS \
+    ((1U << ADSP_IO_SHM_IRAM) | (1U << ADSP_IO_SHM_DRAM) | \
+     (1U << ADSP_IO_SHM_LP_SRAM) | (1U << ADSP_IO_SHM_ROM))
+
+static struct {
+    struct adsp_dev *adsp;
+    int listen_fd;
+} fork_server = {
+    .listen_fd = -1,
+};
+
+/* guest RAM is MADV_DONTFORK by default, children need it COW */
+static int ram_dofork(const char *block_name, void *host_addr,
+    ram_addr_t offset, ram_addr_t length, void *opaque)
+{
+#ifdef MADV_DOFORK
+    if (madvise(host_addr, length, MADV_DOFORK) < 0)
+        fprintf(stderr, "error: fork: cant DOFORK %s %d\n",
+            block_name, errno);
+#endif
+    return 0;
+}
+
+static bool valid_id(const char *id)
+{
+    const char *c;
+
+    if (*id == 0)
+        return false;
+
+    for (c = id; *c; c++) {
+        if (!qemu_isalnum(*c) && *c != '-' && *c != '_' && *c != '.')
+            return false;
+    }
+
+    return true;
+}
+
+static void fork_child(int conn, const char *id)
+{
+    int err;
+
+    /* the server socket belongs to the parent */
+    qemu_set_fd_handler(fork_server.listen_fd, NULL, NULL, NULL);
+    close(fork_server.listen_fd);
+    fork_server.listen_fd = -1;
+    close(conn);
+
+    err = qemu_io_fork_child(id, FORK_PRIVATE_REGIONS);
+    if (err < 0) {
+        fprintf(stderr, "error: fork: cant re-home IO bridge as %s %d\n",
+            id, err);
+        exit(EXIT_FAILURE);
+    }
+
+    qemu_tcg_vcpus_after_fork();
+    adsp_sram_poison_fork_child();
+    adsp_trace_fork_child(id);
+
+    printf(" ** fork-server child %s pid %d running\n", id, getpid());
+    vm_start();
+}
+
+static void fork_request(void *opaque)
+{
+    char id[FORK_ID_SIZE], reply[32];
+    ssize_t len;
+    pid_t pid;
+    int conn;
+
+    conn = qemu_accept(fork_server.listen_fd, NULL, NULL);
+    if (conn < 0)
+        return;
+
+    len = read(conn, id, sizeof(id) - 1);
+    if (len <= 0)
+        goto out;
+    id[len] = 0;
+    id[strcspn(id, "\r\n")] = 0;
+
+    if (!valid_id(id)) {
+        snprintf(reply, sizeof(reply), "error %d\n", EINVAL);
+        goto reply;
+    }
+
+    /* reap any children that have finished */
+    while (waitpid(-1, NULL, WNOHANG) > 0)
+        ;
+
+    /* park the booted DSP, children resume from this point */
+    if (runstate_is_running()) {
+        vm_stop(RUN_STATE_PAUSED);
+        printf(" ** fork-server parked, forking children\n");
+    }
+
+    qemu_ram_foreach_block(ram_dofork, NULL);
+
+    fflush(stdout);
+    fflush(stderr);
+
+    rcu_enable_atfork();
+    pid = fork();
+    rcu_disable_atfork();
+
+    if (pid == 0) {
+        fork_child(conn, id);
+        return;
+    }
+
+    if (pid < 0)
+        snprintf(reply, sizeof(reply), "error %d\n", errno);
+    else
+        snprintf(reply, sizeof(reply), "%d\n", pid);
+
+reply:
+    if (write(conn, reply, strlen(reply)) < 0)
+        fprintf(stderr, "error: fork: cant reply %d\n", errno);
+out:
+    close(conn);
+}
+
+void adsp_fork_server_init(struct adsp_dev *adsp)
+{
+    const char *path;
+    Error *err = NULL;
+
+    path = qemu_opt_get(adsp->machine_opts, "fork-server");
+    if (path == NULL)
+        return;
+
+    if (!tcg_enabled()) {
+        fprintf(stderr, "error: fork-server needs TCG\n");
+        return;
+    }
+
+    fork_server.adsp = adsp;
+    fork_server.listen_fd = unix_listen(path, NULL, 0, &err);
+    if (fork_server.listen_fd < 0) {
+        error_report_err(err);
+        return;
+    }
+
+    qemu_set_fd_handler(fork_server.listen_fd, fork_request, NULL, NULL);
+    printf(" ** fork-server listening on %s\n", path);
+}
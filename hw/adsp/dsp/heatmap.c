@@ -0,0 +1,248 @@
+/* Memory access heatmap and bandwidth accounting for audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu-common.h"
+#include "sysemu/sysemu.h"
+#include "exec/exec-all.h"
+#include "exec/memory.h"
+#include "qmp-commands.h"
+
+#include "hw/audio/adsp-dev.h"
+#include "hw/dma/dw-dma.h"
+#include "common.h"
+
+#define HEATMAP_PAGE_SHIFT	12
+#define HEATMAP_MAX_REGIONS	4
+
+struct heatmap_page {
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t tlb_fills;
+};
+
+struct heatmap_region {
+    char *name;
+    const struct adsp_mem_desc *mem;
+    struct heatmap_page *page;
+    int num_pages;
+};
+
+static struct {
+    struct adsp_dev *adsp;
+    bool enabled;
+    int num_regions;
+    struct heatmap_region region[HEATMAP_MAX_REGIONS];
+} heatmap;
+
+static struct heatmap_page *find_page(uint32_t addr)
+{
+    struct heatmap_region *r;
+    int i;
+
+    for (i = 0; i < heatmap.num_regions; i++) {
+        r = &heatmap.region[i];
+
+        if (addr - r->mem->base < r->mem->size)
+            return &r->page[(addr - r->mem->base) >> HEATMAP_PAGE_SHIFT];
+    }
+
+    return NULL;
+}
+
+static void heatmap_access(void *opaque, uint32_t addr, unsigned size,
+    bool store)
+{
+    struct heatmap_page *page = find_page(addr);
+
+    if (page == NULL)
+        return;
+
+    if (store)
+        page->write_bytes += size;
+    else
+        page->read_bytes += size;
+}
+
+static void heatmap_tlb_fill(void *opaque, uint32_t addr, int access_type)
+{
+    struct heatmap_page *page = find_page(addr);
+
+    if (page)
+        page->tlb_fills++;
+}
+
+static const XtensaMemHook heatmap_hook = {
+    .access = heatmap_access,
+    .tlb_fill = heatmap_tlb_fill,
+};
+
+/* region is named after the board memory region mapped at its base */
+static void add_region(struct adsp_dev *adsp, const struct adsp_mem_desc *mem)
+{
+    MemoryRegionSection section;
+    struct heatmap_region *r;
+
+    if (mem->size == 0 || heatmap.num_regions == HEATMAP_MAX_REGIONS)
+        return;
+
+    section = memory_region_find(adsp->system_memory, mem->base, 1);
+    if (section.mr == NULL)
+        return;
+
+    r = &heatmap.region[heatmap.num_regions++];
+    r->name = g_strdup(memory_region_name(section.mr));
+    r->mem = mem;
+    r->num_pages = DIV_ROUND_UP(mem->size, 1 << HEATMAP_PAGE_SHIFT);
+    r->page = g_new0(struct heatmap_page, r->num_pages);
+
+    memory_region_unref(section.mr);
+}
+
+void adsp_heatmap_init(struct adsp_dev *adsp)
+{
+    const struct adsp_desc *board = adsp->desc;
+
+    heatmap.adsp = adsp;
+    add_region(adsp, &board->iram);
+    add_region(adsp, &board->dram0);
+    add_region(adsp, &board->lp_sram);
+    add_region(adsp, &board->rom);
+}
+
+static void heatmap_reset(void)
+{
+    struct adsp_gp_dmac *dmac;
+    int i;
+
+    for (i = 0; i < heatmap.num_regions; i++)
+        memset(heatmap.region[i].page, 0,
+            sizeof(struct heatmap_page) * heatmap.region[i].num_pages);
+
+    for (i = 0; i < ADSP_MAX_GP_DMAC; i++) {
+        dmac = heatmap.adsp->gp_dmac[i];
+        if (dmac == NULL)
+            continue;
+        atomic_set(&dmac->read_bytes, 0);
+        atomic_set(&dmac->write_bytes, 0);
+    }
+}
+
+void qmp_adsp_heatmap_enable(bool enable, Error **errp)
+{
+    int n;
+
+    if (heatmap.adsp == NULL) {
+        error_setg(errp, "no audio DSP heatmap on this machine");
+        return;
+    }
+
+    if (heatmap.enabled == enable)
+        return;
+
+    if (enable)
+        heatmap_reset();
+
+    for (n = 0; n < smp_cpus; n++)
+        heatmap.adsp->xtensa[n]->env->mem_hook =
+            enable ? &heatmap_hook : NULL;
+    heatmap.enabled = enable;
+
+    /* retranslate so loads and stores are (un)instrumented */
+    tb_flush(CPU(heatmap.adsp->xtensa[0]->cpu));
+}
+
+static AdspHeatmapRegion *snapshot_region(struct heatmap_region *r)
+{
+    AdspHeatmapRegion *region = g_new0(AdspHeatmapRegion, 1);
+    AdspHeatmapPageList *entry;
+    struct heatmap_page *page;
+    int i;
+
+    region->name = g_strdup(r->name);
+    region->base = r->mem->base;
+    region->size = r->mem->size;
+
+    /* build list backwards so pages are in address order, skip idle pages */
+    for (i = r->num_pages - 1; i >= 0; i--) {
+        page = &r->page[i];
+
+        region->read_bytes += page->read_bytes;
+        region->write_bytes += page->write_bytes;
+        region->tlb_fills += page->tlb_fills;
+
+        if (!page->read_bytes && !page->write_bytes && !page->tlb_fills)
+            continue;
+
+        entry = g_new0(AdspHeatmapPageList, 1);
+        entry->value = g_new0(AdspHeatmapPage, 1);
+        entry->value->offset = (uint64_t)i << HEATMAP_PAGE_SHIFT;
+        entry->value->read_bytes = page->read_bytes;
+        entry->value->write_bytes = page->write_bytes;
+        entry->value->tlb_fills = page->tlb_fills;
+        entry->next = region->pages;
+        region->pages = entry;
+    }
+
+    return region;
+}
+
+AdspHeatmap *qmp_query_adsp_heatmap(bool has_reset, bool reset, Error **errp)
+{
+    AdspHeatmap *map;
+    AdspHeatmapRegionList *rentry;
+    AdspDmacTrafficList *dentry;
+    struct adsp_gp_dmac *dmac;
+    int i;
+
+    if (heatmap.adsp == NULL) {
+        error_setg(errp, "no audio DSP heatmap on this machine");
+        return NULL;
+    }
+
+    map = g_new0(AdspHeatmap, 1);
+
+    for (i = heatmap.num_regions - 1; i >= 0; i--) {
+        rentry = g_new0(AdspHeatmapRegionList, 1);
+        rentry->value = snapshot_region(&heatmap.region[i]);
+        rentry->next = map->regions;
+        map->regions = rentry;
+    }
+
+    for (i = ADSP_MAX_GP_DMAC - 1; i >= 0; i--) {
+        dmac = heatmap.adsp->gp_dmac[i];
+        if (dmac == NULL)
+            continue;
+
+        dentry = g_new0(AdspDmacTrafficList, 1);
+        dentry->value = g_new0(AdspDmacTraffic, 1);
+        dentry->value->id = dmac->id;
+        dentry->value->read_bytes = atomic_read(&dmac->read_bytes);
+        dentry->value->write_bytes = atomic_read(&dmac->write_bytes);
+        dentry->next = map->dmacs;
+        map->dmacs = dentry;
+    }
+
+    if (has_reset && reset)
+        heatmap_reset();
+
+    return map;
+}
@@ -50,9 +50,9 @@ static uint64_t shim_read(void *opaque, hwaddr addr,
     struct adsp_dev *adsp = opaque;
 
     log_read(adsp->log, &adsp->desc->shim_dev, addr, size,
-        adsp->shim_io[addr >> 2]);
+        shim_io_read(adsp->shim_io, addr));
 
-    return adsp->shim_io[addr >> 2];
+    return shim_io_read(adsp->shim_io, addr);
 }
 
 /* SHIM IO from ADSP */
@@ -61,11 +61,10 @@ static void shim_write(void *opaque, hwaddr addr,
 {
     struct adsp_dev *adsp = opaque;
     struct qemu_io_msg_reg32 reg32;
-    struct qemu_io_msg_irq irq;
     uint32_t active, isrx;
 
     log_write(adsp->log, &adsp->desc->shim_dev, addr, val, size,
-        adsp->shim_io[addr >> 2]);
+        shim_io_read(adsp->shim_io, addr));
 
     /* special case registers */
     switch (addr) {
@@ -73,13 +72,13 @@ static void shim_write(void *opaque, hwaddr addr,
         /* DSP to host IPC command */
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* set/clear status bit */
-        isrx = adsp->shim_io[SHIM_ISRX >> 2] & ~(SHIM_ISRX_DONE | SHIM_ISRX_BUSY);
-        isrx |= val & SHIM_IPCD_BUSY ? SHIM_ISRX_BUSY : 0;
+        isrx = val & SHIM_IPCD_BUSY ? SHIM_ISRX_BUSY : 0;
         isrx |= val & SHIM_IPCD_DONE ? SHIM_ISRX_DONE : 0;
-        adsp->shim_io[SHIM_ISRX >> 2] = isrx;
+        shim_io_update(adsp->shim_io, SHIM_ISRX,
+            SHIM_ISRX_DONE | SHIM_ISRX_BUSY, isrx);
 
         /* do we need to send an IRQ ? */
         if (val & SHIM_IPCD_BUSY) {
@@ -88,25 +87,20 @@ static void shim_write(void *opaque, hwaddr addr,
                 "irq: send busy interrupt 0x%8.8lx\n", val);
 
             /* send IRQ to parent */
-            irq.hdr.type = QEMU_IO_TYPE_IRQ;
-            irq.hdr.msg = QEMU_IO_MSG_IRQ;
-            irq.hdr.size = sizeof(irq);
-            irq.irq = 0;
-
-            qemu_io_send_msg(&irq.hdr);
+            qemu_io_send_irq(0);
         }
         break;
     case SHIM_IPCX:
         /* DSP to host IPC notify */
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* set/clear status bit */
-        isrx = adsp->shim_io[SHIM_ISRX >> 2] & ~(SHIM_ISRX_DONE | SHIM_ISRX_BUSY);
-        isrx |= val & SHIM_IPCX_BUSY ? SHIM_ISRX_BUSY : 0;
+        isrx = val & SHIM_IPCX_BUSY ? SHIM_ISRX_BUSY : 0;
         isrx |= val & SHIM_IPCX_DONE ? SHIM_ISRX_DONE : 0;
-        adsp->shim_io[SHIM_ISRX >> 2] = isrx;
+        shim_io_update(adsp->shim_io, SHIM_ISRX,
+            SHIM_ISRX_DONE | SHIM_ISRX_BUSY, isrx);
 
         /* do we need to send an IRQ ? */
         if (val & SHIM_IPCX_DONE) {
@@ -115,26 +109,22 @@ static void shim_write(void *opaque, hwaddr addr,
                 "irq: send done interrupt 0x%8.8lx\n", val);
 
             /* send IRQ to parent */
-            irq.hdr.type = QEMU_IO_TYPE_IRQ;
-            irq.hdr.msg = QEMU_IO_MSG_IRQ;
-            irq.hdr.size = sizeof(irq);
-            irq.irq = 0;
-
-            qemu_io_send_msg(&irq.hdr);
+            qemu_io_send_irq(0);
         }
         break;
     case SHIM_IMRD:
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* DSP IPC interrupt mask */
-        active = adsp->shim_io[SHIM_ISRD >> 2] & ~(adsp->shim_io[SHIM_IMRD >> 2]);
+        active = shim_io_read(adsp->shim_io, SHIM_ISRD) &
+            ~shim_io_read(adsp->shim_io, SHIM_IMRD);
 
         log_text(adsp->log, LOG_IRQ_ACTIVE,
             "irq: IMRD masking %x mask %x active %x\n",
-            adsp->shim_io[SHIM_ISRD >> 2],
-            adsp->shim_io[SHIM_IMRD >> 2], active);
+            shim_io_read(adsp->shim_io, SHIM_ISRD),
+            shim_io_read(adsp->shim_io, SHIM_IMRD), active);
 
         if (!active) {
             adsp_set_irq(adsp, adsp->desc->ia_irq, 0);
@@ -144,7 +134,7 @@ static void shim_write(void *opaque, hwaddr addr,
     case SHIM_CSR:
 
         /* set value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* now send msg to HOST VM to notify register write */
         reg32.hdr.type = QEMU_IO_TYPE_REG;
@@ -240,23 +230,25 @@ void adsp_bdw_shim_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg)
     }
 }
 
+/* called with BQL held, msg is NULL for doorbells */
 void adsp_bdw_irq_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg)
 {
     uint32_t active;
 
-    active = adsp->shim_io[SHIM_ISRD >> 2] & ~(adsp->shim_io[SHIM_IMRD >> 2]);
+    active = shim_io_read(adsp->shim_io, SHIM_ISRD) &
+        ~shim_io_read(adsp->shim_io, SHIM_IMRD);
 
     log_text(adsp->log, LOG_IRQ_ACTIVE,
         "IRQ: from HOST status %x mask %x active %x cmd %x\n",
-        adsp->shim_io[SHIM_ISRD >> 2],
-        adsp->shim_io[SHIM_IMRD >> 2], active,
-        adsp->shim_io[SHIM_IPCX >> 2]);
+        shim_io_read(adsp->shim_io, SHIM_ISRD),
+        shim_io_read(adsp->shim_io, SHIM_IMRD), active,
+        shim_io_read(adsp->shim_io, SHIM_IPCX));
 
-    if (active) {
-        qemu_mutex_lock_iothread();
+    /* load library requests page in deferred modules before firmware */
+    adsp_lazy_ipc(adsp);
+
+    if (active)
         adsp_set_irq(adsp, adsp->desc->ia_irq, 1);
-        qemu_mutex_unlock_iothread();
-    }
 }
 
 static const MemoryRegionOps shim_ops = {
@@ -0,0 +1,345 @@
+/* Lazy firmware module loading for audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * With -machine lazy-modules=on the SOF base firmware is copied at boot but
+ * each loadable module is left in the firmware file. An IO overlay covers
+ * every module block in IRAM/DRAM and the whole module is paged in when :-
+ *
+ *  fetch	the core executes from it, via the overlay request_ptr
+ *  access	the core or a DMA engine reads or writes it
+ *  ipc		the host sends a load library IPC for the module index
+ *
+ * Paging in removes the overlays so later accesses run from RAM at full
+ * speed. Modules are numbered in firmware file order, base is module 0.
+ * Residency is migrated as a bitmap, RAM contents travel with the RAM.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/main-loop.h"
+#include "qemu/atomic.h"
+#include "exec/memory.h"
+#include "migration/vmstate.h"
+#include "hw/boards.h"
+#include "hw/misc/mmio_interface.h"
+
+#include "hw/audio/adsp-dev.h"
+#include "hw/adsp/log.h"
+#include "mbox.h"
+#include "common.h"
+
+#define LAZY_MAX_MODULES	32
+#define LAZY_MAX_BLOCKS		8
+
+/* SOF load library IPC in the inbox, global type 0xe with module index */
+#define LAZY_IPC_INBOX		1
+#define LAZY_IPC_GLB_TYPE_MASK	(0xfU << 28)
+#define LAZY_IPC_GLB_LOAD_LIB	(0xeU << 28)
+#define LAZY_IPC_LIB_MASK	0xffff
+
+struct lazy_module;
+
+struct lazy_block {
+    struct lazy_module *module;
+    MemoryRegion overlay;
+    MemoryRegion *ram;
+    hwaddr addr;
+    hwaddr ram_offset;
+    uint8_t *host;
+    const void *data;
+    uint32_t size;
+};
+
+struct lazy_module {
+    int index;
+    bool resident;
+    int num_blocks;
+    struct lazy_block block[LAZY_MAX_BLOCKS];
+};
+
+static struct adsp_lazy {
+    struct adsp_dev *adsp;
+    int num_modules;
+    struct lazy_module module[LAZY_MAX_MODULES];
+    uint32_t resident;	/* bitmap by module slot, for migration */
+} lazy;
+
+static void lazy_page_in(struct lazy_module *m, const char *why)
+{
+    struct adsp_dev *adsp = lazy.adsp;
+    struct lazy_block *b;
+    uint32_t bytes = 0;
+    int i;
+
+    if (m->resident)
+        return;
+    m->resident = true;
+
+    /* copy straight into RAM, the overlays are still mapped */
+    memory_region_transaction_begin();
+    for (i = 0; i < m->num_blocks; i++) {
+        b = &m->block[i];
+        memcpy(b->host, b->data, b->size);
+        memory_region_set_dirty(b->ram, b->ram_offset, b->size);
+        memory_region_del_subregion(adsp->system_memory, &b->overlay);
+        bytes += b->size;
+    }
+    memory_region_transaction_commit();
+
+    log_text(adsp->log, LOG_CPU_RESET,
+        "lazy: module %d paged in on %s, 0x%x bytes\n", m->index, why, bytes);
+}
+
+static int lazy_pre_save(void *opaque)
+{
+    int i;
+
+    lazy.resident = 0;
+    for (i = 0; i < lazy.num_modules; i++) {
+        if (lazy.module[i].resident)
+            lazy.resident |= 1U << i;
+    }
+    return 0;
+}
+
+/* RAM already holds the migrated contents, only the overlays change */
+static int lazy_post_load(void *opaque, int version_id)
+{
+    struct adsp_dev *adsp = lazy.adsp;
+    struct lazy_module *m;
+    bool resident;
+    int i, j;
+
+    memory_region_transaction_begin();
+    for (i = 0; i < lazy.num_modules; i++) {
+        m = &lazy.module[i];
+        resident = !!(lazy.resident & (1U << i));
+        if (m->resident == resident)
+            continue;
+        m->resident = resident;
+
+        for (j = 0; j < m->num_blocks; j++) {
+            if (resident)
+                memory_region_del_subregion(adsp->system_memory,
+                    &m->block[j].overlay);
+            else
+                memory_region_add_subregion_overlap(adsp->system_memory,
+                    m->block[j].addr, &m->block[j].overlay, 1);
+        }
+    }
+    memory_region_transaction_commit();
+    return 0;
+}
+
+static const VMStateDescription vmstate_lazy = {
+    .name = "adsp-lazy",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .pre_save = lazy_pre_save,
+    .post_load = lazy_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(resident, struct adsp_lazy),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+/* drop the unused mmio_interface the fetch path attached to the overlay */
+static void lazy_fetch_bh(void *opaque)
+{
+    struct lazy_block *b = opaque;
+    MemoryRegion *sub, *next;
+    Object *owner;
+
+    QTAILQ_FOREACH_SAFE(sub, &b->overlay.subregions, subregions_link, next) {
+        owner = sub->owner;
+        if (owner == NULL ||
+            !object_dynamic_cast(owner, TYPE_MMIO_INTERFACE))
+            continue;
+        object_property_set_bool(owner, false, "realized", NULL);
+        object_unref(owner);
+    }
+}
+
+/*
+ * Instruction fetch from an overlay. The overlay is removed inside the
+ * same memory transaction, so the fetch is retried from RAM and the
+ * interface QEMU creates for the returned pointer is never mapped.
+ */
+static void *lazy_request_ptr(void *opaque, hwaddr addr, unsigned *size,
+    unsigned *offset)
+{
+    struct lazy_block *b = opaque;
+
+    lazy_page_in(b->module, "fetch");
+    aio_bh_schedule_oneshot(qemu_get_aio_context(), lazy_fetch_bh, b);
+
+    *size = b->size;
+    *offset = 0;
+    return b->host;
+}
+
+static uint64_t lazy_read(void *opaque, hwaddr addr, unsigned size)
+{
+    struct lazy_block *b = opaque;
+
+    lazy_page_in(b->module, "access");
+
+    switch (size) {
+    case 1:
+        return ldub_p(b->host + addr);
+    case 2:
+        return lduw_le_p(b->host + addr);
+    default:
+        return ldl_le_p(b->host + addr);
+    }
+}
+
+static void lazy_write(void *opaque, hwaddr addr, uint64_t val,
+    unsigned size)
+{
+    struct lazy_block *b = opaque;
+
+    lazy_page_in(b->module, "access");
+
+    switch (size) {
+    case 1:
+        stb_p(b->host + addr, val);
+        break;
+    case 2:
+        stw_le_p(b->host + addr, val);
+        break;
+    default:
+        stl_le_p(b->host + addr, val);
+        break;
+    }
+    memory_region_set_dirty(b->ram, b->ram_offset + addr, size);
+}
+
+static const MemoryRegionOps lazy_ops = {
+    .read = lazy_read,
+    .write = lazy_write,
+    .request_ptr = lazy_request_ptr,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 8,
+        .unaligned = true,
+    },
+    .impl = {
+        .min_access_size = 1,
+        .max_access_size = 4,
+        .unaligned = true,
+    },
+};
+
+static struct lazy_module *lazy_get_module(int index)
+{
+    struct lazy_module *m;
+    int i;
+
+    for (i = 0; i < lazy.num_modules; i++) {
+        if (lazy.module[i].index == index)
+            return &lazy.module[i];
+    }
+
+    if (lazy.num_modules == LAZY_MAX_MODULES)
+        return NULL;
+
+    m = &lazy.module[lazy.num_modules++];
+    m->index = index;
+    return m;
+}
+
+/*
+ * Defer a module block at addr until first use. data must stay valid for
+ * the life of the machine. Returns -errno when the block should be copied
+ * now instead.
+ */
+int adsp_lazy_add_block(struct adsp_dev *adsp, int index, hwaddr addr,
+    const void *data, uint32_t size)
+{
+    MemoryRegionSection section;
+    struct lazy_module *m;
+    struct lazy_block *b;
+    char name[32];
+
+    if (!object_property_get_bool(qdev_get_machine(), "lazy-modules", NULL))
+        return -ENODEV;
+
+    m = lazy_get_module(index);
+    if (m == NULL || m->resident || m->num_blocks == LAZY_MAX_BLOCKS)
+        return -ENOMEM;
+
+    /* must land in a single RAM region not already deferred */
+    section = memory_region_find(adsp->system_memory, addr, size);
+    if (section.mr == NULL)
+        return -EINVAL;
+    if (!memory_region_is_ram(section.mr) ||
+        int128_get64(section.size) < size) {
+        memory_region_unref(section.mr);
+        return -EINVAL;
+    }
+
+    /* both ends defer the same modules from the same firmware at init */
+    if (lazy.adsp == NULL)
+        vmstate_register(NULL, 0, &vmstate_lazy, &lazy);
+    lazy.adsp = adsp;
+    b = &m->block[m->num_blocks];
+    b->module = m;
+    b->ram = section.mr;
+    b->addr = addr;
+    b->ram_offset = section.offset_within_region;
+    b->host = (uint8_t *)memory_region_get_ram_ptr(section.mr) +
+        section.offset_within_region;
+    b->data = data;
+    b->size = size;
+    memory_region_unref(section.mr);
+
+    snprintf(name, sizeof(name), "lpe.lazy.%d.%d", index, m->num_blocks);
+    memory_region_init_io(&b->overlay, NULL, &lazy_ops, b, name, size);
+    memory_region_add_subregion_overlap(adsp->system_memory, addr,
+        &b->overlay, 1);
+    m->num_blocks++;
+
+    fprintf(stdout, "lazy: module %d block 0x%" HWADDR_PRIx " size 0x%x\n",
+        index, addr, size);
+    return 0;
+}
+
+/* host IPC, called with BQL held. Peeks the inbox for load library */
+void adsp_lazy_ipc(struct adsp_dev *adsp)
+{
+    uint32_t cmd;
+    int i;
+
+    if (lazy.adsp != adsp)
+        return;
+
+    cmd = atomic_read(&adsp->mbox_io[
+        (adsp_mbox_map[LAZY_IPC_INBOX].offset >> 2) + 1]);
+    if ((cmd & LAZY_IPC_GLB_TYPE_MASK) != LAZY_IPC_GLB_LOAD_LIB)
+        return;
+
+    for (i = 0; i < lazy.num_modules; i++) {
+        if (lazy.module[i].index == (cmd & LAZY_IPC_LIB_MASK))
+            lazy_page_in(&lazy.module[i], "ipc");
+    }
+}
@@ -74,7 +74,9 @@ static void adsp_mbox_write(void *opaque, hwaddr addr,
 {
     struct adsp_dev *adsp = opaque;
 
-    log_area_write(adsp->log, &adsp->desc->mbox_dev, addr, val, size,
+    /* trace words are only queued when the capture engine is running */
+    if (!adsp_trace_write(addr, val))
+        log_area_write(adsp->log, &adsp->desc->mbox_dev, addr, val, size,
                 adsp->mbox_io[addr >> 2]);
 
     adsp->mbox_io[addr >> 2] = val;
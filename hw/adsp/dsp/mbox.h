@@ -26,6 +26,7 @@ struct adsp_gp_dmac;
 struct adsp_log;
 
 #define ADSP_MBOX_AREAS        6
+#define ADSP_MBOX_TRACE        5
 extern const struct adsp_reg_desc adsp_mbox_map[ADSP_MBOX_AREAS];
 
 void adsp_mbox_init(struct adsp_dev *adsp, const char *name);
@@ -0,0 +1,293 @@
+/* Power management for audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host sends the device D state it wrote to PMCS and the system S state.
+ * Any S state other than S0 powers the DSP down like D3. D1 and D2 only
+ * stall the cores. D3 also stops DMA and SSP and power gates every SRAM
+ * but LP SRAM, the non zero pages are kept aside and the SHM backing is
+ * dropped so the pages are freed in both processes. D0 restores them.
+ * Pages never touched are skipped so lazy poison still fills them on
+ * first access, zero pages are rewritten so they dont fault in poison.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu-common.h"
+#include "qemu/bitmap.h"
+#include "qemu/cutils.h"
+#include "qemu/main-loop.h"
+#include "sysemu/sysemu.h"
+#include "sysemu/cpus.h"
+#include "exec/memory.h"
+#include "block/aio.h"
+
+#include "qemu/io-bridge.h"
+#include "hw/audio/adsp-dev.h"
+#include "hw/adsp/shim.h"
+#include "hw/adsp/log.h"
+#include "hw/dma/dw-dma.h"
+#include "hw/dma/hda-dma.h"
+#include "hw/ssi/ssp.h"
+#include "common.h"
+
+#define PM_MAX_SRAM	2
+
+struct pm_sram {
+    const char *name;
+    uint8_t *ptr;
+    size_t size;
+
+    /* context while power gated */
+    unsigned long *saved;	/* bitmap of non zero pages */
+    unsigned long *zero;	/* bitmap of touched zero pages */
+    uint8_t *data;		/* saved pages in page order */
+};
+
+static struct {
+    struct adsp_dev *adsp;
+    int num_sram;
+    struct pm_sram sram[PM_MAX_SRAM];
+
+    uint16_t dstate;	/* last D state from host */
+    uint16_t sstate;	/* last S state from host */
+    uint16_t state;	/* D state we are in */
+    bool stalled;
+} pm = {
+    .dstate = QEMU_IO_PM_D0,
+    .sstate = QEMU_IO_PM_S0,
+    .state = QEMU_IO_PM_D0,
+};
+
+static size_t page_len(struct pm_sram *s, long i)
+{
+    size_t page = qemu_real_host_page_size;
+
+    return MIN(page, s->size - i * page);
+}
+
+static void sram_save(struct pm_sram *s)
+{
+    size_t page = qemu_real_host_page_size;
+    long npages = DIV_ROUND_UP(s->size, page);
+    long i, count = 0;
+    unsigned char *vec;
+    uint8_t *data;
+
+    /* reading a page not in the SHM yet would fault it in */
+    vec = g_malloc(npages);
+    if (mincore(s->ptr, s->size, vec) < 0)
+        memset(vec, 1, npages);
+
+    s->saved = bitmap_new(npages);
+    s->zero = bitmap_new(npages);
+    for (i = 0; i < npages; i++) {
+        if (!(vec[i] & 1))
+            continue;
+        if (buffer_is_zero(s->ptr + i * page, page_len(s, i)))
+            set_bit(i, s->zero);
+        else {
+            set_bit(i, s->saved);
+            count++;
+        }
+    }
+    g_free(vec);
+
+    s->data = data = g_malloc(count * page);
+    for (i = 0; i < npages; i++) {
+        if (!test_bit(i, s->saved))
+            continue;
+        memcpy(data, s->ptr + i * page, page_len(s, i));
+        data += page;
+    }
+
+    /* SHM backed, DONTNEED alone would keep the pages in the shm file */
+    if (madvise(s->ptr, s->size, MADV_REMOVE) < 0 &&
+        madvise(s->ptr, s->size, MADV_DONTNEED) < 0)
+        fprintf(stderr, "error: pm: cant gate %s %d\n", s->name, errno);
+
+    printf(" ** pm: %s gated, kept %ld of %ld pages\n", s->name,
+        count, npages);
+}
+
+static void sram_restore(struct pm_sram *s)
+{
+    size_t page = qemu_real_host_page_size;
+    long npages = DIV_ROUND_UP(s->size, page);
+    uint8_t *data = s->data;
+    long i;
+
+    for (i = 0; i < npages; i++) {
+        if (test_bit(i, s->zero))
+            memset(s->ptr + i * page, 0, page_len(s, i));
+        if (!test_bit(i, s->saved))
+            continue;
+        memcpy(s->ptr + i * page, data, page_len(s, i));
+        data += page;
+    }
+
+    g_free(s->saved);
+    g_free(s->zero);
+    g_free(s->data);
+    s->saved = NULL;
+    s->zero = NULL;
+    s->data = NULL;
+}
+
+static void pm_stall(bool stall)
+{
+    int n;
+
+    if (pm.stalled == stall)
+        return;
+
+    for (n = 0; n < smp_cpus; n++)
+        xtensa_runstall(pm.adsp->xtensa[n]->env, stall);
+    pm.stalled = stall;
+}
+
+static void pm_power_off(void)
+{
+    struct adsp_dev *adsp = pm.adsp;
+    struct adsp_ssp *ssp;
+    int i;
+
+    for (i = 0; i < ADSP_MAX_GP_DMAC; i++) {
+        if (adsp->gp_dmac[i])
+            dw_dmac_stop(adsp->gp_dmac[i]);
+    }
+
+    if (adsp->hda)
+        adsp_hda_dma_stop(adsp->hda);
+
+    for (i = 0; i < ADSP_MAX_SSP; i++) {
+        ssp = ssp_get_port(i);
+        if (ssp)
+            adsp_ssp_stop(ssp);
+    }
+
+    for (i = 0; i < pm.num_sram; i++)
+        sram_save(&pm.sram[i]);
+}
+
+static void pm_power_on(void)
+{
+    int i;
+
+    for (i = 0; i < pm.num_sram; i++)
+        sram_restore(&pm.sram[i]);
+}
+
+static void pm_set_state(uint16_t state)
+{
+    bool running;
+
+    if (state == pm.state)
+        return;
+
+    log_text(pm.adsp->log, LOG_CPU_RESET, "pm: D%d -> D%d\n",
+        pm.state - QEMU_IO_PM_D0, state - QEMU_IO_PM_D0);
+
+    /* cores are stalled first so they never see gated SRAM */
+    pm_stall(state != QEMU_IO_PM_D0);
+
+    /*
+     * RUNSTALL only takes effect when a core leaves its current TB, so
+     * wait for the vCPU threads to stop before SRAM is gated or restored.
+     */
+    if (state == QEMU_IO_PM_D3 || pm.state == QEMU_IO_PM_D3) {
+        running = runstate_is_running();
+        if (running)
+            pause_all_vcpus();
+
+        if (state == QEMU_IO_PM_D3)
+            pm_power_off();
+        else
+            pm_power_on();
+
+        if (running)
+            resume_all_vcpus();
+    }
+
+    pm.state = state;
+}
+
+/* runs in main loop with iothread lock, not in the bridge reader */
+static void pm_bh(void *opaque)
+{
+    struct qemu_io_msg_pm_state *msg = opaque;
+
+    if (msg->hdr.msg >= QEMU_IO_PM_D0)
+        pm.dstate = msg->hdr.msg;
+    else
+        pm.sstate = msg->hdr.msg;
+
+    pm_set_state(pm.sstate == QEMU_IO_PM_S0 ? pm.dstate : QEMU_IO_PM_D3);
+
+    /* host waits for the state we actually entered */
+    msg->hdr.msg = pm.state;
+    qemu_io_send_msg_reply(&msg->hdr);
+    g_free(msg);
+}
+
+void adsp_pm_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg)
+{
+    struct qemu_io_msg_pm_state *m;
+
+    if (msg->msg < QEMU_IO_PM_S0 || msg->msg > QEMU_IO_PM_D3)
+        return;
+
+    m = g_memdup(msg, sizeof(*m));
+
+    aio_bh_schedule_oneshot(qemu_get_aio_context(), pm_bh, m);
+}
+
+static void add_sram(struct adsp_dev *adsp, const struct adsp_mem_desc *mem)
+{
+    MemoryRegionSection section;
+    struct pm_sram *s;
+
+    if (mem->size == 0 || pm.num_sram == PM_MAX_SRAM)
+        return;
+
+    section = memory_region_find(adsp->system_memory, mem->base, mem->size);
+    if (section.mr == NULL)
+        return;
+
+    if (memory_region_is_ram(section.mr)) {
+        s = &pm.sram[pm.num_sram++];
+        s->name = memory_region_name(section.mr);
+        s->ptr = (uint8_t *)memory_region_get_ram_ptr(section.mr) +
+            section.offset_within_region;
+        s->size = mem->size;
+    }
+
+    memory_region_unref(section.mr);
+}
+
+void adsp_pm_init(struct adsp_dev *adsp)
+{
+    const struct adsp_desc *board = adsp->desc;
+
+    /* LP SRAM and ROM stay powered in D3 */
+    pm.adsp = adsp;
+    add_sram(adsp, &board->iram);
+    add_sram(adsp, &board->dram0);
+}
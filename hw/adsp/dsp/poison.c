@@ -0,0 +1,327 @@
+/* SRAM poison patterns for audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SRAM starts filled with a per region pattern so firmware reading
+ * uninitialised memory stands out. Filling it at startup makes every SHM
+ * page resident in every instance, so -machine sram-poison selects :-
+ *
+ *  lazy	pattern written on first touch through userfaultfd (default)
+ *  eager	pattern written at startup
+ *  off		SRAM reads as zero
+ *
+ * Lazy needs userfaultfd with shmem support and falls back to eager. With
+ * vm.unprivileged_userfaultfd=0 and no CAP_SYS_PTRACE the syscall fails
+ * with EPERM, that is reported and eager is used, so pass sram-poison=eager
+ * on such hosts. Only the DSP mapping is registered, a page the host
+ * touches first reads as zero. A fork-server child registers its re-homed
+ * SRAM mappings again, so pages the parent never touched still fault.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/option.h"
+#include "qemu/thread.h"
+#include "qemu/atomic.h"
+
+#include "hw/audio/adsp-dev.h"
+
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <asm/types.h>
+#endif
+
+#if defined(__linux__) && defined(__NR_userfaultfd)
+#include <linux/userfaultfd.h>
+#define POISON_UFFD
+#endif
+
+#define POISON_MAX_REGIONS	8
+
+enum poison_mode {
+    POISON_LAZY = 0,
+    POISON_EAGER,
+    POISON_OFF,
+};
+
+struct poison_region {
+    uintptr_t start;
+    size_t size;
+    void *page;		/* one host page of pattern for UFFDIO_COPY */
+};
+
+static struct {
+    bool init;
+    enum poison_mode mode;
+    int ufd;
+    QemuThread thread;
+    int num_regions;
+    struct poison_region region[POISON_MAX_REGIONS];
+} poison = {
+    .ufd = -1,
+};
+
+static void poison_fill(void *ptr, size_t size, uint32_t pattern)
+{
+    uint32_t *uptr = ptr;
+    size_t i;
+
+    for (i = 0; i < size >> 2; i++)
+        uptr[i] = pattern;
+}
+
+#ifdef POISON_UFFD
+static struct poison_region *poison_find(uintptr_t addr)
+{
+    struct poison_region *r;
+    int i, n = atomic_mb_read(&poison.num_regions);
+
+    for (i = 0; i < n; i++) {
+        r = &poison.region[i];
+        if (addr >= r->start && addr - r->start < r->size)
+            return r;
+    }
+
+    return NULL;
+}
+
+/* resolve missing SHM pages, vCPUs and QEMU itself block until we copy */
+static void *poison_thread(void *data)
+{
+    size_t page = qemu_real_host_page_size;
+    struct uffdio_range range;
+    struct uffdio_copy copy;
+    struct poison_region *r;
+    struct uffd_msg msg;
+    uintptr_t addr;
+    ssize_t len;
+
+    for (;;) {
+        len = read(poison.ufd, &msg, sizeof(msg));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len != sizeof(msg))
+            break;
+        if (msg.event != UFFD_EVENT_PAGEFAULT)
+            continue;
+
+        addr = msg.arg.pagefault.address & ~(uintptr_t)(page - 1);
+        r = poison_find(addr);
+        if (r == NULL) {
+            fprintf(stderr, "error: poison: fault at 0x%" PRIxPTR
+                " outside SRAM\n", addr);
+            continue;
+        }
+
+        copy.dst = addr;
+        copy.src = (uintptr_t)r->page;
+        copy.len = page;
+        copy.mode = 0;
+        copy.copy = 0;
+        if (ioctl(poison.ufd, UFFDIO_COPY, &copy) == 0)
+            continue;
+
+        /* host populated it first, just wake the faulting thread */
+        if (errno == EEXIST) {
+            range.start = addr;
+            range.len = page;
+            ioctl(poison.ufd, UFFDIO_WAKE, &range);
+        } else
+            fprintf(stderr, "error: poison: cant fill 0x%" PRIxPTR " %d\n",
+                addr, -errno);
+    }
+
+    fprintf(stderr, "error: poison: fault thread exited %d\n", -errno);
+    return NULL;
+}
+
+static int poison_uffd_open(void)
+{
+    struct uffdio_api api = {
+        .api = UFFD_API,
+    };
+    int fd;
+
+    fd = syscall(__NR_userfaultfd, O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    if (ioctl(fd, UFFDIO_API, &api) < 0 ||
+        !(api.features & UFFD_FEATURE_MISSING_SHMEM)) {
+        close(fd);
+        return -ENOSYS;
+    }
+
+    return fd;
+}
+
+static int poison_start(void)
+{
+    poison.ufd = poison_uffd_open();
+    if (poison.ufd == -EPERM)
+        fprintf(stderr, "warning: poison: userfaultfd not permitted, "
+            "see vm.unprivileged_userfaultfd\n");
+    if (poison.ufd < 0)
+        return poison.ufd;
+
+    qemu_thread_create(&poison.thread, "adsp-poison", poison_thread,
+        NULL, QEMU_THREAD_DETACHED);
+    return 0;
+}
+
+static int poison_register(struct poison_region *r)
+{
+    struct uffdio_register reg;
+
+    reg.range.start = r->start;
+    reg.range.len = r->size;
+    reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+    if (ioctl(poison.ufd, UFFDIO_REGISTER, &reg) < 0)
+        return -errno;
+    return 0;
+}
+
+static int poison_lazy(void *ptr, size_t size, uint32_t pattern)
+{
+    size_t page = qemu_real_host_page_size;
+    struct poison_region *r;
+    int n = poison.num_regions;
+    int err;
+
+    if (n == POISON_MAX_REGIONS || (((uintptr_t)ptr | size) & (page - 1)))
+        return -EINVAL;
+
+    if (poison.ufd < 0) {
+        err = poison_start();
+        if (err < 0)
+            return err;
+        printf(" ** SRAM poison filled on first access\n");
+    }
+
+    r = &poison.region[n];
+    r->start = (uintptr_t)ptr;
+    r->size = size;
+    r->page = qemu_memalign(page, page);
+    poison_fill(r->page, page, pattern);
+    atomic_mb_set(&poison.num_regions, n + 1);
+
+    err = poison_register(r);
+    if (err < 0) {
+        atomic_mb_set(&poison.num_regions, n);
+        qemu_vfree(r->page);
+        return err;
+    }
+
+    return 0;
+}
+
+/*
+ * The child of a fork has neither the fault thread nor the registration,
+ * and the IO bridge has since mapped the SRAM again at the same address.
+ */
+void adsp_sram_poison_fork_child(void)
+{
+    int i, err;
+
+    if (poison.ufd < 0)
+        return;
+
+    close(poison.ufd);
+    err = poison_start();
+
+    for (i = 0; err == 0 && i < poison.num_regions; i++)
+        err = poison_register(&poison.region[i]);
+
+    if (err < 0)
+        fprintf(stderr, "error: poison: cant register child SRAM %d, "
+            "untouched pages read as zero\n", err);
+}
+#else
+static int poison_lazy(void *ptr, size_t size, uint32_t pattern)
+{
+    return -ENOSYS;
+}
+
+void adsp_sram_poison_fork_child(void)
+{
+}
+#endif
+
+static enum poison_mode poison_get_mode(struct adsp_dev *adsp)
+{
+    const char *opt = qemu_opt_get(adsp->machine_opts, "sram-poison");
+
+    if (opt == NULL || !strcmp(opt, "lazy"))
+        return POISON_LAZY;
+    if (!strcmp(opt, "eager"))
+        return POISON_EAGER;
+    if (!strcmp(opt, "off"))
+        return POISON_OFF;
+
+    fprintf(stderr, "error: poison: unknown mode %s, using eager\n", opt);
+    return POISON_EAGER;
+}
+
+/* drop pages left in the SHM by an earlier run, they now read as 0 */
+static int poison_discard(void *ptr, size_t size)
+{
+#ifdef MADV_REMOVE
+    if (madvise(ptr, size, MADV_REMOVE) == 0)
+        return 0;
+#endif
+    return -EINVAL;
+}
+
+/* set SHM backed SRAM at ptr to pattern, now or on first touch */
+void adsp_sram_poison(struct adsp_dev *adsp, void *ptr, size_t size,
+    uint32_t pattern)
+{
+    int err;
+
+    if (ptr == NULL)
+        return;
+
+    if (!poison.init) {
+        poison.mode = poison_get_mode(adsp);
+        poison.init = true;
+    }
+
+    if (poison.mode == POISON_EAGER) {
+        poison_fill(ptr, size, pattern);
+        return;
+    }
+
+    if (poison_discard(ptr, size) < 0) {
+        poison_fill(ptr, size, poison.mode == POISON_OFF ? 0 : pattern);
+        return;
+    }
+
+    if (poison.mode == POISON_OFF || pattern == 0)
+        return;
+
+    err = poison_lazy(ptr, size, pattern);
+    if (err < 0) {
+        fprintf(stderr, "warning: poison: no lazy fill %d, "
+            "filling SRAM now\n", err);
+        poison.mode = POISON_EAGER;
+        poison_fill(ptr, size, pattern);
+    }
+}
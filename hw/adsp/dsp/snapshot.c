@@ -0,0 +1,141 @@
+/* Device state and coordinated snapshot support for audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu-common.h"
+#include "qemu/main-loop.h"
+#include "qemu/error-report.h"
+#include "sysemu/sysemu.h"
+#include "migration/vmstate.h"
+#include "migration/snapshot.h"
+#include "block/aio.h"
+
+#include "qemu/io-bridge.h"
+#include "hw/audio/adsp-dev.h"
+
+/*
+ * Shim, mailbox and common IO live in SHM shared with the host, so they
+ * are saved here by the DSP only. The host saves its own private state
+ * and both sides snapshot under the same tag while both are stopped.
+ */
+static bool common_io_needed(void *opaque, int version_id)
+{
+    struct adsp_dev *adsp = opaque;
+
+    return adsp->common_io != NULL;
+}
+
+static bool ext_timer_needed(void *opaque, int version_id)
+{
+    struct adsp_dev *adsp = opaque;
+
+    return adsp->ext_timer != NULL;
+}
+
+static const VMStateDescription vmstate_adsp = {
+    .name = "adsp",
+    .version_id = 2,
+    .minimum_version_id = 2,
+    .fields = (VMStateField[]) {
+        VMSTATE_VBUFFER_UINT32(shim_io, struct adsp_dev, 1, NULL, shim_size),
+        VMSTATE_VBUFFER_UINT32(mbox_io, struct adsp_dev, 1, NULL, mbox_size),
+        VMSTATE_VBUFFER_UINT32(common_io, struct adsp_dev, 1,
+            common_io_needed, common_size),
+        VMSTATE_BOOL(cpu_stalled, struct adsp_dev),
+        VMSTATE_BOOL(in_reset, struct adsp_dev),
+        VMSTATE_TIMER_PTR_TEST(ext_timer, struct adsp_dev, ext_timer_needed),
+        VMSTATE_UINT32(ext_clk_kHz, struct adsp_dev),
+        VMSTATE_INT64(ext_timer_start, struct adsp_dev),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+void adsp_snapshot_init(struct adsp_dev *adsp)
+{
+    const struct adsp_desc *board = adsp->desc;
+
+    adsp->shim_size = board->shim_dev.desc.size;
+    adsp->mbox_size = board->mbox_dev.desc.size;
+    adsp->common_size = board->io_dev.desc.size;
+
+    vmstate_register(NULL, 0, &vmstate_adsp, adsp);
+}
+
+/* was the DSP running before the host asked for the snapshot */
+static bool resume_vm;
+
+/* runs in main loop with iothread lock, not in the bridge reader */
+static void snapshot_bh(void *opaque)
+{
+    struct qemu_io_msg_vm *vm = opaque;
+    Error *err = NULL;
+    int ret;
+
+    switch (vm->hdr.msg) {
+    case QEMU_IO_VM_SAVE:
+        resume_vm = runstate_is_running();
+        vm_stop(RUN_STATE_PAUSED);
+        ret = save_snapshot(vm->tag, &err);
+        break;
+    case QEMU_IO_VM_LOAD:
+        resume_vm = runstate_is_running();
+        vm_stop(RUN_STATE_RESTORE_VM);
+        ret = load_snapshot(vm->tag, &err);
+        break;
+    case QEMU_IO_VM_RESUME:
+        if (resume_vm)
+            vm_start();
+        resume_vm = false;
+        g_free(vm);
+        return;
+    default:
+        g_free(vm);
+        return;
+    }
+
+    if (err) {
+        error_report_err(err);
+        if (ret >= 0)
+            ret = -EIO;
+    }
+
+    /* DSP stays stopped until host has finished its own snapshot */
+    vm->hdr.msg = QEMU_IO_VM_DONE;
+    vm->reply = ret < 0 ? ret : 0;
+    qemu_io_send_msg_reply(&vm->hdr);
+    g_free(vm);
+}
+
+void adsp_snapshot_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg)
+{
+    struct qemu_io_msg_vm *vm;
+
+    if (msg->size < sizeof(*vm)) {
+        fprintf(stderr, "error: short VM message %d size %d\n",
+            msg->msg, msg->size);
+        return;
+    }
+
+    vm = g_memdup(msg, sizeof(*vm));
+    vm->tag[QEMU_IO_VM_TAG_SIZE - 1] = 0;
+
+    aio_bh_schedule_oneshot(qemu_get_aio_context(), snapshot_bh, vm);
+}
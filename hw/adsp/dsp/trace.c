@@ -0,0 +1,475 @@
+/* Firmware trace capture for audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Writes to the mailbox trace area are queued by the vCPU into a circular
+ * SHM ring and nothing else. A capture thread drains the ring and encodes
+ * each word into a compact record, output is flushed at least every
+ * TRACE_FLUSH_MS.
+ *
+ * -machine fw-trace=<file>           write to file, rotated at fw-trace-rotate
+ * -machine fw-trace=chardev:<id>     write to an existing chardev
+ *
+ * Output starts with struct trace_file_hdr, all fields little endian. Each
+ * record then starts with a LEB128 value V, the delta in ns from the
+ * previous record is V >> 1. When V & 1 is clear a word follows as an
+ * 8 bit slot (trace area offset / 4) and 32 bit value. When V & 1 is set a
+ * LEB128 count of words dropped on a full ring follows. Rotated files start
+ * a new header whose base is the time of the last record in the old file.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu-common.h"
+#include "qemu/cutils.h"
+#include "qemu/bswap.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qemu/error-report.h"
+#include "sysemu/sysemu.h"
+#include "chardev/char-fe.h"
+
+#include "qemu/io-bridge.h"
+#include "hw/audio/adsp-dev.h"
+#include "hw/adsp/shim.h"
+#include "mbox.h"
+
+#define TRACE_RING_MAGIC	0x474e5254	/* "TRNG" */
+#define TRACE_RING_SHIFT	16
+#define TRACE_RING_ENTRIES	(1 << TRACE_RING_SHIFT)
+#define TRACE_RING_MASK		(TRACE_RING_ENTRIES - 1)
+
+#define TRACE_FILE_MAGIC	0x54464f53	/* "SOFT" */
+#define TRACE_FILE_VERSION	1
+
+#define TRACE_BUF_SIZE		(64 * 1024)
+#define TRACE_RECORD_MAX	32
+#define TRACE_FLUSH_MS		100
+#define TRACE_POLL_US		1000
+#define TRACE_ROTATE_DEFAULT	(64 * 1024 * 1024)
+#define TRACE_ROTATE_FILES	4
+
+/* seq is the ring lap + 1 of the reservation, published last */
+struct trace_entry {
+    uint64_t time;
+    uint32_t value;
+    uint16_t offset;
+    uint16_t seq;
+};
+
+/* head is reserved by vCPUs, tail is only advanced by the capture thread */
+struct trace_ring {
+    uint32_t magic;
+    uint32_t entries;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t dropped;
+    struct trace_entry entry[TRACE_RING_ENTRIES];
+};
+
+struct trace_file_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint64_t base_ns;
+} QEMU_PACKED;
+
+static struct {
+    bool enabled;
+    bool stop;
+    struct trace_ring *ring;
+    hwaddr area_start;
+    hwaddr area_end;
+
+    /* output */
+    char *path;
+    int fd;
+    uint64_t file_size;
+    uint64_t rotate_size;
+    CharBackend chr;
+    bool use_chr;
+
+    /* capture thread state */
+    QemuThread thread;
+    uint8_t buf[TRACE_BUF_SIZE];
+    size_t len;
+    uint64_t prev_time;
+    uint64_t buf_base;
+} trace = {
+    .fd = -1,
+};
+
+static inline uint16_t ring_lap(uint64_t pos)
+{
+    return (uint16_t)(pos >> TRACE_RING_SHIFT) + 1;
+}
+
+/* called by vCPUs, returns true if the word was captured */
+bool adsp_trace_write(hwaddr addr, uint32_t val)
+{
+    struct trace_ring *ring = trace.ring;
+    struct trace_entry *e;
+    uint64_t head;
+
+    if (!atomic_read(&trace.enabled))
+        return false;
+
+    if (addr < trace.area_start || addr >= trace.area_end)
+        return false;
+
+    do {
+        head = atomic_read(&ring->head);
+        if (head - atomic_load_acquire(&ring->tail) >= TRACE_RING_ENTRIES) {
+            atomic_inc(&ring->dropped);
+            return true;
+        }
+    } while (atomic_cmpxchg(&ring->head, head, head + 1) != head);
+
+    e = &ring->entry[head & TRACE_RING_MASK];
+    e->time = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    e->value = val;
+    e->offset = addr - trace.area_start;
+    atomic_store_release(&e->seq, ring_lap(head));
+    return true;
+}
+
+static size_t put_leb128(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+
+    do {
+        p[n] = v & 0x7f;
+        v >>= 7;
+        if (v)
+            p[n] |= 0x80;
+        n++;
+    } while (v);
+
+    return n;
+}
+
+static uint64_t record_delta(uint64_t time)
+{
+    /* vCPUs may publish slightly out of order */
+    uint64_t delta = time > trace.prev_time ? time - trace.prev_time : 0;
+
+    if (time > trace.prev_time)
+        trace.prev_time = time;
+    return delta;
+}
+
+static void out_write(const uint8_t *buf, size_t len)
+{
+    ssize_t ret;
+
+    if (trace.use_chr) {
+        qemu_chr_fe_write_all(&trace.chr, buf, len);
+        return;
+    }
+
+    while (len) {
+        ret = write(trace.fd, buf, len);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "error: trace: write failed %d\n", errno);
+            return;
+        }
+        buf += ret;
+        len -= ret;
+        trace.file_size += ret;
+    }
+}
+
+static void out_header(uint64_t base_ns)
+{
+    struct trace_file_hdr hdr = {
+        .magic = cpu_to_le32(TRACE_FILE_MAGIC),
+        .version = cpu_to_le16(TRACE_FILE_VERSION),
+        .base_ns = cpu_to_le64(base_ns),
+    };
+
+    out_write((uint8_t *)&hdr, sizeof(hdr));
+}
+
+static int out_open(void)
+{
+    trace.fd = open(trace.path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace.fd < 0) {
+        fprintf(stderr, "error: trace: cant open %s %d\n", trace.path, errno);
+        return -errno;
+    }
+
+    trace.file_size = 0;
+    return 0;
+}
+
+/* <path> becomes <path>.1, oldest file is dropped */
+static void out_rotate(void)
+{
+    char *from, *to;
+    int i;
+
+    close(trace.fd);
+
+    for (i = TRACE_ROTATE_FILES - 1; i > 0; i--) {
+        from = i > 1 ? g_strdup_printf("%s.%d", trace.path, i - 1) :
+            g_strdup(trace.path);
+        to = g_strdup_printf("%s.%d", trace.path, i);
+        rename(from, to);
+        g_free(from);
+        g_free(to);
+    }
+
+    if (out_open() == 0)
+        out_header(trace.buf_base);
+}
+
+static void trace_flush(void)
+{
+    if (trace.len == 0)
+        return;
+
+    if (!trace.use_chr && trace.rotate_size &&
+        trace.file_size + trace.len > trace.rotate_size)
+        out_rotate();
+
+    if (trace.use_chr || trace.fd >= 0)
+        out_write(trace.buf, trace.len);
+
+    trace.len = 0;
+}
+
+static void trace_put_record(const struct trace_entry *e)
+{
+    uint8_t *p;
+
+    if (trace.len + TRACE_RECORD_MAX > TRACE_BUF_SIZE)
+        trace_flush();
+
+    if (trace.len == 0)
+        trace.buf_base = trace.prev_time;
+
+    p = trace.buf + trace.len;
+    p += put_leb128(p, record_delta(e->time) << 1);
+    *p++ = e->offset >> 2;
+    stl_le_p(p, e->value);
+    p += 4;
+    trace.len = p - trace.buf;
+}
+
+static void trace_put_dropped(uint64_t count)
+{
+    uint8_t *p;
+
+    if (trace.len + TRACE_RECORD_MAX > TRACE_BUF_SIZE)
+        trace_flush();
+
+    if (trace.len == 0)
+        trace.buf_base = trace.prev_time;
+
+    p = trace.buf + trace.len;
+    p += put_leb128(p, 1);
+    p += put_leb128(p, count);
+    trace.len = p - trace.buf;
+}
+
+/* returns the number of words decoded */
+static unsigned trace_drain(void)
+{
+    struct trace_ring *ring = trace.ring;
+    struct trace_entry *e;
+    uint64_t tail = ring->tail;
+    uint64_t head = atomic_read(&ring->head);
+    uint64_t dropped;
+    unsigned count = 0;
+
+    while (tail != head) {
+        e = &ring->entry[tail & TRACE_RING_MASK];
+
+        /* reserved but not yet published */
+        if (atomic_load_acquire(&e->seq) != ring_lap(tail))
+            break;
+
+        trace_put_record(e);
+        tail++;
+        count++;
+    }
+    atomic_store_release(&ring->tail, tail);
+
+    dropped = atomic_xchg(&ring->dropped, 0);
+    if (dropped)
+        trace_put_dropped(dropped);
+
+    return count;
+}
+
+static void *trace_thread(void *data)
+{
+    int64_t last_flush = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    int64_t now;
+
+    while (!atomic_read(&trace.stop)) {
+
+        if (trace_drain() == 0)
+            g_usleep(TRACE_POLL_US);
+
+        now = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+        if (now - last_flush >= TRACE_FLUSH_MS) {
+            trace_flush();
+            last_flush = now;
+        }
+    }
+
+    while (trace_drain())
+        ;
+    trace_flush();
+    return NULL;
+}
+
+static void trace_exit(Notifier *n, void *data)
+{
+    if (!atomic_read(&trace.enabled))
+        return;
+
+    atomic_set(&trace.enabled, false);
+    atomic_set(&trace.stop, true);
+    qemu_thread_join(&trace.thread);
+
+    if (trace.fd >= 0)
+        close(trace.fd);
+}
+
+static Notifier trace_exit_notifier = {
+    .notify = trace_exit,
+};
+
+static void trace_start(void)
+{
+    trace.len = 0;
+    trace.stop = false;
+    out_header(trace.prev_time);
+
+    qemu_thread_create(&trace.thread, "adsp-trace", trace_thread, NULL,
+        QEMU_THREAD_JOINABLE);
+    atomic_set(&trace.enabled, true);
+}
+
+static int trace_open_chardev(const char *id)
+{
+    Chardev *chr;
+    Error *err = NULL;
+
+    chr = qemu_chr_find(id);
+    if (chr == NULL) {
+        fprintf(stderr, "error: trace: no chardev %s\n", id);
+        return -ENODEV;
+    }
+
+    if (!qemu_chr_fe_init(&trace.chr, chr, &err)) {
+        error_report_err(err);
+        return -EBUSY;
+    }
+
+    trace.use_chr = true;
+    return 0;
+}
+
+void adsp_trace_init(struct adsp_dev *adsp, const char *name)
+{
+    const struct adsp_reg_desc *area = &adsp_mbox_map[ADSP_MBOX_TRACE];
+    const char *out, *rotate, *id;
+    char trace_name[32];
+    void *ptr = NULL;
+    uint64_t size;
+    int err;
+
+    out = qemu_opt_get(adsp->machine_opts, "fw-trace");
+    if (out == NULL)
+        return;
+
+    trace.rotate_size = TRACE_ROTATE_DEFAULT;
+    rotate = qemu_opt_get(adsp->machine_opts, "fw-trace-rotate");
+    if (rotate) {
+        if (qemu_strtosz(rotate, NULL, &size) < 0) {
+            fprintf(stderr, "error: trace: invalid rotate size %s\n", rotate);
+            return;
+        }
+        trace.rotate_size = size;
+    }
+
+    sprintf(trace_name, "%s-trace", name);
+    err = qemu_io_register_shm(trace_name, ADSP_IO_SHM_TRACE,
+        sizeof(struct trace_ring), &ptr);
+    if (err < 0) {
+        fprintf(stderr, "error: trace: cant alloc ring %d\n", err);
+        return;
+    }
+
+    trace.ring = ptr;
+    memset(trace.ring, 0, sizeof(struct trace_ring));
+    trace.ring->magic = TRACE_RING_MAGIC;
+    trace.ring->entries = TRACE_RING_ENTRIES;
+
+    trace.area_start = area->offset;
+    trace.area_end = area->offset + area->size;
+
+    if (strstart(out, "chardev:", &id)) {
+        if (trace_open_chardev(id) < 0)
+            return;
+    } else {
+        trace.path = g_strdup(out);
+        if (out_open() < 0)
+            return;
+    }
+
+    trace.prev_time = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    qemu_add_exit_notifier(&trace_exit_notifier);
+    trace_start();
+
+    printf(" ** firmware trace captured to %s\n", out);
+}
+
+/* capture thread did not survive fork, children trace to <path>.<id> */
+void adsp_trace_fork_child(const char *id)
+{
+    char *path;
+
+    if (!atomic_read(&trace.enabled))
+        return;
+
+    /* a chardev cant be shared by parent and children */
+    if (trace.use_chr) {
+        atomic_set(&trace.enabled, false);
+        return;
+    }
+
+    close(trace.fd);
+    path = g_strdup_printf("%s.%s", trace.path, id);
+    g_free(trace.path);
+    trace.path = path;
+
+    if (out_open() < 0) {
+        atomic_set(&trace.enabled, false);
+        return;
+    }
+
+    trace_start();
+}
@@ -0,0 +1,136 @@
+/* Coordinated debug stop and continue between host and audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A gdb breakpoint or monitor stop on either side stalls the peer, which
+ * stops its vCPUs, virtual clock and DMA bursts. Continuing resumes the
+ * peer, but only if it was stalled by us and not stopped by its own user.
+ *
+ * The peer stops from a main loop BH once the bridge delivers the request,
+ * so the stall takes as long as its main loop needs to get there. The time
+ * to the peer's reply is measured and reported when it exceeds
+ * GDB_STALL_WARN_US, the peer may run on for that long after we stop.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "sysemu/sysemu.h"
+#include "block/aio.h"
+
+#include "qemu/io-bridge.h"
+#include "hw/adsp/gdb.h"
+
+#define GDB_STALL_WARN_US	1000
+
+static struct {
+    const char *peer;
+    bool stalled;       /* stopped on request of peer */
+    bool peer_request;  /* run state change is being made for peer */
+    int64_t stall_ns;   /* when we asked peer to stall */
+} gdb_sync;
+
+static void gdb_send(uint16_t cmd)
+{
+    struct qemu_io_msg msg;
+
+    if (!qemu_io_peer_connected())
+        return;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = QEMU_IO_TYPE_GDB;
+    msg.msg = cmd;
+    msg.size = sizeof(msg);
+    qemu_io_send_msg(&msg);
+}
+
+/* our own stop or continue is mirrored to peer */
+static void gdb_run_state(void *opaque, int running, RunState state)
+{
+    if (gdb_sync.peer_request)
+        return;
+
+    if (running) {
+        gdb_sync.stalled = false;
+        gdb_send(QEMU_IO_GDB_CONT);
+    } else if (state == RUN_STATE_DEBUG || state == RUN_STATE_PAUSED) {
+        gdb_sync.stall_ns = get_clock();
+        gdb_send(QEMU_IO_GDB_STALL);
+    }
+}
+
+/* runs in main loop with iothread lock, not in the bridge reader */
+static void gdb_bh(void *opaque)
+{
+    uint16_t cmd = (uintptr_t)opaque;
+
+    gdb_sync.peer_request = true;
+
+    switch (cmd) {
+    case QEMU_IO_GDB_STALL:
+        if (runstate_is_running()) {
+            vm_stop(RUN_STATE_PAUSED);
+            gdb_sync.stalled = true;
+        }
+        gdb_send(QEMU_IO_GDB_STALL_RPLY);
+        break;
+    case QEMU_IO_GDB_CONT:
+        if (gdb_sync.stalled) {
+            gdb_sync.stalled = false;
+            vm_start();
+        }
+        break;
+    default:
+        break;
+    }
+
+    gdb_sync.peer_request = false;
+}
+
+void adsp_gdb_msg(struct qemu_io_msg *msg)
+{
+    int64_t us;
+
+    switch (msg->msg) {
+    case QEMU_IO_GDB_STALL:
+    case QEMU_IO_GDB_CONT:
+        aio_bh_schedule_oneshot(qemu_get_aio_context(), gdb_bh,
+            (void *)(uintptr_t)msg->msg);
+        break;
+    case QEMU_IO_GDB_STALL_RPLY:
+        us = (get_clock() - gdb_sync.stall_ns) / SCALE_US;
+        if (us > GDB_STALL_WARN_US)
+            fprintf(stderr, "warning: gdb: %s took %" PRId64 " us to stall\n",
+                gdb_sync.peer, us);
+        else
+            printf(" ** gdb: %s stalled in %" PRId64 " us\n",
+                gdb_sync.peer, us);
+        break;
+    default:
+        break;
+    }
+}
+
+void adsp_gdb_init(const char *peer)
+{
+    gdb_sync.peer = peer;
+    qemu_add_vm_change_state_handler(gdb_run_state, NULL);
+}
@@ -40,13 +40,15 @@ static void bxt_pci_write(void *opaque, hwaddr addr,
         uint64_t val, unsigned size)
 {
     struct adsp_host *adsp = opaque;
+    uint32_t old = adsp->pci_io[addr >> 2];
 
     log_area_write(adsp->log, &adsp->desc->pci_dev,
             addr, val, size, adsp->pci_io[addr >> 2]);
 
     adsp->pci_io[addr >> 2] = val;
 
-    /* TODO: pass on certain writes to DSP as MQ messages e.g. PM */
+    /* D state changes are passed on to the DSP */
+    adsp_host_pm_pci_write(adsp, addr, val, old);
 }
 
 static const MemoryRegionOps bxt_pci_ops = {
@@ -95,6 +97,9 @@ return;
 
 void adsp_bxt_pci_exit(PCIDevice *pci_dev)
 {
+    struct adsp_host *adsp = DO_UPCAST(struct adsp_host, dev, pci_dev);
+
+    adsp_host_irq_exit(adsp);
 }
 
 void adsp_bxt_pci_realize(PCIDevice *pci_dev, Error **errp)
@@ -107,6 +112,7 @@ void adsp_bxt_pci_realize(PCIDevice *pci_dev, Error **errp)
     pci_conf[PCI_INTERRUPT_PIN] = 1; /* interrupt pin A */
 
     adsp->irq = pci_allocate_irq(&adsp->dev);
+    adsp_host_irq_init(adsp);
 
     adsp_bxt_host_init(adsp, "bxt");
 }
@@ -20,14 +20,18 @@
 
 #include "hw/audio/adsp-host.h"
 #include "hw/adsp/bxt.h"
+#include "hw/adsp/time-sync.h"
+#include "hw/audio/adsp-sink.h"
+#include "hw/adsp/gdb.h"
+#include "hw/dma/hda-dma.h"
+#include "migration/vmstate.h"
 
 /* hardware memory map */
 static const struct adsp_desc bxt_board = {
     .iram = {.base = 0xFE4c0000, .size = ADSP_BXT_DSP_SRAM_SIZE},
     .dram0 = {.base = 0xFE500000, .size = ADSP_BXT_DSP_HP_SRAM_SIZE},
     .pci =  {.base = 0xFE830000, .size = 0x1000},
-
-    /* TODO add HDA base */
+    .hda = {.base = 0xFE800000, .size = ADSP_BXT_HDA_SIZE},
 
     .shim_dev = {
         .name = "shim",
@@ -50,6 +54,91 @@ static const struct adsp_desc bxt_board = {
     },
 };
 
+/* HDA registers in SHM, the DSP HDA DMA engine sets status bits concurrently */
+static struct adsp_host_hda {
+    uint32_t *io;
+    uint32_t size;
+} hda_io;
+
+static const VMStateDescription vmstate_adsp_hda = {
+    .name = "adsp-hda",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_VBUFFER_UINT32(io, struct adsp_host_hda, 1, NULL, size),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+/* write 1 to clear bits of each register word */
+static uint32_t hda_w1c_bits(hwaddr addr)
+{
+    if (addr == HDA_INTSTS)
+        return ~0;
+
+    if (addr >= HDA_SD_BASE(0) && addr < HDA_SD_BASE(HDA_MAX_SD) &&
+        ((addr - HDA_SD_BASE(0)) & 0x1f) == HDA_SD_CTL)
+        return HDA_SD_STS_BCIS | HDA_SD_STS_FIFOE;
+
+    return 0;
+}
+
+static uint64_t hda_io_read(void *opaque, hwaddr addr, unsigned size)
+{
+    uint32_t val = atomic_read(&hda_io.io[addr >> 2]);
+
+    return val >> ((addr & 3) * 8);
+}
+
+static void hda_io_write(void *opaque, hwaddr addr, uint64_t val,
+    unsigned size)
+{
+    hwaddr reg = addr & ~3;
+    int shift = (addr & 3) * 8;
+    uint32_t mask, w1c, clear, bits, old, new, cur;
+    int sd;
+
+    mask = size == 4 ? ~0 : ((1U << (size * 8)) - 1) << shift;
+    w1c = hda_w1c_bits(reg) & mask;
+    clear = (val << shift) & w1c;
+    bits = (val << shift) & mask & ~w1c;
+
+    cur = atomic_read(&hda_io.io[reg >> 2]);
+    do {
+        old = cur;
+        new = (old & ~(mask & ~w1c) & ~clear) | bits;
+        cur = atomic_cmpxchg(&hda_io.io[reg >> 2], old, new);
+    } while (cur != old);
+
+    if (reg == HDA_INTSTS || !clear)
+        return;
+
+    /* drop the stream from INTSTS once its status is clear, and put it
+       back if the DSP raised status again meanwhile */
+    sd = (reg - HDA_SD_BASE(0)) >> 5;
+    if (new & (HDA_SD_STS_BCIS | HDA_SD_STS_FIFOE))
+        return;
+    atomic_and(&hda_io.io[HDA_INTSTS >> 2], ~(1U << sd));
+    if (atomic_read(&hda_io.io[reg >> 2]) &
+        (HDA_SD_STS_BCIS | HDA_SD_STS_FIFOE))
+        atomic_or(&hda_io.io[HDA_INTSTS >> 2], 1U << sd);
+}
+
+static const MemoryRegionOps hda_io_ops = {
+    .read = hda_io_read,
+    .write = hda_io_write,
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 4,
+    },
+    .impl = {
+        .min_access_size = 1,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+/* called with BQL held, msg is NULL for doorbells */
 static void do_irq(struct adsp_host *adsp, struct qemu_io_msg *msg)
 {
     uint32_t active;
@@ -62,13 +151,13 @@ static void do_irq(struct adsp_host *adsp, struct qemu_io_msg *msg)
         adsp->shim_io[SHIM_IMRX >> 2], active,
         adsp->shim_io[SHIM_IPCD >> 2]);
 
-    if (active) {
-        pci_set_irq(&adsp->dev, 1);
-    }
+    adsp_host_irq_ipc(adsp, active);
 }
 
-static void do_pm(struct qemu_io_msg *msg)
+/* DSP rang the IPC doorbell */
+static void doorbell_ring(void *opaque)
 {
+    do_irq(opaque, NULL);
 }
 
 static int bxt_bridge_cb(void *data, struct qemu_io_msg *msg)
@@ -80,14 +169,25 @@ static int bxt_bridge_cb(void *data, struct qemu_io_msg *msg)
         /* mostly handled by SHM, some exceptions */
         break;
     case QEMU_IO_TYPE_IRQ:
+        qemu_mutex_lock_iothread();
         do_irq(adsp, msg);
+        qemu_mutex_unlock_iothread();
         break;
     case QEMU_IO_TYPE_PM:
-        do_pm(msg);
+        adsp_host_pm_msg(adsp, msg);
         break;
     case QEMU_IO_TYPE_DMA:
         adsp_host_do_dma(adsp, msg);
         break;
+    case QEMU_IO_TYPE_GDB:
+        adsp_gdb_msg(msg);
+        break;
+    case QEMU_IO_TYPE_TIME:
+        adsp_time_sync_msg(msg);
+        break;
+    case QEMU_IO_TYPE_VM:
+        adsp_host_snapshot_msg(adsp, msg);
+        break;
     case QEMU_IO_TYPE_MEM:
     default:
         break;
@@ -97,7 +197,7 @@ static int bxt_bridge_cb(void *data, struct qemu_io_msg *msg)
 
 static void init_memory(struct adsp_host *adsp, const char *name)
 {
-    MemoryRegion *iram, *dram0;
+    MemoryRegion *iram, *dram0, *hda;
     const struct adsp_desc *board = adsp->desc;
     char shm_name[32];
     void *ptr;
@@ -127,6 +227,21 @@ static void init_memory(struct adsp_host *adsp, const char *name)
     memory_region_add_subregion(adsp->system_memory,
         board->dram0.base, dram0);
 
+    /* HD-Audio stream and position registers - shared via SHM with the
+       DSP HDA DMA engine */
+    sprintf(shm_name, "%s-hda", name);
+    err = qemu_io_register_shm(shm_name, ADSP_IO_SHM_HDA,
+        board->hda.size, &ptr);
+    if (err < 0)
+        fprintf(stderr, "error: cant alloc HDA SHM %d\n", err);
+    hda_io.io = ptr;
+    hda_io.size = board->hda.size;
+    vmstate_register(NULL, 0, &vmstate_adsp_hda, &hda_io);
+    hda = g_malloc(sizeof(*hda));
+    memory_region_init_io(hda, NULL, &hda_io_ops, adsp, "hda.io",
+        board->hda.size);
+    memory_region_add_subregion(adsp->system_memory,
+        board->hda.base, hda);
 }
 
 void adsp_bxt_host_init(struct adsp_host *adsp, const char *name)
@@ -134,14 +249,22 @@ void adsp_bxt_host_init(struct adsp_host *adsp, const char *name)
     adsp->desc = &bxt_board;
     adsp->system_memory = get_system_memory();
     adsp->machine_opts = qemu_get_machine_opts();
+    qemu_io_set_instance(adsp->bridge_id);
+    adsp_sink_init(adsp->dump_dir, adsp->dump_format, adsp->dump_streams);
     adsp->log = log_init(NULL);    /* TODO: add log name to cmd line */
     init_memory(adsp, name);
     adsp_bxt_init_pci(adsp);
     adsp_bxt_init_shim(adsp, name);
     adsp_host_init_mbox(adsp, name);
+    adsp_host_snapshot_init(adsp);
+    adsp_gdb_init("DSP");
+    adsp_host_pm_init(adsp);
 
     /* initialise bridge to x86 host driver */
     qemu_io_register_parent(name, &bxt_bridge_cb, (void*)adsp);
+    adsp_time_sync_init(adsp->sync_quantum);
+    adsp_doorbell_init(&adsp->doorbell, doorbell_ring, adsp);
+    adsp_host_dma_map_init(adsp);
 
 }
 
@@ -150,6 +273,9 @@ static void bxt_reset(DeviceState *dev)
 }
 
 static Property bxt_properties[] = {
+    DEFINE_PROP_BIT("msi", struct adsp_host, flags, ADSP_HOST_F_MSI, true),
+    DEFINE_PROP_BIT("msix", struct adsp_host, flags, ADSP_HOST_F_MSIX, true),
+    DEFINE_ADSP_HOST_PROPERTIES(),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -170,6 +296,7 @@ static void bxt_class_init(ObjectClass *klass, void *data)
 
     dc->desc = "Intel Audio DSP Broxton";
     dc->reset = bxt_reset;
+    dc->vmsd = &vmstate_adsp_host;
     dc->props = bxt_properties;
 }
 
@@ -49,13 +49,15 @@ static void byt_pci_write(void *opaque, hwaddr addr,
         uint64_t val, unsigned size)
 {
     struct adsp_host *adsp = opaque;
+    uint32_t old = adsp->pci_io[addr >> 2];
     printf("%s %d\n", __func__, __LINE__);
     log_write(adsp->log, &adsp->desc->pci_dev,
             addr, val, size, adsp->pci_io[addr >> 2]);
 
     adsp->pci_io[addr >> 2] = val;
 
-    /* TODO: pass on certain writes to DSP as MQ messages e.g. PM */
+    /* D state changes are passed on to the DSP */
+    adsp_host_pm_pci_write(adsp, addr, val, old);
 }
 
 static const MemoryRegionOps byt_pci_ops = {
@@ -217,6 +219,9 @@ void build_acpi_byt_adsp_devices(Aml *table)
 
 void adsp_byt_pci_exit(PCIDevice *pci_dev)
 {
+    struct adsp_host *adsp = DO_UPCAST(struct adsp_host, dev, pci_dev);
+
+    adsp_host_irq_exit(adsp);
 }
 
 static void adsp_byt_write_config(PCIDevice *pci_dev, uint32_t address,
@@ -240,6 +245,7 @@ void adsp_byt_pci_realize(PCIDevice *pci_dev, Error **errp)
     pci_set_byte(&pci_conf[PCI_MAX_LAT], 0);
 
     adsp->irq = pci_allocate_irq(&adsp->dev);
+    adsp_host_irq_init(adsp);
     pdata.build_byt = 1;
 
     adsp_byt_host_init(adsp, "byt");
@@ -255,6 +261,7 @@ void adsp_cht_pci_realize(PCIDevice *pci_dev, Error **errp)
     pci_conf[PCI_INTERRUPT_PIN] = 1; /* interrupt pin A */
 
     adsp->irq = pci_allocate_irq(&adsp->dev);
+    adsp_host_irq_init(adsp);
     pdata.build_cht = 1;
 
     adsp_byt_host_init(adsp, "cht");
@@ -29,13 +29,13 @@ static uint64_t adsp_shim_read(void *opaque, hwaddr addr,
     struct adsp_host *adsp = opaque;
 
     log_read(adsp->log, &adsp->desc->shim_dev,
-                addr, size, adsp->shim_io[addr >> 2]);
+                addr, size, shim_io_read(adsp->shim_io, addr));
 
     switch (size) {
     case 4:
-        return adsp->shim_io[addr >> 2];
+        return shim_io_read(adsp->shim_io, addr);
     case 8:
-        return ((uint64_t*)adsp->shim_io)[addr >> 3];
+        return shim_io_read64(adsp->shim_io, addr);
     default:
         printf("shim.io invalid read size %d at 0x%8.8x\n",
             size, (unsigned int)addr);
@@ -49,24 +49,33 @@ static void adsp_shim_write(void *opaque, hwaddr addr,
 {
     struct adsp_host *adsp = opaque;
     struct qemu_io_msg_reg32 reg32;
-    struct qemu_io_msg_irq irq;
     uint32_t active, isrd;
 
     log_write(adsp->log, &adsp->desc->shim_dev,
-                    addr, val, size, adsp->shim_io[addr >> 2]);
-
-    /* write value via SHM */
-    adsp->shim_io[addr >> 2] = val;
+                    addr, val, size, shim_io_read(adsp->shim_io, addr));
 
     /* most IO is handled by SHM, but there are some exceptions */
     switch (addr) {
+    case SHIM_ISRX:
+        /* write 1 to clear, the DSP sets bits concurrently */
+        active = shim_io_clear(adsp->shim_io, addr, val) &
+            ~shim_io_read(adsp->shim_io, SHIM_IMRX);
+        if (!active)
+            adsp_host_irq_lower(adsp);
+        break;
+    case SHIM_ISRD:
+        /* write 1 to clear */
+        shim_io_clear(adsp->shim_io, addr, val);
+        break;
     case SHIM_IPCXH:
+        /* write value via SHM */
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* now set/clear status bit */
-        isrd = adsp->shim_io[SHIM_ISRD >> 2] & ~(SHIM_ISRD_DONE | SHIM_ISRD_BUSY);
-        isrd |= val & SHIM_IPCX_BUSY ? SHIM_ISRD_BUSY : 0;
+        isrd = val & SHIM_IPCX_BUSY ? SHIM_ISRD_BUSY : 0;
         isrd |= val & SHIM_IPCX_DONE ? SHIM_ISRD_DONE : 0;
-        adsp->shim_io[SHIM_ISRD >> 2] = isrd;
+        shim_io_update(adsp->shim_io, SHIM_ISRD,
+            SHIM_ISRD_DONE | SHIM_ISRD_BUSY, isrd);
 
         /* do we need to send an IRQ ? */
         if (val & SHIM_IPCX_BUSY) {
@@ -75,22 +84,18 @@ static void adsp_shim_write(void *opaque, hwaddr addr,
                 "irq: send busy interrupt 0x%8.8lx\n", val);
 
             /* send IRQ to child */
-            irq.hdr.type = QEMU_IO_TYPE_IRQ;
-            irq.hdr.msg = QEMU_IO_MSG_IRQ;
-            irq.hdr.size = sizeof(irq);
-            irq.irq = 0;
-
-            qemu_io_send_msg(&irq.hdr);
+            qemu_io_send_irq(0);
         }
         break;
     case SHIM_IPCDH:
+        /* write value via SHM */
+        shim_io_write(adsp->shim_io, addr, val);
 
         /* set/clear status bit */
-        isrd = adsp->shim_io[SHIM_ISRD >> 2] &
-            ~(SHIM_ISRD_DONE | SHIM_ISRD_BUSY);
-        isrd |= val & SHIM_IPCD_BUSY ? SHIM_ISRD_BUSY : 0;
+        isrd = val & SHIM_IPCD_BUSY ? SHIM_ISRD_BUSY : 0;
         isrd |= val & SHIM_IPCD_DONE ? SHIM_ISRD_DONE : 0;
-        adsp->shim_io[SHIM_ISRD >> 2] = isrd;
+        shim_io_update(adsp->shim_io, SHIM_ISRD,
+            SHIM_ISRD_DONE | SHIM_ISRD_BUSY, isrd);
 
         /* do we need to send an IRQ ? */
         if (val & SHIM_IPCD_DONE) {
@@ -99,31 +104,28 @@ static void adsp_shim_write(void *opaque, hwaddr addr,
                 "irq: send done interrupt 0x%8.8lx\n", val);
 
             /* send IRQ to child */
-            irq.hdr.type = QEMU_IO_TYPE_IRQ;
-            irq.hdr.msg = QEMU_IO_MSG_IRQ;
-            irq.hdr.size = sizeof(irq);
-            irq.irq = 0;
-
-            qemu_io_send_msg(&irq.hdr);
+            qemu_io_send_irq(0);
         }
         break;
     case SHIM_IMRX:
         /* write value via SHM */
-        adsp->shim_io[addr >> 2] = val;
+        shim_io_write(adsp->shim_io, addr, val);
 
-        active = adsp->shim_io[SHIM_ISRX >> 2] &
-            ~(adsp->shim_io[SHIM_IMRX >> 2]);
+        active = shim_io_read(adsp->shim_io, SHIM_ISRX) &
+            ~shim_io_read(adsp->shim_io, SHIM_IMRX);
 
         log_text(adsp->log, LOG_IRQ_ACTIVE,
             "irq: masking %x mask %x active %x\n",
-            adsp->shim_io[SHIM_ISRD >> 2],
-            adsp->shim_io[SHIM_IMRD >> 2], active);
+            shim_io_read(adsp->shim_io, SHIM_ISRD),
+            shim_io_read(adsp->shim_io, SHIM_IMRD), active);
 
-        if (!active) {
-            pci_set_irq(&adsp->dev, 0);
-        }
+        if (!active)
+            adsp_host_irq_lower(adsp);
         break;
     case SHIM_CSR:
+        /* write value via SHM */
+        shim_io_write(adsp->shim_io, addr, val);
+
         /* now send msg to DSP VM to notify register write */
         reg32.hdr.type = QEMU_IO_TYPE_REG;
         reg32.hdr.msg = QEMU_IO_MSG_REG32W;
@@ -133,6 +135,8 @@ static void adsp_shim_write(void *opaque, hwaddr addr,
         qemu_io_send_msg(&reg32.hdr);
         break;
     default:
+        /* write value via SHM */
+        shim_io_write(adsp->shim_io, addr, val);
         break;
     }
 }
@@ -22,114 +22,211 @@
 #include "hw/audio/adsp-host.h"
 #include "hw/adsp/shim.h"
 #include "hw/adsp/log.h"
+#include "exec/memory.h"
+#include "exec/address-spaces.h"
 #include <sys/mman.h>
 
-static void dma_M2M_create_read_shm(struct adsp_host *adsp, struct qemu_io_msg *msg)
+/* the DSP owns the vector, its segments must fit in the SHM it sized */
+static bool dma_sg_valid(const struct qemu_io_dma_sg *sg, uint32_t shm_size)
 {
-    struct qemu_io_msg_dma32 *dma_msg = (struct qemu_io_msg_dma32 *)msg;
-    struct qemu_io_msg_dma32 ack_msg = *dma_msg;
-    hwaddr size = dma_msg->size;
-    void *data, *cpu_data;
-    int err;
+    uint64_t total = 0;
+    int i;
 
-    /* make sure request is valid */
-    if (dma_msg->size == 0) {
-        fprintf(stderr, "error: DMA M2M read size is 0\n");
-        return;
-    }
+    if (sg->count > QEMU_IO_DMA_SG_MAX ||
+        sizeof(*sg) + (uint64_t)sg->size > shm_size)
+        return false;
 
-    /* allocate context and SHM buffer */
-    data = g_malloc(dma_msg->size);
-    ack_msg.host_data = (uint64_t)data;
+    for (i = 0; i < sg->count; i++)
+        total += sg->seg[i].size;
 
-    /* map guest physical address space */
-    cpu_data = cpu_physical_memory_map(dma_msg->src, &size, 0);
+    return total <= sg->size;
+}
 
-    /* share guest via SHM */
-    err = qemu_io_register_shm(
-        adsp->dma_shm_buffer[dma_msg->dmac_id][dma_msg->chan_id].name,
-        ADSP_IO_SHM_DMA(dma_msg->dmac_id, dma_msg->chan_id),
-        dma_msg->size, &data);
-    if (err < 0)
-        fprintf(stderr, "error: cant alloc dma SHM %d\n", err);
+/* copy segment seg, or every segment when < 0, between guest RAM and SHM */
+static void dma_sg_copy(struct adsp_dma_buffer *buf, int seg, bool to_guest)
+{
+    struct qemu_io_dma_sg *sg = buf->sg;
+    uint8_t *data = qemu_io_dma_sg_data(sg);
+    int i;
+
+    if (!dma_sg_valid(sg, buf->sg_size)) {
+        fprintf(stderr, "error: DMA M2M chain of %u blocks overruns SHM\n",
+            sg->count);
+        return;
+    }
 
-    /* copy CPU data to SHM and unmap CPU */
-    memcpy(data, cpu_data, dma_msg->size);
-    cpu_physical_memory_unmap(cpu_data, size, 0, size);
+    for (i = 0; i < sg->count; i++) {
+        if (seg < 0 || i == seg) {
+            if (to_guest)
+                cpu_physical_memory_write(sg->seg[i].addr, data,
+                    sg->seg[i].size);
+            else
+                cpu_physical_memory_read(sg->seg[i].addr, data,
+                    sg->seg[i].size);
+        }
+        data += sg->seg[i].size;
+    }
+}
+
+static void dma_sg_ready(struct qemu_io_msg_dma32 *dma_msg)
+{
+    struct qemu_io_msg_dma32 ack_msg = *dma_msg;
 
     /* send IRQ to DSP client */
     ack_msg.hdr.type = QEMU_IO_TYPE_DMA;
     ack_msg.hdr.msg = QEMU_IO_DMA_REQ_READY;
-    ack_msg.size = sizeof(struct qemu_io_msg_dma32);
+    ack_msg.hdr.size = sizeof(ack_msg);
 
     qemu_io_send_msg(&ack_msg.hdr);
 }
 
-static void dma_M2M_destroy_read_shm(struct adsp_host *adsp, struct qemu_io_msg *msg)
+static struct adsp_dma_buffer *dma_buffer(struct adsp_host *adsp,
+    struct qemu_io_msg_dma32 *dma_msg)
 {
-    struct qemu_io_msg_dma32 *dma_msg = (struct qemu_io_msg_dma32 *)msg;
+    if (dma_msg->dmac_id >= ADSP_MAX_GP_DMAC ||
+        dma_msg->chan_id >= ARRAY_SIZE(adsp->dma_shm_buffer[0])) {
+        fprintf(stderr, "error: DMA M2M invalid DMAC %d chan %d\n",
+            dma_msg->dmac_id, dma_msg->chan_id);
+        return NULL;
+    }
 
-    qemu_io_free_shm(ADSP_IO_SHM_DMA(dma_msg->dmac_id, dma_msg->chan_id));
-    g_free((void*)dma_msg->host_data);
+    return &adsp->dma_shm_buffer[dma_msg->dmac_id][dma_msg->chan_id];
 }
 
-static void dma_M2M_create_write_shm(struct adsp_host *adsp, struct qemu_io_msg *msg)
+/* DSP shares the whole LLI chain, map it once for all its blocks */
+static void dma_M2M_create_sg(struct adsp_host *adsp, struct qemu_io_msg *msg)
 {
     struct qemu_io_msg_dma32 *dma_msg = (struct qemu_io_msg_dma32 *)msg;
-    struct qemu_io_msg_dma32 ack_msg = *dma_msg;
-    void *data;
+    struct adsp_dma_buffer *buf;
+    struct qemu_io_dma_sg *sg;
+    void *ptr = NULL;
     int err;
 
     /* make sure request is valid */
-    if (dma_msg->size == 0) {
-        fprintf(stderr, "error: DMA M2M write size is 0\n");
+    buf = dma_buffer(adsp, dma_msg);
+    if (buf == NULL)
+        return;
+    if (dma_msg->size < sizeof(*sg)) {
+        fprintf(stderr, "error: DMA M2M SHM size 0x%x too small\n",
+            dma_msg->size);
         return;
     }
 
-    /* allocate context and SHM buffer */
-    data = g_malloc(dma_msg->size);
-    ack_msg.host_data = (uint64_t)data;
+    if (buf->name == NULL)
+        buf->name = g_strdup_printf("dmac:%d.%d", dma_msg->dmac_id,
+            dma_msg->chan_id);
 
-    /* share guest via SHM */
-    err = qemu_io_register_shm(
-        adsp->dma_shm_buffer[dma_msg->dmac_id][dma_msg->chan_id].name,
+    /* DSP created the SHM and put the segment vector in it */
+    err = qemu_io_register_shm(buf->name,
         ADSP_IO_SHM_DMA(dma_msg->dmac_id, dma_msg->chan_id),
-        dma_msg->size, &data);
-    if (err < 0)
+        dma_msg->size, &ptr);
+    if (err < 0) {
         fprintf(stderr, "error: cant alloc dma SHM %d\n", err);
+        return;
+    }
 
-    /* send IRQ to DSP client */
-    ack_msg.hdr.type = QEMU_IO_TYPE_DMA;
-    ack_msg.hdr.msg = QEMU_IO_DMA_REQ_READY;
-    ack_msg.size = sizeof(struct qemu_io_msg_dma32);
+    sg = ptr;
+    if (!dma_sg_valid(sg, dma_msg->size)) {
+        fprintf(stderr, "error: DMA M2M invalid chain of %u blocks\n",
+            sg->count);
+        qemu_io_free_shm(ADSP_IO_SHM_DMA(dma_msg->dmac_id, dma_msg->chan_id));
+        return;
+    }
+    buf->sg = sg;
+    buf->sg_size = dma_msg->size;
 
-    qemu_io_send_msg(&ack_msg.hdr);
+    /* DSP reads the guest buffers */
+    if (dma_msg->direction == QEMU_IO_DMA_DIR_READ)
+        dma_sg_copy(buf, -1, false);
+
+    dma_sg_ready(dma_msg);
 }
 
-static void dma_M2M_destroy_write_shm(struct adsp_host *adsp, struct qemu_io_msg *msg)
+/* publish a block the DSP wrote or refresh one it is about to read */
+static void dma_M2M_sync_sg(struct adsp_host *adsp, struct qemu_io_msg *msg)
 {
     struct qemu_io_msg_dma32 *dma_msg = (struct qemu_io_msg_dma32 *)msg;
-    void *cpu_data, *data = (void*)dma_msg->host_data;
-    hwaddr size = dma_msg->size;
-
-    /* sanity check */
-    if (data == NULL) {
-        fprintf(stderr, "error: DMA M2M write no source buffer\n");
-        goto free;
+    struct adsp_dma_buffer *buf;
+    uint32_t seg;
+
+    buf = dma_buffer(adsp, dma_msg);
+    if (buf && buf->sg) {
+        seg = buf->sg->sync;
+        if (seg < buf->sg->count)
+            dma_sg_copy(buf, seg,
+                dma_msg->direction == QEMU_IO_DMA_DIR_WRITE);
+        else
+            fprintf(stderr, "error: DMA M2M sync of block %u\n", seg);
     }
 
-    /* map guest physical address space */
-    cpu_data = cpu_physical_memory_map(dma_msg->src, &size, 1);
+    dma_sg_ready(dma_msg);
+}
 
-    /* copy SHM data to CPU and unmap CPU */
-    memcpy(cpu_data, data, dma_msg->size);
-    cpu_physical_memory_unmap(cpu_data, size, 1, size);
+static void dma_M2M_destroy_sg(struct adsp_host *adsp, struct qemu_io_msg *msg)
+{
+    struct qemu_io_msg_dma32 *dma_msg = (struct qemu_io_msg_dma32 *)msg;
+    struct adsp_dma_buffer *buf;
+
+    buf = dma_buffer(adsp, dma_msg);
+    if (buf == NULL || buf->sg == NULL) {
+        fprintf(stderr, "error: DMA M2M complete without chain\n");
+        return;
+    }
+
+    /* DSP wrote the guest buffers */
+    if (dma_msg->direction == QEMU_IO_DMA_DIR_WRITE)
+        dma_sg_copy(buf, -1, true);
 
-free:
     qemu_io_free_shm(ADSP_IO_SHM_DMA(dma_msg->dmac_id, dma_msg->chan_id));
-    g_free((void*)dma_msg->host_data);
+    buf->sg = NULL;
 }
 
+/*
+ * Guest RAM that is backed by an fd (e.g. memory-backend-file,share=on) is
+ * passed to the DSP once so it can DMA directly without the SHM round trip.
+ */
+static void dma_map_region_add(MemoryListener *listener,
+    MemoryRegionSection *section)
+{
+    MemoryRegion *mr = section->mr;
+    ram_addr_t offset;
+    void *host;
+    int fd, err;
+
+    if (!memory_region_is_ram(mr) || memory_region_is_rom(mr))
+        return;
+
+    host = memory_region_get_ram_ptr(mr) + section->offset_within_region;
+    mr = memory_region_from_host(host, &offset);
+    if (mr == NULL)
+        return;
+
+    fd = memory_region_get_fd(mr);
+    if (fd < 0)
+        return;
+
+    err = qemu_io_add_dma_map(section->offset_within_address_space,
+        int128_get64(section->size), fd, offset);
+    if (err < 0)
+        fprintf(stderr, "error: cant add DMA map 0x%" HWADDR_PRIx " %d\n",
+            section->offset_within_address_space, err);
+}
+
+static void dma_map_region_del(MemoryListener *listener,
+    MemoryRegionSection *section)
+{
+    if (!memory_region_is_ram(section->mr))
+        return;
+
+    qemu_io_del_dma_map(section->offset_within_address_space);
+}
+
+void adsp_host_dma_map_init(struct adsp_host *adsp)
+{
+    adsp->dma_listener.region_add = dma_map_region_add;
+    adsp->dma_listener.region_del = dma_map_region_del;
+    memory_listener_register(&adsp->dma_listener, &address_space_memory);
+}
 
 void adsp_host_do_dma(struct adsp_host *adsp, struct qemu_io_msg *msg)
 {
@@ -137,16 +234,17 @@ void adsp_host_do_dma(struct adsp_host *adsp, struct qemu_io_msg *msg)
 
     switch (dma_msg->hdr.msg) {
     case QEMU_IO_DMA_REQ_NEW:
-        if (dma_msg->direction == QEMU_IO_DMA_DIR_READ)
-            dma_M2M_create_read_shm(adsp, msg);
-        else
-            dma_M2M_create_write_shm(adsp, msg);
+        dma_M2M_create_sg(adsp, msg);
+        break;
+    case QEMU_IO_DMA_REQ_SYNC:
+        dma_M2M_sync_sg(adsp, msg);
         break;
     case QEMU_IO_DMA_REQ_COMPLETE:
-        if (dma_msg->direction == QEMU_IO_DMA_DIR_READ)
-            dma_M2M_destroy_read_shm(adsp, msg);
-        else
-            dma_M2M_destroy_write_shm(adsp, msg);
+        dma_M2M_destroy_sg(adsp, msg);
+
+        qemu_mutex_lock_iothread();
+        adsp_host_irq_dma(adsp, dma_msg->dmac_id);
+        qemu_mutex_unlock_iothread();
         break;
     default:
         break;
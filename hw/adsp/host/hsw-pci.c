@@ -48,13 +48,15 @@ static void hsw_pci_write(void *opaque, hwaddr addr,
         uint64_t val, unsigned size)
 {
     struct adsp_host *adsp = opaque;
+    uint32_t old = adsp->pci_io[addr >> 2];
 
     log_write(adsp->log, &adsp->desc->pci_dev,
             addr, val, size, adsp->pci_io[addr >> 2]);
 
     adsp->pci_io[addr >> 2] = val;
 
-    /* TODO: pass on certain writes to DSP as MQ messages e.g. PM */
+    /* D state changes are passed on to the DSP */
+    adsp_host_pm_pci_write(adsp, addr, val, old);
 }
 
 static const MemoryRegionOps hsw_pci_ops = {
@@ -174,6 +176,9 @@ void build_acpi_hsw_adsp_devices(Aml *table)
 
 void adsp_hsw_pci_exit(PCIDevice *pci_dev)
 {
+    struct adsp_host *adsp = DO_UPCAST(struct adsp_host, dev, pci_dev);
+
+    adsp_host_irq_exit(adsp);
 }
 
 static void adsp_hsw_write_config(PCIDevice *pci_dev, uint32_t address,
@@ -196,6 +201,7 @@ void adsp_hsw_pci_realize(PCIDevice *pci_dev, Error **errp)
     pci_set_byte(&pci_conf[PCI_MAX_LAT], 0);
 
     adsp->irq = pci_allocate_irq(&adsp->dev);
+    adsp_host_irq_init(adsp);
     pdata.build_hsw = 1;
 
     adsp_hsw_host_init(adsp, "hsw");
@@ -215,6 +221,7 @@ void adsp_bdw_pci_realize(PCIDevice *pci_dev, Error **errp)
     pci_set_byte(&pci_conf[PCI_MAX_LAT], 0);
 
     adsp->irq = pci_allocate_irq(&adsp->dev);
+    adsp_host_irq_init(adsp);
     pdata.build_bdw = 1;
 
     adsp_bdw_host_init(adsp, "bdw");
@@ -20,6 +20,9 @@
 
 #include "hw/audio/adsp-host.h"
 #include "hw/adsp/hsw.h"
+#include "hw/adsp/time-sync.h"
+#include "hw/audio/adsp-sink.h"
+#include "hw/adsp/gdb.h"
 
 static const struct adsp_desc hsw_board = {
     .iram = {.base = ADSP_HSW_HOST_IRAM_BASE, .size = ADSP_HSW_IRAM_SIZE},
@@ -77,6 +80,7 @@ static const struct adsp_desc bdw_board = {
     },
 };
 
+/* called with BQL held, msg is NULL for doorbells */
 static void do_irq(struct adsp_host *adsp, struct qemu_io_msg *msg)
 {
     uint32_t active;
@@ -89,13 +93,13 @@ static void do_irq(struct adsp_host *adsp, struct qemu_io_msg *msg)
         adsp->shim_io[SHIM_IMRX >> 2], active,
         adsp->shim_io[SHIM_IPCD >> 2]);
 
-    if (active) {
-        pci_set_irq(&adsp->dev, 1);
-    }
+    adsp_host_irq_ipc(adsp, active);
 }
 
-static void do_pm(struct qemu_io_msg *msg)
+/* DSP rang the IPC doorbell */
+static void doorbell_ring(void *opaque)
 {
+    do_irq(opaque, NULL);
 }
 
 static int hsw_bridge_cb(void *data, struct qemu_io_msg *msg)
@@ -107,14 +111,25 @@ static int hsw_bridge_cb(void *data, struct qemu_io_msg *msg)
         /* mostly handled by SHM, some exceptions */
         break;
     case QEMU_IO_TYPE_IRQ:
+        qemu_mutex_lock_iothread();
         do_irq(adsp, msg);
+        qemu_mutex_unlock_iothread();
         break;
     case QEMU_IO_TYPE_PM:
-        do_pm(msg);
+        adsp_host_pm_msg(adsp, msg);
         break;
     case QEMU_IO_TYPE_DMA:
         adsp_host_do_dma(adsp, msg);
         break;
+    case QEMU_IO_TYPE_GDB:
+        adsp_gdb_msg(msg);
+        break;
+    case QEMU_IO_TYPE_TIME:
+        adsp_time_sync_msg(msg);
+        break;
+    case QEMU_IO_TYPE_VM:
+        adsp_host_snapshot_msg(adsp, msg);
+        break;
     case QEMU_IO_TYPE_MEM:
     default:
         break;
@@ -161,6 +176,8 @@ void adsp_hsw_host_init(struct adsp_host *adsp, const char *name)
     adsp->desc = &hsw_board;
     adsp->system_memory = get_system_memory();
     adsp->machine_opts = qemu_get_machine_opts();
+    qemu_io_set_instance(adsp->bridge_id);
+    adsp_sink_init(adsp->dump_dir, adsp->dump_format, adsp->dump_streams);
 
     adsp->log = log_init(NULL);    /* TODO: add log name to cmd line */
 
@@ -168,9 +185,15 @@ void adsp_hsw_host_init(struct adsp_host *adsp, const char *name)
     adsp_hsw_init_pci(adsp);
     adsp_hsw_init_shim(adsp, name);
     adsp_host_init_mbox(adsp, name);
+    adsp_host_snapshot_init(adsp);
+    adsp_gdb_init("DSP");
+    adsp_host_pm_init(adsp);
 
     /* initialise bridge to x86 host driver */
     qemu_io_register_parent(name, &hsw_bridge_cb, (void*)adsp);
+    adsp_time_sync_init(adsp->sync_quantum);
+    adsp_doorbell_init(&adsp->doorbell, doorbell_ring, adsp);
+    adsp_host_dma_map_init(adsp);
 }
 
 void adsp_bdw_host_init(struct adsp_host *adsp, const char *name)
@@ -178,6 +201,8 @@ void adsp_bdw_host_init(struct adsp_host *adsp, const char *name)
     adsp->desc = &bdw_board;
     adsp->system_memory = get_system_memory();
     adsp->machine_opts = qemu_get_machine_opts();
+    qemu_io_set_instance(adsp->bridge_id);
+    adsp_sink_init(adsp->dump_dir, adsp->dump_format, adsp->dump_streams);
 
     adsp->log = log_init(NULL);    /* TODO: add log name to cmd line */
 
@@ -185,9 +210,15 @@ void adsp_bdw_host_init(struct adsp_host *adsp, const char *name)
     adsp_hsw_init_pci(adsp);
     adsp_hsw_init_shim(adsp, name);
     adsp_host_init_mbox(adsp, name);
+    adsp_host_snapshot_init(adsp);
+    adsp_gdb_init("DSP");
+    adsp_host_pm_init(adsp);
 
     /* initialise bridge to x86 host driver */
     qemu_io_register_parent(name, &hsw_bridge_cb, (void*)adsp);
+    adsp_time_sync_init(adsp->sync_quantum);
+    adsp_doorbell_init(&adsp->doorbell, doorbell_ring, adsp);
+    adsp_host_dma_map_init(adsp);
 }
 
 static void hsw_reset(DeviceState *dev)
@@ -195,6 +226,9 @@ static void hsw_reset(DeviceState *dev)
 }
 
 static Property hsw_properties[] = {
+    DEFINE_PROP_BIT("msi", struct adsp_host, flags, ADSP_HOST_F_MSI, true),
+    DEFINE_PROP_BIT("msix", struct adsp_host, flags, ADSP_HOST_F_MSIX, true),
+    DEFINE_ADSP_HOST_PROPERTIES(),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -215,6 +249,7 @@ static void hsw_class_init(ObjectClass *klass, void *data)
 
     dc->desc = "Intel Audio DSP Haswell";
     dc->reset = hsw_reset;
+    dc->vmsd = &vmstate_adsp_host;
     dc->props = hsw_properties;
 }
 
@@ -235,6 +270,7 @@ static void bdw_class_init(ObjectClass *klass, void *data)
 
     dc->desc = "Intel Audio DSP Broadwell";
     dc->reset = hsw_reset;
+    dc->vmsd = &vmstate_adsp_host;
     dc->props = hsw_properties;
 }
 
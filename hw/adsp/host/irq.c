@@ -0,0 +1,122 @@
+/* Core IA host MSI/MSI-X interrupt support for audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/host-utils.h"
+#include "hw/pci/msi.h"
+#include "hw/pci/msix.h"
+#include "hw/audio/adsp-host.h"
+#include "hw/adsp/shim.h"
+
+/* MSI-X table and PBA get their own BAR so they never clash with the DSP */
+#define ADSP_HOST_MSIX_BAR	4
+
+void adsp_host_irq_init(struct adsp_host *adsp)
+{
+    PCIDevice *dev = &adsp->dev;
+    Error *err = NULL;
+    int i;
+
+    if (adsp->flags & (1 << ADSP_HOST_F_MSIX)) {
+        if (msix_init_exclusive_bar(dev, ADSP_IRQ_VEC_COUNT,
+            ADSP_HOST_MSIX_BAR, &err) < 0) {
+            fprintf(stderr, "warning: no MSI-X: %s\n",
+                error_get_pretty(err));
+            error_free(err);
+            err = NULL;
+        } else {
+            for (i = 0; i < ADSP_IRQ_VEC_COUNT; i++)
+                msix_vector_use(dev, i);
+        }
+    }
+
+    if (adsp->flags & (1 << ADSP_HOST_F_MSI)) {
+        /* MSI vector counts are powers of two, the top ones stay unused */
+        if (msi_init(dev, 0, pow2ceil(ADSP_IRQ_VEC_COUNT), true, false,
+            &err) < 0) {
+            fprintf(stderr, "warning: no MSI: %s\n", error_get_pretty(err));
+            error_free(err);
+        }
+    }
+}
+
+void adsp_host_irq_exit(struct adsp_host *adsp)
+{
+    PCIDevice *dev = &adsp->dev;
+
+    msi_uninit(dev);
+    if (msix_present(dev))
+        msix_uninit_exclusive_bar(dev);
+}
+
+static bool irq_is_msi(struct adsp_host *adsp)
+{
+    return msix_enabled(&adsp->dev) || msi_enabled(&adsp->dev);
+}
+
+static void irq_notify(struct adsp_host *adsp, unsigned vector)
+{
+    PCIDevice *dev = &adsp->dev;
+    uint16_t flags;
+
+    if (msix_enabled(dev)) {
+        msix_notify(dev, vector);
+        return;
+    }
+
+    /* guest may have enabled fewer MSI vectors than we asked for */
+    flags = pci_get_word(dev->config + dev->msi_cap + PCI_MSI_FLAGS);
+    if (vector >= 1U << ((flags & PCI_MSI_FLAGS_QSIZE) >> 4))
+        vector = 0;
+
+    msi_notify(dev, vector);
+}
+
+/* DSP IPC interrupt, active is the unmasked ISRX status */
+void adsp_host_irq_ipc(struct adsp_host *adsp, uint32_t active)
+{
+    if (!irq_is_msi(adsp)) {
+        if (active)
+            pci_set_irq(&adsp->dev, 1);
+        return;
+    }
+
+    if (active & SHIM_ISRX_BUSY)
+        irq_notify(adsp, ADSP_IRQ_VEC_IPC_BUSY);
+    if (active & SHIM_ISRX_DONE)
+        irq_notify(adsp, ADSP_IRQ_VEC_IPC_DONE);
+}
+
+/* MSI is edge triggered, only INTx has to be deasserted */
+void adsp_host_irq_lower(struct adsp_host *adsp)
+{
+    if (!irq_is_msi(adsp))
+        pci_set_irq(&adsp->dev, 0);
+}
+
+/* host side DMA completion, there is no INTx status bit for this source */
+void adsp_host_irq_dma(struct adsp_host *adsp, int dmac)
+{
+    if (dmac < 0 || dmac >= ADSP_MAX_GP_DMAC || !irq_is_msi(adsp))
+        return;
+
+    irq_notify(adsp, ADSP_IRQ_VEC_DMAC(dmac));
+}
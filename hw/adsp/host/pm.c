@@ -0,0 +1,94 @@
+/* Power management for audio DSP host.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/atomic.h"
+#include "qemu/notify.h"
+#include "sysemu/sysemu.h"
+
+#include "qemu/io-bridge.h"
+#include "hw/audio/adsp-host.h"
+#include "hw/adsp/hw.h"
+#include "hw/adsp/log.h"
+
+static struct adsp_host *pm_adsp;
+
+static void pm_send(uint16_t state)
+{
+    struct qemu_io_msg_pm_state msg;
+
+    if (!qemu_io_peer_connected())
+        return;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.hdr.type = QEMU_IO_TYPE_PM;
+    msg.hdr.msg = state;
+    msg.hdr.size = sizeof(msg);
+    qemu_io_send_msg(&msg.hdr);
+}
+
+/* driver moved the device between D0 and D3 via PMCS */
+void adsp_host_pm_pci_write(struct adsp_host *adsp, hwaddr addr,
+    uint32_t val, uint32_t old)
+{
+    if (addr != ADSP_PCI_PMCS || !((val ^ old) & ADSP_PCI_PMCS_PS_MASK))
+        return;
+
+    pm_send(QEMU_IO_PM_D0 + (val & ADSP_PCI_PMCS_PS_MASK));
+}
+
+static void pm_suspend(Notifier *notifier, void *data)
+{
+    pm_send(QEMU_IO_PM_S3);
+}
+
+static void pm_wakeup(Notifier *notifier, void *data)
+{
+    pm_send(QEMU_IO_PM_S0);
+}
+
+static Notifier pm_suspend_notifier = {
+    .notify = pm_suspend,
+};
+
+static Notifier pm_wakeup_notifier = {
+    .notify = pm_wakeup,
+};
+
+/* called from bridge reader thread, DSP reports the D state it entered */
+void adsp_host_pm_msg(struct adsp_host *adsp, struct qemu_io_msg *msg)
+{
+    if (msg->msg < QEMU_IO_PM_D0 || msg->msg > QEMU_IO_PM_D3)
+        return;
+
+    atomic_set(&adsp->pm_state, msg->msg - QEMU_IO_PM_D0);
+    log_text(adsp->log, LOG_MSGQ, "pm: DSP in D%d\n", adsp->pm_state);
+}
+
+void adsp_host_pm_init(struct adsp_host *adsp)
+{
+    /* guest system sleep powers down the DSP too */
+    if (pm_adsp == NULL) {
+        qemu_register_suspend_notifier(&pm_suspend_notifier);
+        qemu_register_wakeup_notifier(&pm_wakeup_notifier);
+    }
+    pm_adsp = adsp;
+}
@@ -0,0 +1,157 @@
+/* Core IA host support for coordinated audio DSP snapshots.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/cutils.h"
+#include "qemu/thread.h"
+#include "qemu/main-loop.h"
+#include "migration/vmstate.h"
+#include "migration/snapshot.h"
+#include "hw/pci/msix.h"
+#include "qmp-commands.h"
+#include "hw/audio/adsp-host.h"
+
+/* DSP savevm of a booted firmware is well under this */
+#define SNAPSHOT_TIMEOUT_MS	30000
+
+static struct {
+    struct adsp_host *adsp;
+    QemuSemaphore done;
+    uint32_t reply_id;
+    int32_t reply;
+} snapshot;
+
+/* PCI config, MSI-X table and private PCI IO, shim and mbox are saved by the DSP */
+const VMStateDescription vmstate_adsp_host = {
+    .name = "adsp-host",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_PCI_DEVICE(dev, struct adsp_host),
+        VMSTATE_BUFFER_POINTER_UNSAFE(pci_io, struct adsp_host, 1,
+            ADSP_PCI_SIZE),
+        VMSTATE_MSIX(dev, struct adsp_host),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+void adsp_host_snapshot_init(struct adsp_host *adsp)
+{
+    snapshot.adsp = adsp;
+    qemu_sem_init(&snapshot.done, 0);
+}
+
+/* called from bridge reader thread */
+void adsp_host_snapshot_msg(struct adsp_host *adsp, struct qemu_io_msg *msg)
+{
+    struct qemu_io_msg_vm *vm = (struct qemu_io_msg_vm *)msg;
+
+    if (msg->msg != QEMU_IO_VM_DONE || msg->size < sizeof(*vm))
+        return;
+
+    snapshot.reply_id = msg->id;
+    snapshot.reply = vm->reply;
+    qemu_sem_post(&snapshot.done);
+}
+
+static int snapshot_dsp(int cmd, const char *tag)
+{
+    struct qemu_io_msg_vm vm;
+
+    memset(&vm, 0, sizeof(vm));
+    vm.hdr.type = QEMU_IO_TYPE_VM;
+    vm.hdr.msg = cmd;
+    vm.hdr.size = sizeof(vm);
+    pstrcpy(vm.tag, sizeof(vm.tag), tag);
+
+    qemu_io_send_msg(&vm.hdr);
+    if (cmd == QEMU_IO_VM_RESUME)
+        return 0;
+
+    /*
+     * VM_DONE arrives on the bridge reader thread, which takes the BQL for
+     * messages queued ahead of it, so wait without holding it. The host VM
+     * is stopped so nothing else changes device state meanwhile.
+     */
+    qemu_mutex_unlock_iothread();
+
+    /* discard any late reply from an earlier timed out request */
+    do {
+        if (qemu_sem_timedwait(&snapshot.done, SNAPSHOT_TIMEOUT_MS) < 0) {
+            qemu_mutex_lock_iothread();
+            return -ETIMEDOUT;
+        }
+    } while (snapshot.reply_id != vm.hdr.id);
+
+    qemu_mutex_lock_iothread();
+    return snapshot.reply;
+}
+
+static void snapshot_do(int cmd, const char *tag, Error **errp)
+{
+    bool running = runstate_is_running();
+    Error *local_err = NULL;
+    int ret;
+
+    if (snapshot.adsp == NULL) {
+        error_setg(errp, "no audio DSP on this machine");
+        return;
+    }
+
+    if (strlen(tag) >= QEMU_IO_VM_TAG_SIZE) {
+        error_setg(errp, "snapshot tag '%s' too long", tag);
+        return;
+    }
+
+    vm_stop(cmd == QEMU_IO_VM_SAVE ? RUN_STATE_PAUSED : RUN_STATE_RESTORE_VM);
+
+    /* DSP goes first and stays stopped until we resume it */
+    ret = snapshot_dsp(cmd, tag);
+    if (ret < 0) {
+        error_setg_errno(&local_err, -ret, "DSP failed to %s snapshot '%s'",
+            cmd == QEMU_IO_VM_SAVE ? "save" : "load", tag);
+        goto out;
+    }
+
+    if (cmd == QEMU_IO_VM_SAVE)
+        save_snapshot(tag, &local_err);
+    else
+        load_snapshot(tag, &local_err);
+
+out:
+    snapshot_dsp(QEMU_IO_VM_RESUME, tag);
+
+    /* like loadvm, a failed load leaves the host stopped */
+    if (running && (cmd == QEMU_IO_VM_SAVE || local_err == NULL))
+        vm_start();
+
+    error_propagate(errp, local_err);
+}
+
+void qmp_adsp_snapshot_save(const char *tag, Error **errp)
+{
+    snapshot_do(QEMU_IO_VM_SAVE, tag, errp);
+}
+
+void qmp_adsp_snapshot_load(const char *tag, Error **errp)
+{
+    snapshot_do(QEMU_IO_VM_LOAD, tag, errp);
+}
@@ -0,0 +1,238 @@
+/* Virtual time sync between host and audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loosely timed quanta. Every quantum Q of virtual time each side sends
+ * its elapsed virtual time to the peer. A side that is more than Q ahead
+ * of a running peer holds its vCPUs and virtual clock until the peer has
+ * caught up, so the two clocks never drift more than Q apart whatever the
+ * host load. Elapsed time counts from when each side first hears from the
+ * peer, a side that (re)starts sends HELLO until it does and the other
+ * side restarts its count on HELLO.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/cutils.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "sysemu/sysemu.h"
+#include "sysemu/cpus.h"
+
+#include "qemu/io-bridge.h"
+#include "hw/adsp/time-sync.h"
+
+/* give up waiting on a peer that is hung but did not tell us it stopped */
+#define SYNC_TIMEOUT_MS		100
+
+/* while held, recheck the peer this often if no message wakes us sooner */
+#define SYNC_RECHECK_MS		1
+
+static struct {
+    int64_t quantum;
+    QEMUTimer *timer;
+    QEMUBH *bh;
+
+    /* vCPUs and virtual clock held, main loop keeps running */
+    bool held;
+    int64_t hold_deadline;
+    QEMUTimer *recheck;
+
+    /* written by bridge reader thread */
+    bool synced;
+    int64_t epoch;
+    int64_t peer_time;
+    bool peer_running;
+
+    /* stats */
+    uint64_t holds;
+    uint64_t timeouts;
+} tsync;
+
+static int64_t local_time(void)
+{
+    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - atomic_read(&tsync.epoch);
+}
+
+static void time_send(uint16_t cmd)
+{
+    struct qemu_io_msg_time msg;
+
+    if (!qemu_io_peer_connected())
+        return;
+
+    if (cmd == QEMU_IO_TIME_SYNC && !atomic_load_acquire(&tsync.synced))
+        cmd = QEMU_IO_TIME_HELLO;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.hdr.type = QEMU_IO_TYPE_TIME;
+    msg.hdr.msg = cmd;
+    msg.hdr.size = sizeof(msg);
+    msg.time = cmd == QEMU_IO_TIME_SYNC ? local_time() : 0;
+    qemu_io_send_msg(&msg.hdr);
+}
+
+static bool time_ahead(int64_t now)
+{
+    return atomic_read(&tsync.peer_running) &&
+        now > atomic_read(&tsync.peer_time) + tsync.quantum;
+}
+
+static void time_release(void)
+{
+    tsync.held = false;
+    timer_del(tsync.recheck);
+
+    resume_all_vcpus();
+    cpu_enable_ticks();
+}
+
+/* main loop, BQL held. Local time is frozen while held */
+static void time_recheck(void *opaque)
+{
+    if (!tsync.held)
+        return;
+
+    if (!time_ahead(local_time())) {
+        time_release();
+        return;
+    }
+
+    if (get_clock() > tsync.hold_deadline) {
+        if (tsync.timeouts++ == 0)
+            fprintf(stderr, "warning: time-sync: peer not keeping up, "
+                "continuing\n");
+        time_release();
+        return;
+    }
+
+    timer_mod(tsync.recheck,
+        qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + SYNC_RECHECK_MS);
+}
+
+/*
+ * Main loop BH, cant pause vCPUs from inside a virtual clock timer. The
+ * hold never blocks the main loop, peer messages kick this BH and a
+ * realtime timer rechecks until the peer catches up or times out.
+ */
+static void time_hold(void *opaque)
+{
+    if (tsync.held) {
+        time_recheck(NULL);
+        return;
+    }
+
+    if (!atomic_load_acquire(&tsync.synced) || !runstate_is_running())
+        return;
+
+    if (!time_ahead(local_time()))
+        return;
+
+    /* freeze like vm_stop() but without a run state change */
+    cpu_disable_ticks();
+    pause_all_vcpus();
+    tsync.holds++;
+    tsync.held = true;
+    tsync.hold_deadline = get_clock() + SYNC_TIMEOUT_MS * SCALE_MS;
+
+    timer_mod(tsync.recheck,
+        qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + SYNC_RECHECK_MS);
+}
+
+static void time_quantum(void *opaque)
+{
+    time_send(QEMU_IO_TIME_SYNC);
+    qemu_bh_schedule(tsync.bh);
+
+    timer_mod(tsync.timer,
+        qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + tsync.quantum);
+}
+
+static void time_run_state(void *opaque, int running, RunState state)
+{
+    /* vm_stop() and vm_start() take over the vCPUs and ticks we held */
+    if (tsync.held) {
+        tsync.held = false;
+        timer_del(tsync.recheck);
+    }
+
+    time_send(running ? QEMU_IO_TIME_SYNC : QEMU_IO_TIME_STOP);
+}
+
+void adsp_time_sync_msg(struct qemu_io_msg *msg)
+{
+    struct qemu_io_msg_time *t = (struct qemu_io_msg_time *)msg;
+
+    if (atomic_load_acquire(&tsync.quantum) == 0 || msg->size < sizeof(*t))
+        return;
+
+    /* first word from a (re)started peer, both count from now */
+    if (msg->msg == QEMU_IO_TIME_HELLO || !atomic_read(&tsync.synced)) {
+        atomic_set(&tsync.epoch, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+        atomic_set(&tsync.peer_time, 0);
+        atomic_store_release(&tsync.synced, true);
+    }
+
+    switch (msg->msg) {
+    case QEMU_IO_TIME_SYNC:
+        atomic_set(&tsync.peer_time, t->time);
+        atomic_set(&tsync.peer_running, true);
+        break;
+    case QEMU_IO_TIME_HELLO:
+        atomic_set(&tsync.peer_running, true);
+        break;
+    case QEMU_IO_TIME_STOP:
+        atomic_set(&tsync.peer_running, false);
+        break;
+    default:
+        return;
+    }
+
+    /* let a hold waiting on us recheck now */
+    qemu_bh_schedule(tsync.bh);
+}
+
+bool adsp_time_sync_enabled(void)
+{
+    return tsync.quantum != 0;
+}
+
+void adsp_time_sync_init(const char *q)
+{
+    uint64_t quantum;
+
+    if (q == NULL || tsync.quantum)
+        return;
+
+    if (qemu_strtou64(q, NULL, 0, &quantum) < 0 || quantum == 0 ||
+        quantum > INT64_MAX) {
+        fprintf(stderr, "error: time-sync: invalid quantum %s\n", q);
+        return;
+    }
+
+    tsync.bh = qemu_bh_new(time_hold, NULL);
+    tsync.recheck = timer_new_ms(QEMU_CLOCK_REALTIME, time_recheck, NULL);
+    atomic_store_release(&tsync.quantum, quantum);
+    tsync.timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, time_quantum, NULL);
+    timer_mod(tsync.timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + quantum);
+    qemu_add_vm_change_state_handler(time_run_state, NULL);
+
+    printf(" ** time-sync quantum %" PRId64 " ns\n", tsync.quantum);
+}
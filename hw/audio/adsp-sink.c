@@ -0,0 +1,287 @@
+/* Buffered audio dump files for DSP audio streams.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Streams copy their data into a ring and a writer thread per file drains
+ * it to disk, so DMA and SSP timing never wait on the file system. Data
+ * that does not fit in the ring is dropped and counted. The DSP machine
+ * options, or the same host device properties, select what is dumped and
+ * where:
+ *
+ *   dump-dir=<dir>           default /tmp
+ *   dump-format=wav|raw      default wav
+ *   dump-streams=<glob>:...  stream names to dump, default all, or none
+ *
+ * WAV files are written with streaming sizes and the real sizes are
+ * patched into the header when the stream closes.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "qemu/option.h"
+#include "qemu/thread.h"
+#include "sysemu/sysemu.h"
+
+#include "hw/audio/adsp-sink.h"
+
+#define WAV_HDR_SIZE		44
+#define WAV_RIFF_SIZE		4
+#define WAV_DATA_SIZE		40
+
+struct adsp_sink {
+    char file_name[128];
+    int fd;
+    enum adsp_sink_format format;
+
+    /* written by the stream */
+    uint8_t *ring;
+    uint32_t wr;
+    uint64_t dropped;
+
+    /* written by the writer thread */
+    uint32_t rd;
+    uint64_t bytes;
+    bool error;
+
+    bool stop;
+    QemuEvent event;
+    QemuThread thread;
+};
+
+/* set by the host device, the DSP uses its machine options */
+static struct {
+    bool set;
+    char *dir;
+    char *format;
+    char *streams;
+} sink_opts;
+
+void adsp_sink_init(const char *dir, const char *format, const char *streams)
+{
+    sink_opts.dir = g_strdup(dir);
+    sink_opts.format = g_strdup(format);
+    sink_opts.streams = g_strdup(streams);
+    sink_opts.set = true;
+}
+
+static bool sink_enabled(const char *stream, const char *streams)
+{
+    char **globs, **g;
+    bool enabled = false;
+
+    if (streams == NULL)
+        return true;
+
+    globs = g_strsplit(streams, ":", 0);
+    for (g = globs; *g != NULL && !enabled; g++)
+        enabled = g_pattern_match_simple(*g, stream);
+    g_strfreev(globs);
+
+    return enabled;
+}
+
+static void wav_header(uint8_t *hdr, const struct adsp_sink_pcm *pcm,
+    uint32_t data_bytes)
+{
+    uint32_t block = pcm->channels * pcm->bits / 8;
+
+    memcpy(hdr, "RIFF", 4);
+    stl_le_p(hdr + WAV_RIFF_SIZE, data_bytes + WAV_HDR_SIZE - 8);
+    memcpy(hdr + 8, "WAVEfmt ", 8);
+    stl_le_p(hdr + 16, 16);
+    stw_le_p(hdr + 20, 1);		/* PCM */
+    stw_le_p(hdr + 22, pcm->channels);
+    stl_le_p(hdr + 24, pcm->rate);
+    stl_le_p(hdr + 28, pcm->rate * block);
+    stw_le_p(hdr + 32, block);
+    stw_le_p(hdr + 34, pcm->bits);
+    memcpy(hdr + 36, "data", 4);
+    stl_le_p(hdr + WAV_DATA_SIZE, data_bytes);
+}
+
+/* write what the stream has produced, one or two runs of the ring */
+static void sink_drain(struct adsp_sink *sink)
+{
+    uint32_t wr = atomic_mb_read(&sink->wr);
+    uint32_t off, len;
+    ssize_t ret;
+
+    while (sink->rd != wr) {
+        off = sink->rd & (ADSP_SINK_RING_SIZE - 1);
+        len = MIN(wr - sink->rd, ADSP_SINK_RING_SIZE - off);
+
+        ret = write(sink->fd, sink->ring + off, len);
+        if (ret < 0 && errno == EINTR)
+            continue;
+
+        if (ret <= 0) {
+            if (!sink->error)
+                fprintf(stderr, "error: writing to %s %d\n",
+                    sink->file_name, -errno);
+            sink->error = true;
+            ret = len;
+        } else
+            sink->bytes += ret;
+
+        atomic_mb_set(&sink->rd, sink->rd + ret);
+    }
+}
+
+static void sink_finalise(struct adsp_sink *sink)
+{
+    uint8_t size[4];
+
+    if (sink->format != ADSP_SINK_WAV)
+        return;
+
+    /* the sizes are 32 bit, longer files keep the streaming sizes */
+    if (sink->bytes > UINT32_MAX - WAV_HDR_SIZE)
+        return;
+
+    stl_le_p(size, sink->bytes + WAV_HDR_SIZE - 8);
+    if (pwrite(sink->fd, size, 4, WAV_RIFF_SIZE) != 4)
+        fprintf(stderr, "error: header of %s %d\n", sink->file_name, -errno);
+    stl_le_p(size, sink->bytes);
+    if (pwrite(sink->fd, size, 4, WAV_DATA_SIZE) != 4)
+        fprintf(stderr, "error: header of %s %d\n", sink->file_name, -errno);
+}
+
+static void *sink_thread(void *data)
+{
+    struct adsp_sink *sink = data;
+    bool stop;
+
+    for (;;) {
+        qemu_event_reset(&sink->event);
+        stop = atomic_mb_read(&sink->stop);
+
+        sink_drain(sink);
+        if (stop)
+            break;
+
+        if (atomic_mb_read(&sink->wr) == sink->rd)
+            qemu_event_wait(&sink->event);
+    }
+
+    sink_finalise(sink);
+    return NULL;
+}
+
+/*
+ * Open <dir>/<stream>-play<index>.<ext> if the stream is enabled. Returns
+ * NULL when the stream is not dumped, writes and closes then do nothing.
+ */
+struct adsp_sink *adsp_sink_open(const char *stream, int index,
+    const struct adsp_sink_pcm *pcm)
+{
+    QemuOpts *opts = qemu_get_machine_opts();
+    const char *dir = sink_opts.set ? sink_opts.dir :
+        qemu_opt_get(opts, "dump-dir");
+    const char *format = sink_opts.set ? sink_opts.format :
+        qemu_opt_get(opts, "dump-format");
+    const char *streams = sink_opts.set ? sink_opts.streams :
+        qemu_opt_get(opts, "dump-streams");
+    uint8_t hdr[WAV_HDR_SIZE];
+    struct adsp_sink *sink;
+    char thread_name[32];
+
+    if (!sink_enabled(stream, streams))
+        return NULL;
+
+    if (dir == NULL)
+        dir = ADSP_SINK_DIR;
+
+    sink = g_new0(struct adsp_sink, 1);
+    sink->format = format && !strcmp(format, "raw") ?
+        ADSP_SINK_RAW : ADSP_SINK_WAV;
+
+    snprintf(sink->file_name, sizeof(sink->file_name), "%s/%s-play%d.%s",
+        dir, stream, index, sink->format == ADSP_SINK_WAV ? "wav" : "raw");
+    unlink(sink->file_name);
+
+    sink->fd = open(sink->file_name, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+    if (sink->fd < 0) {
+        fprintf(stderr, "cant open file %s %d\n", sink->file_name, -errno);
+        g_free(sink);
+        return NULL;
+    }
+
+    /* streaming sizes until the stream closes */
+    if (sink->format == ADSP_SINK_WAV) {
+        wav_header(hdr, pcm, UINT32_MAX - WAV_HDR_SIZE);
+        if (write(sink->fd, hdr, sizeof(hdr)) != sizeof(hdr))
+            fprintf(stderr, "error: header of %s %d\n", sink->file_name,
+                -errno);
+    }
+
+    sink->ring = g_malloc(ADSP_SINK_RING_SIZE);
+    qemu_event_init(&sink->event, false);
+
+    snprintf(thread_name, sizeof(thread_name), "sink:%s", stream);
+    qemu_thread_create(&sink->thread, thread_name, sink_thread, sink,
+        QEMU_THREAD_JOINABLE);
+
+    printf("%s opened %s for playback\n", stream, sink->file_name);
+    return sink;
+}
+
+/* called by the single producer of the stream, never blocks */
+void adsp_sink_write(struct adsp_sink *sink, const void *data, size_t bytes)
+{
+    uint32_t rd, off, len;
+
+    if (sink == NULL)
+        return;
+
+    rd = atomic_mb_read(&sink->rd);
+    if (bytes > ADSP_SINK_RING_SIZE - (sink->wr - rd)) {
+        sink->dropped += bytes;
+        return;
+    }
+
+    off = sink->wr & (ADSP_SINK_RING_SIZE - 1);
+    len = MIN(bytes, ADSP_SINK_RING_SIZE - off);
+    memcpy(sink->ring + off, data, len);
+    memcpy(sink->ring, (const uint8_t *)data + len, bytes - len);
+
+    atomic_mb_set(&sink->wr, sink->wr + bytes);
+    qemu_event_set(&sink->event);
+}
+
+/* flush and finalise the file, waits for the writer */
+void adsp_sink_close(struct adsp_sink *sink)
+{
+    if (sink == NULL)
+        return;
+
+    atomic_mb_set(&sink->stop, true);
+    qemu_event_set(&sink->event);
+    qemu_thread_join(&sink->thread);
+
+    printf("closed %s at %" PRIu64 " bytes, %" PRIu64 " dropped\n",
+        sink->file_name, sink->bytes, sink->dropped);
+
+    close(sink->fd);
+    qemu_event_destroy(&sink->event);
+    g_free(sink->ring);
+    g_free(sink);
+}
@@ -28,6 +28,9 @@
 #include "exec/memory.h"
 #include "exec/address-spaces.h"
 #include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qemu/main-loop.h"
+#include "block/aio.h"
 #include "qemu/io-bridge.h"
 
 #include "hw/pci/pci.h"
@@ -35,7 +38,9 @@
 #include "hw/audio/adsp-host.h"
 #include "hw/adsp/shim.h"
 #include "hw/adsp/log.h"
+#include "hw/adsp/time-sync.h"
 #include "hw/ssi/ssp.h"
+#include "hw/audio/adsp-sink.h"
 #include "hw/dma/dw-dma.h"
 
 
@@ -44,15 +49,57 @@ const struct adsp_reg_desc adsp_gp_dma_map[] = {
         .offset = 0x00000000, .size = 0x4000},
 };
 
+/* set while the VM runs, bursts are held at a breakpoint or debug stall */
+static QemuEvent dma_run;
+static bool dma_run_init;
+
+static void dma_run_state(void *opaque, int running, RunState state)
+{
+    if (running)
+        qemu_event_set(&dma_run);
+    else
+        qemu_event_reset(&dma_run);
+}
+
+void dw_dma_run_gate_init(void)
+{
+    if (dma_run_init)
+        return;
+
+    qemu_event_init(&dma_run, runstate_is_running());
+    qemu_add_vm_change_state_handler(dma_run_state, NULL);
+    dma_run_init = true;
+}
+
 static inline void dma_sleep(long nsec)
 {
     struct timespec req;
+    int64_t now, end;
+
+    /* low bandwidth bursts can take longer than a second */
+    req.tv_sec = nsec / NANOSECONDS_PER_SECOND;
+    req.tv_nsec = nsec % NANOSECONDS_PER_SECOND;
+
+    /* pace bursts on the synced virtual clock rather than host time */
+    if (adsp_time_sync_enabled()) {
+        end = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + nsec;
+        while ((now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL)) < end) {
+            req.tv_sec = (end - now) / NANOSECONDS_PER_SECOND;
+            req.tv_nsec = (end - now) % NANOSECONDS_PER_SECOND;
+            if (nanosleep(&req, NULL) < 0)
+                break;
+        }
+    } else if (nanosleep(&req, NULL) < 0)
+        fprintf(stderr, "failed to sleep %d\n", -errno);
 
-    req.tv_sec = 0;
-    req.tv_nsec = nsec;
+    qemu_event_wait(&dma_run);
+}
 
-    if (nanosleep(&req, NULL) < 0)
-        fprintf(stderr, "failed to sleep %d\n", -errno);
+/* sample bytes from the source transfer width, 16 or 32 bit */
+static inline uint32_t dma_chan_width(struct adsp_gp_dmac *dmac,
+    uint32_t chan)
+{
+    return ((dmac->io[DW_CTRL_LOW(chan) >> 2] >> 4) & 0x7) >= 2 ? 4 : 2;
 }
 
 static void dmac_reg_sync(struct adsp_gp_dmac *dmac, hwaddr addr)
@@ -107,11 +154,89 @@ static void dmac_reg_sync(struct adsp_gp_dmac *dmac, hwaddr addr)
     }
 }
 
-static void dma_host_req(struct adsp_gp_dmac *dmac, uint32_t chan,
+/* host side of a M2M block, the burst copies treat SAR as host for reads */
+static uint32_t dma_host_addr(struct adsp_gp_dmac *dmac, uint32_t chan,
+    uint32_t direction)
+{
+    if (direction == QEMU_IO_DMA_DIR_READ)
+        return dmac->io[DW_SAR(chan) >> 2];
+    return dmac->io[DW_DAR(chan) >> 2];
+}
+
+static void dma_sg_add(struct qemu_io_dma_sg *sg, uint32_t addr,
+    uint32_t size)
+{
+    sg->seg[sg->count].addr = addr;
+    sg->seg[sg->count].size = size;
+    sg->count++;
+    sg->size += size;
+}
+
+/* walk the LLI chain from the block in the channel registers */
+static void dma_sg_build(struct adsp_gp_dmac *dmac, uint32_t chan,
+    uint32_t direction, struct qemu_io_dma_sg *sg)
+{
+    uint32_t ctrl_lo = dmac->io[DW_CTRL_LOW(chan) >> 2];
+    uint32_t llp = dmac->io[DW_LLP(chan) >> 2];
+    uint32_t first = llp, addr, size;
+    struct dw_lli2 lli;
+    bool llp_en;
+
+    memset(sg, 0, sizeof(*sg));
+
+    addr = dma_host_addr(dmac, chan, direction);
+    size = dmac->io[DW_CTRL_HIGH(chan) >> 2] & DW_CTLH_BLOCK_TS_MASK;
+    dma_sg_add(sg, addr, size);
+
+    while (llp && sg->count < QEMU_IO_DMA_SG_MAX) {
+        cpu_physical_memory_read(llp, &lli, sizeof(lli));
+
+        /* host address is reloaded or carries on after the last block */
+        if (direction == QEMU_IO_DMA_DIR_READ) {
+            llp_en = ctrl_lo & DW_CTLL_LLP_S_EN;
+            addr = llp_en ? lli.sar : addr + size;
+        } else {
+            llp_en = ctrl_lo & DW_CTLL_LLP_D_EN;
+            addr = llp_en ? lli.dar : addr + size;
+        }
+        size = lli.ctrl_hi & DW_CTLH_BLOCK_TS_MASK;
+        dma_sg_add(sg, addr, size);
+
+        ctrl_lo = lli.ctrl_lo;
+        llp = lli.llp;
+        if (llp == first) {
+            sg->cyclic = 1;
+            break;
+        }
+    }
+}
+
+/* share the whole chain with the host in one request */
+static void dma_sg_req(struct adsp_gp_dmac *dmac, uint32_t chan,
     uint32_t direction)
 {
     struct dma_chan *dma_chan = &dmac->dma_chan[chan];
     struct qemu_io_msg_dma32 *dma_msg = &dma_chan->dma_msg;
+    struct qemu_io_dma_sg sg;
+    void *ptr = NULL;
+    uint32_t size;
+    int err;
+
+    dma_sg_build(dmac, chan, direction, &sg);
+    size = sizeof(sg) + sg.size;
+
+    err = qemu_io_register_shm(dma_chan->thread_name,
+        ADSP_IO_SHM_DMA(dmac->id, chan), size, &ptr);
+    if (err < 0) {
+        fprintf(stderr, "error: can't create SHM size 0x%x for DMAC %d chan %d\n",
+            size, dmac->id, chan);
+        return;
+    }
+
+    memcpy(ptr, &sg, sizeof(sg));
+    dma_chan->sg = ptr;
+    dma_chan->sg_idx = 0;
+    dma_chan->mapped = false;
 
     /* send IRQ to parent */
     dma_msg->hdr.type = QEMU_IO_TYPE_DMA;
@@ -120,20 +245,43 @@ static void dma_host_req(struct adsp_gp_dmac *dmac, uint32_t chan,
     dma_msg->host_data = 0;
     dma_msg->src = dmac->io[DW_SAR(chan) >> 2];
     dma_msg->dest = dmac->io[DW_DAR(chan) >> 2];
-    dma_msg->size = dmac->io[DW_CTRL_HIGH(chan) >> 2] & DW_CTLH_BLOCK_TS_MASK;
+    dma_msg->size = size;
     dma_msg->dmac_id = dmac->id;
     dma_msg->chan_id = chan;
     dma_msg->client_data = (uint64_t)dma_chan;
     dma_msg->direction = direction;
 
     log_text(dmac->log, LOG_DMA_M2M,
-        "DMA req: src 0x%x dest 0x%x size 0x%x\n",
-        dma_msg->src, dma_msg->dest, dma_msg->size);
+        "DMA req: src 0x%x dest 0x%x %d blocks size 0x%x%s\n",
+        dma_msg->src, dma_msg->dest, sg.count, sg.size,
+        sg.cyclic ? " cyclic" : "");
+
+    qemu_io_send_msg(&dma_msg->hdr);
+}
+
+/*
+ * Wait for the host to copy one block between the SHM and guest RAM, a
+ * written block before the guest sees its BLOCK irq and a read block just
+ * before it is copied so it has what the guest refilled since.
+ */
+static void dma_sg_sync(struct dma_chan *dma_chan, uint32_t seg)
+{
+    struct qemu_io_msg_dma32 *dma_msg = &dma_chan->dma_msg;
 
+    dma_chan->sg->sync = seg;
+    qemu_event_reset(&dma_chan->sg_event);
+    atomic_set(&dma_chan->sg_sync, true);
+
+    dma_msg->hdr.type = QEMU_IO_TYPE_DMA;
+    dma_msg->hdr.msg = QEMU_IO_DMA_REQ_SYNC;
+    dma_msg->hdr.size = sizeof(*dma_msg);
     qemu_io_send_msg(&dma_msg->hdr);
+
+    /* stop also wakes us */
+    qemu_event_wait(&dma_chan->sg_event);
 }
 
-static void dma_host_complete(struct adsp_gp_dmac *dmac, uint32_t chan)
+static void dma_sg_complete(struct adsp_gp_dmac *dmac, uint32_t chan)
 {
     struct dma_chan *dma_chan = &dmac->dma_chan[chan];
     struct qemu_io_msg_dma32 *dma_msg = &dma_chan->dma_msg;
@@ -141,13 +289,47 @@ static void dma_host_complete(struct adsp_gp_dmac *dmac, uint32_t chan)
     /* send IRQ to parent */
     dma_msg->hdr.type = QEMU_IO_TYPE_DMA;
     dma_msg->hdr.msg = QEMU_IO_DMA_REQ_COMPLETE;
-    dma_msg->size = sizeof(struct qemu_io_msg_dma32);
+    dma_msg->hdr.size = sizeof(*dma_msg);
 
     log_text(dmac->log, LOG_DMA_M2M,
         "DMA req complete: src 0x%x dest 0x%x size 0x%x\n",
         dma_msg->src, dma_msg->dest, dma_msg->size);
 
     qemu_io_send_msg(&dma_msg->hdr);
+
+    /* host keeps its own mapping until it has copied the data back */
+    qemu_io_free_shm(ADSP_IO_SHM_DMA(dmac->id, chan));
+    dma_chan->sg = NULL;
+}
+
+/* drop the bridge DMA map reference held for the current block */
+static void dma_host_unmap(struct dma_chan *dma_chan)
+{
+    qemu_io_dma_put(dma_chan->map);
+    dma_chan->map = NULL;
+}
+
+/* use host RAM shared up front by the bridge instead of a SHM round trip */
+static bool dma_host_map(struct dma_chan *dma_chan, uint32_t direction)
+{
+    struct adsp_gp_dmac *dmac = dma_chan->dmac;
+    uint32_t chan = dma_chan->chan;
+    uint32_t size;
+    void *ptr;
+
+    dma_host_unmap(dma_chan);
+
+    size = dmac->io[DW_CTRL_HIGH(chan) >> 2] & DW_CTLH_BLOCK_TS_MASK;
+    ptr = qemu_io_dma_map(dma_host_addr(dmac, chan, direction), size);
+
+    dma_chan->mapped = ptr != NULL;
+    if (ptr == NULL)
+        return false;
+
+    dma_chan->map = ptr;
+    dma_chan->ptr = ptr;
+    dma_chan->bytes = 0;
+    return true;
 }
 
 static int dma_llp_reloaded(struct dma_chan *dma_chan)
@@ -199,6 +381,44 @@ static int dma_llp_reloaded(struct dma_chan *dma_chan)
     return 1;
 }
 
+/* M2M block after LLP reload, returns 0 when the channel thread exits */
+static int dma_M2M_next_block(struct dma_chan *dma_chan, uint32_t direction)
+{
+    struct adsp_gp_dmac *dmac = dma_chan->dmac;
+    struct qemu_io_dma_sg *sg = dma_chan->sg;
+
+    dma_chan->bytes = 0;
+
+    if (dma_chan->mapped) {
+        if (dma_host_map(dma_chan, direction))
+            return 1;
+
+        /* next block is outside the DMA map, new thread on READY */
+        dma_sg_req(dmac, dma_chan->chan, direction);
+        return 0;
+    }
+
+    /* data is packed in chain order, ptr is already at the next block */
+    if (++dma_chan->sg_idx < sg->count) {
+        if (direction == QEMU_IO_DMA_DIR_READ)
+            dma_sg_sync(dma_chan, dma_chan->sg_idx);
+        return 1;
+    }
+
+    if (sg->cyclic) {
+        dma_chan->sg_idx = 1;
+        dma_chan->ptr = qemu_io_dma_sg_data(sg) + sg->seg[0].size;
+        if (direction == QEMU_IO_DMA_DIR_READ)
+            dma_sg_sync(dma_chan, dma_chan->sg_idx);
+        return 1;
+    }
+
+    /* chain is longer than one vector, carry on from this block */
+    dma_sg_complete(dmac, dma_chan->chan);
+    dma_sg_req(dmac, dma_chan->chan, direction);
+    return 0;
+}
+
 /* read from MEM and write to SSP - audio playback */
 static int dma_M2P_copy_burst(struct dma_chan *dma_chan)
 {
@@ -215,17 +435,12 @@ static int dma_M2P_copy_burst(struct dma_chan *dma_chan)
 
     /* copy burst from SAR to DAR */
     cpu_physical_memory_read(sar, buffer, burst_size);
+    atomic_add(&dmac->read_bytes, burst_size);
 
     /* copy buffer to files */
-    if (dma_chan->fd > 0) {
-        if (write(dma_chan->fd, buffer, burst_size) != burst_size)
-            fprintf(stderr, "error: writing to DMAC file %d\n", -errno);
-    }
+    adsp_sink_write(dma_chan->sink, buffer, burst_size);
 
-    if (ssp->tx.fd > 0) {
-        if (write(ssp->tx.fd, buffer, burst_size) != burst_size)
-            fprintf(stderr, "error: writing to SSP%d file %d\n", dma_chan->ssp, -errno);
-    }
+    adsp_ssp_playback(ssp, buffer, burst_size);
 
     /* update SAR, DAR and bytes copied */
     dmac->io[DW_SAR(chan) >> 2] += burst_size;
@@ -288,14 +503,12 @@ static int dma_P2M_copy_burst(struct dma_chan *dma_chan)
     burst_size = size / 2;
     dar = dmac->io[DW_DAR(chan) >> 2];
 
-    /* read in data from SSP file */
-    if (ssp->rx.fd > 0) {
-        if (write(ssp->rx.fd, buffer, burst_size) != burst_size)
-            fprintf(stderr, "error: reading from SSP%d file %d\n", dma_chan->ssp, -errno);
-    }
+    /* read in data from the SSP capture source */
+    adsp_ssp_capture(ssp, buffer, burst_size);
 
-    /* copy burst from SAR to DAR */
-    cpu_physical_memory_read(dar, buffer, burst_size);
+    /* copy burst to DAR */
+    cpu_physical_memory_write(dar, buffer, burst_size);
+    atomic_add(&dmac->write_bytes, burst_size);
 
     /* update SAR, DAR and bytes copied */
     dmac->io[DW_DAR(chan) >> 2] += burst_size;
@@ -357,6 +570,14 @@ static int dma_M2M_read_host_burst(struct dma_chan *dma_chan)
 
     /* copy burst from SAR to DAR */
     cpu_physical_memory_write(dar, dma_chan->ptr, burst_size);
+    atomic_add(&dmac->write_bytes, burst_size);
+
+    adsp_sink_write(dma_chan->sink, dma_chan->ptr, burst_size);
+
+    /* host write time stamps latency markers */
+    if (ssp_analysis_enabled())
+        ssp_analysis_host_write(dma_chan->ptr, burst_size,
+            dma_chan_width(dmac, chan));
 
     /* update SAR, DAR and bytes copied */
     dmac->io[DW_DAR(chan) >> 2] += burst_size;
@@ -366,11 +587,6 @@ static int dma_M2M_read_host_burst(struct dma_chan *dma_chan)
     dma_chan->bytes += burst_size;
     dma_chan->tbytes += burst_size;
 
-    if (dma_chan->fd > 0) {
-        if (write(dma_chan->fd, dma_chan->ptr, burst_size) != burst_size)
-            fprintf(stderr, "error: writing to DMAC file %d\n", -errno);
-    }
-
     /* block complete ? then send IRQ */
     if (dma_chan->bytes >= size || dma_chan->stop) {
 
@@ -378,15 +594,8 @@ static int dma_M2M_read_host_burst(struct dma_chan *dma_chan)
         dmac->io[DW_RAW_BLOCK >> 2] |= CHAN_RAW_ENABLE(chan);
         dmac_reg_sync(dmac, DW_STATUS_BLOCK);
 
-        /* tell host we are complete */
-        dma_host_complete(dmac, chan);
-
-        /* free SHM */
-        qemu_io_free_shm(ADSP_IO_SHM_DMA(dmac->id, chan)) ;
-
-        /* reload LLP and re-arm the timer if LLP exists */
+        /* reload LLP and carry on with the next block of the chain */
         if (dma_llp_reloaded(dma_chan) && !dma_chan->stop) {
-            dma_host_req(dmac, chan, QEMU_IO_DMA_DIR_READ);
 
             log_text(dmac->log, LOG_DMA_M2M,
                 "dma: %d:%d: completed SAR 0x%x DAR 0x%x size 0x%x total bytes 0x%x\n",
@@ -394,8 +603,14 @@ static int dma_M2M_read_host_burst(struct dma_chan *dma_chan)
                 dmac->io[DW_CTRL_HIGH(chan) >> 2] & DW_CTLH_BLOCK_TS_MASK,
                 dma_chan->tbytes);
 
-            return 1;
+            return dma_M2M_next_block(dma_chan, QEMU_IO_DMA_DIR_READ);
         } else {
+            /* host copies back and frees its SHM, mapped drops its map */
+            if (dma_chan->mapped)
+                dma_host_unmap(dma_chan);
+            else
+                dma_sg_complete(dmac, chan);
+
             /* clear chan enable bit */
             dmac->io[DW_DMA_CHAN_EN >> 2] &= ~CHAN_RAW_ENABLE(chan);
 
@@ -425,6 +640,7 @@ static int dma_M2M_write_host_burst(struct dma_chan *dma_chan)
 
     /* copy burst from SAR to DAR */
     cpu_physical_memory_read(sar, dma_chan->ptr, burst_size);
+    atomic_add(&dmac->read_bytes, burst_size);
 
     /* update SAR, DAR and bytes copied */
     dmac->io[DW_DAR(chan) >> 2] += burst_size;
@@ -436,19 +652,16 @@ static int dma_M2M_write_host_burst(struct dma_chan *dma_chan)
     /* block complete ? then send IRQ */
     if (dma_chan->bytes >= size || dma_chan->stop) {
 
+        /* guest must find the block in its buffer when it sees the IRQ */
+        if (!dma_chan->mapped && !dma_chan->stop)
+            dma_sg_sync(dma_chan, dma_chan->sg_idx);
+
         /* assert block interrupt */
         dmac->io[DW_RAW_BLOCK >> 2] |= CHAN_RAW_ENABLE(chan);
         dmac_reg_sync(dmac, DW_STATUS_BLOCK);
 
-        /* tell host we are complete */
-        dma_host_complete(dmac, chan);
-
-        /* free SHm */
-        qemu_io_free_shm(ADSP_IO_SHM_DMA(dmac->id, chan));
-
-        /* reload LLP and re-arm the timer if LLP exists */
+        /* reload LLP and carry on with the next block of the chain */
         if (dma_llp_reloaded(dma_chan) && !dma_chan->stop) {
-            dma_host_req(dmac, chan, QEMU_IO_DMA_DIR_WRITE);
 
             log_text(dmac->log, LOG_DMA_M2M,
                 "dma: %d:%d: completed SAR 0x%x DAR 0x%x size 0x%x total bytes 0x%x\n",
@@ -456,8 +669,14 @@ static int dma_M2M_write_host_burst(struct dma_chan *dma_chan)
                 dmac->io[DW_CTRL_HIGH(chan) >> 2] & DW_CTLH_BLOCK_TS_MASK,
                 dma_chan->tbytes);
 
-            return 1;
+            return dma_M2M_next_block(dma_chan, QEMU_IO_DMA_DIR_WRITE);
         } else {
+            /* host copies back and frees its SHM, mapped drops its map */
+            if (dma_chan->mapped)
+                dma_host_unmap(dma_chan);
+            else
+                dma_sg_complete(dmac, chan);
+
             /* clear chan enable bit */
             dmac->io[DW_DMA_CHAN_EN >> 2] &= ~CHAN_RAW_ENABLE(chan);
 
@@ -474,46 +693,64 @@ static int dma_M2M_write_host_burst(struct dma_chan *dma_chan)
     }
 }
 
+/* channel data has no rate or channel count, the header assumes stereo */
 static void open_dmac_file(struct dma_chan *dma_chan)
 {
     struct adsp_gp_dmac *dmac = dma_chan->dmac;
+    struct adsp_sink_pcm pcm = {
+        .rate = 48000,
+        .channels = 2,
+        .bits = dma_chan_width(dmac, dma_chan->chan) * 8,
+    };
     char name[32];
 
-    /* create filename */
-    sprintf(name, "/tmp/dmac%d-%d-%d.wav", dmac->id, dma_chan->chan,
-        dma_chan->file_idx++);
-    unlink(name);
-
-    if (dma_chan->fd == 0)
-        dma_chan->fd = open(name, O_WRONLY | O_CREAT,
-            S_IRUSR | S_IWUSR | S_IXUSR);
-
-    if (dma_chan->fd < 0)
-        fprintf(stderr, "error: can't open file %s %d\n", name, -errno);
+    sprintf(name, "dmac%d-%d", dmac->id, dma_chan->chan);
+    dma_chan->sink = adsp_sink_open(name, dma_chan->file_idx++, &pcm);
 }
 
 static void close_dmac_file(struct dma_chan *dma_chan)
 {
-    if (dma_chan->fd > 0) {
-        close(dma_chan->fd);
-        dma_chan->fd = 0;
-    }
+    adsp_sink_close(dma_chan->sink);
+    dma_chan->sink = NULL;
 }
 
-/* TODO: make these configurable on rate etc */
-#define DMA_M2M_BURST_SLEEP    (200 * 1000)    /* 200us */
-#define DMA_M2P_BURST_SLEEP    (6667 * 1000)    /* 6.66ms */
-#define DMA_P2M_BURST_SLEEP    (6667 * 1000)    /* 6.66ms */
+static const struct adsp_io_timing dma_default_timing = {
+    .dma_m2m_burst_ns = DW_DMA_M2M_BURST_NS,
+    .dma_m2p_burst_ns = DW_DMA_M2P_BURST_NS,
+    .dma_p2m_burst_ns = DW_DMA_P2M_BURST_NS,
+};
+
+static inline const struct adsp_io_timing *dma_timing(struct dma_chan *dma_chan)
+{
+    const struct adsp_io_timing *timing = dma_chan->dmac->timing;
+
+    return timing ? timing : &dma_default_timing;
+}
+
+/* burst period plus the time the last burst takes at the bus bandwidth */
+static long dma_burst_ns(struct dma_chan *dma_chan, uint32_t period,
+    uint32_t bytes)
+{
+    uint32_t bandwidth = dma_timing(dma_chan)->dma_bandwidth;
+
+    if (bandwidth == 0)
+        return period;
+
+    return period + muldiv64(bytes, NANOSECONDS_PER_SECOND, bandwidth);
+}
 
 /* dsp mem to host mem work for capture */
 static void * dma_channel_Mhost2Mdsp_work(void *data)
 {
     struct dma_chan *dma_chan = data;
+    uint32_t period = dma_timing(dma_chan)->dma_m2m_burst_ns;
+    uint32_t tbytes = 0;
 
     open_dmac_file(dma_chan);
 
     do {
-        dma_sleep(DMA_M2M_BURST_SLEEP);
+        dma_sleep(dma_burst_ns(dma_chan, period, dma_chan->tbytes - tbytes));
+        tbytes = dma_chan->tbytes;
     } while (dma_M2M_write_host_burst(dma_chan));
 
     close_dmac_file(dma_chan);
@@ -525,11 +762,14 @@ static void * dma_channel_Mhost2Mdsp_work(void *data)
 static void * dma_channel_Mdsp2Mhost_work(void *data)
 {
     struct dma_chan *dma_chan = data;
+    uint32_t period = dma_timing(dma_chan)->dma_m2m_burst_ns;
+    uint32_t tbytes = 0;
 
     open_dmac_file(dma_chan);
 
     do {
-        dma_sleep(DMA_M2M_BURST_SLEEP);
+        dma_sleep(dma_burst_ns(dma_chan, period, dma_chan->tbytes - tbytes));
+        tbytes = dma_chan->tbytes;
     } while (dma_M2M_read_host_burst(dma_chan));
 
     close_dmac_file(dma_chan);
@@ -541,11 +781,14 @@ static void * dma_channel_Mdsp2Mhost_work(void *data)
 static void * dma_channel_P2M_work(void *data)
 {
     struct dma_chan *dma_chan = data;
+    uint32_t period = dma_timing(dma_chan)->dma_p2m_burst_ns;
+    uint32_t tbytes = 0;
 
     open_dmac_file(dma_chan);
 
     do {
-        dma_sleep(DMA_P2M_BURST_SLEEP);
+        dma_sleep(dma_burst_ns(dma_chan, period, dma_chan->tbytes - tbytes));
+        tbytes = dma_chan->tbytes;
     } while (dma_P2M_copy_burst(dma_chan));
 
     close_dmac_file(dma_chan);
@@ -557,11 +800,14 @@ static void * dma_channel_P2M_work(void *data)
 static void * dma_channel_M2P_work(void *data)
 {
     struct dma_chan *dma_chan = data;
+    uint32_t period = dma_timing(dma_chan)->dma_m2p_burst_ns;
+    uint32_t tbytes = 0;
 
     open_dmac_file(dma_chan);
 
     do {
-        dma_sleep(DMA_M2P_BURST_SLEEP);
+        dma_sleep(dma_burst_ns(dma_chan, period, dma_chan->tbytes - tbytes));
+        tbytes = dma_chan->tbytes;
     } while (dma_M2P_copy_burst(dma_chan));
 
     close_dmac_file(dma_chan);
@@ -624,23 +870,15 @@ static void dma_M2M_do_transfer(struct dma_chan *dma_chan,
     uint32_t chan, int direction)
 {
     struct adsp_gp_dmac *dmac = dma_chan->dmac;
-    void *ptr = NULL;
-    uint32_t size;
-    int err;
 
-    size = dmac->io[DW_CTRL_HIGH(chan) >> 2] & DW_CTLH_BLOCK_TS_MASK;
-
-    /* create SHM region for DMA */
-    err = qemu_io_register_shm(dma_chan->thread_name,
-        ADSP_IO_SHM_DMA(dmac->id, chan), size, &ptr);
-    if (err < 0) {
-        fprintf(stderr, "error: can't create SHM size 0x%x for DMAC %d chan %d\n", size,
+    if (dma_chan->sg == NULL) {
+        fprintf(stderr, "error: DMAC %d chan %d ready without SHM\n",
             dmac->id, chan);
         return;
     }
 
-    /* prepare timer context */
-    dma_chan->ptr = ptr;
+    /* host has filled the chain data for reads */
+    dma_chan->ptr = qemu_io_dma_sg_data(dma_chan->sg);
 
     /* allocate new timer for DMAC channel and direction */
     if (direction == QEMU_IO_DMA_DIR_READ)
@@ -649,6 +887,169 @@ static void dma_M2M_do_transfer(struct dma_chan *dma_chan,
         dma_Mhost2Mdsp_start(dmac, chan);
 }
 
+/*
+ * PCI DMACs copy host guest RAM to host guest RAM, so their channels run as
+ * timers on an AioContext (an IOThread if one is given) instead of detached
+ * threads. Each pass copies up to a slice in large memcpy()s and raises
+ * BLOCK and TFR once however many blocks completed in the pass.
+ */
+#define DW_DMA_AIO_SLICE	(1024 * 1024)
+#define DW_DMA_AIO_BLOCKS	64	/* LLI reloads per pass */
+#define DW_DMA_AIO_IDLE_NS	1000000	/* next pass when nothing moved */
+
+static void dma_aio_copy(AddressSpace *as, hwaddr src, hwaddr dst,
+    hwaddr len)
+{
+    hwaddr slen = len, dlen = len, n, chunk;
+    uint8_t buf[4096];
+    void *s, *d;
+
+    s = address_space_map(as, src, &slen, false);
+    d = address_space_map(as, dst, &dlen, true);
+
+    if (s && d && slen == len && dlen == len) {
+        memcpy(d, s, len);
+        address_space_unmap(as, s, slen, false, slen);
+        address_space_unmap(as, d, dlen, true, dlen);
+        return;
+    }
+
+    if (s)
+        address_space_unmap(as, s, slen, false, 0);
+    if (d)
+        address_space_unmap(as, d, dlen, true, 0);
+
+    /* MMIO or split region, bounce it */
+    for (n = 0; n < len; n += chunk) {
+        chunk = MIN(sizeof(buf), len - n);
+        address_space_read(as, src + n, MEMTXATTRS_UNSPECIFIED, buf, chunk);
+        address_space_write(as, dst + n, MEMTXATTRS_UNSPECIFIED, buf, chunk);
+    }
+}
+
+static void dma_aio_irq(struct adsp_gp_dmac *dmac, uint32_t chan,
+    bool block, bool tfr)
+{
+    bool locked = qemu_mutex_iothread_locked();
+
+    if (!locked)
+        qemu_mutex_lock_iothread();
+
+    if (block) {
+        dmac->io[DW_RAW_BLOCK >> 2] |= CHAN_RAW_ENABLE(chan);
+        dmac_reg_sync(dmac, DW_STATUS_BLOCK);
+    }
+
+    if (tfr) {
+        dmac->io[DW_DMA_CHAN_EN >> 2] &= ~CHAN_RAW_ENABLE(chan);
+        dmac->io[DW_RAW_TFR >> 2] |= CHAN_RAW_ENABLE(chan);
+        dmac_reg_sync(dmac, DW_STATUS_TFR);
+    }
+
+    if (!locked)
+        qemu_mutex_unlock_iothread();
+}
+
+/*
+ * Registers are written by the guest and the LLI reload with the BQL held,
+ * so the pass holds it too except while copying. Zero sized blocks in a
+ * cyclic chain never move data, the reload count bounds the pass.
+ */
+static void dma_aio_run(void *opaque)
+{
+    struct dma_chan *dma_chan = opaque;
+    struct adsp_gp_dmac *dmac = dma_chan->dmac;
+    uint32_t chan = dma_chan->chan;
+    uint32_t done = 0, sar, dar, size, n;
+    bool block = false, tfr = false;
+    bool locked = qemu_mutex_iothread_locked();
+    int64_t delay = 0;
+    int blocks = 0;
+
+    if (!locked)
+        qemu_mutex_lock_iothread();
+
+    while (done < DW_DMA_AIO_SLICE) {
+
+        if (atomic_read(&dma_chan->stop)) {
+            block = tfr = true;
+            break;
+        }
+
+        sar = dmac->io[DW_SAR(chan) >> 2];
+        dar = dmac->io[DW_DAR(chan) >> 2];
+        size = dmac->io[DW_CTRL_HIGH(chan) >> 2] & DW_CTLH_BLOCK_TS_MASK;
+
+        /* BLOCK_TS can be rewritten below what was already copied */
+        n = 0;
+        if (dma_chan->bytes < size)
+            n = MIN(size - dma_chan->bytes, DW_DMA_AIO_SLICE - done);
+
+        if (n) {
+            if (!locked)
+                qemu_mutex_unlock_iothread();
+            dma_aio_copy(dmac->as, sar, dar, n);
+            if (!locked)
+                qemu_mutex_lock_iothread();
+        }
+
+        dmac->io[DW_SAR(chan) >> 2] = sar + n;
+        dmac->io[DW_DAR(chan) >> 2] = dar + n;
+        dma_chan->bytes += n;
+        dma_chan->tbytes += n;
+        done += n;
+
+        if (dma_chan->bytes < size)
+            break;
+
+        /* block complete, carry on with the chain in this pass */
+        block = true;
+        dma_chan->bytes = 0;
+        if (!dma_llp_reloaded(dma_chan)) {
+            tfr = true;
+            break;
+        }
+        if (++blocks == DW_DMA_AIO_BLOCKS)
+            break;
+    }
+
+    atomic_add(&dmac->read_bytes, done);
+    atomic_add(&dmac->write_bytes, done);
+
+    if (block || tfr)
+        dma_aio_irq(dmac, chan, block, tfr);
+
+    if (!locked)
+        qemu_mutex_unlock_iothread();
+
+    if (tfr) {
+        log_text(dmac->log, LOG_DMA_M2M,
+            "dma: %d:%d: aio complete total bytes 0x%x\n",
+            dmac->id, chan, dma_chan->tbytes);
+        return;
+    }
+
+    /* the pass took as long as the slice at the bus bandwidth */
+    if (done == 0)
+        delay = DW_DMA_AIO_IDLE_NS;
+    else if (dmac->bandwidth)
+        delay = muldiv64(done, NANOSECONDS_PER_SECOND, dmac->bandwidth);
+    timer_mod(dma_chan->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + delay);
+}
+
+static void dma_aio_start(struct adsp_gp_dmac *dmac, uint32_t chan)
+{
+    struct dma_chan *dma_chan = &dmac->dma_chan[chan];
+
+    if (dma_chan->timer == NULL)
+        dma_chan->timer = aio_timer_new(dmac->ctx, QEMU_CLOCK_VIRTUAL,
+            SCALE_NS, dma_aio_run, dma_chan);
+
+    dma_chan->bytes = 0;
+    dma_chan->tbytes = 0;
+    timer_mod(dma_chan->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+}
+
 /* stop DMA transaction */
 static void dma_stop_transfer(struct adsp_gp_dmac *dmac, uint32_t chan)
 {
@@ -657,6 +1058,9 @@ static void dma_stop_transfer(struct adsp_gp_dmac *dmac, uint32_t chan)
     /* prepare timer context */
     dma_chan->stop = 1;
 
+    /* release a channel thread waiting on the host */
+    qemu_event_set(&dma_chan->sg_event);
+
     log_text(dmac->log, LOG_DMA,
         "dma: %d:%d: stop SAR 0x%x DAR 0x%x size 0x%x total bytes 0x%x\n",
         dmac->id, chan, dmac->io[DW_SAR(chan) >> 2], dmac->io[DW_DAR(chan) >> 2],
@@ -664,6 +1068,19 @@ static void dma_stop_transfer(struct adsp_gp_dmac *dmac, uint32_t chan)
         dma_chan->tbytes);
 }
 
+/* stop all channels, e.g. when the DSP is powered down */
+void dw_dmac_stop(struct adsp_gp_dmac *dmac)
+{
+    uint32_t chan;
+
+    for (chan = 0; chan < NUM_CHANNELS; chan++) {
+        if (dmac->io[DW_DMA_CHAN_EN >> 2] & CHAN_RAW_ENABLE(chan))
+            dma_stop_transfer(dmac, chan);
+    }
+
+    dmac->io[DW_DMA_CHAN_EN >> 2] = 0;
+}
+
 /* init new DMA mem to mem playback transfer */
 static void dma_start_transfer(struct adsp_gp_dmac *dmac, uint32_t chan)
 {
@@ -690,12 +1107,24 @@ static void dma_start_transfer(struct adsp_gp_dmac *dmac, uint32_t chan)
 
     switch (ctl_lo) {
     case 0: /* DW_CTLL_FC_M2M */
+        /* PCI DMAC, both sides are host guest RAM */
+        if (dmac->ctx) {
+            dma_aio_start(dmac, chan);
+            return;
+        }
+
         /* determine if we are to/from host - MSB == 1 then addr is DSP */
         if (sar & 0x80000000) {
-            dma_host_req(dmac, chan, QEMU_IO_DMA_DIR_READ); /* capture */
+            if (dma_host_map(dma_chan, QEMU_IO_DMA_DIR_READ))
+                dma_Mdsp2Mhost_start(dmac, chan);
+            else
+                dma_sg_req(dmac, chan, QEMU_IO_DMA_DIR_READ); /* capture */
             return;
         } else {
-            dma_host_req(dmac, chan, QEMU_IO_DMA_DIR_WRITE); /* playback */
+            if (dma_host_map(dma_chan, QEMU_IO_DMA_DIR_WRITE))
+                dma_Mhost2Mdsp_start(dmac, chan);
+            else
+                dma_sg_req(dmac, chan, QEMU_IO_DMA_DIR_WRITE); /* playback */
             return;
         }
         break;
@@ -738,6 +1167,53 @@ void dw_dmac_reset(void *opaque)
     dmac->io[DW_DMA_CFG >> 2] = 0x1;
 }
 
+static const VMStateDescription vmstate_dw_dma_chan = {
+    .name = "dw-dma/chan",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(bytes, struct dma_chan),
+        VMSTATE_UINT32(tbytes, struct dma_chan),
+        VMSTATE_INT32(ssp, struct dma_chan),
+        VMSTATE_UINT32(stop, struct dma_chan),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+/* channel threads hold host pointers and can't be saved mid transfer */
+static int dw_dmac_pre_save(void *opaque)
+{
+    struct adsp_gp_dmac *dmac = opaque;
+    int i;
+
+    for (i = 0; i < NUM_CHANNELS; i++) {
+        if ((dmac->io[DW_DMA_CHAN_EN >> 2] & CHAN_RAW_ENABLE(i)) &&
+            !dmac->dma_chan[i].stop) {
+            fprintf(stderr, "error: dmac%d chan %d busy, can't save\n",
+                dmac->id, i);
+            return -EBUSY;
+        }
+    }
+
+    return 0;
+}
+
+const VMStateDescription vmstate_dw_dmac = {
+    .name = "dw-dma",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .pre_save = dw_dmac_pre_save,
+    .fields = (VMStateField[]) {
+        VMSTATE_VBUFFER_UINT32(io, struct adsp_gp_dmac, 1, NULL, io_size),
+        VMSTATE_INT32(irq_assert, struct adsp_gp_dmac),
+        VMSTATE_STRUCT_ARRAY(dma_chan, struct adsp_gp_dmac, NUM_CHANNELS, 1,
+            vmstate_dw_dma_chan, struct dma_chan),
+        VMSTATE_UINT64(read_bytes, struct adsp_gp_dmac),
+        VMSTATE_UINT64(write_bytes, struct adsp_gp_dmac),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static uint64_t dmac_read(void *opaque, hwaddr addr,
         unsigned size)
 {
@@ -889,12 +1365,16 @@ void dw_dma_msg(struct qemu_io_msg *msg)
     /* get host buffer address */
     local_dma_msg->host_data = dma_msg->host_data;
 
-    if (msg->msg == QEMU_IO_DMA_REQ_READY) {
+    if (msg->msg != QEMU_IO_DMA_REQ_READY)
+        return;
 
-        dma_M2M_do_transfer(
-            (struct dma_chan*)dma_msg->client_data,
-            dma_msg->chan_id, dma_msg->direction);
+    /* reply to a block sync, channel thread is waiting */
+    if (atomic_xchg(&dma_chan->sg_sync, false)) {
+        qemu_event_set(&dma_chan->sg_event);
+        return;
     }
+
+    dma_M2M_do_transfer(dma_chan, dma_msg->chan_id, dma_msg->direction);
 }
 
 const MemoryRegionOps dw_dmac_ops = {
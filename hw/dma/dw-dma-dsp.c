@@ -51,6 +51,8 @@ void dw_dma_init_dev(struct adsp_dev *adsp, MemoryRegion *parent,
     char name[32];
     int i, j;
 
+    dw_dma_run_gate_init();
+
     for (i = 0; i < num_dmac; i++) {
 
         dmac = g_malloc(sizeof(*dmac));
@@ -61,24 +63,31 @@ void dw_dma_init_dev(struct adsp_dev *adsp, MemoryRegion *parent,
         dmac->do_irq = dw_dsp_do_irq;
         dmac->log = log_init(NULL);
         dmac->desc = &dev[i];
+        dmac->timing = &adsp->desc->io_timing;
+        dmac->read_bytes = 0;
+        dmac->write_bytes = 0;
+        adsp->gp_dmac[i] = dmac;
 
         sprintf(name, "dmac%d.io", i);
 
         /* DMAC */
         reg_dmac = g_malloc(sizeof(*reg_dmac));
         dmac->io = g_malloc(dev[i].desc.size);
+        dmac->io_size = dev[i].desc.size;
         memory_region_init_io(reg_dmac, NULL, &dw_dmac_ops, dmac,
             name, dev[i].desc.size);
         memory_region_add_subregion(parent, dev[i].desc.base, reg_dmac);
         qemu_register_reset(dw_dmac_reset, dmac);
+        vmstate_register(NULL, i, &vmstate_dw_dmac, dmac);
 
         /* channels */
         for (j = 0; j < NUM_CHANNELS; j++) {
             dmac->dma_chan[j].dmac = dmac;
-            dmac->dma_chan[j].fd = 0;
+            dmac->dma_chan[j].sink = NULL;
             dmac->dma_chan[j].chan = j;
             dmac->dma_chan[j].file_idx = 0;
             sprintf(dmac->dma_chan[j].thread_name, "dmac:%d.%d", i, j);
+            qemu_event_init(&dmac->dma_chan[j].sg_event, false);
         }
     }
 }
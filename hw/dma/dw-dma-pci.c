@@ -29,6 +29,7 @@
 #include "exec/address-spaces.h"
 #include "hw/sysbus.h"
 #include "qemu/error-report.h"
+#include "qemu/main-loop.h"
 #include "qemu/io-bridge.h"
 #include "hw/pci/pci.h"
 
@@ -47,6 +48,7 @@
 static const struct dw_desc dw_dev = {
 
     .pci =  {.base = DWDMA_HOST_PCI_BASE, .size = DWDMA_HOST_PCI_SIZE},
+    .num_dmac = 1,
 
     .gp_dmac_dev[0] = {
         .name = "dmac0",
@@ -165,56 +167,51 @@ static void dw_pci_exit(PCIDevice *pci_dev)
 
 static void dw_dmac_init(struct dw_host *dw, int id)
 {
-    MemoryRegion *mmio;
-    char dmac_name[16];
     struct adsp_gp_dmac *dmac;
-    const struct dw_desc *board = dw->desc;
     MemoryRegion *reg_dmac;
     char name[32];
     int j;
-    void *ptr;
-    int err;
 
-    sprintf(dmac_name, "dmac%d", id);
-
-    /* DMAC MMIO -shared via SHM */
-    err = qemu_io_register_shm(dmac_name, ADSP_IO_SHM_DMAC(id),
-            board->gp_dmac_dev[id].desc.size, &ptr);
-    if (err < 0)
-        fprintf(stderr, "error: cant alloc DMAC%d SHM %d\n", id, err);
-
-    mmio = g_malloc(sizeof(*mmio));
-    memory_region_init_ram_ptr(mmio, NULL, dmac_name,
-        board->gp_dmac_dev[id].desc.size, ptr);
-    //vmstate_register_ram_global(iram);
-    memory_region_add_subregion(dw->system_memory,
-            board->gp_dmac_dev[id].desc.base, mmio);
-
-    dmac = g_malloc(sizeof(*dmac));
+    /* standalone, registers are not shared with a DSP over the bridge */
+    dmac = g_malloc0(sizeof(*dmac));
     dmac->id = id;
     dmac->irq_assert = 0;
     dmac->is_pci_dev = 1;
     dmac->do_irq = dw_host_do_irq;
     dmac->dw_host = dw;
+    dmac->timing = NULL;
+    dmac->read_bytes = 0;
+    dmac->write_bytes = 0;
+    dmac->log = dw->log;
+    dmac->desc = &dw->desc->gp_dmac_dev[id];
+
+    /* channels run on the IOThread if given, bus master DMA */
+    dmac->ctx = dw->iothread ? iothread_get_aio_context(dw->iothread) :
+        qemu_get_aio_context();
+    dmac->as = pci_get_address_space(&dw->dev);
+    dmac->bandwidth = dw->bandwidth;
 
     sprintf(name, "dmac%d.io", id);
 
     /* DMAC */
     reg_dmac = g_malloc(sizeof(*reg_dmac));
     dmac->io = g_malloc(dw->desc->gp_dmac_dev[id].desc.size);
+    dmac->io_size = dw->desc->gp_dmac_dev[id].desc.size;
     memory_region_init_io(reg_dmac, NULL, &dw_dmac_ops, dmac,
             name, dw->desc->gp_dmac_dev[id].desc.size);
     memory_region_add_subregion(dw->system_memory,
             dw->desc->gp_dmac_dev[id].desc.base, reg_dmac);
     qemu_register_reset(dw_dmac_reset, dmac);
+    vmstate_register(NULL, id, &vmstate_dw_dmac, dmac);
 
     /* channels */
     for (j = 0; j < NUM_CHANNELS; j++) {
         dmac->dma_chan[j].dmac = dmac;
-        dmac->dma_chan[j].fd = 0;
+        dmac->dma_chan[j].sink = NULL;
         dmac->dma_chan[j].chan = j;
         dmac->dma_chan[j].file_idx = 0;
         sprintf(dmac->dma_chan[j].thread_name, "dmac:%d.%d", id, j);
+        qemu_event_init(&dmac->dma_chan[j].sg_event, false);
     }
 }
 
@@ -247,6 +244,7 @@ static void dw_pci_realize(PCIDevice *pci_dev, Error **errp)
             dw_dev.pci.base, pci);
     //qemu_register_reset(pci_reset, dw);
 
+    dw_dma_run_gate_init();
     for (i = 0; i < dw_dev.num_dmac; i++)
         dw_dmac_init(dw, i);
 
@@ -259,6 +257,9 @@ static void dw_reset(DeviceState *dev)
 }
 
 static Property dw_properties[] = {
+    DEFINE_PROP_LINK("iothread", struct dw_host, iothread, TYPE_IOTHREAD,
+        IOThread *),
+    DEFINE_PROP_UINT32("bandwidth", struct dw_host, bandwidth, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
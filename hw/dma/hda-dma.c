@@ -0,0 +1,701 @@
+/* Virtualization support for HD-Audio host and link DMA.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Each stream has a gateway register block in DSP space describing a ring
+ * buffer in DSP SRAM. Firmware moves its side of the ring with DGBFPI and
+ * the engine moves the other side:-
+ *
+ *  host out  x86 BDL -> DSP ring	engine writes, firmware reads
+ *  host in   DSP ring -> x86 BDL	engine reads, firmware writes
+ *  link out  DSP ring -> codec file	engine reads, firmware writes
+ *  link in   silence -> DSP ring	engine writes, firmware reads
+ *  code ldr  x86 BDL -> ROM image	engine writes, ROM loader reads
+ *
+ * The x86 side stream descriptors and position buffer registers live in
+ * the "<name>-hda" SHM that the host maps as the HD-Audio controller BAR.
+ * BDLs and buffers are read and written in place through the io bridge
+ * DMA map of x86 guest RAM, nothing is copied through messages.
+ *
+ * All streams are serviced from one virtual clock timer that runs while
+ * any stream is enabled. Host streams share the board DMA bandwidth per
+ * tick, link streams run at the codec rate.
+ *
+ * The code loader is the ROM side of firmware download. It is started by
+ * the ROM model with the stream tag from the host purge request, then
+ * takes the BDL of the host out stream with that tag and fills a linear
+ * image buffer at the board code loader rate.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/timer.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "sysemu/sysemu.h"
+#include "exec/memory.h"
+#include "exec/address-spaces.h"
+#include "migration/vmstate.h"
+#include "qemu/io-bridge.h"
+#include "hw/audio/adsp-dev.h"
+#include "hw/adsp/shim.h"
+#include "hw/adsp/log.h"
+#include "hw/audio/adsp-sink.h"
+#include "hw/dma/hda-dma.h"
+#include "hw/ssi/ssp.h"
+
+#define HDA_TICK_NS		(1000 * 1000)
+#define HDA_LINK_BYTES		384	/* per tick, 48kHz stereo 32 bit */
+
+struct adsp_hda_dma {
+    struct adsp_dev *adsp;
+    uint32_t *io;		/* x86 visible controller registers */
+    QEMUTimer *timer;
+    int num_streams;
+    int next;			/* first stream serviced, rotates per tick */
+    struct hda_stream *stream;
+};
+
+static inline uint32_t hda_read(struct adsp_hda_dma *hda, hwaddr reg)
+{
+    return atomic_read(&hda->io[reg >> 2]);
+}
+
+static inline uint32_t sd_read(struct hda_stream *s, hwaddr reg)
+{
+    return hda_read(s->hda, HDA_SD_BASE(s->sd) + reg);
+}
+
+static inline void sd_write(struct hda_stream *s, hwaddr reg, uint32_t val)
+{
+    atomic_set(&s->hda->io[(HDA_SD_BASE(s->sd) + reg) >> 2], val);
+}
+
+/* status bits are cleared by the x86 driver concurrently */
+static inline void sd_set(struct hda_stream *s, hwaddr reg, uint32_t bits)
+{
+    atomic_or(&s->hda->io[(HDA_SD_BASE(s->sd) + reg) >> 2], bits);
+}
+
+static bool stream_is_host(struct hda_stream *s)
+{
+    return s->desc->type == HDA_HOST_OUT || s->desc->type == HDA_HOST_IN ||
+        s->desc->type == HDA_CODE_LDR;
+}
+
+/* engine fills the DSP ring for these and firmware drains it */
+static bool stream_engine_writes(struct hda_stream *s)
+{
+    return s->desc->type == HDA_HOST_OUT || s->desc->type == HDA_LINK_IN ||
+        s->desc->type == HDA_CODE_LDR;
+}
+
+static bool stream_active(struct hda_stream *s)
+{
+    if (s->desc->type == HDA_CODE_LDR)
+        return s->cl_buf != NULL;
+
+    return (s->io[HDA_DGCS >> 2] & HDA_DGCS_GEN) && s->io[HDA_DGBS >> 2];
+}
+
+static uint32_t ring_space(struct hda_stream *s)
+{
+    return s->io[HDA_DGBS >> 2] - s->avail;
+}
+
+static void ring_move(struct hda_stream *s, hwaddr reg, uint32_t bytes)
+{
+    s->io[reg >> 2] = (s->io[reg >> 2] + bytes) % s->io[HDA_DGBS >> 2];
+}
+
+/* engine side pointer moves, flag when it passes the segment pointer */
+static void ring_advance(struct hda_stream *s, hwaddr reg, uint32_t bytes)
+{
+    uint32_t size = s->io[HDA_DGBS >> 2];
+    uint32_t seg = s->io[HDA_DGBSP >> 2];
+    uint32_t dist;
+
+    if (seg < size) {
+        dist = (seg + size - s->io[reg >> 2]) % size;
+        if (bytes >= (dist ? dist : size))
+            s->io[HDA_DGCS >> 2] |= HDA_DGCS_BSC;
+    }
+
+    ring_move(s, reg, bytes);
+}
+
+/* copy between buf and the DSP ring at the engine pointer */
+static void ring_copy(struct hda_stream *s, uint8_t *buf, uint32_t bytes)
+{
+    bool to_dsp = stream_engine_writes(s);
+    hwaddr reg = to_dsp ? HDA_DGBWP : HDA_DGBRP;
+    hwaddr base = s->io[HDA_DGBBA >> 2];
+    uint32_t size = s->io[HDA_DGBS >> 2];
+    uint32_t pos = s->io[reg >> 2];
+    uint32_t done = 0, n;
+
+    /* code loader image is linear */
+    if (s->desc->type == HDA_CODE_LDR) {
+        memcpy(s->cl_buf + s->cl_pos, buf, bytes);
+        s->cl_pos += bytes;
+        return;
+    }
+
+    while (done < bytes) {
+        n = MIN(bytes - done, size - pos);
+        if (to_dsp)
+            cpu_physical_memory_write(base + pos, buf + done, n);
+        else
+            cpu_physical_memory_read(base + pos, buf + done, n);
+        pos = (pos + n) % size;
+        done += n;
+    }
+
+    ring_advance(s, reg, bytes);
+    if (to_dsp)
+        s->avail += bytes;
+    else
+        s->avail -= bytes;
+}
+
+static void cl_finish(struct hda_stream *s, int err)
+{
+    s->cl_buf = NULL;
+
+    log_text(s->hda->adsp->log, LOG_DMA, "hda: %s done 0x%x bytes err %d\n",
+        s->name, s->cl_pos, err);
+
+    s->cl_cb(s->cl_opaque, s->cl_pos, err);
+}
+
+static void stream_error(struct hda_stream *s, const char *what,
+    uint64_t addr)
+{
+    fprintf(stderr, "error: hda: %s %s 0x%" PRIx64 " not mapped\n",
+        s->name, what, addr);
+
+    /* stop the stream, driver sees a FIFO error */
+    s->io[HDA_DGCS >> 2] &= ~HDA_DGCS_GEN;
+    sd_set(s, HDA_SD_CTL, HDA_SD_STS_FIFOE);
+
+    if (s->desc->type == HDA_CODE_LDR)
+        cl_finish(s, -EIO);
+}
+
+static void pos_update(struct hda_stream *s)
+{
+    struct adsp_hda_dma *hda = s->hda;
+    uint64_t base;
+    uint32_t *pos;
+
+    base = hda_read(hda, HDA_DPLBASE) |
+        (uint64_t)hda_read(hda, HDA_DPUBASE) << 32;
+    if (!(base & HDA_DPLBASE_ENABLE))
+        return;
+
+    /* 8 bytes per stream descriptor, LPIB in the first word */
+    base = (base & HDA_DPLBASE_MASK) + s->sd * 8;
+    pos = qemu_io_dma_map(base, sizeof(*pos));
+    if (pos)
+        atomic_set(pos, cpu_to_le32(s->lpib));
+    qemu_io_dma_put(pos);
+}
+
+/* walk the BDL moving at most budget bytes, returns bytes moved */
+static uint32_t host_service(struct hda_stream *s, uint32_t budget)
+{
+    struct hda_bdle *bdl, *e;
+    uint64_t addr;
+    uint32_t lvi, cbl, len, n, moved = 0;
+    uint8_t *buf;
+
+    if (s->sd < 0 || !(sd_read(s, HDA_SD_CTL) & HDA_SD_CTL_RUN))
+        return 0;
+
+    lvi = sd_read(s, HDA_SD_LVI) & 0xff;
+    cbl = sd_read(s, HDA_SD_CBL);
+    addr = sd_read(s, HDA_SD_BDPL) | (uint64_t)sd_read(s, HDA_SD_BDPU) << 32;
+
+    bdl = qemu_io_dma_map(addr, (lvi + 1) * sizeof(*bdl));
+    if (bdl == NULL) {
+        stream_error(s, "BDL", addr);
+        return 0;
+    }
+
+    if (s->desc->type == HDA_CODE_LDR)
+        budget = MIN(budget, s->cl_size - s->cl_pos);
+    else
+        budget = MIN(budget,
+            stream_engine_writes(s) ? ring_space(s) : s->avail);
+
+    while (moved < budget) {
+        if (s->bdle > lvi)
+            s->bdle = 0;
+
+        e = &bdl[s->bdle];
+        addr = le64_to_cpu(e->addr);
+        len = le32_to_cpu(e->len);
+
+        buf = len ? qemu_io_dma_map(addr, len) : NULL;
+        if (buf == NULL) {
+            stream_error(s, "BDLE", addr);
+            break;
+        }
+
+        n = MIN(len - s->bdle_off, budget - moved);
+        ring_copy(s, buf + s->bdle_off, n);
+
+        /* host write time stamps latency markers, 32 bit samples */
+        if (s->desc->type == HDA_HOST_OUT && ssp_analysis_enabled())
+            ssp_analysis_host_write(buf + s->bdle_off, n, 4);
+        qemu_io_dma_put(buf);
+        s->bdle_off += n;
+        moved += n;
+        s->lpib = cbl ? (s->lpib + n) % cbl : s->lpib + n;
+
+        if (s->bdle_off < len)
+            continue;
+
+        /* buffer complete, the driver polls the status or position */
+        if (le32_to_cpu(e->ioc) & 0x1) {
+            sd_set(s, HDA_SD_CTL, HDA_SD_STS_BCIS);
+            atomic_or(&s->hda->io[HDA_INTSTS >> 2], 1 << s->sd);
+        }
+        s->bdle_off = 0;
+        s->bdle = s->bdle == lvi ? 0 : s->bdle + 1;
+    }
+    qemu_io_dma_put(bdl);
+
+    sd_write(s, HDA_SD_LPIB, s->lpib);
+    s->io[HDA_DGLPIBI >> 2] = s->lpib;
+    pos_update(s);
+
+    return moved;
+}
+
+static void link_service(struct hda_stream *s)
+{
+    uint8_t buf[HDA_LINK_BYTES];
+    uint32_t n;
+
+    if (s->desc->type == HDA_LINK_OUT) {
+        n = MIN(s->avail, HDA_LINK_BYTES);
+        ring_copy(s, buf, n);
+        adsp_sink_write(s->sink, buf, n);
+    } else {
+        n = MIN(ring_space(s), HDA_LINK_BYTES);
+        memset(buf, 0, n);
+        ring_copy(s, buf, n);
+    }
+
+    s->lpib += n;
+    s->io[HDA_DGLLPI >> 2] = s->lpib;
+    s->io[HDA_DGLPIBI >> 2] = s->lpib;
+}
+
+/* code loader runs at its own rate within the shared bus budget */
+static uint32_t cl_service(struct hda_stream *s, uint32_t budget)
+{
+    uint32_t bw = s->hda->adsp->desc->io_timing.cl_bandwidth;
+    uint32_t moved;
+
+    if (bw)
+        budget = MIN(budget,
+            muldiv64(bw, HDA_TICK_NS, NANOSECONDS_PER_SECOND));
+
+    moved = host_service(s, budget);
+
+    /* stopped by a BDL error */
+    if (s->cl_buf == NULL)
+        return moved;
+
+    if (s->cl_pos == s->cl_size)
+        cl_finish(s, 0);
+    else if (moved)
+        s->cl_cb(s->cl_opaque, s->cl_pos, 0);
+
+    return moved;
+}
+
+static void hda_schedule(void *opaque)
+{
+    struct adsp_hda_dma *hda = opaque;
+    uint32_t bw = hda->adsp->desc->io_timing.dma_bandwidth;
+    uint32_t budget;
+    struct hda_stream *s;
+    bool active = false;
+    int i;
+
+    /* host streams share the bus, 0 is unlimited */
+    budget = bw ? muldiv64(bw, HDA_TICK_NS, NANOSECONDS_PER_SECOND) :
+        UINT32_MAX;
+
+    for (i = 0; i < hda->num_streams; i++) {
+        s = &hda->stream[(hda->next + i) % hda->num_streams];
+
+        if (!stream_active(s))
+            continue;
+
+        active = true;
+        if (s->desc->type == HDA_CODE_LDR)
+            budget -= cl_service(s, budget);
+        else if (stream_is_host(s))
+            budget -= host_service(s, budget);
+        else
+            link_service(s);
+    }
+
+    hda->next = (hda->next + 1) % hda->num_streams;
+
+    if (active)
+        timer_mod(hda->timer,
+            qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + HDA_TICK_NS);
+}
+
+static void hda_kick(struct adsp_hda_dma *hda)
+{
+    if (!timer_pending(hda->timer))
+        timer_mod(hda->timer,
+            qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + HDA_TICK_NS);
+}
+
+static void stream_start(struct hda_stream *s)
+{
+    static const struct adsp_sink_pcm link_pcm = {
+        .rate = 48000,
+        .channels = 2,
+        .bits = 32,
+    };
+
+    s->io[HDA_DGBRP >> 2] = 0;
+    s->io[HDA_DGBWP >> 2] = 0;
+    s->avail = 0;
+    s->bdle = 0;
+    s->bdle_off = 0;
+    s->lpib = 0;
+
+    if (s->desc->type == HDA_LINK_OUT)
+        s->sink = adsp_sink_open(s->name, s->file_idx++, &link_pcm);
+
+    log_text(s->hda->adsp->log, LOG_DMA, "hda: %s start size 0x%x\n",
+        s->name, s->io[HDA_DGBS >> 2]);
+
+    hda_kick(s->hda);
+}
+
+static void stream_stop(struct hda_stream *s)
+{
+    adsp_sink_close(s->sink);
+    s->sink = NULL;
+
+    log_text(s->hda->adsp->log, LOG_DMA, "hda: %s stop lpib 0x%x\n",
+        s->name, s->lpib);
+}
+
+/* firmware consumed or produced bytes on its side of the ring */
+static void stream_fw_move(struct hda_stream *s, uint32_t bytes)
+{
+    uint32_t space;
+
+    if (!stream_active(s))
+        return;
+
+    if (stream_engine_writes(s)) {
+        bytes = MIN(bytes, s->avail);
+        ring_move(s, HDA_DGBRP, bytes);
+        s->avail -= bytes;
+    } else {
+        space = ring_space(s);
+        if (bytes > space) {
+            s->io[HDA_DGCS >> 2] |= HDA_DGCS_BOR;
+            bytes = space;
+        }
+        ring_move(s, HDA_DGBWP, bytes);
+        s->avail += bytes;
+    }
+
+    hda_kick(s->hda);
+}
+
+static void stream_status(struct hda_stream *s)
+{
+    uint32_t dgcs = s->io[HDA_DGCS >> 2];
+
+    dgcs &= ~(HDA_DGCS_BNE | HDA_DGCS_BF);
+    if (s->avail)
+        dgcs |= HDA_DGCS_BNE;
+    if (s->io[HDA_DGBS >> 2] && s->avail == s->io[HDA_DGBS >> 2])
+        dgcs |= HDA_DGCS_BF;
+    if (dgcs & HDA_DGCS_GEN)
+        dgcs |= HDA_DGCS_FIFORDY;
+    else
+        dgcs &= ~HDA_DGCS_FIFORDY;
+
+    s->io[HDA_DGCS >> 2] = dgcs;
+}
+
+static uint64_t gtw_read(void *opaque, hwaddr addr, unsigned size)
+{
+    struct hda_stream *s = opaque;
+
+    if (addr >= HDA_GTW_REGS * 4)
+        return 0;
+
+    if (addr == HDA_DGCS)
+        stream_status(s);
+
+    return s->io[addr >> 2];
+}
+
+static void gtw_write(void *opaque, hwaddr addr, uint64_t val,
+    unsigned size)
+{
+    struct hda_stream *s = opaque;
+    uint32_t old;
+
+    if (addr >= HDA_GTW_REGS * 4)
+        return;
+
+    log_text(s->hda->adsp->log, LOG_DMA, "hda: %s write 0x%x = 0x%x\n",
+        s->name, (uint32_t)addr, (uint32_t)val);
+
+    switch (addr) {
+    case HDA_DGCS:
+        old = s->io[HDA_DGCS >> 2];
+
+        /* BSC and BOR are write 1 to clear, BNE and BF are read only */
+        s->io[HDA_DGCS >> 2] = (val & ~(HDA_DGCS_BSC | HDA_DGCS_BOR |
+            HDA_DGCS_BF | HDA_DGCS_BNE)) |
+            (old & (HDA_DGCS_BSC | HDA_DGCS_BOR) & ~val);
+
+        if ((val & HDA_DGCS_GEN) && !(old & HDA_DGCS_GEN))
+            stream_start(s);
+        else if (!(val & HDA_DGCS_GEN) && (old & HDA_DGCS_GEN))
+            stream_stop(s);
+        break;
+    case HDA_DGBFPI:
+        stream_fw_move(s, val);
+        break;
+    case HDA_DGBS:
+        /* ring pointers and avail are bounded by the size it started with */
+        if (s->io[HDA_DGCS >> 2] & HDA_DGCS_GEN) {
+            fprintf(stderr, "error: hda: %s DGBS 0x%x written while running\n",
+                s->name, (uint32_t)val);
+            break;
+        }
+        s->io[HDA_DGBS >> 2] = val;
+        break;
+    case HDA_DGBRP:
+    case HDA_DGBWP:
+    case HDA_DGLLPI:
+    case HDA_DGLPIBI:
+        /* read only */
+        break;
+    default:
+        s->io[addr >> 2] = val;
+        break;
+    }
+
+    stream_status(s);
+}
+
+static const MemoryRegionOps gtw_ops = {
+    .read = gtw_read,
+    .write = gtw_write,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static int stream_post_load(void *opaque, int version_id)
+{
+    struct hda_stream *s = opaque;
+
+    /* timer is shared, rearm it for any stream still running */
+    if (stream_active(s))
+        hda_kick(s->hda);
+    return 0;
+}
+
+static const VMStateDescription vmstate_hda_stream = {
+    .name = "hda-stream",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = stream_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(io, struct hda_stream, HDA_GTW_REGS),
+        VMSTATE_UINT32(avail, struct hda_stream),
+        VMSTATE_UINT32(bdle, struct hda_stream),
+        VMSTATE_UINT32(bdle_off, struct hda_stream),
+        VMSTATE_UINT32(lpib, struct hda_stream),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+void adsp_hda_dma_stop(struct adsp_hda_dma *hda)
+{
+    struct hda_stream *s;
+    int i;
+
+    timer_del(hda->timer);
+
+    for (i = 0; i < hda->num_streams; i++) {
+        s = &hda->stream[i];
+        if (s->io[HDA_DGCS >> 2] & HDA_DGCS_GEN)
+            stream_stop(s);
+        s->io[HDA_DGCS >> 2] &= ~HDA_DGCS_GEN;
+    }
+}
+
+static void hda_reset(void *opaque)
+{
+    struct adsp_hda_dma *hda = opaque;
+    struct hda_stream *s;
+    int i;
+
+    adsp_hda_dma_stop(hda);
+
+    for (i = 0; i < hda->num_streams; i++) {
+        s = &hda->stream[i];
+        memset(s->io, 0, sizeof(s->io));
+        s->avail = 0;
+        s->bdle = 0;
+        s->bdle_off = 0;
+        s->lpib = 0;
+        s->cl_buf = NULL;
+    }
+}
+
+/*
+ * ROM code loader. Streams the image from the host out stream with tag
+ * into buf once the driver runs it, cb reports progress and the end of the
+ * download. Returns the image size, the CBL of the stream.
+ */
+int adsp_hda_dma_load(struct adsp_hda_dma *hda, int tag, void *buf,
+    uint32_t max, void (*cb)(void *opaque, uint32_t bytes, int err),
+    void *opaque)
+{
+    struct hda_stream *cl = NULL, *s;
+    uint32_t ctl;
+    int i, sd = -1;
+
+    for (i = 0; i < hda->num_streams; i++) {
+        s = &hda->stream[i];
+
+        if (s->desc->type == HDA_CODE_LDR) {
+            cl = s;
+        } else if (s->desc->type == HDA_HOST_OUT && s->sd >= 0 && sd < 0) {
+            ctl = sd_read(s, HDA_SD_CTL);
+            if ((ctl & HDA_SD_CTL_STRM_MASK) >> HDA_SD_CTL_STRM_SHIFT == tag)
+                sd = s->sd;
+        }
+    }
+
+    if (cl == NULL || sd < 0) {
+        fprintf(stderr, "error: hda: no code loader for stream tag %d\n",
+            tag);
+        return -ENODEV;
+    }
+
+    if (cl->cl_buf)
+        return -EBUSY;
+
+    cl->sd = sd;
+    cl->cl_size = sd_read(cl, HDA_SD_CBL);
+    if (cl->cl_size == 0 || cl->cl_size > max) {
+        fprintf(stderr, "error: hda: code loader image size 0x%x\n",
+            cl->cl_size);
+        return -EINVAL;
+    }
+
+    cl->cl_buf = buf;
+    cl->cl_pos = 0;
+    cl->cl_cb = cb;
+    cl->cl_opaque = opaque;
+    cl->bdle = 0;
+    cl->bdle_off = 0;
+    cl->lpib = 0;
+
+    log_text(hda->adsp->log, LOG_DMA, "hda: %s start sd %d size 0x%x\n",
+        cl->name, sd, cl->cl_size);
+
+    hda_kick(hda);
+    return cl->cl_size;
+}
+
+void adsp_hda_dma_init(struct adsp_dev *adsp, const char *name,
+    const struct hda_stream_desc *desc, int num_desc)
+{
+    const struct adsp_mem_desc *regs = &adsp->desc->hda;
+    struct adsp_hda_dma *hda;
+    struct hda_stream *s;
+    MemoryRegion *mr;
+    char shm_name[32];
+    void *ptr = NULL;
+    int i, j, err;
+
+    hda = g_malloc0(sizeof(*hda));
+    hda->adsp = adsp;
+
+    /* controller registers - shared via SHM with the x86 BAR */
+    sprintf(shm_name, "%s-hda", name);
+    err = qemu_io_register_shm(shm_name, ADSP_IO_SHM_HDA, regs->size, &ptr);
+    if (err < 0) {
+        fprintf(stderr, "error: cant alloc HDA SHM %d\n", err);
+        ptr = g_malloc0(regs->size);
+    }
+    hda->io = ptr;
+
+    for (i = 0; i < num_desc; i++)
+        hda->num_streams += desc[i].count;
+    hda->stream = g_new0(struct hda_stream, hda->num_streams);
+
+    s = hda->stream;
+    for (i = 0; i < num_desc; i++) {
+        for (j = 0; j < desc[i].count; j++, s++) {
+            s->hda = hda;
+            s->desc = &desc[i];
+            snprintf(s->name, sizeof(s->name), "%s%d", desc[i].name, j);
+
+            if (s->desc->type == HDA_CODE_LDR) {
+                s->sd = -1;
+            } else if (stream_is_host(s)) {
+                s->sd = desc[i].sd + j;
+                if (s->sd >= HDA_MAX_SD) {
+                    fprintf(stderr, "error: hda: %s has no SD\n", s->name);
+                    s->sd = -1;
+                }
+            }
+
+            /* gateways sit inside the common IO window */
+            mr = g_malloc(sizeof(*mr));
+            memory_region_init_io(mr, NULL, &gtw_ops, s, s->name,
+                desc[i].stride);
+            memory_region_add_subregion_overlap(adsp->system_memory,
+                desc[i].base + j * desc[i].stride, mr, 1);
+
+            vmstate_register(NULL, s - hda->stream, &vmstate_hda_stream, s);
+        }
+    }
+
+    hda->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, hda_schedule, hda);
+    qemu_register_reset(hda_reset, hda);
+    adsp->hda = hda;
+}
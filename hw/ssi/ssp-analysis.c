@@ -0,0 +1,414 @@
+/* Audio quality and latency analysis for SSP streams.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Every SSP stream is measured on the frames it moves, in the DMA burst
+ * context that moves them:
+ *
+ *  - xruns, the DMA position falling more than 10ms behind a frame clock
+ *    started with the stream on the virtual clock.
+ *  - glitches, a second difference above -12dBFS in the first slot.
+ *  - THD+N and SNR of the first slot, Goertzel at the analysis tone and
+ *    its harmonics over a block of whole tone periods.
+ *  - latency, a marker sample above -1dBFS in host DMA data is time
+ *    stamped and matched to the next marker leaving an SSP.
+ *
+ * Markers are expected to be sparse, e.g. the impulse capture source
+ * looped through the firmware, and both sides ignore a marker within 50ms
+ * of the last one. Results are read without locking, they are statistics.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/timer.h"
+#include "qemu/host-utils.h"
+#include "qemu/thread.h"
+#include "qapi-types.h"
+#include <math.h>
+
+#include "hw/adsp/hw.h"
+#include "hw/ssi/ssp.h"
+
+#define ANA_MARKER_LEVEL	0x7214a000	/* -1dBFS */
+#define ANA_GLITCH_LEVEL	0x20000000	/* -12dBFS */
+#define ANA_HOLDOFF_NS		50000000
+#define ANA_XRUN_NS		10000000
+#define ANA_BLOCK_FRAMES	8192
+#define ANA_HARMONICS		5
+#define ANA_MARKERS		16
+
+struct ssp_analysis {
+    bool active;
+    uint32_t rate;
+    uint32_t channels;
+    uint64_t frames;
+    uint32_t xruns;
+    uint32_t glitches;
+
+    /* frame clock */
+    int64_t start_ns;
+    uint64_t start_frames;
+
+    /* first slot history */
+    int32_t x1;
+    int32_t x2;
+    int64_t marker_ns;
+
+    /* Goertzel per harmonic, first is the tone */
+    uint32_t block;
+    uint32_t count;
+    double coeff[ANA_HARMONICS];
+    double s1[ANA_HARMONICS];
+    double s2[ANA_HARMONICS];
+    double sum;
+    double sum_sq;
+    bool measured;
+    double thd_n_db;
+    double snr_db;
+
+    /* latency */
+    uint32_t markers;
+    int64_t lat_last;
+    int64_t lat_min;
+    int64_t lat_max;
+    int64_t lat_sum;
+};
+
+static struct {
+    bool enabled;
+    uint32_t freq;
+
+    /* host marker times not matched yet */
+    QemuMutex lock;
+    int64_t marker[ANA_MARKERS];
+    uint32_t head;
+    uint32_t tail;
+    int64_t host_marker_ns;
+} ana;
+
+bool ssp_analysis_enabled(void)
+{
+    return ana.enabled;
+}
+
+void ssp_analysis_enable(uint32_t freq)
+{
+    qemu_mutex_init(&ana.lock);
+    ana.freq = freq;
+    ana.host_marker_ns = INT64_MIN / 2;
+    ana.enabled = true;
+}
+
+static void goertzel_init(struct ssp_analysis *a)
+{
+    uint32_t periods;
+    double f;
+    int h;
+
+    /* whole periods of the tone so the bins need no window */
+    periods = MAX(1, ANA_BLOCK_FRAMES * ana.freq / a->rate);
+    a->block = MAX(1, lround((double)periods * a->rate / ana.freq));
+    a->count = 0;
+    a->sum = 0;
+    a->sum_sq = 0;
+
+    for (h = 0; h < ANA_HARMONICS; h++) {
+        f = (double)ana.freq * (h + 1) / a->rate;
+        a->coeff[h] = f < 0.5 ? 2 * cos(2 * M_PI * f) : 0;
+        a->s1[h] = 0;
+        a->s2[h] = 0;
+    }
+}
+
+static void goertzel_done(struct ssp_analysis *a)
+{
+    double n = a->block, total, tone = 0, harm = 0, p;
+    int h;
+
+    /* mean square of a tone is 2P/N^2 of its Goertzel power */
+    for (h = 0; h < ANA_HARMONICS; h++) {
+        p = a->s1[h] * a->s1[h] + a->s2[h] * a->s2[h] -
+            a->coeff[h] * a->s1[h] * a->s2[h];
+        p = a->coeff[h] ? 2 * p / (n * n) : 0;
+        if (h == 0)
+            tone = p;
+        else
+            harm += p;
+    }
+
+    total = a->sum_sq / n - (a->sum / n) * (a->sum / n);
+
+    /* nothing at the tone, keep the last result */
+    if (tone > total * 1e-6 && tone > 0) {
+        a->thd_n_db = 10 * log10(MAX(total - tone, 1e-20) / tone);
+        a->snr_db = 10 * log10(tone / MAX(total - tone - harm, 1e-20));
+        a->measured = true;
+    }
+
+    goertzel_init(a);
+}
+
+static void goertzel_run(struct ssp_analysis *a, const int32_t *frames,
+    uint32_t nframes, uint32_t slots)
+{
+    uint32_t i, n;
+    double x, s0;
+    int h;
+
+    while (nframes) {
+        n = MIN(nframes, a->block - a->count);
+
+        for (i = 0; i < n; i++) {
+            x = frames[i * slots] * (1.0 / 2147483648.0);
+            a->sum += x;
+            a->sum_sq += x * x;
+            for (h = 0; h < ANA_HARMONICS; h++) {
+                s0 = x + a->coeff[h] * a->s1[h] - a->s2[h];
+                a->s2[h] = a->s1[h];
+                a->s1[h] = s0;
+            }
+        }
+
+        a->count += n;
+        if (a->count == a->block)
+            goertzel_done(a);
+
+        frames += n * slots;
+        nframes -= n;
+    }
+}
+
+static void latency_add(struct ssp_analysis *a, int64_t out_ns)
+{
+    int64_t in_ns, lat;
+    bool found = false;
+
+    qemu_mutex_lock(&ana.lock);
+    if (ana.tail != ana.head) {
+        in_ns = ana.marker[ana.tail++ % ANA_MARKERS];
+        found = true;
+    }
+    qemu_mutex_unlock(&ana.lock);
+
+    if (!found || out_ns < in_ns)
+        return;
+
+    lat = out_ns - in_ns;
+    if (a->markers == 0 || lat < a->lat_min)
+        a->lat_min = lat;
+    if (a->markers == 0 || lat > a->lat_max)
+        a->lat_max = lat;
+    a->lat_last = lat;
+    a->lat_sum += lat;
+    a->markers++;
+}
+
+/* glitches and markers on the first slot */
+static void edges_run(struct ssp_analysis *a, const int32_t *frames,
+    uint32_t nframes, uint32_t slots, int64_t now, bool playback)
+{
+    int64_t d2, t;
+    int32_t x;
+    uint32_t i;
+
+    for (i = 0; i < nframes; i++) {
+        x = frames[i * slots];
+
+        if (x >= ANA_MARKER_LEVEL || x <= -ANA_MARKER_LEVEL) {
+            t = now + muldiv64(i, NANOSECONDS_PER_SECOND, a->rate);
+            if (t - a->marker_ns >= ANA_HOLDOFF_NS) {
+                if (playback)
+                    latency_add(a, t);
+                a->marker_ns = t;
+            }
+        } else if (now - a->marker_ns >= ANA_HOLDOFF_NS) {
+            d2 = (int64_t)x - 2 * (int64_t)a->x1 + a->x2;
+            if (d2 > ANA_GLITCH_LEVEL || d2 < -ANA_GLITCH_LEVEL)
+                a->glitches++;
+        }
+
+        a->x2 = a->x1;
+        a->x1 = x;
+    }
+}
+
+static struct ssp_analysis *analysis_start(struct adsp_ssp *ssp,
+    bool playback, int64_t now)
+{
+    struct ssp_analysis **ap = playback ? &ssp->tx_ana : &ssp->rx_ana;
+    struct ssp_analysis *a = *ap;
+
+    if (a == NULL)
+        a = *ap = g_new0(struct ssp_analysis, 1);
+
+    a->rate = ssp->fmt.rate;
+    a->channels = ssp->fmt.slots;
+    a->start_ns = now;
+    a->start_frames = a->frames;
+    a->marker_ns = INT64_MIN / 2;
+    a->x1 = 0;
+    a->x2 = 0;
+    goertzel_init(a);
+    a->active = true;
+
+    return a;
+}
+
+/* whole TDM frames moved by a DMA burst, called from the burst context */
+void ssp_analysis_stream(struct adsp_ssp *ssp, bool playback,
+    const int32_t *frames, uint32_t nframes)
+{
+    struct ssp_analysis *a = playback ? ssp->tx_ana : ssp->rx_ana;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    uint64_t due;
+
+    if (a == NULL || !a->active)
+        a = analysis_start(ssp, playback, now);
+
+    /* bursts may run ahead of the frame clock, falling behind is an xrun */
+    due = muldiv64(now - a->start_ns, a->rate, NANOSECONDS_PER_SECOND);
+    if (due > a->frames - a->start_frames +
+        muldiv64(ANA_XRUN_NS, a->rate, NANOSECONDS_PER_SECOND)) {
+        a->xruns++;
+        a->start_ns = now;
+        a->start_frames = a->frames;
+    }
+
+    edges_run(a, frames, nframes, a->channels, now, playback);
+    goertzel_run(a, frames, nframes, a->channels);
+    a->frames += nframes;
+}
+
+void ssp_analysis_stop(struct adsp_ssp *ssp, bool playback)
+{
+    struct ssp_analysis *a = playback ? ssp->tx_ana : ssp->rx_ana;
+
+    if (a)
+        a->active = false;
+}
+
+/* host DMA data written to the DSP, samples are width bytes */
+void ssp_analysis_host_write(const void *data, uint32_t bytes,
+    uint32_t width)
+{
+    const int16_t *s16 = data;
+    const int32_t *s32 = data;
+    uint32_t i, n = bytes / width;
+    int64_t now;
+    int32_t x;
+
+    for (i = 0; i < n; i++) {
+        x = width == 2 ? (int32_t)s16[i] << 16 : s32[i];
+        if (x < ANA_MARKER_LEVEL && x > -ANA_MARKER_LEVEL)
+            continue;
+
+        now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        qemu_mutex_lock(&ana.lock);
+        if (now - ana.host_marker_ns >= ANA_HOLDOFF_NS) {
+            /* oldest unmatched marker is lost on overflow */
+            if (ana.head - ana.tail == ANA_MARKERS)
+                ana.tail++;
+            ana.marker[ana.head++ % ANA_MARKERS] = now;
+            ana.host_marker_ns = now;
+        }
+        qemu_mutex_unlock(&ana.lock);
+        return;
+    }
+}
+
+static AdspAudioStream *stream_info(struct adsp_ssp *ssp,
+    struct ssp_analysis *a, bool playback)
+{
+    AdspAudioStream *s = g_new0(AdspAudioStream, 1);
+
+    s->name = g_strdup(ssp->name);
+    s->playback = playback;
+    s->rate = a->rate;
+    s->channels = a->channels;
+    s->frames = a->frames;
+    s->xruns = a->xruns;
+    s->glitches = a->glitches;
+    s->has_thd_n_db = s->has_snr_db = a->measured;
+    s->thd_n_db = a->thd_n_db;
+    s->snr_db = a->snr_db;
+    s->markers = a->markers;
+    if (a->markers) {
+        s->has_latency_ns = s->has_latency_min_ns = true;
+        s->has_latency_max_ns = s->has_latency_avg_ns = true;
+        s->latency_ns = a->lat_last;
+        s->latency_min_ns = a->lat_min;
+        s->latency_max_ns = a->lat_max;
+        s->latency_avg_ns = a->lat_sum / a->markers;
+    }
+
+    return s;
+}
+
+static void stream_reset(struct ssp_analysis *a)
+{
+    a->frames = 0;
+    a->start_frames = 0;
+    a->start_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    a->xruns = 0;
+    a->glitches = 0;
+    a->measured = false;
+    a->markers = 0;
+    a->lat_sum = 0;
+}
+
+AdspAudioAnalysis *ssp_analysis_query(bool reset)
+{
+    AdspAudioAnalysis *info = g_new0(AdspAudioAnalysis, 1);
+    AdspAudioStreamList *entry;
+    struct ssp_analysis *a;
+    struct adsp_ssp *ssp;
+    int i, dir;
+
+    info->freq = ana.freq;
+
+    /* list is built backwards, ports in order with playback first */
+    for (i = ADSP_MAX_SSP - 1; i >= 0; i--) {
+        ssp = ssp_get_port(i);
+        if (ssp == NULL)
+            continue;
+
+        for (dir = 0; dir < 2; dir++) {
+            a = dir ? ssp->tx_ana : ssp->rx_ana;
+            if (a == NULL)
+                continue;
+
+            entry = g_new0(AdspAudioStreamList, 1);
+            entry->value = stream_info(ssp, a, dir);
+            entry->next = info->streams;
+            info->streams = entry;
+
+            if (reset)
+                stream_reset(a);
+        }
+    }
+
+    if (reset) {
+        qemu_mutex_lock(&ana.lock);
+        ana.tail = ana.head;
+        qemu_mutex_unlock(&ana.lock);
+    }
+
+    return info;
+}
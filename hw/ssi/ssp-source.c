@@ -0,0 +1,436 @@
+/* Capture sources for SSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Capture data is generated a block of whole TDM frames at a time with
+ * samples left justified in 32 bits, the SSP then keeps the slots enabled
+ * in SSRSA. Sources are picked per port with -machine ssp-capture=<src> or
+ * ssp-capture=<port>=<src>;... where <src> is one of
+ *
+ *   silence
+ *   sine[:<hz>]       -6dB tone on every slot, default 1kHz
+ *   impulse[:<ms>]    one full scale sample every period, default 100ms
+ *   noise             white noise, independent per slot
+ *   wav:<file>        RIFF file looped, channels wrap onto slots
+ *   loopback          frames sent by the playback side of the same port
+ *
+ * SSCR1.LBM selects loopback whatever the source is.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/cutils.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include <math.h>
+
+#include "hw/adsp/hw.h"
+#include "hw/ssi/ssp.h"
+
+#define SSP_SINE_BITS		10
+#define SSP_SINE_SIZE		(1 << SSP_SINE_BITS)
+#define SSP_SINE_FREQ		1000
+#define SSP_IMPULSE_MS		100
+
+/* -6dB full scale */
+#define SSP_SRC_PEAK		0x40000000
+
+static int32_t sine_table[SSP_SINE_SIZE];
+
+static const char * const source_names[] = {
+    [SSP_SRC_SILENCE] = "silence",
+    [SSP_SRC_SINE] = "sine",
+    [SSP_SRC_IMPULSE] = "impulse",
+    [SSP_SRC_NOISE] = "noise",
+    [SSP_SRC_WAV] = "wav",
+    [SSP_SRC_LOOPBACK] = "loopback",
+};
+
+static void sine_init(void)
+{
+    int i;
+
+    if (sine_table[SSP_SINE_SIZE / 4])
+        return;
+
+    for (i = 0; i < SSP_SINE_SIZE; i++)
+        sine_table[i] = SSP_SRC_PEAK * sin(2 * M_PI * i / SSP_SINE_SIZE);
+}
+
+/* same value on every slot of a frame */
+static void frames_fill(int32_t *frames, const int32_t *mono,
+    uint32_t nframes, uint32_t slots)
+{
+    uint32_t i, s;
+
+    for (i = 0; i < nframes; i++) {
+        for (s = 0; s < slots; s++)
+            frames[i * slots + s] = mono[i];
+    }
+}
+
+static void sine_read(struct ssp_source *src, int32_t *frames,
+    uint32_t nframes, uint32_t slots)
+{
+    int32_t mono[SSP_BLOCK_FRAMES];
+    uint32_t phase = src->phase;
+    uint32_t i;
+
+    for (i = 0; i < nframes; i++) {
+        mono[i] = sine_table[phase >> (32 - SSP_SINE_BITS)];
+        phase += src->step;
+    }
+    src->phase = phase;
+
+    frames_fill(frames, mono, nframes, slots);
+}
+
+static void impulse_read(struct ssp_source *src, int32_t *frames,
+    uint32_t nframes, uint32_t slots)
+{
+    uint32_t i = src->count, s;
+
+    memset(frames, 0, nframes * slots * sizeof(*frames));
+
+    /* count is frames to the next impulse */
+    for (; i < nframes; i += src->period) {
+        for (s = 0; s < slots; s++)
+            frames[i * slots + s] = INT32_MAX;
+    }
+    src->count = i - nframes;
+}
+
+/* four independent xorshift32 lanes so the loop vectorises */
+static void noise_read(struct ssp_source *src, int32_t *frames,
+    uint32_t nframes, uint32_t slots)
+{
+    uint32_t samples = nframes * slots;
+    uint32_t x[4], i, l;
+
+    for (l = 0; l < 4; l++)
+        x[l] = src->seed[l];
+
+    for (i = 0; i < samples; i += 4) {
+        for (l = 0; l < 4; l++) {
+            x[l] ^= x[l] << 13;
+            x[l] ^= x[l] >> 17;
+            x[l] ^= x[l] << 5;
+        }
+        for (l = 0; l < 4 && i + l < samples; l++)
+            frames[i + l] = (int32_t)x[l] >> 1;
+    }
+
+    for (l = 0; l < 4; l++)
+        src->seed[l] = x[l];
+}
+
+static void wav_close(struct ssp_source *src)
+{
+    if (src->fd > 0) {
+        close(src->fd);
+        src->fd = 0;
+    }
+}
+
+static int wav_open(struct adsp_ssp *ssp)
+{
+    struct ssp_source *src = &ssp->src;
+    uint8_t hdr[16];
+    uint32_t size;
+
+    src->fd = open(src->file_name, O_RDONLY);
+    if (src->fd < 0) {
+        fprintf(stderr, "cant open file %s %d\n", src->file_name, -errno);
+        src->fd = 0;
+        return -errno;
+    }
+
+    if (read(src->fd, hdr, 12) != 12 || memcmp(hdr, "RIFF", 4) ||
+        memcmp(hdr + 8, "WAVE", 4))
+        goto err;
+
+    src->file_channels = 0;
+
+    /* walk chunks to the data, fmt must come first */
+    while (read(src->fd, hdr, 8) == 8) {
+        size = ldl_le_p(hdr + 4);
+
+        if (!memcmp(hdr, "data", 4)) {
+            if (src->file_channels == 0)
+                goto err;
+            src->data_start = lseek(src->fd, 0, SEEK_CUR);
+            printf("%s opened %s for capture %u ch %u bits\n", ssp->name,
+                src->file_name, src->file_channels, src->file_bytes * 8);
+            return 0;
+        }
+
+        if (!memcmp(hdr, "fmt ", 4)) {
+            if (size < 16 || read(src->fd, hdr, 16) != 16)
+                goto err;
+            src->file_channels = lduw_le_p(hdr + 2);
+            src->file_bytes = lduw_le_p(hdr + 14) / 8;
+            size -= 16;
+
+            if (src->file_channels == 0 ||
+                src->file_channels > SSP_MAX_SLOTS ||
+                src->file_bytes < 2 || src->file_bytes > 4)
+                goto err;
+        }
+
+        /* chunks are word aligned */
+        if (lseek(src->fd, size + (size & 1), SEEK_CUR) < 0)
+            goto err;
+    }
+
+err:
+    fprintf(stderr, "error: %s: %s is not a supported WAV file\n",
+        ssp->name, src->file_name);
+    wav_close(src);
+    return -EINVAL;
+}
+
+static void wav_read(struct ssp_source *src, int32_t *frames,
+    uint32_t nframes, uint32_t slots)
+{
+    uint8_t raw[SSP_BLOCK_FRAMES * SSP_MAX_SLOTS * 4];
+    uint32_t frame_bytes = src->file_channels * src->file_bytes;
+    uint32_t want = nframes * frame_bytes, got = 0;
+    bool rewound = false;
+    const uint8_t *p;
+    uint32_t i, s;
+    ssize_t ret;
+
+    /* loop the file, give up on an empty data chunk */
+    while (got < want) {
+        ret = read(src->fd, raw + got, want - got);
+        if (ret > 0) {
+            got += ret;
+            rewound = false;
+            continue;
+        }
+
+        if (ret < 0 || rewound ||
+            lseek(src->fd, src->data_start, SEEK_SET) < 0) {
+            memset(raw + got, 0, want - got);
+            break;
+        }
+        rewound = true;
+    }
+
+    for (i = 0; i < nframes; i++) {
+        for (s = 0; s < slots; s++) {
+            p = raw + i * frame_bytes +
+                (s % src->file_channels) * src->file_bytes;
+
+            switch (src->file_bytes) {
+            case 2:
+                frames[i * slots + s] = (int32_t)lduw_le_p(p) << 16;
+                break;
+            case 3:
+                frames[i * slots + s] =
+                    (p[0] << 8) | (p[1] << 16) | (p[2] << 24);
+                break;
+            default:
+                frames[i * slots + s] = ldl_le_p(p);
+                break;
+            }
+        }
+    }
+}
+
+static void loopback_read(struct ssp_source *src, int32_t *frames,
+    uint32_t nframes, uint32_t slots)
+{
+    uint32_t rd = src->ring_rd;
+    uint32_t wr = atomic_mb_read(&src->ring_wr);
+    uint32_t i;
+
+    for (i = 0; i < nframes && rd != wr; i++, rd++)
+        memcpy(&frames[i * slots],
+            &src->ring[(rd % SSP_RING_FRAMES) * SSP_MAX_SLOTS],
+            slots * sizeof(*frames));
+
+    atomic_mb_set(&src->ring_rd, rd);
+
+    /* playback underrun */
+    if (i < nframes)
+        memset(&frames[i * slots], 0, (nframes - i) * slots * sizeof(*frames));
+}
+
+/* playback side of the port, frames are dropped when capture is behind */
+void ssp_source_loopback(struct adsp_ssp *ssp, const int32_t *frames,
+    uint32_t nframes)
+{
+    struct ssp_source *src = &ssp->src;
+    uint32_t slots = ssp->fmt.slots;
+    uint32_t rd = atomic_mb_read(&src->ring_rd);
+    uint32_t wr = src->ring_wr;
+    uint32_t i;
+
+    for (i = 0; i < nframes && wr - rd < SSP_RING_FRAMES; i++, wr++)
+        memcpy(&src->ring[(wr % SSP_RING_FRAMES) * SSP_MAX_SLOTS],
+            &frames[i * slots], slots * sizeof(*frames));
+
+    atomic_mb_set(&src->ring_wr, wr);
+}
+
+/* fill nframes whole TDM frames, nframes <= SSP_BLOCK_FRAMES */
+void ssp_source_read(struct adsp_ssp *ssp, int32_t *frames,
+    uint32_t nframes)
+{
+    struct ssp_source *src = &ssp->src;
+    uint32_t slots = ssp->fmt.slots;
+
+    if (ssp->io[SSCR1 >> 2] & SSCR1_LBM) {
+        loopback_read(src, frames, nframes, slots);
+        return;
+    }
+
+    switch (src->type) {
+    case SSP_SRC_SINE:
+        sine_read(src, frames, nframes, slots);
+        break;
+    case SSP_SRC_IMPULSE:
+        impulse_read(src, frames, nframes, slots);
+        break;
+    case SSP_SRC_NOISE:
+        noise_read(src, frames, nframes, slots);
+        break;
+    case SSP_SRC_WAV:
+        if (src->fd > 0) {
+            wav_read(src, frames, nframes, slots);
+            break;
+        }
+        memset(frames, 0, nframes * slots * sizeof(*frames));
+        break;
+    case SSP_SRC_LOOPBACK:
+        loopback_read(src, frames, nframes, slots);
+        break;
+    default:
+        memset(frames, 0, nframes * slots * sizeof(*frames));
+        break;
+    }
+}
+
+/* capture enabled in SSCR1, rate and slots are known now */
+void ssp_source_start(struct adsp_ssp *ssp)
+{
+    struct ssp_source *src = &ssp->src;
+    uint32_t rate = ssp->fmt.rate;
+
+    src->phase = 0;
+    src->step = ((uint64_t)src->freq << 32) / rate;
+    src->period = MAX((uint64_t)src->freq * rate / 1000, 1);
+    src->count = 0;
+    src->seed[0] = 0x12345678;
+    src->seed[1] = 0x9abcdef1;
+    src->seed[2] = 0x2468ace0;
+    src->seed[3] = 0x13579bdf;
+
+    /* capture starts with what is played from now on */
+    atomic_mb_set(&src->ring_rd, atomic_mb_read(&src->ring_wr));
+
+    if (src->type == SSP_SRC_WAV)
+        wav_open(ssp);
+    else
+        printf("%s capture from %s at %u Hz %u slots\n", ssp->name,
+            source_names[src->type], rate, ssp->fmt.slots);
+}
+
+void ssp_source_stop(struct adsp_ssp *ssp)
+{
+    wav_close(&ssp->src);
+}
+
+static int source_parse(struct ssp_source *src, const char *str)
+{
+    const char *arg = strchr(str, ':');
+    size_t len = arg ? arg - str : strlen(str);
+    uint64_t val;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(source_names); i++) {
+        if (strlen(source_names[i]) == len &&
+            !strncmp(source_names[i], str, len))
+            break;
+    }
+
+    if (i == ARRAY_SIZE(source_names))
+        return -EINVAL;
+
+    src->type = i;
+    src->freq = i == SSP_SRC_IMPULSE ? SSP_IMPULSE_MS : SSP_SINE_FREQ;
+
+    if (arg == NULL)
+        return i == SSP_SRC_WAV ? -EINVAL : 0;
+
+    arg++;
+    if (i == SSP_SRC_WAV) {
+        pstrcpy(src->file_name, sizeof(src->file_name), arg);
+        return 0;
+    }
+
+    if (qemu_strtou64(arg, NULL, 0, &val) < 0 || val == 0 ||
+        val > UINT32_MAX)
+        return -EINVAL;
+
+    src->freq = val;
+    return 0;
+}
+
+/* "<src>" for every port or "<port>=<src>;...", ':' is taken by <src> */
+void ssp_source_init(struct adsp_ssp *ssp, int port, const char *opt)
+{
+    struct ssp_source *src = &ssp->src;
+    char **opts, **o, *val;
+    uint64_t p;
+
+    src->type = SSP_SRC_SILENCE;
+    src->fd = 0;
+    src->ring = g_new0(int32_t, SSP_RING_FRAMES * SSP_MAX_SLOTS);
+    src->ring_rd = 0;
+    src->ring_wr = 0;
+    sine_init();
+
+    if (opt == NULL)
+        return;
+
+    opts = g_strsplit(opt, ";", 0);
+    for (o = opts; *o != NULL; o++) {
+
+        val = strchr(*o, '=');
+        if (val) {
+            *val++ = 0;
+            if (qemu_strtou64(*o, NULL, 0, &p) < 0) {
+                fprintf(stderr, "error: ssp: invalid port %s\n", *o);
+                continue;
+            }
+            if (p != port)
+                continue;
+        }
+
+        if (source_parse(src, val ? val : *o) < 0) {
+            fprintf(stderr, "error: ssp: invalid capture source %s\n",
+                val ? val : *o);
+            src->type = SSP_SRC_SILENCE;
+        }
+    }
+    g_strfreev(opts);
+}
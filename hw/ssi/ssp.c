@@ -24,10 +24,15 @@
 #include "sysemu/sysemu.h"
 #include "hw/boards.h"
 #include "hw/loader.h"
+#include "qemu/host-utils.h"
+#include "qemu/option.h"
+#include "qemu/timer.h"
+#include "migration/vmstate.h"
 
 #include "qemu/io-bridge.h"
 #include "hw/adsp/shim.h"
 #include "hw/adsp/log.h"
+#include "hw/audio/adsp-sink.h"
 #include "hw/ssi/ssp.h"
 
 static struct adsp_ssp *ssp_port[ADSP_MAX_SSP];
@@ -37,12 +42,246 @@ const struct adsp_reg_desc adsp_ssp_map[ADSP_SSP_REGS] = {
         .offset = 0x00000000, .size = 0x4000},
 };
 
+/*
+ * Network mode frames carry FRDC + 1 slots and the DMA stream only the
+ * slots enabled in SSTSA/SSRSA. Other modes carry a single word per frame
+ * so the stream goes through unchanged.
+ */
+static uint32_t ssp_slot_mask(uint32_t sxsa, uint32_t slots, bool network)
+{
+    uint32_t all = (1 << slots) - 1;
+
+    if (!network || (sxsa & all) == 0)
+        return all;
+    return sxsa & all;
+}
+
+static void ssp_update_format(struct adsp_ssp *ssp)
+{
+    struct ssp_format *fmt = &ssp->fmt;
+    uint32_t sscr0 = ssp->io[SSCR0 >> 2];
+    uint32_t sspsp = ssp->io[SSPSP >> 2];
+    bool network = sscr0 & SSCR0_MOD;
+    uint32_t frame_bits, div;
+
+    fmt->sample_bits = (sscr0 & SSCR0_DSS_MASK) + 1;
+    if (sscr0 & SSCR0_EDSS)
+        fmt->sample_bits += 16;
+    fmt->sample_bytes = fmt->sample_bits > 16 ? 4 : 2;
+
+    fmt->slots = network ?
+        ((sscr0 & SSCR0_FRDC) >> SSCR0_FRDC_SHIFT) + 1 : 1;
+    fmt->tx_mask = ssp_slot_mask(ssp->io[SSTSA >> 2] & SSTSA_TTSA_MASK,
+        fmt->slots, network);
+    fmt->rx_mask = ssp_slot_mask(ssp->io[SSRSA >> 2] & SSRSA_RTSA_MASK,
+        fmt->slots, network);
+    fmt->tx_channels = ctpop32(fmt->tx_mask);
+    fmt->rx_channels = ctpop32(fmt->rx_mask);
+
+    /* only the internal clock is known, frame has dummy start/stop bits */
+    frame_bits = fmt->slots * fmt->sample_bits +
+        ((sspsp >> 7) & 0x3) + ((sspsp >> 23) & 0x3);
+    div = ((sscr0 >> 8) & 0xfff) + 1;
+    fmt->rate = SSP_CLK_KHZ * 1000 / div / frame_bits;
+    if ((sscr0 & SSCR0_ECS) || fmt->rate < 8000 || fmt->rate > 384000)
+        fmt->rate = SSP_DEFAULT_RATE;
+}
+
 static void ssp_reset(void *opaque)
 {
     struct adsp_ssp *ssp = opaque;
     const struct adsp_reg_space *ssp_dev = ssp->ssp_dev;
 
     memset(ssp->io, 0, ssp_dev->desc.size);
+    ssp_update_format(ssp);
+}
+
+/* 16 bit slots use S16, wider slots are LSB justified in 32 bits */
+static inline uint32_t ssp_shift(const struct ssp_format *fmt)
+{
+    return fmt->sample_bytes == 2 ? 16 : 32 - fmt->sample_bits;
+}
+
+static uint32_t ssp_slot_map(const struct ssp_format *fmt, uint32_t mask,
+    uint32_t *map)
+{
+    uint32_t s, ch = 0;
+
+    for (s = 0; s < fmt->slots; s++) {
+        if (mask & (1 << s))
+            map[ch++] = s;
+    }
+    return ch;
+}
+
+/* DMA stream of active slots into whole frames, idle slots are silent */
+static void ssp_unpack(const struct ssp_format *fmt, uint32_t mask,
+    int32_t *frames, const void *buf, uint32_t nframes)
+{
+    const int16_t *s16 = buf;
+    const int32_t *s32 = buf;
+    uint32_t map[SSP_MAX_SLOTS], shift = ssp_shift(fmt);
+    uint32_t slots = fmt->slots, ch, i, c;
+
+    ch = ssp_slot_map(fmt, mask, map);
+    if (ch != slots)
+        memset(frames, 0, nframes * slots * sizeof(*frames));
+
+    if (fmt->sample_bytes == 2) {
+        for (i = 0; i < nframes; i++) {
+            for (c = 0; c < ch; c++)
+                frames[i * slots + map[c]] = (int32_t)s16[i * ch + c] << 16;
+        }
+    } else {
+        for (i = 0; i < nframes; i++) {
+            for (c = 0; c < ch; c++)
+                frames[i * slots + map[c]] = s32[i * ch + c] << shift;
+        }
+    }
+}
+
+/* whole frames into a DMA stream of the active slots */
+static void ssp_pack(const struct ssp_format *fmt, uint32_t mask,
+    void *buf, const int32_t *frames, uint32_t nframes)
+{
+    int16_t *d16 = buf;
+    int32_t *d32 = buf;
+    uint32_t map[SSP_MAX_SLOTS], shift = ssp_shift(fmt);
+    uint32_t slots = fmt->slots, ch, i, c;
+
+    ch = ssp_slot_map(fmt, mask, map);
+
+    if (fmt->sample_bytes == 2) {
+        for (i = 0; i < nframes; i++) {
+            for (c = 0; c < ch; c++)
+                d16[i * ch + c] = frames[i * slots + map[c]] >> 16;
+        }
+    } else {
+        for (i = 0; i < nframes; i++) {
+            for (c = 0; c < ch; c++)
+                d32[i * ch + c] = frames[i * slots + map[c]] >> shift;
+        }
+    }
+}
+
+/*
+ * While the port is enabled the TX FIFO drains and the RX FIFO fills at the
+ * frame rate. Whole frames only, the remainder is kept for the next call.
+ * Called with the port lock held.
+ */
+static void ssp_fifo_update(struct adsp_ssp *ssp)
+{
+    const struct ssp_format *fmt = &ssp->fmt;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    uint64_t frames;
+
+    if (!(ssp->io[SSCR0 >> 2] & SSCR0_SSE)) {
+        ssp->fifo_ns = now;
+        return;
+    }
+
+    frames = muldiv64(now - ssp->fifo_ns, fmt->rate, NANOSECONDS_PER_SECOND);
+    if (frames == 0)
+        return;
+    ssp->fifo_ns += muldiv64(frames, NANOSECONDS_PER_SECOND, fmt->rate);
+
+    frames = MIN(frames, ssp->fifo_depth);
+    ssp->tx.level -= MIN(ssp->tx.level, frames * fmt->tx_channels);
+    ssp->rx.level = MIN(ssp->fifo_depth,
+        ssp->rx.level + frames * fmt->rx_channels);
+}
+
+/*
+ * DMA has read a burst for the port. The dump file gets whole TDM frames,
+ * wide slots left justified as WAV wants them. Bursts are whole frames as
+ * DMA blocks are whole periods, any partial frame at the end is dropped.
+ */
+static void ssp_playback(struct adsp_ssp *ssp, const void *buf,
+    uint32_t bytes)
+{
+    const struct ssp_format *fmt = &ssp->fmt;
+    int32_t frames[SSP_BLOCK_FRAMES * SSP_MAX_SLOTS];
+    int16_t out[SSP_BLOCK_FRAMES * SSP_MAX_SLOTS];
+    uint32_t frame_bytes = fmt->tx_channels * fmt->sample_bytes;
+    uint32_t nframes = bytes / frame_bytes, n, all;
+    const uint8_t *src = buf;
+    bool loopback;
+
+    loopback = (ssp->io[SSCR1 >> 2] & SSCR1_LBM) ||
+        ssp->src.type == SSP_SRC_LOOPBACK;
+    all = (1 << fmt->slots) - 1;
+
+    /* stream is already whole frames in the file format */
+    if (fmt->tx_mask == all && !loopback && ssp_shift(fmt) % 16 == 0 &&
+        !ssp_analysis_enabled()) {
+        adsp_sink_write(ssp->tx.sink, buf, nframes * frame_bytes);
+        ssp->tx.total_frames += nframes;
+        return;
+    }
+
+    while (nframes) {
+        n = MIN(nframes, SSP_BLOCK_FRAMES);
+        ssp_unpack(fmt, fmt->tx_mask, frames, src, n);
+
+        if (loopback)
+            ssp_source_loopback(ssp, frames, n);
+        if (ssp_analysis_enabled())
+            ssp_analysis_stream(ssp, true, frames, n);
+
+        if (fmt->sample_bytes == 2) {
+            ssp_pack(fmt, all, out, frames, n);
+            adsp_sink_write(ssp->tx.sink, out, n * fmt->slots * 2);
+        } else
+            adsp_sink_write(ssp->tx.sink, frames, n * fmt->slots * 4);
+
+        ssp->tx.total_frames += n;
+        src += n * frame_bytes;
+        nframes -= n;
+    }
+}
+
+void adsp_ssp_playback(struct adsp_ssp *ssp, const void *buf, uint32_t bytes)
+{
+    qemu_mutex_lock(&ssp->lock);
+    ssp_playback(ssp, buf, bytes);
+
+    /* DMA tops the TX FIFO up with the burst */
+    ssp_fifo_update(ssp);
+    ssp->tx.level = MIN(ssp->fifo_depth,
+        ssp->tx.level + bytes / ssp->fmt.sample_bytes);
+    qemu_mutex_unlock(&ssp->lock);
+}
+
+/* DMA wants a burst from the port, made from the capture source */
+void adsp_ssp_capture(struct adsp_ssp *ssp, void *buf, uint32_t bytes)
+{
+    const struct ssp_format *fmt = &ssp->fmt;
+    int32_t frames[SSP_BLOCK_FRAMES * SSP_MAX_SLOTS];
+    uint32_t frame_bytes = fmt->rx_channels * fmt->sample_bytes;
+    uint32_t nframes = bytes / frame_bytes, n;
+    uint8_t *dest = buf;
+
+    qemu_mutex_lock(&ssp->lock);
+
+    /* DMA empties the RX FIFO into the burst */
+    ssp_fifo_update(ssp);
+    ssp->rx.level -= MIN(ssp->rx.level, bytes / fmt->sample_bytes);
+
+    while (nframes) {
+        n = MIN(nframes, SSP_BLOCK_FRAMES);
+        ssp_source_read(ssp, frames, n);
+        if (ssp_analysis_enabled())
+            ssp_analysis_stream(ssp, false, frames, n);
+        ssp_pack(fmt, fmt->rx_mask, dest, frames, n);
+
+        ssp->rx.total_frames += n;
+        dest += n * frame_bytes;
+        nframes -= n;
+    }
+    qemu_mutex_unlock(&ssp->lock);
+
+    /* partial frame */
+    memset(dest, 0, (uint8_t *)buf + bytes - dest);
 }
 
 static uint64_t ssp_read(void *opaque, hwaddr addr,
@@ -50,6 +289,32 @@ static uint64_t ssp_read(void *opaque, hwaddr addr,
 {
     struct adsp_ssp *ssp = opaque;
     const struct adsp_reg_space *ssp_dev = ssp->ssp_dev;
+    uint32_t sssr;
+
+    switch (addr) {
+    case SSSR:
+        /* FIFO status from the modelled levels */
+        qemu_mutex_lock(&ssp->lock);
+        ssp_fifo_update(ssp);
+        sssr = ssp->io[addr >> 2] & ~(SSSR_TNF | SSSR_RNE);
+        if (ssp->tx.level < ssp->fifo_depth)
+            sssr |= SSSR_TNF;
+        if (ssp->rx.level > 0)
+            sssr |= SSSR_RNE;
+        ssp->io[addr >> 2] = sssr;
+        qemu_mutex_unlock(&ssp->lock);
+        break;
+    case SSDR:
+        /* PIO read pops the RX FIFO */
+        qemu_mutex_lock(&ssp->lock);
+        ssp_fifo_update(ssp);
+        if (ssp->rx.level > 0)
+            ssp->rx.level--;
+        qemu_mutex_unlock(&ssp->lock);
+        break;
+    default:
+        break;
+    }
 
     /* only print IO from guest */
     log_read(ssp->log, ssp_dev, addr, size,
@@ -75,71 +340,73 @@ static void ssp_write(void *opaque, hwaddr addr,
 
         ssp->io[addr >> 2] = val;
 
-        /* open file if playback has been enabled */
+        /* open dump file if playback has been enabled */
         if (set & SSCR1_TSRE) {
-
-            /* create filename */
-            sprintf(ssp->tx.file_name, "/tmp/%s-play%d.wav",
-                ssp->name, ssp->tx.index++);
-
-            unlink(ssp->tx.file_name);
-            ssp->tx.fd = open(ssp->tx.file_name, O_WRONLY | O_CREAT,
-                S_IRUSR | S_IWUSR | S_IXUSR);
-
-            if (ssp->tx.fd < 0) {
-                fprintf(stderr, "cant open file %s %d\n",
-                    ssp->tx.file_name, -errno);
-                return;
-            } else
-                printf("%s opened %s for playback\n",
-                    ssp->name, ssp->tx.file_name);
-
+            struct adsp_sink_pcm pcm = {
+                .rate = ssp->fmt.rate,
+                .channels = ssp->fmt.slots,
+                .bits = ssp->fmt.sample_bytes * 8,
+            };
+
+            qemu_mutex_lock(&ssp->lock);
+            ssp->tx.sink = adsp_sink_open(ssp->name, ssp->tx.index++, &pcm);
             ssp->tx.total_frames = 0;
+            qemu_mutex_unlock(&ssp->lock);
         }
 
-        /* close file if playback has finished */
+        /* close dump file if playback has finished */
         if (clear & SSCR1_TSRE) {
-            printf("%s closed %s for playback at %d frames\n",
-                ssp->name,
-                ssp->tx.file_name, ssp->tx.total_frames);
-            close(ssp->tx.fd);
-            ssp->tx.fd = 0;
+            printf("%s stopped playback at %d frames\n", ssp->name,
+                ssp->tx.total_frames);
+            qemu_mutex_lock(&ssp->lock);
+            adsp_sink_close(ssp->tx.sink);
+            ssp->tx.sink = NULL;
+            qemu_mutex_unlock(&ssp->lock);
+            ssp_analysis_stop(ssp, true);
         }
 
-        /* open file if capture has been enabled */
+        /* start the capture source if capture has been enabled */
         if (set & SSCR1_RSRE) {
-
-            /* create filename */
-            sprintf(ssp->rx.file_name, "/tmp/%s-capture.wav",
-                ssp->name);
-
-            ssp->rx.fd = open(ssp->tx.file_name, O_RDONLY,
-                S_IRUSR | S_IWUSR | S_IXUSR);
-
-            if (ssp->rx.fd < 0) {
-                fprintf(stderr, "cant open file %s %d\n",
-                    ssp->rx.file_name, -errno);
-                return;
-            } else
-                printf("%s opened %s for capture\n",
-                    ssp->name, ssp->rx.file_name);
-
+            qemu_mutex_lock(&ssp->lock);
+            ssp_source_start(ssp);
             ssp->rx.total_frames = 0;
+            qemu_mutex_unlock(&ssp->lock);
         }
 
-        /* close file if capture has finished */
+        /* stop the capture source if capture has finished */
         if (clear & SSCR1_RSRE) {
-            printf("%s closed %s for capture at %d frames\n", ssp->name,
-                ssp->rx.file_name, ssp->rx.total_frames);
-            close(ssp->rx.fd);
-            ssp->rx.fd = 0;
+            printf("%s stopped capture at %d frames\n", ssp->name,
+                ssp->rx.total_frames);
+            qemu_mutex_lock(&ssp->lock);
+            ssp_source_stop(ssp);
+            qemu_mutex_unlock(&ssp->lock);
+            ssp_analysis_stop(ssp, false);
         }
         break;
     case SSDR:
-        /* update counters */
-        ssp->tx.total_frames =+ size;
+        /* update counters, PIO write pushes the TX FIFO */
+        qemu_mutex_lock(&ssp->lock);
+        ssp_fifo_update(ssp);
+        if (ssp->tx.level < ssp->fifo_depth)
+            ssp->tx.data[ssp->tx.level++] = val;
+        ssp->tx.total_frames += size;
         ssp->io[addr >> 2] = val;
+        qemu_mutex_unlock(&ssp->lock);
+
+        break;
+    case SSCR0:
+    case SSPSP:
+    case SSTSA:
+    case SSRSA:
+        log_write(ssp->log, ssp_dev, addr, val, size,
+                ssp->io[addr >> 2]);
 
+        /* levels move at the old rate up to now */
+        qemu_mutex_lock(&ssp->lock);
+        ssp_fifo_update(ssp);
+        ssp->io[addr >> 2] = val;
+        ssp_update_format(ssp);
+        qemu_mutex_unlock(&ssp->lock);
         break;
     default:
         log_area_write(ssp->log, ssp_dev, addr, val, size,
@@ -155,37 +422,99 @@ struct adsp_ssp *ssp_get_port(int port)
     return ssp_port[port];
 }
 
+/* port powered off, stop streaming and close backing files */
+void adsp_ssp_stop(struct adsp_ssp *ssp)
+{
+    qemu_mutex_lock(&ssp->lock);
+    adsp_sink_close(ssp->tx.sink);
+    ssp->tx.sink = NULL;
+    ssp_source_stop(ssp);
+    qemu_mutex_unlock(&ssp->lock);
+
+    ssp->io[SSCR0 >> 2] &= ~SSCR0_SSE;
+    ssp->io[SSCR1 >> 2] &= ~(SSCR1_TSRE | SSCR1_RSRE);
+}
+
 static const MemoryRegionOps ssp_ops = {
     .read = ssp_read,
     .write = ssp_write,
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
+static const VMStateDescription vmstate_ssp_fifo = {
+    .name = "ssp/fifo",
+    .version_id = 2,
+    .minimum_version_id = 2,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(total_frames, struct ssp_fifo),
+        VMSTATE_UINT32(index, struct ssp_fifo),
+        VMSTATE_UINT32_ARRAY(data, struct ssp_fifo, SSP_FIFO_MAX),
+        VMSTATE_UINT32(level, struct ssp_fifo),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static int ssp_post_load(void *opaque, int version_id)
+{
+    struct adsp_ssp *ssp = opaque;
+
+    ssp_update_format(ssp);
+    ssp->fifo_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    return 0;
+}
+
+/*
+ * Backing files and capture sources are restarted by the next SSCR1
+ * enable after a load, the frame format comes from the registers.
+ */
+static const VMStateDescription vmstate_ssp = {
+    .name = "ssp",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = ssp_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_VBUFFER_UINT32(io, struct adsp_ssp, 1, NULL, io_size),
+        VMSTATE_STRUCT(tx, struct adsp_ssp, 1, vmstate_ssp_fifo,
+            struct ssp_fifo),
+        VMSTATE_STRUCT(rx, struct adsp_ssp, 1, vmstate_ssp_fifo,
+            struct ssp_fifo),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 void adsp_ssp_init(MemoryRegion *system_memory,
-    const struct adsp_reg_space *ssp_dev, int num_ssp)
+    const struct adsp_reg_space *ssp_dev, int num_ssp, uint32_t fifo_depth)
 {
+    const char *capture = qemu_opt_get(qemu_get_machine_opts(),
+        "ssp-capture");
     MemoryRegion *reg_ssp;
     struct adsp_ssp *ssp;
     int i;
 
     for (i = 0; i < num_ssp; i++) {
-        ssp = g_malloc(sizeof(*ssp));
+        ssp = g_malloc0(sizeof(*ssp));
 
         ssp->tx.level = 0;
         ssp->rx.level = 0;
+        ssp->fifo_depth = fifo_depth;
         ssp->ssp_dev = &ssp_dev[i];
         sprintf(ssp->name, "%s.io", ssp_dev[i].name);
 
         ssp->log = log_init(NULL);
+        qemu_mutex_init(&ssp->lock);
+        ssp_source_init(ssp, i, capture);
 
         /* SSP */
         reg_ssp = g_malloc(sizeof(*reg_ssp));
         ssp->io = g_malloc(ssp_dev[i].desc.size);
+        ssp->io_size = ssp_dev[i].desc.size;
+        ssp_reset(ssp);
         memory_region_init_io(reg_ssp, NULL, &ssp_ops, ssp,
             ssp->name, ssp_dev[i].desc.size);
         memory_region_add_subregion(system_memory,
             ssp_dev[i].desc.base, reg_ssp);
         qemu_register_reset(ssp_reset, ssp);
+        vmstate_register(NULL, i, &vmstate_ssp, ssp);
         ssp_port[i] = ssp;
     }
 }
@@ -88,6 +88,11 @@ static void xtensa_ccompare_cb(void *opaque)
     CPUXtensaState *env = ccompare->env;
     unsigned i = ccompare - env->ccompare;
 
+    /* with the timing model CCOUNT may not have reached CCOMPARE yet */
+    if (env->timing.enabled && !xtensa_timing_ccompare_due(env, i)) {
+        return;
+    }
+
     xtensa_timer_irq(env, i, 1);
 }
 
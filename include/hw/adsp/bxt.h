@@ -92,6 +92,11 @@
 #define ADSP_BXT_DSP_GTW_CODE_LDR_SIZE  0x00000040
 #define ADSP_BXT_DSP_GTW_CODE_LDR_BASE  0x00002BC0
 
+/* HD-Audio controller, input stream descriptors come first */
+#define ADSP_BXT_HDA_SIZE           0x00004000
+#define ADSP_BXT_HDA_IN_STREAMS     6
+#define ADSP_BXT_HDA_OUT_STREAMS    7
+
 #define ADSP_BXT_DSP_DMIC_BASE      0x00004000
 #define ADSP_BXT_DSP_DMIC_SIZE      0x00004000
 
@@ -130,4 +135,21 @@
 #define ADSP_BXT_DSP_MAILBOX_BASE \
     (ADSP_BXT_DSP_HP_SRAM_BASE + ADSP_BXT_DSP_HP_SRAM_SIZE - ADSP_BXT_DSP_MAILBOX_SIZE)
 
+/* ROM status and error in the mailbox, polled by the driver during boot */
+#define ADSP_BXT_ROM_STATUS         0x0
+#define ADSP_BXT_ROM_ERROR          0x4
+
+#define ADSP_BXT_ROM_INIT                   0x1
+#define ADSP_BXT_ROM_FW_MANIFEST_LOADED     0x3
+#define ADSP_BXT_ROM_FW_FW_LOADED           0x4
+#define ADSP_BXT_ROM_FW_ENTERED             0x5
+
+#define ADSP_BXT_ROM_ERR_DMA        0x1
+#define ADSP_BXT_ROM_ERR_AUTH       0x2
+
+/* code loader request to the ROM in IPCXH, tag is stream tag - 1 */
+#define ADSP_BXT_IPC_PURGE_FW       0x01004000
+#define ADSP_BXT_IPC_PURGE_TAG_SHIFT    9
+#define ADSP_BXT_IPC_PURGE_TAG_MASK     (0x1f << ADSP_BXT_IPC_PURGE_TAG_SHIFT)
+
 #endif
@@ -0,0 +1,38 @@
+/* IPC doorbell between host and audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ADSP_DOORBELL_H__
+#define __ADSP_DOORBELL_H__
+
+#include "qemu/event_notifier.h"
+
+/* IPC doorbell from the peer, bypasses the bridge queues */
+struct adsp_doorbell {
+    EventNotifier notifier;
+    bool bound;
+    void (*ring)(void *opaque);
+    void *opaque;
+};
+
+/* ring is called with BQL held, status is already in SHM */
+void adsp_doorbell_init(struct adsp_doorbell *db,
+    void (*ring)(void *opaque), void *opaque);
+
+#endif
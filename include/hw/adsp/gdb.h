@@ -0,0 +1,32 @@
+/* Coordinated debug stop and continue between host and audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ADSP_GDB_H__
+#define __ADSP_GDB_H__
+
+struct qemu_io_msg;
+
+/* peer names the other side in notices, call after registering with bridge */
+void adsp_gdb_init(const char *peer);
+
+/* called from bridge reader thread */
+void adsp_gdb_msg(struct qemu_io_msg *msg);
+
+#endif
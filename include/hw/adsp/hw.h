@@ -36,13 +36,43 @@
 #define ADSP_MMIO_SIZE				0x00200000
 #define ADSP_PCI_SIZE				0x00001000
 
+/* PCI PM control and status in the LPE PCI space */
+#define ADSP_PCI_PMCS				0x84
+#define ADSP_PCI_PMCS_PS_MASK			0x3
+
 struct adsp_dev;
 struct adsp_gp_dmac;
+struct adsp_hda_dma;
 struct adsp_log;
 
 struct adsp_mem_desc {
 	hwaddr base;
 	size_t size;
+
+	/* timing model - extra cycles per access, 0 is single cycle */
+	uint32_t load_cycles;
+	uint32_t store_cycles;
+	bool cached;		/* accesses go via the core cache */
+};
+
+/* core cache descriptor for timing model */
+struct adsp_cache_desc {
+	uint32_t size;		/* 0 means no cache modelled */
+	uint32_t line_size;
+	uint32_t ways;
+	uint32_t miss_cycles;
+};
+
+/* peripheral timing, zero fields take the model defaults */
+struct adsp_io_timing {
+	uint32_t dma_m2m_burst_ns;	/* period between host DMA bursts */
+	uint32_t dma_m2p_burst_ns;	/* period between playback bursts */
+	uint32_t dma_p2m_burst_ns;	/* period between capture bursts */
+	uint32_t dma_bandwidth;		/* bytes per second, 0 is unlimited */
+	uint32_t ssp_fifo_depth;	/* words */
+	uint32_t ext_clk_kHz;		/* external timer clock */
+	uint32_t irq_latency_ns;	/* interrupt assert to core */
+	uint32_t cl_bandwidth;		/* ROM code loader bytes per second */
 };
 
 /* Register descriptor */
@@ -76,9 +106,14 @@ struct adsp_desc {
         struct adsp_mem_desc lp_sram;
 	struct adsp_mem_desc rom;
 	struct adsp_mem_desc pci;
+	struct adsp_mem_desc hda;	/* HD-Audio controller registers */
 	uint32_t host_iram_offset;
 	uint32_t host_dram_offset;
 
+	/* timing model */
+	struct adsp_cache_desc cache;
+	struct adsp_io_timing io_timing;
+
 	/* devices */
 	int num_ssp;
 	int num_dmac;
@@ -91,6 +126,20 @@ struct adsp_desc {
 	struct adsp_reg_space io_dev; /* misc device atm */	
 };
 
+/* board table with -machine board-file and timing overrides applied */
+struct adsp_desc *adsp_board_load(const struct adsp_desc *board,
+	QemuOpts *opts);
+void adsp_board_class_init(MachineClass *mc, const struct adsp_desc *desc);
+
 int adsp_load_modules(struct adsp_dev *adsp, void *fw, size_t size);
+int adsp_lazy_add_block(struct adsp_dev *adsp, int index, hwaddr addr,
+	const void *data, uint32_t size);
+void adsp_lazy_ipc(struct adsp_dev *adsp);
+void adsp_sram_poison(struct adsp_dev *adsp, void *ptr, size_t size,
+	uint32_t pattern);
+void adsp_sram_poison_fork_child(void);
+void adsp_timing_init(struct adsp_dev *adsp);
+void adsp_heatmap_init(struct adsp_dev *adsp);
+void adsp_analysis_init(struct adsp_dev *adsp);
 
 #endif
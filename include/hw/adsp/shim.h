@@ -21,6 +21,9 @@
 #ifndef ADSP_IO_H
 #define ADSP_IO_H
 
+#include "qemu/atomic.h"
+#include "exec/hwaddr.h"
+
 #define SHIM_CSR		0x00
 #define SHIM_PISR		0x08
 #define SHIM_PIMR		0x10
@@ -146,8 +149,59 @@
 #define ADSP_IO_SHM_LP_SRAM	4
 #define ADSP_IO_SHM_ROM		5
 #define ADSP_IO_SHM_IO		6
+#define ADSP_IO_SHM_TRACE	7
 #define ADSP_IO_SHM_DMAC(dmac)			(8 + dmac)
 #define ADSP_IO_SHM_DMA(c, chan)		((c + 1) * 8 + chan)
+#define ADSP_IO_SHM_HDA		32
+
+/*
+ * Shim registers live in SHM and are updated concurrently by the host and
+ * DSP processes. Status and doorbell bits are changed atomically. Payload
+ * registers and mailbox data are published before the doorbell write with
+ * release ordering, and the peer reads them back with acquire ordering.
+ */
+static inline uint32_t shim_io_read(uint32_t *io, hwaddr addr)
+{
+    return atomic_load_acquire(&io[addr >> 2]);
+}
+
+static inline uint64_t shim_io_read64(uint32_t *io, hwaddr addr)
+{
+    return atomic_load_acquire(&((uint64_t *)io)[addr >> 3]);
+}
+
+static inline void shim_io_write(uint32_t *io, hwaddr addr, uint32_t val)
+{
+    atomic_store_release(&io[addr >> 2], val);
+}
+
+/* atomically set bits, returns the new value */
+static inline uint32_t shim_io_set(uint32_t *io, hwaddr addr, uint32_t bits)
+{
+    return atomic_fetch_or(&io[addr >> 2], bits) | bits;
+}
+
+/* atomically clear bits, returns the new value */
+static inline uint32_t shim_io_clear(uint32_t *io, hwaddr addr, uint32_t bits)
+{
+    return atomic_fetch_and(&io[addr >> 2], ~bits) & ~bits;
+}
+
+/* atomically replace the bits in mask, returns the new value */
+static inline uint32_t shim_io_update(uint32_t *io, hwaddr addr,
+    uint32_t mask, uint32_t bits)
+{
+    uint32_t old, new, cur;
+
+    cur = atomic_read(&io[addr >> 2]);
+    do {
+        old = cur;
+        new = (old & ~mask) | (bits & mask);
+        cur = atomic_cmpxchg(&io[addr >> 2], old, new);
+    } while (cur != old);
+
+    return new;
+}
 
 /* messages */
 #define PMC_DDR_LINK_UP		0xc0	/* LPE req path to DRAM is up */
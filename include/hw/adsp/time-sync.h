@@ -0,0 +1,36 @@
+/* Virtual time sync between host and audio DSP.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ADSP_TIME_SYNC_H__
+#define __ADSP_TIME_SYNC_H__
+
+#include "qemu/option.h"
+
+struct qemu_io_msg;
+
+/* quantum is the sync-quantum option in ns, call after bridge registration */
+void adsp_time_sync_init(const char *quantum);
+
+/* called from bridge reader thread */
+void adsp_time_sync_msg(struct qemu_io_msg *msg);
+
+bool adsp_time_sync_enabled(void);
+
+#endif
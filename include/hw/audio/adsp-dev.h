@@ -22,8 +22,10 @@
 #define __ADSP_XTENSA_H__
 
 #include "hw/adsp/hw.h"
+#include "hw/adsp/doorbell.h"
 
 struct adsp_xtensa;
+struct qemu_io_msg;
 #define ADSP_MAX_CORES	4
 
 struct adsp_dev {
@@ -32,6 +34,9 @@ struct adsp_dev {
 	uint32_t *mbox_io;
 	uint32_t *shim_io;
 	uint32_t *common_io;
+	uint32_t mbox_size;
+	uint32_t shim_size;
+	uint32_t common_size;
 
 	/* runtime CPU */
 	struct adsp_xtensa *xtensa[ADSP_MAX_CORES];
@@ -54,17 +59,39 @@ struct adsp_dev {
 	uint32_t ext_clk_kHz;
 	int64_t ext_timer_start;
 
+	/* IRQs waiting out the board IRQ latency */
+	QEMUTimer *irq_timer;
+	uint32_t irq_pending;
+
 	/* GP DMA */
 	struct adsp_gp_dmac *gp_dmac[ADSP_MAX_GP_DMAC];
 
 	/* SSP */
 	struct adsp_ssp *ssp[ADSP_MAX_SSP];
 
-	/* PMC */
-	QemuThread pmc_thread;
-	uint32_t pmc_cmd;
+	/* HD-Audio host and link DMA, NULL if board has none */
+	struct adsp_hda_dma *hda;
+
+	/* IPC doorbell from host */
+	struct adsp_doorbell doorbell;
 };
 
 void adsp_set_irq(struct adsp_dev *adsp, int irq, int active);
 
+/* coordinated snapshot with host */
+void adsp_snapshot_init(struct adsp_dev *adsp);
+void adsp_snapshot_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg);
+
+/* D0-D3 and S0-S3 from host, D3 power gates all but LP SRAM */
+void adsp_pm_init(struct adsp_dev *adsp);
+void adsp_pm_msg(struct adsp_dev *adsp, struct qemu_io_msg *msg);
+
+/* copy on write fork server, needs -machine fork-server=<path> */
+void adsp_fork_server_init(struct adsp_dev *adsp);
+
+/* firmware trace capture, needs -machine fw-trace=<file|chardev:id> */
+void adsp_trace_init(struct adsp_dev *adsp, const char *name);
+bool adsp_trace_write(hwaddr addr, uint32_t val);
+void adsp_trace_fork_child(const char *id);
+
 #endif
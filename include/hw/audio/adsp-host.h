@@ -39,6 +39,7 @@
 #include "sysemu/device_tree.h"
 #include "qemu/error-report.h"
 #include "qemu/io-bridge.h"
+#include "hw/adsp/doorbell.h"
 
 #include "hw/i386/pc.h"
 #include "hw/i386/ioapic.h"
@@ -60,11 +61,24 @@ struct adsp_dma_buffer {
     uint32_t *io;
     struct adsp_mem_desc shm_desc;
     char *name;
+    struct qemu_io_dma_sg *sg;  /* LLI chain in SHM while in flight */
+    uint32_t sg_size;           /* bytes of SHM mapped at sg */
 };
 
+/* MSI/MSI-X vectors, one per interrupt source */
+#define ADSP_IRQ_VEC_IPC_BUSY       0
+#define ADSP_IRQ_VEC_IPC_DONE       1
+#define ADSP_IRQ_VEC_DMAC(dmac)     (2 + (dmac))
+#define ADSP_IRQ_VEC_COUNT          ADSP_IRQ_VEC_DMAC(ADSP_MAX_GP_DMAC)
+
+/* device property flags */
+#define ADSP_HOST_F_MSI             0
+#define ADSP_HOST_F_MSIX            1
+
 struct adsp_host {
 
     PCIDevice dev;
+    uint32_t flags;
 
     /* IO mapped from ACPI tables */
     uint32_t *pci_io;
@@ -89,8 +103,31 @@ struct adsp_host {
     const struct adsp_desc *desc;
     const char *cpu_model;
     const char *kernel_filename;
+
+    /* guest RAM shared with the DSP for direct DMA */
+    MemoryListener dma_listener;
+
+    /* IPC doorbell from DSP */
+    struct adsp_doorbell doorbell;
+
+    /* D state last entered by DSP */
+    uint32_t pm_state;
+
+    /* options shared with the DSP machine */
+    char *bridge_id;
+    char *sync_quantum;
+    char *dump_dir;
+    char *dump_format;
+    char *dump_streams;
 };
 
+#define DEFINE_ADSP_HOST_PROPERTIES() \
+    DEFINE_PROP_STRING("bridge-id", struct adsp_host, bridge_id), \
+    DEFINE_PROP_STRING("sync-quantum", struct adsp_host, sync_quantum), \
+    DEFINE_PROP_STRING("dump-dir", struct adsp_host, dump_dir), \
+    DEFINE_PROP_STRING("dump-format", struct adsp_host, dump_format), \
+    DEFINE_PROP_STRING("dump-streams", struct adsp_host, dump_streams)
+
 #define adsp_get_pdata(obj, type) \
     OBJECT_CHECK(struct adsp_host, (obj), type)
 
@@ -99,8 +136,26 @@ extern const struct adsp_reg_desc adsp_host_mbox_map[ADSP_HOST_MBOX_COUNT];
 
 void adsp_host_init(struct adsp_host *adsp, const struct adsp_desc *board);
 void adsp_host_do_dma(struct adsp_host *adsp, struct qemu_io_msg *msg);
+void adsp_host_dma_map_init(struct adsp_host *adsp);
 void adsp_host_init_mbox(struct adsp_host *adsp, const char *name);
 
+extern const VMStateDescription vmstate_adsp_host;
+void adsp_host_snapshot_init(struct adsp_host *adsp);
+void adsp_host_snapshot_msg(struct adsp_host *adsp, struct qemu_io_msg *msg);
+
+/* PCI PMCS and system sleep passed on to DSP */
+void adsp_host_pm_init(struct adsp_host *adsp);
+void adsp_host_pm_msg(struct adsp_host *adsp, struct qemu_io_msg *msg);
+void adsp_host_pm_pci_write(struct adsp_host *adsp, hwaddr addr,
+    uint32_t val, uint32_t old);
+
+/* INTx or per source MSI/MSI-X, called with BQL held */
+void adsp_host_irq_init(struct adsp_host *adsp);
+void adsp_host_irq_exit(struct adsp_host *adsp);
+void adsp_host_irq_ipc(struct adsp_host *adsp, uint32_t active);
+void adsp_host_irq_lower(struct adsp_host *adsp);
+void adsp_host_irq_dma(struct adsp_host *adsp, int dmac);
+
 #define ADSP_HOST_BYT_NAME        "adsp-byt"
 #define ADSP_HOST_CHT_NAME        "adsp-cht"
 
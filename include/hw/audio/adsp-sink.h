@@ -0,0 +1,51 @@
+/* Buffered audio dump files for DSP audio streams.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HW_ADSP_SINK_H__
+#define __HW_ADSP_SINK_H__
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+
+struct adsp_sink;
+
+/* ring between the stream and its writer thread, power of 2 */
+#define ADSP_SINK_RING_SIZE	(1 << 20)
+#define ADSP_SINK_DIR		"/tmp"
+
+enum adsp_sink_format {
+	ADSP_SINK_WAV = 0,
+	ADSP_SINK_RAW,
+};
+
+/* PCM format recorded in the file header */
+struct adsp_sink_pcm {
+	uint32_t rate;
+	uint32_t channels;
+	uint32_t bits;		/* container bits */
+};
+
+void adsp_sink_init(const char *dir, const char *format, const char *streams);
+struct adsp_sink *adsp_sink_open(const char *stream, int index,
+    const struct adsp_sink_pcm *pcm);
+void adsp_sink_write(struct adsp_sink *sink, const void *data, size_t bytes);
+void adsp_sink_close(struct adsp_sink *sink);
+
+#endif
@@ -34,16 +34,24 @@
 #include "exec/address-spaces.h"
 #include "qemu/thread.h"
 #include "qemu/io-bridge.h"
+#include "sysemu/iothread.h"
 
 struct adsp_dev;
 struct adsp_host;
 struct adsp_gp_dmac;
 struct adsp_log;
+struct adsp_sink;
+struct adsp_io_timing;
 
 #define DW_DMA_PCI_ID		0x9c60
 
 #define NUM_CHANNELS        8
 
+/* default burst periods, boards can override in adsp_io_timing */
+#define DW_DMA_M2M_BURST_NS     (200 * 1000)    /* 200us */
+#define DW_DMA_M2P_BURST_NS     (6667 * 1000)   /* 6.66ms */
+#define DW_DMA_P2M_BURST_NS     (6667 * 1000)   /* 6.66ms */
+
 /* channel registers */
 #define DW_MAX_CHAN         8
 #define DW_CH_SIZE          0x58
@@ -155,7 +163,7 @@ struct adsp_log;
 #define DWDMA_HOST_PCI_SIZE             0x00001000
 #define DWDMA_HOST_DMAC_SIZE            0x00001000
 #define DWDMA_HOST_DMAC_BASE(x)         \
-    (DWDMA_HOST_PCI_BASE + x * DWDMA_HOST_DMAC_SIZE)
+    (DWDMA_HOST_PCI_BASE + (x + 1) * DWDMA_HOST_DMAC_SIZE)
 
 /* DMA descriptor used by HW version 2 */
 struct dw_lli2 {
@@ -178,13 +186,24 @@ struct dma_chan {
     void *ptr;
     void *base;
     uint32_t tbytes;
+    bool mapped;        /* ptr is host RAM from the bridge DMA map */
+    void *map;          /* bridge DMA map reference for the block */
+
+    /* LLI chain shared with host when not mapped, vector then data */
+    struct qemu_io_dma_sg *sg;
+    uint32_t sg_idx;    /* block of the chain being copied */
+    bool sg_sync;       /* waiting for host to refresh a cyclic chain */
+    QemuEvent sg_event;
+
+    /* PCI channels run as a timer on the DMAC AioContext */
+    QEMUTimer *timer;
 
     /* endpoint */
     struct qemu_io_msg_dma32 dma_msg;
     int ssp;
 
-    /* file output/input */
-    int fd;
+    /* dump file output */
+    struct adsp_sink *sink;
     int file_idx;
 
     /* threading */
@@ -197,6 +216,7 @@ struct adsp_gp_dmac {
     int id;
     int num_chan;
     uint32_t *io;
+    uint32_t io_size;
     int irq_assert;
     int irq;
     int is_pci_dev;
@@ -204,9 +224,19 @@ struct adsp_gp_dmac {
     struct adsp_log *log;
 
     const struct adsp_reg_space *desc;
+    const struct adsp_io_timing *timing;    /* NULL for defaults */
+
+    /* PCI only - M2M runs here instead of channel threads */
+    AioContext *ctx;
+    AddressSpace *as;
+    uint32_t bandwidth;     /* bytes per second, 0 is unlimited */
     struct adsp_dev *adsp;
     struct dw_host *dw_host;
     struct dma_chan dma_chan[NUM_CHANNELS];
+
+    /* traffic accounting - bytes read from and written to memory */
+    uint64_t read_bytes;
+    uint64_t write_bytes;
 };
 
 struct dw_desc {
@@ -227,17 +257,24 @@ struct dw_host {
     struct adsp_log *log;
     const struct dw_desc *desc;
     uint32_t *pci_io;
+
+    /* properties */
+    IOThread *iothread;
+    uint32_t bandwidth;
 };
 
 #define ADSP_GP_DMA_REGS		1
 extern const struct adsp_reg_desc adsp_gp_dma_map[ADSP_GP_DMA_REGS];
 
 extern const MemoryRegionOps dw_dmac_ops;
+extern const VMStateDescription vmstate_dw_dmac;
 
 void build_acpi_dwdma_device(Aml *table);
 void dw_dma_init_dev(struct adsp_dev *adsp, MemoryRegion *parent,
     const struct adsp_reg_space *dev, int num_dmac);
 void dw_dma_msg(struct qemu_io_msg *msg);
 void dw_dmac_reset(void *opaque);
+void dw_dmac_stop(struct adsp_gp_dmac *dmac);
+void dw_dma_run_gate_init(void);
 
 #endif
@@ -0,0 +1,141 @@
+/* Virtualization support for HD-Audio host and link DMA.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HW_HDA_DMA_H__
+#define __HW_HDA_DMA_H__
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/timer.h"
+#include "exec/memory.h"
+
+struct adsp_dev;
+struct adsp_hda_dma;
+struct adsp_sink;
+
+/* DSP gateway registers, one block per stream */
+#define HDA_DGCS		0x00
+#define HDA_DGBBA		0x04
+#define HDA_DGBS		0x08
+#define HDA_DGBFPI		0x0c	/* firmware moves its pointer by this */
+#define HDA_DGBRP		0x10
+#define HDA_DGBWP		0x14
+#define HDA_DGBSP		0x18
+#define HDA_DGMBS		0x1c
+#define HDA_DGLLPI		0x24
+#define HDA_DGLPIBI		0x28
+#define HDA_GTW_REGS		16
+
+#define HDA_DGCS_GEN		(1 << 26)
+#define HDA_DGCS_FWCB		(1 << 23)
+#define HDA_DGCS_BSC		(1 << 11)
+#define HDA_DGCS_BOR		(1 << 10)
+#define HDA_DGCS_BF		(1 << 9)
+#define HDA_DGCS_BNE		(1 << 8)
+#define HDA_DGCS_FIFORDY	(1 << 5)
+
+/* HD-Audio controller registers seen by the x86 driver */
+#define HDA_INTSTS		0x24
+#define HDA_DPLBASE		0x70
+#define HDA_DPUBASE		0x74
+#define HDA_DPLBASE_ENABLE	0x1
+#define HDA_DPLBASE_MASK	(~0x7fULL)
+
+#define HDA_SD_BASE(sd)		(0x80 + (sd) * 0x20)
+#define HDA_SD_CTL		0x00	/* CTL in bits 0..23, STS in 24..31 */
+#define HDA_SD_LPIB		0x04
+#define HDA_SD_CBL		0x08
+#define HDA_SD_LVI		0x0c
+#define HDA_SD_BDPL		0x18
+#define HDA_SD_BDPU		0x1c
+
+#define HDA_SD_CTL_SRST		(1 << 0)
+#define HDA_SD_CTL_RUN		(1 << 1)
+#define HDA_SD_CTL_STRM_SHIFT	20
+#define HDA_SD_CTL_STRM_MASK	(0xf << HDA_SD_CTL_STRM_SHIFT)
+#define HDA_SD_STS_BCIS		(1 << 26)
+#define HDA_SD_STS_FIFOE	(1 << 27)
+
+#define HDA_MAX_SD		16
+
+/* ROM code loader download rate, bytes per second */
+#define HDA_CL_BANDWIDTH	100000000
+#define HDA_REG_SIZE		(HDA_SD_BASE(HDA_MAX_SD))
+
+/* buffer descriptor list entry in x86 guest memory */
+struct hda_bdle {
+    uint64_t addr;
+    uint32_t len;
+    uint32_t ioc;
+} __attribute__((packed));
+
+enum hda_stream_type {
+    HDA_HOST_OUT = 0,	/* x86 memory to DSP buffer - playback */
+    HDA_HOST_IN,	/* DSP buffer to x86 memory - capture */
+    HDA_LINK_OUT,	/* DSP buffer to codec link */
+    HDA_LINK_IN,	/* codec link to DSP buffer */
+    HDA_CODE_LDR,	/* x86 memory to ROM image buffer - firmware download */
+};
+
+/* a block of streams of one type in the DSP gateway register space */
+struct hda_stream_desc {
+    const char *name;
+    enum hda_stream_type type;
+    int count;
+    hwaddr base;	/* first gateway block */
+    uint32_t stride;
+    int sd;		/* first x86 stream descriptor, host streams only */
+};
+
+struct hda_stream {
+    struct adsp_hda_dma *hda;
+    const struct hda_stream_desc *desc;
+    char name[32];
+    int sd;
+    uint32_t io[HDA_GTW_REGS];
+
+    /* DSP buffer level in bytes */
+    uint32_t avail;
+
+    /* BDL walk, host streams */
+    uint32_t bdle;
+    uint32_t bdle_off;
+    uint32_t lpib;
+
+    /* link endpoint dump */
+    struct adsp_sink *sink;
+    int file_idx;
+
+    /* code loader, image buffer filled from the BDL */
+    uint8_t *cl_buf;
+    uint32_t cl_size;
+    uint32_t cl_pos;
+    void (*cl_cb)(void *opaque, uint32_t bytes, int err);
+    void *cl_opaque;
+};
+
+void adsp_hda_dma_init(struct adsp_dev *adsp, const char *name,
+    const struct hda_stream_desc *desc, int num_desc);
+void adsp_hda_dma_stop(struct adsp_hda_dma *hda);
+int adsp_hda_dma_load(struct adsp_hda_dma *hda, int tag, void *buf,
+    uint32_t max, void (*cb)(void *opaque, uint32_t bytes, int err),
+    void *opaque);
+
+#endif
@@ -9,6 +9,8 @@
 #ifndef __ADSP_SSP_H__
 #define __ADSP_SSP_H__
 
+#include "qemu/thread.h"
+
 /* SSP registers start */
 /* SSP register offsets */
 #define SSCR0       0x00
@@ -38,6 +40,7 @@
 #define SSCR0_RIM   (1 << 22)
 #define SSCR0_TUM   (1 << 23)
 #define SSCR0_FRDC  (0x07000000)
+#define SSCR0_FRDC_SHIFT    24
 #define SSCR0_ACS   (1 << 30)
 #define SSCR0_MOD   (1 << 31)
 
@@ -89,6 +92,9 @@
 #define SSPSP_DMYSTOP(x)    ((x) << 23)
 #define SSPSP_FSRT      (1 << 25)
 
+/* SSTSA/SSRSA bits */
+#define SSTSA_TTSA_MASK (0x000000ff)
+#define SSRSA_RTSA_MASK (0x000000ff)
 
 /* SSP registers end */
 
@@ -107,23 +113,94 @@
 struct adsp_dev;
 struct adsp_gp_dmac;
 struct adsp_log;
+struct adsp_sink;
+struct ssp_analysis;
 struct adsp_reg_space;
 
+/* FIFO depth in words, boards can override in adsp_io_timing */
+#define SSP_FIFO_DEPTH		16
+#define SSP_FIFO_MAX		64
+
+/* TDM frame limits */
+#define SSP_MAX_SLOTS		8
+#define SSP_CLK_KHZ		19200
+#define SSP_DEFAULT_RATE	48000
+#define SSP_BLOCK_FRAMES	256
+#define SSP_RING_FRAMES		4096
+
+/* frame format decoded from SSCR0, SSPSP, SSTSA and SSRSA */
+struct ssp_format {
+	uint32_t slots;		/* slots per TDM frame */
+	uint32_t sample_bits;	/* valid bits per slot */
+	uint32_t sample_bytes;	/* DMA container per slot */
+	uint32_t tx_mask;	/* active playback slots */
+	uint32_t rx_mask;	/* active capture slots */
+	uint32_t tx_channels;
+	uint32_t rx_channels;
+	uint32_t rate;
+};
+
+enum ssp_source_type {
+	SSP_SRC_SILENCE = 0,
+	SSP_SRC_SINE,
+	SSP_SRC_IMPULSE,
+	SSP_SRC_NOISE,
+	SSP_SRC_WAV,
+	SSP_SRC_LOOPBACK,
+};
+
+/* capture data generator, produces whole TDM frames */
+struct ssp_source {
+	enum ssp_source_type type;
+	uint32_t freq;		/* sine Hz or impulse period in ms */
+	char file_name[64];
+
+	/* generator state */
+	uint32_t phase;
+	uint32_t step;
+	uint32_t period;
+	uint32_t count;
+	uint32_t seed[4];
+
+	/* WAV file */
+	int fd;
+	off_t data_start;
+	uint32_t file_channels;
+	uint32_t file_bytes;
+
+	/* loopback ring of TX frames in samples */
+	int32_t *ring;
+	uint32_t ring_rd;
+	uint32_t ring_wr;
+};
+
 struct ssp_fifo {
 	uint32_t total_frames;
 	uint32_t index;
-	int fd;
-	char file_name[64];
-	uint32_t data[16];
+	struct adsp_sink *sink;
+	uint32_t data[SSP_FIFO_MAX];
 	uint32_t level;
 };
 
 struct adsp_ssp {
 	char name[32];
 	uint32_t *io;
+	uint32_t io_size;
+
+	/* DMA thread bursts vs the sink and capture file opened and closed */
+	QemuMutex lock;
 
 	struct ssp_fifo tx;
 	struct ssp_fifo rx;
+	uint32_t fifo_depth;
+	int64_t fifo_ns;	/* virtual time the levels were last moved */
+
+	struct ssp_format fmt;
+	struct ssp_source src;
+
+	/* audio analysis, allocated when a stream first runs */
+	struct ssp_analysis *tx_ana;
+	struct ssp_analysis *rx_ana;
 
 	struct adsp_log *log;
 	const struct adsp_reg_space *ssp_dev;
@@ -133,7 +210,29 @@ struct adsp_ssp {
 extern const struct adsp_reg_desc adsp_ssp_map[ADSP_SSP_REGS];
 
 struct adsp_ssp *ssp_get_port(int port);
+void adsp_ssp_stop(struct adsp_ssp *ssp);
+void adsp_ssp_playback(struct adsp_ssp *ssp, const void *buf, uint32_t bytes);
+void adsp_ssp_capture(struct adsp_ssp *ssp, void *buf, uint32_t bytes);
+
+/* capture sources, ssp-source.c */
+void ssp_source_init(struct adsp_ssp *ssp, int port, const char *opt);
+void ssp_source_start(struct adsp_ssp *ssp);
+void ssp_source_stop(struct adsp_ssp *ssp);
+void ssp_source_read(struct adsp_ssp *ssp, int32_t *frames,
+    uint32_t nframes);
+void ssp_source_loopback(struct adsp_ssp *ssp, const int32_t *frames,
+    uint32_t nframes);
+
+/* audio analysis, ssp-analysis.c */
+void ssp_analysis_enable(uint32_t freq);
+bool ssp_analysis_enabled(void);
+void ssp_analysis_stream(struct adsp_ssp *ssp, bool playback,
+    const int32_t *frames, uint32_t nframes);
+void ssp_analysis_stop(struct adsp_ssp *ssp, bool playback);
+void ssp_analysis_host_write(const void *data, uint32_t bytes,
+    uint32_t width);
+struct AdspAudioAnalysis *ssp_analysis_query(bool reset);
 void adsp_ssp_init(MemoryRegion *system_memory,
-    const struct adsp_reg_space *ssp_dev, int num_ssp);
+    const struct adsp_reg_space *ssp_dev, int num_ssp, uint32_t fifo_depth);
 
 #endif
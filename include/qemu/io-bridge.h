@@ -32,6 +32,7 @@
 #define IO_BRIDGE_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define QEMU_IO_DEBUG           0
 
@@ -43,6 +44,8 @@
 #define QEMU_IO_TYPE_PM         4
 #define QEMU_IO_TYPE_DMA        5
 #define QEMU_IO_TYPE_MEM        6
+#define QEMU_IO_TYPE_VM         7
+#define QEMU_IO_TYPE_TIME       8
 
 /* Global Message Reply */
 #define QEMU_IO_MSG_REPLY       0
@@ -60,15 +63,16 @@
 #define QEMU_IO_DMA_REQ_NEW     96
 #define QEMU_IO_DMA_REQ_READY   97
 #define QEMU_IO_DMA_REQ_COMPLETE    98
+#define QEMU_IO_DMA_REQ_SYNC    99  /* refresh the SHM block at sg->sync */
 
 /* DMA Direction - relative to msg sender */
 #define QEMU_IO_DMA_DIR_READ    256
 #define QEMU_IO_DMA_DIR_WRITE   257
 
-/* GDB Messages */
+/* GDB Messages - either side stalls or continues its peer */
 #define QEMU_IO_GDB_STALL       128
 #define QEMU_IO_GDB_CONT        129
-#define QEMU_IO_GDB_STALL_RPLY  130 /* stall after reply */
+#define QEMU_IO_GDB_STALL_RPLY  130 /* sent by peer once it has stalled */
 
 /* PM Messages */
 #define QEMU_IO_PM_S0           192
@@ -80,6 +84,19 @@
 #define QEMU_IO_PM_D2           198
 #define QEMU_IO_PM_D3           199
 
+/* VM snapshot Messages - parent drives, child replies DONE */
+#define QEMU_IO_VM_SAVE         224
+#define QEMU_IO_VM_LOAD         225
+#define QEMU_IO_VM_DONE         226
+#define QEMU_IO_VM_RESUME       227
+
+#define QEMU_IO_VM_TAG_SIZE     64
+
+/* Time sync Messages - either side, once per quantum of virtual time */
+#define QEMU_IO_TIME_HELLO      240 /* sender has not heard from peer yet */
+#define QEMU_IO_TIME_SYNC       241
+#define QEMU_IO_TIME_STOP       242 /* sender stopped, dont wait for it */
+
 /* Common message header */
 struct qemu_io_msg {
     uint16_t type;
@@ -118,6 +135,19 @@ struct qemu_io_msg_pm_state {
     struct qemu_io_msg hdr;
 };
 
+/* VM snapshot Messages - same message used as reply */
+struct qemu_io_msg_vm {
+    struct qemu_io_msg hdr;
+    int32_t reply;		/* 0 or -errno */
+    char tag[QEMU_IO_VM_TAG_SIZE];
+};
+
+/* Time sync Messages */
+struct qemu_io_msg_time {
+    struct qemu_io_msg hdr;
+    int64_t time;		/* virtual ns since sync start */
+};
+
 /* DMA Messages - same message used as reply */
 struct qemu_io_msg_dma32 {
     struct qemu_io_msg hdr;
@@ -132,6 +162,39 @@ struct qemu_io_msg_dma32 {
     uint64_t client_data;
 };
 
+/*
+ * M2M DMA without a DMA map of guest RAM goes through one SHM per channel
+ * for the whole LLI chain. The DSP puts the segment vector at the start of
+ * the SHM, the segment data follows it packed in chain order. Segment 0 is
+ * the block in the channel registers, a cyclic chain continues at segment 1
+ * after the last one. The request size is the SHM size.
+ *
+ * The chain is set up with one NEW and torn down with one COMPLETE, but
+ * every block still costs one SYNC round trip, before a read block is used
+ * and after a written block so the guest finds it at its BLOCK irq. That
+ * is one round trip per block rather than three messages, not one per lap
+ * of a cyclic ring.
+ */
+#define QEMU_IO_DMA_SG_MAX      64
+
+struct qemu_io_dma_seg {
+    uint32_t addr;		/* host physical address */
+    uint32_t size;
+};
+
+struct qemu_io_dma_sg {
+    uint32_t count;
+    uint32_t cyclic;
+    uint32_t size;		/* of data following the vector */
+    uint32_t sync;		/* segment copied by QEMU_IO_DMA_REQ_SYNC */
+    struct qemu_io_dma_seg seg[QEMU_IO_DMA_SG_MAX];
+};
+
+static inline uint8_t *qemu_io_dma_sg_data(struct qemu_io_dma_sg *sg)
+{
+    return (uint8_t *)(sg + 1);
+}
+
 struct qemu_io_msg_dma64 {
     struct qemu_io_msg hdr;
     uint32_t direction;	/*  QEMU_IO_DMA_DIR_ */
@@ -145,6 +208,27 @@ struct qemu_io_msg_dma64 {
     uint64_t client_data;
 };
 
+/*
+ * Control socket protocol. The parent listens on an abstract UNIX socket
+ * and passes each child that connects its SHM regions, doorbell eventfds and
+ * DMA map of guest RAM by fd. The DMA map can change at runtime.
+ */
+#define QEMU_IO_SOCK_SHM        1   /* region, size + SHM fd */
+#define QEMU_IO_SOCK_DOORBELL   2   /* to child and to parent eventfds */
+#define QEMU_IO_SOCK_DMA_MAP    3   /* addr, size, offset + memory fd */
+#define QEMU_IO_SOCK_DMA_UNMAP  4   /* addr */
+#define QEMU_IO_SOCK_READY      5   /* setup complete */
+
+#define QEMU_IO_SOCK_MAX_FDS    2
+
+struct qemu_io_sock_msg {
+    uint32_t request;
+    uint32_t region;
+    uint64_t addr;
+    uint64_t size;
+    uint64_t offset;
+};
+
 /* API calls for parent and child */
 int qemu_io_register_parent(const char *name,
     int (*cb)(void *, struct qemu_io_msg *msg), void *data);
@@ -154,6 +238,27 @@ int qemu_io_register_child(const char *name,
 int qemu_io_send_msg(struct qemu_io_msg *msg);
 int qemu_io_send_msg_reply(struct qemu_io_msg *msg);
 
+/*
+ * Doorbells - eventfds shared with the peer for IRQs. cb is called from the
+ * bridge thread with a new eventfd to poll (caller owns it) whenever the peer
+ * connects, or with -1 when the peer goes away.
+ */
+int qemu_io_register_doorbell(void (*cb)(void *data, int fd), void *data);
+int qemu_io_ring_doorbell(void);
+
+/* raise peer IRQ by doorbell if connected, otherwise by message */
+int qemu_io_send_irq(uint32_t irq);
+
+/* peer is attached to the control socket */
+bool qemu_io_peer_connected(void);
+
+/* DMA map - parent adds fd backed guest RAM, child gets a direct pointer */
+int qemu_io_add_dma_map(uint64_t addr, uint64_t size, int fd,
+    uint64_t offset);
+void qemu_io_del_dma_map(uint64_t addr);
+void *qemu_io_dma_map(uint64_t addr, uint64_t size);
+void qemu_io_dma_put(void *ptr);
+
 int qemu_io_register_shm(const char *name, int region, size_t size,
     void **addr);
 int qemu_io_sync(int region, unsigned int offset, size_t length);
@@ -161,4 +266,10 @@ int qemu_io_sync(int region, unsigned int offset, size_t length);
 void qemu_io_free(void);
 void qemu_io_free_shm(int region);
 
+/* instance suffix for queue and SHM names, call before registering */
+void qemu_io_set_instance(const char *id);
+
+/* re-home the bridge in a forked process under a new instance name */
+int qemu_io_fork_child(const char *id, uint32_t private_regions);
+
 #endif
@@ -981,6 +981,8 @@ static void qmp_unregister_commands_hack(void)
 #endif
 #ifndef TARGET_I386
     qmp_unregister_command(&qmp_commands, "rtc-reset-reinjection");
+    qmp_unregister_command(&qmp_commands, "adsp-snapshot-save");
+    qmp_unregister_command(&qmp_commands, "adsp-snapshot-load");
 #endif
 #ifndef TARGET_S390X
     qmp_unregister_command(&qmp_commands, "dump-skeys");
@@ -991,6 +993,12 @@ static void qmp_unregister_commands_hack(void)
 #if !defined(TARGET_S390X) && !defined(TARGET_I386)
     qmp_unregister_command(&qmp_commands, "query-cpu-model-expansion");
 #endif
+#ifndef TARGET_XTENSA
+    qmp_unregister_command(&qmp_commands, "xtensa-profile-start");
+    qmp_unregister_command(&qmp_commands, "xtensa-profile-stop");
+    qmp_unregister_command(&qmp_commands, "adsp-heatmap-enable");
+    qmp_unregister_command(&qmp_commands, "query-adsp-heatmap");
+#endif
 #if !defined(TARGET_S390X)
     qmp_unregister_command(&qmp_commands, "query-cpu-model-baseline");
     qmp_unregister_command(&qmp_commands, "query-cpu-model-comparison");
@@ -4173,6 +4181,53 @@ GICCapabilityList *qmp_query_gic_capabilities(Error **errp)
 }
 #endif
 
+#ifndef TARGET_XTENSA
+void qmp_xtensa_profile_start(bool has_sample_period, uint32_t sample_period,
+                              bool has_symbols, const char *symbols,
+                              Error **errp)
+{
+    error_setg(errp, QERR_FEATURE_DISABLED, "xtensa-profile-start");
+}
+
+XtensaProfileFunctionList *qmp_xtensa_profile_stop(bool has_folded,
+                                                   const char *folded,
+                                                   Error **errp)
+{
+    error_setg(errp, QERR_FEATURE_DISABLED, "xtensa-profile-stop");
+    return NULL;
+}
+
+void qmp_adsp_heatmap_enable(bool enable, Error **errp)
+{
+    error_setg(errp, QERR_FEATURE_DISABLED, "adsp-heatmap-enable");
+}
+
+AdspHeatmap *qmp_query_adsp_heatmap(bool has_reset, bool reset, Error **errp)
+{
+    error_setg(errp, QERR_FEATURE_DISABLED, "query-adsp-heatmap");
+    return NULL;
+}
+
+AdspAudioAnalysis *qmp_query_adsp_audio_analysis(bool has_reset, bool reset,
+                                                 Error **errp)
+{
+    error_setg(errp, QERR_FEATURE_DISABLED, "query-adsp-audio-analysis");
+    return NULL;
+}
+#endif
+
+#ifndef TARGET_I386
+void qmp_adsp_snapshot_save(const char *tag, Error **errp)
+{
+    error_setg(errp, QERR_FEATURE_DISABLED, "adsp-snapshot-save");
+}
+
+void qmp_adsp_snapshot_load(const char *tag, Error **errp)
+{
+    error_setg(errp, QERR_FEATURE_DISABLED, "adsp-snapshot-load");
+}
+#endif
+
 HotpluggableCPUList *qmp_query_hotpluggable_cpus(Error **errp)
 {
     MachineState *ms = MACHINE(qdev_get_machine());
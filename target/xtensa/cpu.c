@@ -130,12 +130,9 @@ static void xtensa_cpu_initfn(Object *obj)
     memory_region_init_io(env->system_er, NULL, NULL, env, "er",
                           UINT64_C(0x100000000));
     address_space_init(env->address_space_er, env->system_er, "ER");
-}
 
-static const VMStateDescription vmstate_xtensa_cpu = {
-    .name = "cpu",
-    .unmigratable = 1,
-};
+    xtensa_timing_init(env);
+}
 
 static void xtensa_cpu_class_init(ObjectClass *oc, void *data)
 {
@@ -165,7 +162,9 @@ static void xtensa_cpu_class_init(ObjectClass *oc, void *data)
 #endif
     cc->debug_excp_handler = xtensa_breakpoint_handler;
     cc->tcg_initialize = xtensa_translate_init;
+#ifndef CONFIG_USER_ONLY
     dc->vmsd = &vmstate_xtensa_cpu;
+#endif
 }
 
 static const TypeInfo xtensa_cpu_type_info = {
@@ -395,6 +395,66 @@ enum {
 };
 #endif
 
+/* instruction classes used by the cycle approximate timing model */
+enum {
+    XTENSA_TIMING_ALU,
+    XTENSA_TIMING_MUL,
+    XTENSA_TIMING_DIV,
+    XTENSA_TIMING_LOAD,
+    XTENSA_TIMING_STORE,
+    XTENSA_TIMING_BRANCH,
+    XTENSA_TIMING_JUMP,
+    XTENSA_TIMING_CALL,
+    XTENSA_TIMING_MAC16,
+    XTENSA_TIMING_FP,
+    XTENSA_TIMING_SPECIAL,
+    XTENSA_TIMING_CLASS_MAX,
+};
+
+#define XTENSA_TIMING_MAX_REGIONS 8
+
+/* memory region latency, charged on top of the load/store class cost */
+typedef struct XtensaTimingRegion {
+    uint32_t base;
+    uint32_t size;
+    uint32_t load_cycles;
+    uint32_t store_cycles;
+    bool cached;
+} XtensaTimingRegion;
+
+/* set associative cache with LRU replacement, may be shared by all cores */
+typedef struct XtensaTimingCache {
+    unsigned line_shift;
+    unsigned nsets;
+    unsigned nways;
+    uint32_t miss_cycles;
+    uint32_t *tag;
+    uint32_t *age;
+    uint64_t hits;
+    uint64_t misses;
+} XtensaTimingCache;
+
+typedef struct XtensaTiming {
+    bool enabled;
+    uint64_t cycles;
+    uint32_t insn_cycles[XTENSA_TIMING_CLASS_MAX];
+    unsigned nregions;
+    XtensaTimingRegion region[XTENSA_TIMING_MAX_REGIONS];
+    XtensaTimingCache *cache;
+    /* CCOMPARE targets in model cycles, UINT64_MAX when not armed */
+    uint64_t compare[MAX_NCCOMPARE];
+    uint64_t deadline;
+    /* virtual time WAITI halted the core, -1 when running */
+    int64_t idle_start;
+} XtensaTiming;
+
+/* optional observer of guest data accesses and TLB fills */
+typedef struct XtensaMemHook {
+    void (*access)(void *opaque, uint32_t addr, unsigned size, bool store);
+    void (*tlb_fill)(void *opaque, uint32_t addr, int access_type);
+    void *opaque;
+} XtensaMemHook;
+
 typedef struct CPUXtensaState {
     const XtensaConfig *config;
     uint32_t regs[16];
@@ -428,6 +488,15 @@ typedef struct CPUXtensaState {
     /* Watchpoints for DBREAK registers */
     struct CPUWatchpoint *cpu_watchpoint[MAX_NDBREAK];
 
+    /* cycle approximate timing model, CCOUNT follows it when enabled */
+    XtensaTiming timing;
+
+    /* memory access observer, instrumented at translation when set */
+    const XtensaMemHook *mem_hook;
+
+    /* TBs run since the last profiler stack sample */
+    uint32_t profile_samples;
+
     CPU_COMMON
 } CPUXtensaState;
 
@@ -525,6 +594,44 @@ static inline void xtensa_select_static_vectors(CPUXtensaState *env,
 }
 void xtensa_runstall(CPUXtensaState *env, bool runstall);
 
+#ifndef CONFIG_USER_ONLY
+extern const struct VMStateDescription vmstate_xtensa_cpu;
+#endif
+
+void xtensa_timing_init(CPUXtensaState *env);
+void xtensa_timing_enable(CPUXtensaState *env, bool enable);
+int xtensa_timing_add_region(CPUXtensaState *env, uint32_t base,
+        uint32_t size, uint32_t load_cycles, uint32_t store_cycles,
+        bool cached);
+XtensaTimingCache *xtensa_timing_cache_new(unsigned size, unsigned line_size,
+        unsigned nways, uint32_t miss_cycles);
+void xtensa_timing_set_cache(CPUXtensaState *env, XtensaTimingCache *cache);
+uint32_t xtensa_timing_mem_cycles(CPUXtensaState *env, uint32_t addr,
+        bool store);
+uint64_t xtensa_timing_now(CPUXtensaState *env);
+void xtensa_timing_idle(CPUXtensaState *env, bool idle);
+void xtensa_timing_set_ccompare(CPUXtensaState *env, unsigned i,
+        uint64_t dcc);
+bool xtensa_timing_ccompare_due(CPUXtensaState *env, unsigned i);
+
+typedef struct XtensaProfileCount {
+    uint64_t tb_count;
+    uint64_t insn_count;
+} XtensaProfileCount;
+
+typedef void (*XtensaProfileFunc)(const char *name,
+        const XtensaProfileCount *count, void *data);
+
+typedef struct XtensaProfileTB XtensaProfileTB;
+
+extern bool xtensa_profile_active;
+int xtensa_profile_start(uint32_t sample_period, const char *symbols);
+void xtensa_profile_stop(void);
+XtensaProfileTB *xtensa_profile_tb_new(uint32_t pc);
+void xtensa_profile_tb_insns(XtensaProfileTB *p, uint32_t insns);
+void xtensa_profile_foreach(XtensaProfileFunc fn, void *data);
+int xtensa_profile_write_folded(const char *filename);
+
 #define XTENSA_OPTION_BIT(opt) (((uint64_t)1) << (opt))
 #define XTENSA_OPTION_ALL (~(uint64_t)0)
 
@@ -603,6 +710,9 @@ static inline int cpu_mmu_index(CPUXtensaState *env, bool ifetch)
 #define XTENSA_TBFLAG_WINDOW_MASK 0x18000
 #define XTENSA_TBFLAG_WINDOW_SHIFT 15
 #define XTENSA_TBFLAG_YIELD 0x20000
+#define XTENSA_TBFLAG_TIMING 0x40000
+#define XTENSA_TBFLAG_PROFILE 0x80000
+#define XTENSA_TBFLAG_MEMHOOK 0x100000
 
 static inline void cpu_get_tb_cpu_state(CPUXtensaState *env, target_ulong *pc,
         target_ulong *cs_base, uint32_t *flags)
@@ -647,6 +757,15 @@ static inline void cpu_get_tb_cpu_state(CPUXtensaState *env, target_ulong *pc,
     if (env->yield_needed) {
         *flags |= XTENSA_TBFLAG_YIELD;
     }
+    if (env->timing.enabled) {
+        *flags |= XTENSA_TBFLAG_TIMING;
+    }
+    if (xtensa_profile_active) {
+        *flags |= XTENSA_TBFLAG_PROFILE;
+    }
+    if (env->mem_hook) {
+        *flags |= XTENSA_TBFLAG_MEMHOOK;
+    }
 }
 
 #include "exec/cpu-all.h"
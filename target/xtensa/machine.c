@@ -0,0 +1,107 @@
+/*
+ * Xtensa CPU migration state.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "hw/hw.h"
+#include "hw/boards.h"
+#include "exec/exec-all.h"
+#include "exec/helper-proto.h"
+#include "migration/cpu.h"
+
+static const VMStateDescription vmstate_xtensa_tlb_entry = {
+    .name = "cpu/tlb_entry",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(vaddr, xtensa_tlb_entry),
+        VMSTATE_UINT32(paddr, xtensa_tlb_entry),
+        VMSTATE_UINT8(asid, xtensa_tlb_entry),
+        VMSTATE_UINT8(attr, xtensa_tlb_entry),
+        VMSTATE_BOOL(variable, xtensa_tlb_entry),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+/* the TLB ways are saved as one flat array of entries */
+#define VMSTATE_XTENSA_TLB(_field, _ways) {                         \
+    .name = (stringify(_field)),                                    \
+    .num = (_ways) * MAX_TLB_WAY_SIZE,                              \
+    .vmsd = &vmstate_xtensa_tlb_entry,                              \
+    .size = sizeof(xtensa_tlb_entry),                               \
+    .flags = VMS_STRUCT | VMS_ARRAY,                                \
+    .offset = offsetof(XtensaCPU, env._field),                      \
+}
+
+/* FP registers are a float32/float64 union, save the full 64 bits */
+#define VMSTATE_XTENSA_FREGS(_field) {                              \
+    .name = (stringify(_field)),                                    \
+    .num = 16,                                                      \
+    .info = &vmstate_info_uint64,                                   \
+    .size = sizeof(uint64_t),                                       \
+    .flags = VMS_ARRAY,                                             \
+    .offset = offsetof(XtensaCPU, env._field),                      \
+}
+
+static int xtensa_cpu_post_load(void *opaque, int version_id)
+{
+    XtensaCPU *cpu = opaque;
+    CPUXtensaState *env = &cpu->env;
+    int i;
+
+    tlb_flush(CPU(cpu));
+
+    /* CCOMPARE timers are rebuilt from the restored CCOUNT state */
+    for (i = 0; i < env->config->nccompare; i++) {
+        HELPER(update_ccompare)(env, i);
+    }
+
+    return 0;
+}
+
+const VMStateDescription vmstate_xtensa_cpu = {
+    .name = "cpu",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = xtensa_cpu_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(env.regs, XtensaCPU, 16),
+        VMSTATE_UINT32(env.pc, XtensaCPU),
+        VMSTATE_UINT32_ARRAY(env.sregs, XtensaCPU, 256),
+        VMSTATE_UINT32_ARRAY(env.uregs, XtensaCPU, 256),
+        VMSTATE_UINT32_ARRAY(env.phys_regs, XtensaCPU, MAX_NAREG),
+        VMSTATE_XTENSA_FREGS(fregs),
+        VMSTATE_XTENSA_TLB(itlb, 7),
+        VMSTATE_XTENSA_TLB(dtlb, 10),
+        VMSTATE_UINT32(env.autorefill_idx, XtensaCPU),
+        VMSTATE_BOOL(env.runstall, XtensaCPU),
+        VMSTATE_INT32(env.pending_irq_level, XtensaCPU),
+        VMSTATE_UINT64(env.time_base, XtensaCPU),
+        VMSTATE_UINT64(env.ccount_time, XtensaCPU),
+        VMSTATE_UINT32(env.ccount_base, XtensaCPU),
+        VMSTATE_INT32(env.exception_taken, XtensaCPU),
+        VMSTATE_INT32(env.yield_needed, XtensaCPU),
+        VMSTATE_UINT32(env.static_vectors, XtensaCPU),
+        VMSTATE_UINT64(env.timing.cycles, XtensaCPU),
+        VMSTATE_END_OF_LIST()
+    }
+};
@@ -26,6 +26,8 @@
 #include "monitor/monitor.h"
 #include "monitor/hmp-target.h"
 #include "hmp.h"
+#include "qapi/error.h"
+#include "qmp-commands.h"
 
 void hmp_info_tlb(Monitor *mon, const QDict *qdict)
 {
@@ -37,3 +39,74 @@ void hmp_info_tlb(Monitor *mon, const QDict *qdict)
     }
     dump_mmu((FILE*)mon, (fprintf_function)monitor_printf, env1);
 }
+
+void qmp_xtensa_profile_start(bool has_sample_period, uint32_t sample_period,
+                              bool has_symbols, const char *symbols,
+                              Error **errp)
+{
+    int ret;
+
+    ret = xtensa_profile_start(has_sample_period ? sample_period : 1000,
+                               has_symbols ? symbols : NULL);
+    if (ret == -EBUSY) {
+        error_setg(errp, "profiler is already running");
+    } else if (ret < 0) {
+        error_setg_errno(errp, -ret, "can't load symbols from '%s'",
+                         symbols);
+    }
+}
+
+static void profile_add_func(const char *name,
+                             const XtensaProfileCount *count, void *data)
+{
+    GPtrArray *funcs = data;
+    XtensaProfileFunction *func = g_new0(XtensaProfileFunction, 1);
+
+    func->name = g_strdup(name);
+    func->tb_count = count->tb_count;
+    func->insn_count = count->insn_count;
+    g_ptr_array_add(funcs, func);
+}
+
+static gint profile_cmp(gconstpointer a, gconstpointer b)
+{
+    const XtensaProfileFunction *fa = *(XtensaProfileFunction **)a;
+    const XtensaProfileFunction *fb = *(XtensaProfileFunction **)b;
+
+    return fa->insn_count < fb->insn_count ? -1 :
+        fa->insn_count > fb->insn_count;
+}
+
+XtensaProfileFunctionList *qmp_xtensa_profile_stop(bool has_folded,
+                                                   const char *folded,
+                                                   Error **errp)
+{
+    XtensaProfileFunctionList *list = NULL, *entry;
+    GPtrArray *funcs;
+    int ret, i;
+
+    xtensa_profile_stop();
+
+    if (has_folded) {
+        ret = xtensa_profile_write_folded(folded);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "can't write '%s'", folded);
+            return NULL;
+        }
+    }
+
+    funcs = g_ptr_array_new();
+    xtensa_profile_foreach(profile_add_func, funcs);
+    g_ptr_array_sort(funcs, profile_cmp);
+
+    /* list is built backwards so the hottest function ends up first */
+    for (i = 0; i < funcs->len; i++) {
+        entry = g_new0(XtensaProfileFunctionList, 1);
+        entry->value = g_ptr_array_index(funcs, i);
+        entry->next = list;
+        list = entry;
+    }
+    g_ptr_array_free(funcs, true);
+
+    return list;
+}
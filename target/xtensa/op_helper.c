@@ -64,6 +64,10 @@ void tlb_fill(CPUState *cs, target_ulong vaddr, MMUAccessType access_type,
     qemu_log_mask(CPU_LOG_MMU, "%s(%08x, %d, %d) -> %08x, ret = %d\n",
                   __func__, vaddr, access_type, mmu_idx, paddr, ret);
 
+    if (env->mem_hook && env->mem_hook->tlb_fill) {
+        env->mem_hook->tlb_fill(env->mem_hook->opaque, vaddr, access_type);
+    }
+
     if (ret == 0) {
         tlb_set_page(cs,
                      vaddr & TARGET_PAGE_MASK,
@@ -394,6 +398,9 @@ void HELPER(waiti)(CPUXtensaState *env, uint32_t pc, uint32_t intlevel)
 
     cpu = CPU(xtensa_env_get_cpu(env));
     cpu->halted = 1;
+    if (env->timing.enabled) {
+        xtensa_timing_idle(env, true);
+    }
     HELPER(exception)(env, EXCP_HLT);
 }
 
@@ -402,6 +409,14 @@ void HELPER(update_ccount)(CPUXtensaState *env)
     uint64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
 
     env->ccount_time = now;
+
+    /* the timing model owns CCOUNT when enabled */
+    if (env->timing.enabled) {
+        env->sregs[CCOUNT] = env->ccount_base +
+            (uint32_t)xtensa_timing_now(env);
+        return;
+    }
+
     env->sregs[CCOUNT] = env->ccount_base +
         (uint32_t)((now - env->time_base) *
                    env->config->clock_freq_khz / 1000000);
@@ -424,11 +439,26 @@ void HELPER(update_ccompare)(CPUXtensaState *env, uint32_t i)
 
     HELPER(update_ccount)(env);
     dcc = (uint64_t)(env->sregs[CCOMPARE + i] - env->sregs[CCOUNT] - 1) + 1;
+    /* TBs check the model deadline, the timer covers WAITI */
+    if (env->timing.enabled) {
+        xtensa_timing_set_ccompare(env, i, dcc);
+    }
     timer_mod(env->ccompare[i].timer,
               env->ccount_time + (dcc * 1000000) / env->config->clock_freq_khz);
     env->yield_needed = 1;
 }
 
+void HELPER(mem_hook)(CPUXtensaState *env, uint32_t addr, uint32_t size,
+                      uint32_t store)
+{
+    const XtensaMemHook *hook = env->mem_hook;
+
+    /* hook may be removed before all instrumented TBs are flushed */
+    if (hook && hook->access) {
+        hook->access(hook->opaque, addr, size, store);
+    }
+}
+
 void HELPER(check_interrupts)(CPUXtensaState *env)
 {
     qemu_mutex_lock_iothread();
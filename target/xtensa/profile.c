@@ -0,0 +1,478 @@
+/*
+ * Xtensa guest function profiler.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/helper-proto.h"
+#include "sysemu/sysemu.h"
+#include "disas/disas.h"
+#include "elf.h"
+
+#define PROFILE_MAX_DEPTH    32
+#define PROFILE_SYM_LEN      64
+
+/*
+ * Exact counts for one translated block. Several TBs may start at the
+ * same PC, each gets its own record. Every vCPU only bumps its own slot
+ * so execution needs no lock, slots are summed when reporting.
+ */
+struct XtensaProfileTB {
+    uint32_t pc;
+    uint32_t insns;
+    uint64_t tb_count[];
+};
+
+/* function symbol from an optional firmware ELF */
+typedef struct ProfileSym {
+    uint32_t addr;
+    uint32_t size;
+    char *name;
+} ProfileSym;
+
+static struct {
+    QemuMutex lock;
+    bool init;
+    uint32_t sample_period;
+    GPtrArray *tbs;         /* XtensaProfileTB records */
+    GHashTable *stacks;     /* folded stack -> count */
+    ProfileSym *syms;
+    unsigned nsyms;
+} prof;
+
+bool xtensa_profile_active;
+
+static int sym_cmp(const void *a, const void *b)
+{
+    const ProfileSym *sa = a, *sb = b;
+
+    return sa->addr < sb->addr ? -1 : sa->addr > sb->addr;
+}
+
+static void free_syms(void)
+{
+    unsigned i;
+
+    for (i = 0; i < prof.nsyms; i++) {
+        g_free(prof.syms[i].name);
+    }
+    g_free(prof.syms);
+    prof.syms = NULL;
+    prof.nsyms = 0;
+}
+
+/* load STT_FUNC symbols from ELF32 symbol table, nothing else is touched */
+static int load_syms(const char *filename)
+{
+    gchar *data;
+    gsize size;
+    Elf32_Ehdr *ehdr;
+    Elf32_Shdr *shdr, *symtab = NULL, *strtab;
+    Elf32_Sym *sym;
+    bool swap;
+    unsigned i, nsyms, shnum;
+    const char *strs;
+
+#define E16(v) (swap ? bswap16(v) : (v))
+#define E32(v) (swap ? bswap32(v) : (v))
+
+    if (!g_file_get_contents(filename, &data, &size, NULL)) {
+        return -ENOENT;
+    }
+
+    ehdr = (Elf32_Ehdr *)data;
+    if (size < sizeof(*ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) ||
+        ehdr->e_ident[EI_CLASS] != ELFCLASS32) {
+        g_free(data);
+        return -EINVAL;
+    }
+
+#ifdef HOST_WORDS_BIGENDIAN
+    swap = ehdr->e_ident[EI_DATA] != ELFDATA2MSB;
+#else
+    swap = ehdr->e_ident[EI_DATA] != ELFDATA2LSB;
+#endif
+
+    shnum = E16(ehdr->e_shnum);
+    if (E32(ehdr->e_shoff) + shnum * sizeof(*shdr) > size) {
+        g_free(data);
+        return -EINVAL;
+    }
+
+    shdr = (Elf32_Shdr *)(data + E32(ehdr->e_shoff));
+    for (i = 0; i < shnum; i++) {
+        if (E32(shdr[i].sh_type) == SHT_SYMTAB) {
+            symtab = &shdr[i];
+            break;
+        }
+    }
+
+    if (symtab == NULL || E32(symtab->sh_link) >= shnum) {
+        g_free(data);
+        return -ENOENT;
+    }
+
+    strtab = &shdr[E32(symtab->sh_link)];
+    if (E32(symtab->sh_offset) + E32(symtab->sh_size) > size ||
+        E32(strtab->sh_offset) + E32(strtab->sh_size) > size) {
+        g_free(data);
+        return -EINVAL;
+    }
+
+    sym = (Elf32_Sym *)(data + E32(symtab->sh_offset));
+    strs = data + E32(strtab->sh_offset);
+    nsyms = E32(symtab->sh_size) / sizeof(*sym);
+
+    free_syms();
+    prof.syms = g_new0(ProfileSym, nsyms);
+
+    for (i = 0; i < nsyms; i++) {
+        if (ELF32_ST_TYPE(sym[i].st_info) != STT_FUNC ||
+            E32(sym[i].st_name) >= E32(strtab->sh_size)) {
+            continue;
+        }
+
+        prof.syms[prof.nsyms].addr = E32(sym[i].st_value);
+        prof.syms[prof.nsyms].size = E32(sym[i].st_size);
+        prof.syms[prof.nsyms].name = g_strdup(strs + E32(sym[i].st_name));
+        prof.nsyms++;
+    }
+
+    qsort(prof.syms, prof.nsyms, sizeof(*prof.syms), sym_cmp);
+    g_free(data);
+    return prof.nsyms;
+
+#undef E16
+#undef E32
+}
+
+/* symbol name for pc or hex address if unknown, result valid until next call */
+static const char *pc_to_sym(uint32_t pc)
+{
+    static char buf[PROFILE_SYM_LEN];
+    const char *name;
+    int lo = 0, hi = (int)prof.nsyms - 1, mid;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (prof.syms[mid].addr > pc) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    /* hi is the last symbol at or below pc */
+    if (hi >= 0 && (prof.syms[hi].size == 0 ||
+        pc - prof.syms[hi].addr < prof.syms[hi].size)) {
+        return prof.syms[hi].name;
+    }
+
+    /* fall back to symbols from ELF images loaded by the board */
+    name = lookup_symbol(pc);
+    if (name[0] != '\0') {
+        return name;
+    }
+
+    snprintf(buf, sizeof(buf), "0x%08x", pc);
+    return buf;
+}
+
+static bool read_word(CPUXtensaState *env, uint32_t addr, uint32_t *val)
+{
+    uint8_t buf[4];
+
+    if (cpu_memory_rw_debug(CPU(xtensa_env_get_cpu(env)), addr,
+                            buf, sizeof(buf), 0) < 0) {
+        return false;
+    }
+    *val = ldl_p(buf);
+    return true;
+}
+
+/*
+ * Walk the windowed ABI call chain. The return address call increment
+ * in a0 bits 31:30 tells us where the caller window is. Live windows are
+ * read from the physical register file, spilled ones from the base save
+ * area below the callee stack pointer.
+ */
+static unsigned backtrace(CPUXtensaState *env, uint32_t pc, uint32_t *pcs)
+{
+    unsigned nwin = env->config->nareg / 4;
+    unsigned wb = env->sregs[WINDOW_BASE];
+    uint32_t ws = env->sregs[WINDOW_START];
+    uint32_t a0 = env->regs[0], a1 = env->regs[1];
+    unsigned depth = 0, inc;
+
+    pcs[depth++] = pc;
+
+    if (!xtensa_option_enabled(env->config,
+                               XTENSA_OPTION_WINDOWED_REGISTER)) {
+        return depth;
+    }
+
+    while (depth < PROFILE_MAX_DEPTH) {
+        inc = a0 >> 30;
+        if (inc == 0 || a0 == 0) {
+            break;
+        }
+
+        pc = (a0 & 0x3fffffff) | (pc & 0xc0000000);
+        pcs[depth++] = pc;
+
+        ws &= ~(1 << wb);
+        wb = (wb + nwin - inc) % nwin;
+
+        if (ws & (1 << wb)) {
+            a0 = env->phys_regs[wb * 4];
+            a1 = env->phys_regs[wb * 4 + 1];
+        } else if (!read_word(env, a1 - 16, &a0) ||
+                   !read_word(env, a1 - 12, &a1)) {
+            break;
+        }
+    }
+
+    return depth;
+}
+
+static void sample_stack(CPUXtensaState *env, uint32_t pc)
+{
+    uint32_t pcs[PROFILE_MAX_DEPTH];
+    GString *folded = g_string_new(NULL);
+    gpointer count;
+    int i;
+
+    xtensa_sync_phys_from_window(env);
+
+    /* folded stacks are root first */
+    for (i = backtrace(env, pc, pcs) - 1; i >= 0; i--) {
+        g_string_append(folded, pc_to_sym(pcs[i]));
+        if (i) {
+            g_string_append_c(folded, ';');
+        }
+    }
+
+    count = g_hash_table_lookup(prof.stacks, folded->str);
+    g_hash_table_insert(prof.stacks, g_string_free(folded, false),
+                        GSIZE_TO_POINTER(GPOINTER_TO_SIZE(count) + 1));
+}
+
+void HELPER(profile_tb)(CPUXtensaState *env, void *tb)
+{
+    XtensaProfileTB *p = tb;
+    int cpu = CPU(xtensa_env_get_cpu(env))->cpu_index;
+
+    atomic_set__nocheck(&p->tb_count[cpu], p->tb_count[cpu] + 1);
+
+    if (prof.sample_period && ++env->profile_samples >= prof.sample_period) {
+        env->profile_samples = 0;
+        qemu_mutex_lock(&prof.lock);
+        if (xtensa_profile_active) {
+            sample_stack(env, p->pc);
+        }
+        qemu_mutex_unlock(&prof.lock);
+    }
+}
+
+/* called at translation time, NULL once profiling has stopped */
+XtensaProfileTB *xtensa_profile_tb_new(uint32_t pc)
+{
+    XtensaProfileTB *p = NULL;
+
+    qemu_mutex_lock(&prof.lock);
+    if (xtensa_profile_active) {
+        p = g_malloc0(sizeof(*p) + smp_cpus * sizeof(p->tb_count[0]));
+        p->pc = pc;
+        g_ptr_array_add(prof.tbs, p);
+    }
+    qemu_mutex_unlock(&prof.lock);
+    return p;
+}
+
+/* number of guest insns in the TB, set before the TB can run */
+void xtensa_profile_tb_insns(XtensaProfileTB *p, uint32_t insns)
+{
+    p->insns = insns;
+}
+
+/* safe work queued after tb_flush(), no TB can still point at the records */
+static void free_tbs(CPUState *cpu, run_on_cpu_data data)
+{
+    g_ptr_array_free(data.host_ptr, true);
+}
+
+int xtensa_profile_start(uint32_t sample_period, const char *symbols)
+{
+    GPtrArray *old_tbs = NULL;
+    int ret = 0;
+
+    if (!prof.init) {
+        qemu_mutex_init(&prof.lock);
+        prof.init = true;
+    }
+
+    qemu_mutex_lock(&prof.lock);
+
+    if (xtensa_profile_active) {
+        ret = -EBUSY;
+        goto out;
+    }
+
+    if (symbols) {
+        ret = load_syms(symbols);
+        if (ret < 0) {
+            goto out;
+        }
+    }
+
+    if (prof.stacks == NULL) {
+        prof.stacks = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, NULL);
+    }
+
+    /*
+     * The flush queued by stop may not have run yet, the old records are
+     * freed after the one queued below.
+     */
+    old_tbs = prof.tbs;
+    prof.tbs = g_ptr_array_new_with_free_func(g_free);
+    g_hash_table_remove_all(prof.stacks);
+
+    prof.sample_period = sample_period;
+    xtensa_profile_active = true;
+    ret = 0;
+
+out:
+    qemu_mutex_unlock(&prof.lock);
+
+    /* drop chained TBs translated without the profile hooks */
+    if (ret == 0 && first_cpu) {
+        tb_flush(first_cpu);
+    }
+
+    if (old_tbs && first_cpu) {
+        async_safe_run_on_cpu(first_cpu, free_tbs,
+                              RUN_ON_CPU_HOST_PTR(old_tbs));
+    } else if (old_tbs) {
+        g_ptr_array_free(old_tbs, true);
+    }
+    return ret;
+}
+
+void xtensa_profile_stop(void)
+{
+    if (!prof.init) {
+        return;
+    }
+
+    qemu_mutex_lock(&prof.lock);
+    xtensa_profile_active = false;
+    qemu_mutex_unlock(&prof.lock);
+
+    if (first_cpu) {
+        tb_flush(first_cpu);
+    }
+}
+
+typedef struct ProfileIter {
+    XtensaProfileFunc fn;
+    void *data;
+    GHashTable *funcs;
+} ProfileIter;
+
+static void aggregate_tb(gpointer value, gpointer data)
+{
+    ProfileIter *iter = data;
+    XtensaProfileTB *p = value;
+    XtensaProfileCount *c;
+    const char *name = pc_to_sym(p->pc);
+    uint64_t count = 0;
+    int i;
+
+    for (i = 0; i < smp_cpus; i++) {
+        count += atomic_read__nocheck(&p->tb_count[i]);
+    }
+
+    c = g_hash_table_lookup(iter->funcs, name);
+    if (c == NULL) {
+        c = g_new0(XtensaProfileCount, 1);
+        g_hash_table_insert(iter->funcs, g_strdup(name), c);
+    }
+    c->tb_count += count;
+    c->insn_count += count * p->insns;
+}
+
+static void report_func(gpointer key, gpointer value, gpointer data)
+{
+    ProfileIter *iter = data;
+
+    iter->fn(key, value, iter->data);
+}
+
+/* report exact per function counts gathered since the last start */
+void xtensa_profile_foreach(XtensaProfileFunc fn, void *data)
+{
+    ProfileIter iter = {.fn = fn, .data = data};
+
+    if (!prof.init || prof.tbs == NULL) {
+        return;
+    }
+
+    iter.funcs = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                       g_free, g_free);
+
+    qemu_mutex_lock(&prof.lock);
+    g_ptr_array_foreach(prof.tbs, aggregate_tb, &iter);
+    qemu_mutex_unlock(&prof.lock);
+
+    g_hash_table_foreach(iter.funcs, report_func, &iter);
+    g_hash_table_destroy(iter.funcs);
+}
+
+static void write_stack(gpointer key, gpointer value, gpointer data)
+{
+    fprintf(data, "%s %zu\n", (char *)key, GPOINTER_TO_SIZE(value));
+}
+
+/* write sampled stacks in the folded format used by flame graph tools */
+int xtensa_profile_write_folded(const char *filename)
+{
+    FILE *file;
+
+    if (!prof.init || prof.stacks == NULL) {
+        return -ENODATA;
+    }
+
+    file = fopen(filename, "w");
+    if (file == NULL) {
+        return -errno;
+    }
+
+    qemu_mutex_lock(&prof.lock);
+    g_hash_table_foreach(prof.stacks, write_stack, file);
+    qemu_mutex_unlock(&prof.lock);
+
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,283 @@
+/*
+ * Xtensa cycle approximate timing model.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Author: Liam Girdwood <liam.r.girdwood@linux.intel.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "qemu/atomic.h"
+#include "cpu.h"
+#include "exec/helper-proto.h"
+
+/*
+ * Default per class costs in cycles. These approximate a HiFi2/HiFi3 core
+ * pipeline with the branch cost being the average of taken/not taken.
+ */
+static const uint32_t default_insn_cycles[XTENSA_TIMING_CLASS_MAX] = {
+    [XTENSA_TIMING_ALU] = 1,
+    [XTENSA_TIMING_MUL] = 2,
+    [XTENSA_TIMING_DIV] = 12,
+    [XTENSA_TIMING_LOAD] = 1,
+    [XTENSA_TIMING_STORE] = 1,
+    [XTENSA_TIMING_BRANCH] = 2,
+    [XTENSA_TIMING_JUMP] = 3,
+    [XTENSA_TIMING_CALL] = 3,
+    [XTENSA_TIMING_MAC16] = 1,
+    [XTENSA_TIMING_FP] = 4,
+    [XTENSA_TIMING_SPECIAL] = 5,
+};
+
+void xtensa_timing_init(CPUXtensaState *env)
+{
+    unsigned i;
+
+    memcpy(env->timing.insn_cycles, default_insn_cycles,
+           sizeof(env->timing.insn_cycles));
+
+    for (i = 0; i < MAX_NCCOMPARE; i++) {
+        env->timing.compare[i] = UINT64_MAX;
+    }
+    env->timing.deadline = UINT64_MAX;
+    env->timing.idle_start = -1;
+}
+
+void xtensa_timing_enable(CPUXtensaState *env, bool enable)
+{
+    uint32_t ccount;
+
+    if (env->timing.enabled == enable) {
+        return;
+    }
+
+    /* keep CCOUNT continuous when switching clock source */
+    HELPER(update_ccount)(env);
+    ccount = env->sregs[CCOUNT];
+    env->timing.enabled = enable;
+    HELPER(wsr_ccount)(env, ccount);
+}
+
+int xtensa_timing_add_region(CPUXtensaState *env, uint32_t base,
+        uint32_t size, uint32_t load_cycles, uint32_t store_cycles,
+        bool cached)
+{
+    XtensaTiming *t = &env->timing;
+    XtensaTimingRegion *r;
+
+    if (t->nregions == XTENSA_TIMING_MAX_REGIONS) {
+        return -ENOMEM;
+    }
+
+    r = &t->region[t->nregions++];
+    r->base = base;
+    r->size = size;
+    r->load_cycles = load_cycles;
+    r->store_cycles = store_cycles;
+    r->cached = cached;
+    return 0;
+}
+
+XtensaTimingCache *xtensa_timing_cache_new(unsigned size, unsigned line_size,
+        unsigned nways, uint32_t miss_cycles)
+{
+    XtensaTimingCache *cache;
+
+    if (!is_power_of_2(line_size) || nways == 0 ||
+        size < line_size * nways) {
+        return NULL;
+    }
+
+    cache = g_malloc0(sizeof(*cache));
+    cache->line_shift = ctz32(line_size);
+    cache->nways = nways;
+    cache->nsets = size / line_size / nways;
+    cache->miss_cycles = miss_cycles;
+    /* tags hold line number + 1 so that 0 means invalid */
+    cache->tag = g_malloc0(sizeof(uint32_t) * cache->nsets * nways);
+    cache->age = g_malloc0(sizeof(uint32_t) * cache->nsets * nways);
+
+    return cache;
+}
+
+void xtensa_timing_set_cache(CPUXtensaState *env, XtensaTimingCache *cache)
+{
+    env->timing.cache = cache;
+}
+
+/* returns true on hit, always leaves the line resident */
+static bool cache_access(XtensaTimingCache *cache, uint32_t addr)
+{
+    uint32_t line = (addr >> cache->line_shift) + 1;
+    unsigned set = line % cache->nsets;
+    uint32_t *tag = &cache->tag[set * cache->nways];
+    uint32_t *age = &cache->age[set * cache->nways];
+    unsigned i, victim = 0;
+
+    for (i = 0; i < cache->nways; i++) {
+        age[i]++;
+    }
+
+    for (i = 0; i < cache->nways; i++) {
+        if (tag[i] == line) {
+            age[i] = 0;
+            cache->hits++;
+            return true;
+        }
+        if (age[i] > age[victim]) {
+            victim = i;
+        }
+    }
+
+    tag[victim] = line;
+    age[victim] = 0;
+    cache->misses++;
+    return false;
+}
+
+uint32_t xtensa_timing_mem_cycles(CPUXtensaState *env, uint32_t addr,
+        bool store)
+{
+    XtensaTiming *t = &env->timing;
+    XtensaTimingRegion *r;
+    uint32_t cycles;
+    unsigned i;
+
+    for (i = 0; i < t->nregions; i++) {
+        r = &t->region[i];
+
+        if (addr - r->base >= r->size) {
+            continue;
+        }
+
+        cycles = store ? r->store_cycles : r->load_cycles;
+
+        /* cached regions only pay the backing latency on a miss */
+        if (r->cached && t->cache) {
+            if (cache_access(t->cache, addr)) {
+                return 0;
+            }
+            cycles += t->cache->miss_cycles;
+        }
+
+        return cycles;
+    }
+
+    /* unknown regions are treated as single cycle local memory */
+    return 0;
+}
+
+void HELPER(timing_mem)(CPUXtensaState *env, uint32_t addr, uint32_t store)
+{
+    env->timing.cycles += xtensa_timing_mem_cycles(env, addr, store);
+}
+
+/*
+ * Model cycle count. The core does not execute while halted in WAITI, so
+ * cycles accrue there at the core clock from the virtual clock instead.
+ */
+uint64_t xtensa_timing_now(CPUXtensaState *env)
+{
+    int64_t idle_start = atomic_read__nocheck(&env->timing.idle_start);
+    uint64_t cycles = env->timing.cycles;
+
+    if (idle_start >= 0) {
+        cycles += muldiv64(qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - idle_start,
+                           env->config->clock_freq_khz, 1000000);
+    }
+
+    return cycles;
+}
+
+/* called by the vCPU entering WAITI and on the interrupt that wakes it */
+void xtensa_timing_idle(CPUXtensaState *env, bool idle)
+{
+    if (idle) {
+        atomic_set__nocheck(&env->timing.idle_start,
+                   qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+    } else if (env->timing.idle_start >= 0) {
+        env->timing.cycles = xtensa_timing_now(env);
+        atomic_set__nocheck(&env->timing.idle_start, -1);
+    }
+}
+
+static void timing_update_deadline(XtensaTiming *t)
+{
+    uint64_t deadline = UINT64_MAX;
+    unsigned i;
+
+    for (i = 0; i < MAX_NCCOMPARE; i++) {
+        deadline = MIN(deadline, t->compare[i]);
+    }
+    atomic_set__nocheck(&t->deadline, deadline);
+}
+
+/* CCOMPARE i matches CCOUNT in dcc model cycles */
+void xtensa_timing_set_ccompare(CPUXtensaState *env, unsigned i,
+        uint64_t dcc)
+{
+    env->timing.compare[i] = xtensa_timing_now(env) + dcc;
+    timing_update_deadline(&env->timing);
+}
+
+/*
+ * CCOMPARE timer expiry, the timer only estimates when the model reaches
+ * the target. Returns true to raise the interrupt, otherwise the timer is
+ * armed again for the cycles still to run.
+ */
+bool xtensa_timing_ccompare_due(CPUXtensaState *env, unsigned i)
+{
+    uint64_t target = env->timing.compare[i];
+    uint64_t now = xtensa_timing_now(env);
+
+    if (target == UINT64_MAX) {
+        return false;
+    }
+
+    if (now < target) {
+        timer_mod(env->ccompare[i].timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  muldiv64(target - now, 1000000,
+                           env->config->clock_freq_khz));
+        return false;
+    }
+
+    env->timing.compare[i] = UINT64_MAX;
+    timing_update_deadline(&env->timing);
+    return true;
+}
+
+/* a TB started past the earliest CCOMPARE target */
+void HELPER(timing_deadline)(CPUXtensaState *env)
+{
+    uint64_t cycles = env->timing.cycles;
+    unsigned i;
+
+    qemu_mutex_lock_iothread();
+    for (i = 0; i < env->config->nccompare; i++) {
+        if (env->timing.compare[i] > cycles) {
+            continue;
+        }
+        env->timing.compare[i] = UINT64_MAX;
+        timer_del(env->ccompare[i].timer);
+        xtensa_timer_irq(env, i, 1);
+    }
+    timing_update_deadline(&env->timing);
+    qemu_mutex_unlock_iothread();
+}
@@ -74,6 +74,11 @@ typedef struct DisasContext {
     bool icount;
     TCGv_i32 next_icount;
 
+    bool timing;
+    uint32_t fetch_line;
+    bool profile;
+    bool mem_hook;
+
     unsigned cpenable;
 } DisasContext;
 
@@ -82,6 +87,7 @@ static TCGv_i32 cpu_R[16];
 static TCGv_i32 cpu_FR[16];
 static TCGv_i32 cpu_SR[256];
 static TCGv_i32 cpu_UR[256];
+static TCGv_i64 cpu_cycles;
 
 #include "exec/gen-icount.h"
 
@@ -251,6 +257,9 @@ void xtensa_translate_init(void)
                     uregnames[i].name);
         }
     }
+
+    cpu_cycles = tcg_global_mem_new_i64(cpu_env,
+            offsetof(CPUXtensaState, timing.cycles), "cycles");
 }
 
 static inline bool option_bits_enabled(DisasContext *dc, uint64_t opt)
@@ -893,6 +902,25 @@ static void gen_load_store_alignment(DisasContext *dc, int shift,
     }
 }
 
+static void gen_mem_access(DisasContext *dc, TCGv_i32 addr, int shift,
+        bool store)
+{
+    if (dc->timing) {
+        TCGv_i32 tmp = tcg_const_i32(store);
+
+        gen_helper_timing_mem(cpu_env, addr, tmp);
+        tcg_temp_free(tmp);
+    }
+    if (dc->mem_hook) {
+        TCGv_i32 size = tcg_const_i32(1 << shift);
+        TCGv_i32 tmp = tcg_const_i32(store);
+
+        gen_helper_mem_hook(cpu_env, addr, size, tmp);
+        tcg_temp_free(size);
+        tcg_temp_free(tmp);
+    }
+}
+
 static void gen_waiti(DisasContext *dc, uint32_t imm4)
 {
     TCGv_i32 pc = tcg_const_i32(dc->next_pc);
@@ -2010,6 +2038,7 @@ static void disas_xtensa_insn(CPUXtensaState *env, DisasContext *dc)
                     TCGv_i32 addr = tcg_temp_new_i32();
                     tcg_gen_add_i32(addr, cpu_R[RRR_S], cpu_R[RRR_T]);
                     gen_load_store_alignment(dc, 2, addr, false);
+                    gen_mem_access(dc, addr, 2, OP2 & 0x4);
                     if (OP2 & 0x4) {
                         tcg_gen_qemu_st32(cpu_FR[RRR_R], addr, dc->cring);
                     } else {
@@ -2331,6 +2360,7 @@ static void disas_xtensa_insn(CPUXtensaState *env, DisasContext *dc)
             if (dc->tb->flags & XTENSA_TBFLAG_LITBASE) {
                 tcg_gen_add_i32(tmp, tmp, dc->litbase);
             }
+            gen_mem_access(dc, tmp, 2, false);
             tcg_gen_qemu_ld32u(cpu_R[RRR_T], tmp, dc->cring);
             tcg_temp_free(tmp);
         }
@@ -2345,6 +2375,7 @@ static void disas_xtensa_insn(CPUXtensaState *env, DisasContext *dc)
                 if (shift) { \
                     gen_load_store_alignment(dc, shift, addr, false); \
                 } \
+                gen_mem_access(dc, addr, shift, (#type)[0] == 's'); \
                 tcg_gen_qemu_##type(cpu_R[RRI8_T], addr, dc->cring); \
                 tcg_temp_free(addr); \
             } \
@@ -2642,6 +2673,7 @@ static void disas_xtensa_insn(CPUXtensaState *env, DisasContext *dc)
                 TCGv_i32 addr = tcg_temp_new_i32();
                 tcg_gen_addi_i32(addr, cpu_R[RRI8_S], RRI8_IMM8 << 2);
                 gen_load_store_alignment(dc, 2, addr, false);
+                gen_mem_access(dc, addr, 2, RRI8_R & 0x4);
                 if (RRI8_R & 0x4) {
                     tcg_gen_qemu_st32(cpu_FR[RRI8_T], addr, dc->cring);
                 } else {
@@ -2989,6 +3021,7 @@ static void disas_xtensa_insn(CPUXtensaState *env, DisasContext *dc)
                 TCGv_i32 addr = tcg_temp_new_i32(); \
                 tcg_gen_addi_i32(addr, cpu_R[RRRN_S], RRRN_R << 2); \
                 gen_load_store_alignment(dc, 2, addr, false); \
+                gen_mem_access(dc, addr, 2, (#type)[0] == 's'); \
                 tcg_gen_qemu_##type(cpu_R[RRRN_T], addr, dc->cring); \
                 tcg_temp_free(addr); \
             } \
@@ -3119,6 +3152,149 @@ static void gen_ibreak_check(CPUXtensaState *env, DisasContext *dc)
     }
 }
 
+/* coarse instruction classification for the timing model */
+static unsigned xtensa_timing_class(CPUXtensaState *env, DisasContext *dc)
+{
+    uint8_t b0 = cpu_ldub_code(env, dc->pc);
+    uint8_t b1 = cpu_ldub_code(env, dc->pc + 1);
+    uint8_t b2 = 0;
+
+    if (xtensa_op0_insn_len(OP0) == 3) {
+        b2 = cpu_ldub_code(env, dc->pc + 2);
+    }
+
+    switch (OP0) {
+    case 0: /*QRST*/
+        switch (OP1) {
+        case 0: /*RST0*/
+            if (OP2 == 0) {
+                if (RRR_R != 0) {
+                    return XTENSA_TIMING_SPECIAL;
+                }
+                return CALLX_M == 3 ? XTENSA_TIMING_CALL : XTENSA_TIMING_JUMP;
+            }
+            return OP2 == 5 ? XTENSA_TIMING_SPECIAL : XTENSA_TIMING_ALU;
+
+        case 1: /*RST1*/
+            if (OP2 == 12 || OP2 == 13) {
+                return XTENSA_TIMING_MUL;
+            }
+            return OP2 == 6 ? XTENSA_TIMING_SPECIAL : XTENSA_TIMING_ALU;
+
+        case 2: /*RST2*/
+            if (OP2 >= 12) {
+                return XTENSA_TIMING_DIV;
+            }
+            return OP2 >= 8 ? XTENSA_TIMING_MUL : XTENSA_TIMING_ALU;
+
+        case 3: /*RST3*/
+            return OP2 <= 1 ? XTENSA_TIMING_SPECIAL : XTENSA_TIMING_ALU;
+
+        case 8: /*LSCX*/
+        case 9: /*LSC4*/
+            return (OP2 & 0x4) ? XTENSA_TIMING_STORE : XTENSA_TIMING_LOAD;
+
+        case 10: /*FP0*/
+        case 11: /*FP1*/
+            return XTENSA_TIMING_FP;
+
+        default:
+            return XTENSA_TIMING_ALU;
+        }
+
+    case 1: /*L32R*/
+        return XTENSA_TIMING_LOAD;
+
+    case 2: /*LSAI*/
+        switch (RRI8_R) {
+        case 4: /*S8I*/
+        case 5: /*S16I*/
+        case 6: /*S32I*/
+        case 15: /*S32RI*/
+            return XTENSA_TIMING_STORE;
+        case 7: /*CACHEc*/
+        case 14: /*S32C1I*/
+            return XTENSA_TIMING_SPECIAL;
+        case 10: /*MOVI*/
+        case 12: /*ADDI*/
+        case 13: /*ADDMI*/
+            return XTENSA_TIMING_ALU;
+        default:
+            return XTENSA_TIMING_LOAD;
+        }
+
+    case 3: /*LSCIp*/
+        return (RRI8_R & 0x4) ? XTENSA_TIMING_STORE : XTENSA_TIMING_LOAD;
+
+    case 4: /*MAC16d*/
+        return XTENSA_TIMING_MAC16;
+
+    case 5: /*CALLN*/
+        return XTENSA_TIMING_CALL;
+
+    case 6: /*SI*/
+        if (CALL_N == 0) {
+            return XTENSA_TIMING_JUMP;
+        }
+        if (CALL_N == 3 && BRI8_M == 0) {
+            return XTENSA_TIMING_CALL;
+        }
+        return XTENSA_TIMING_BRANCH;
+
+    case 7: /*B*/
+        return XTENSA_TIMING_BRANCH;
+
+    case 8: /*L32I.Nn*/
+        return XTENSA_TIMING_LOAD;
+
+    case 9: /*S32I.Nn*/
+        return XTENSA_TIMING_STORE;
+
+    case 12: /*ST2n*/
+        return (RRRN_T & 0x8) ? XTENSA_TIMING_BRANCH : XTENSA_TIMING_ALU;
+
+    case 13: /*ST3n*/
+        return RRRN_R == 15 ? XTENSA_TIMING_JUMP : XTENSA_TIMING_ALU;
+
+    default:
+        return XTENSA_TIMING_ALU;
+    }
+}
+
+static void gen_timing_insn(CPUXtensaState *env, DisasContext *dc)
+{
+    XtensaTimingCache *cache = env->timing.cache;
+    unsigned cls = xtensa_timing_class(env, dc);
+
+    /* charge the fetch once for each cache line the TB enters */
+    if (cache && (dc->pc >> cache->line_shift) != dc->fetch_line) {
+        TCGv_i32 pc = tcg_const_i32(dc->pc);
+        TCGv_i32 store = tcg_const_i32(0);
+
+        dc->fetch_line = dc->pc >> cache->line_shift;
+        gen_helper_timing_mem(cpu_env, pc, store);
+        tcg_temp_free(store);
+        tcg_temp_free(pc);
+    }
+
+    tcg_gen_addi_i64(cpu_cycles, cpu_cycles,
+                     env->timing.insn_cycles[cls]);
+}
+
+/* raise CCOMPARE interrupts when the TB starts past the model deadline */
+static void gen_timing_deadline(void)
+{
+    TCGLabel *label = gen_new_label();
+    TCGv_i64 deadline = tcg_temp_new_i64();
+
+    tcg_gen_ld_i64(deadline, cpu_env,
+                   offsetof(CPUXtensaState, timing.deadline));
+    tcg_gen_brcond_i64(TCG_COND_LTU, cpu_cycles, deadline, label);
+    gen_helper_timing_deadline(cpu_env);
+    gen_set_label(label);
+    tcg_temp_free_i64(deadline);
+}
+
 void gen_intermediate_code(CPUState *cs, TranslationBlock *tb)
 {
     CPUXtensaState *env = cs->env_ptr;
@@ -3128,6 +3304,7 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb)
     uint32_t pc_start = tb->pc;
     uint32_t next_page_start =
         (pc_start & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
+    XtensaProfileTB *profile_tb = NULL;
 
     if (max_insns == 0) {
         max_insns = CF_COUNT_MASK;
@@ -3147,6 +3324,10 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb)
     dc.is_jmp = DISAS_NEXT;
     dc.debug = tb->flags & XTENSA_TBFLAG_DEBUG;
     dc.icount = tb->flags & XTENSA_TBFLAG_ICOUNT;
+    dc.timing = tb->flags & XTENSA_TBFLAG_TIMING;
+    dc.fetch_line = UINT32_MAX;
+    dc.profile = tb->flags & XTENSA_TBFLAG_PROFILE;
+    dc.mem_hook = tb->flags & XTENSA_TBFLAG_MEMHOOK;
     dc.cpenable = (tb->flags & XTENSA_TBFLAG_CPENABLE_MASK) >>
         XTENSA_TBFLAG_CPENABLE_SHIFT;
     dc.window = ((tb->flags & XTENSA_TBFLAG_WINDOW_MASK) >>
@@ -3176,6 +3357,20 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb)
         goto done;
     }
 
+    if (dc.profile) {
+        profile_tb = xtensa_profile_tb_new(dc.pc);
+    }
+    if (profile_tb) {
+        TCGv_ptr p = tcg_const_ptr(profile_tb);
+
+        gen_helper_profile_tb(cpu_env, p);
+        tcg_temp_free_ptr(p);
+    }
+
+    if (dc.timing) {
+        gen_timing_deadline();
+    }
+
     do {
         tcg_gen_insn_start(dc.pc);
         ++insn_count;
@@ -3212,6 +3407,10 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb)
             gen_ibreak_check(env, &dc);
         }
 
+        if (dc.timing) {
+            gen_timing_insn(env, &dc);
+        }
+
         disas_xtensa_insn(env, &dc);
         if (dc.icount) {
             tcg_gen_mov_i32(cpu_SR[ICOUNT], dc.next_icount);
@@ -3255,6 +3454,10 @@ done:
 #endif
     tb->size = dc.pc - pc_start;
     tb->icount = insn_count;
+
+    if (profile_tb) {
+        xtensa_profile_tb_insns(profile_tb, insn_count);
+    }
 }
 
 void xtensa_cpu_dump_state(CPUState *cs, FILE *f,
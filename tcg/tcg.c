@@ -544,6 +544,16 @@ void tcg_register_thread(void)
     g_assert(!err);
     qemu_mutex_unlock(&region.lock);
 }
+
+/*
+ * A vCPU thread re-created in a forked child adopts the context that the
+ * n'th registered thread used before fork, along with its code region.
+ */
+void tcg_reregister_thread(unsigned int n)
+{
+    g_assert(n < atomic_read(&n_tcg_ctxs));
+    tcg_ctx = atomic_read(&tcg_ctxs[n]);
+}
 #endif /* !CONFIG_USER_ONLY */
 
 /*
@@ -829,6 +829,7 @@ static inline void *tcg_malloc(int size)
 
 void tcg_context_init(TCGContext *s);
 void tcg_register_thread(void);
+void tcg_reregister_thread(unsigned int n);
 void tcg_prologue_init(TCGContext *s);
 void tcg_func_start(TCGContext *s);
 
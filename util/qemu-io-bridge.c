@@ -32,10 +32,16 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stddef.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <glib.h>
 #include <errno.h>
 #include "qemu/io-bridge.h"
@@ -52,7 +58,7 @@ static int role = ROLE_NONE;
 
 #define QEMU_IO_MAX_MSGS    8
 #define QEMU_IO_MAX_MSG_SIZE    128
-#define QEMU_IO_MAX_SHM_REGIONS    32
+#define QEMU_IO_MAX_SHM_REGIONS    40
 
 #define NAME_SIZE       64
 
@@ -60,7 +66,9 @@ struct io_shm {
     int fd;
     void *addr;
     char name[NAME_SIZE];
+    char rname[NAME_SIZE];
     size_t size;
+    int private;    /* COW copy of another instance region, never unlink */
 };
 
 struct io_mq {
@@ -70,9 +78,44 @@ struct io_mq {
     mqd_t mqdes;
 };
 
+/*
+ * The control socket is an abstract UNIX socket served by the parent. Each
+ * child that connects is passed the SHM region fds, a doorbell eventfd pair
+ * and the DMA map of fd backed guest RAM, so memory is shared once up front
+ * and the child can be restarted without the parent. Raising an IRQ is then
+ * a single eventfd write that the peer main loop polls directly.
+ */
+#define DOORBELL_TO_CHILD   0
+#define DOORBELL_TO_PARENT  1
+
+#define QEMU_IO_MAX_DMA_MAPS    32
+
+struct io_dma_map {
+    uint64_t addr;
+    uint64_t size;      /* 0 when unused */
+    uint64_t offset;
+    int fd;             /* parent only */
+    void *ptr;          /* child only */
+    void *base;         /* child page aligned mapping */
+    size_t len;
+    int refs;           /* child pointers handed out and not yet put */
+    bool dead;          /* child unmap deferred until refs drop to 0 */
+};
+
+struct io_ctl {
+    int fd[2];          /* doorbells */
+    int peer;           /* socket to peer, -1 when not connected */
+    GMutex lock;
+    GThread *thread;
+    void (*cb)(void *data, int fd);
+    void *data;
+    struct io_dma_map map[QEMU_IO_MAX_DMA_MAPS];
+};
+
 struct io_bridge {
     struct io_mq parent;
     struct io_mq child;
+    struct io_ctl ctl;
     GThread *io_thread;
     int (*cb)(void *data, struct qemu_io_msg *msg);
     struct io_shm shm[QEMU_IO_MAX_SHM_REGIONS];
@@ -82,6 +125,12 @@ struct io_bridge {
 static struct io_bridge _iob;
 static int _id = 0;
 
+/* bridge base name and optional instance suffix for all queues and SHM */
+static char _name[NAME_SIZE];
+static char _instance[NAME_SIZE];
+
+static void ctl_start(struct io_ctl *ctl);
+
 /* parent reader Q */
 static gpointer parent_reader_thread(gpointer data)
 {
@@ -170,12 +219,12 @@ static int mq_init(const char *name, struct io_bridge *io)
 
     if (role == ROLE_PARENT) {
 
-        sprintf(io->parent.thread_name, "io-bridge-%s", name);
+        sprintf(io->parent.thread_name, "io-bridge-%s%s", name, _instance);
         io->io_thread = g_thread_new(io->parent.thread_name,
             parent_reader_thread, io);
 
         /* parent Rx Q */
-        sprintf(io->parent.mq_name, "/qemu-io-parent-%s", name);
+        sprintf(io->parent.mq_name, "/qemu-io-parent-%s%s", name, _instance);
         io->parent.mqdes = mq_open(io->parent.mq_name, O_RDONLY | O_CREAT,
             0664, &io->parent.mqattr);
         if (io->parent.mqdes < 0) {
@@ -184,7 +233,7 @@ static int mq_init(const char *name, struct io_bridge *io)
         }
 
         /* parent Tx Q */
-        sprintf(io->child.mq_name, "/qemu-io-child-%s", name);
+        sprintf(io->child.mq_name, "/qemu-io-child-%s%s", name, _instance);
         io->child.mqdes = mq_open(io->child.mq_name, O_WRONLY | O_CREAT,
             0664, &io->child.mqattr);
         if (io->child.mqdes < 0) {
@@ -194,12 +243,12 @@ static int mq_init(const char *name, struct io_bridge *io)
 
     } else {
 
-        sprintf(io->child.thread_name, "io-bridge-%s", name);
+        sprintf(io->child.thread_name, "io-bridge-%s%s", name, _instance);
         io->io_thread = g_thread_new(io->child.thread_name,
             child_reader_thread, io);
 
         /* child Rx Q */
-        sprintf(io->child.mq_name, "/qemu-io-child-%s", name);
+        sprintf(io->child.mq_name, "/qemu-io-child-%s%s", name, _instance);
         io->child.mqdes = mq_open(io->child.mq_name, O_RDONLY | O_CREAT,
             0664, &io->child.mqattr);
         if (io->child.mqdes < 0) {
@@ -208,7 +257,7 @@ static int mq_init(const char *name, struct io_bridge *io)
         }
 
         /* child Tx Q */
-        sprintf(io->parent.mq_name, "/qemu-io-parent-%s", name);
+        sprintf(io->parent.mq_name, "/qemu-io-parent-%s%s", name, _instance);
         io->parent.mqdes = mq_open(io->parent.mq_name, O_WRONLY | O_CREAT,
             0664, &io->parent.mqattr);
         if (io->parent.mqdes < 0) {
@@ -234,8 +283,10 @@ int qemu_io_register_parent(const char *name,
     role = ROLE_PARENT;
     _iob.cb = cb;
     _iob.data = data;
+    snprintf(_name, sizeof(_name), "%s", name);
 
     mq_init(name, &_iob);
+    ctl_start(&_iob.ctl);
 
     return 0;
 }
@@ -251,8 +302,10 @@ int qemu_io_register_child(const char *name,
     role = ROLE_CHILD;
     _iob.cb = cb;
     _iob.data = data;
+    snprintf(_name, sizeof(_name), "%s", name);
 
     mq_init(name, &_iob);
+    ctl_start(&_iob.ctl);
 
     return ret;
 }
@@ -268,7 +321,8 @@ int qemu_io_register_shm(const char *rname, int region, size_t size, void **addr
         return -EBUSY;
 
     name = _iob.shm[region].name;
-    sprintf(name, "qemu-bridge-%s", rname);
+    sprintf(name, "qemu-bridge-%s%s", rname, _instance);
+    snprintf(_iob.shm[region].rname, NAME_SIZE, "%s", rname);
 
     fd = shm_open(name, O_RDWR | O_CREAT, 0664);
     if (fd < 0) {
@@ -305,7 +359,7 @@ int qemu_io_register_shm(const char *rname, int region, size_t size, void **addr
 
 int qemu_io_sync(int region, unsigned int offset, size_t length)
 {
-    if (region < 0 || region > QEMU_IO_MAX_SHM_REGIONS)
+    if (region < 0 || region >= QEMU_IO_MAX_SHM_REGIONS)
         return -EINVAL;
 
     /* check that region is in use */
@@ -363,7 +417,8 @@ void qemu_io_free(void)
     for (i = 0; i < QEMU_IO_MAX_SHM_REGIONS; i++) {
         if (_iob.shm[i].fd) {
             munmap(_iob.shm[i].addr, _iob.shm[i].size);
-            shm_unlink(_iob.shm[i].name);
+            if (!_iob.shm[i].private)
+                shm_unlink(_iob.shm[i].name);
             close(_iob.shm[i].fd);
         }
     }
@@ -381,8 +436,777 @@ void qemu_io_free_shm(int region)
             fprintf(stderr, "bridge-io: munmap failed %d\n", errno);
 
         /* client or host can unlink this, so it gets done twice */
-        shm_unlink(_iob.shm[region].name);
+        if (!_iob.shm[region].private)
+            shm_unlink(_iob.shm[region].name);
+        _iob.shm[region].private = 0;
         close(_iob.shm[region].fd);
         _iob.shm[region].fd = 0;
     }
 }
+
+void qemu_io_set_instance(const char *id)
+{
+    if (id && id[0])
+        snprintf(_instance, NAME_SIZE, "-%s", id);
+    else
+        _instance[0] = 0;
+}
+
+/* keep region at the same address but copy on write from the old SHM */
+static int shm_remap_private(struct io_shm *shm)
+{
+    void *a;
+
+    a = mmap(shm->addr, shm->size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_FIXED, shm->fd, 0);
+    if (a == MAP_FAILED) {
+        fprintf(stderr, "bridge-io: cant remap %s private %d\n",
+            shm->name, errno);
+        return -errno;
+    }
+
+    shm->private = 1;
+    return 0;
+}
+
+/* move region to a new SHM for this instance, seeded from the old one */
+static int shm_remap_copy(struct io_shm *shm)
+{
+    char name[NAME_SIZE];
+    ssize_t bytes;
+    void *a;
+    int fd, err;
+
+    sprintf(name, "qemu-bridge-%s%s", shm->rname, _instance);
+
+    fd = shm_open(name, O_RDWR | O_CREAT, 0664);
+    if (fd < 0) {
+        fprintf(stderr, "bridge-io: cant open SHM %s %d\n", name, errno);
+        return -errno;
+    }
+
+    if (ftruncate(fd, shm->size) < 0)
+        goto err;
+
+    a = mmap(shm->addr, shm->size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_FIXED, fd, 0);
+    if (a == MAP_FAILED)
+        goto err;
+
+    /* old mapping may not survive fork, so copy from the old SHM file */
+    bytes = pread(shm->fd, a, shm->size, 0);
+    if (bytes < 0 || (size_t)bytes != shm->size)
+        goto err;
+
+    if (io_bridge_debug)
+        fprintf(stdout, "bridge-io: %s moved to %s\n", shm->name, name);
+
+    close(shm->fd);
+    shm->fd = fd;
+    shm->private = 0;
+    strcpy(shm->name, name);
+    return 0;
+
+err:
+    err = errno ? errno : EIO;
+    fprintf(stderr, "bridge-io: cant move SHM %s to %s %d\n",
+        shm->name, name, err);
+    close(fd);
+    shm_unlink(name);
+    return -err;
+}
+
+static void ctl_reset(struct io_ctl *ctl);
+
+int qemu_io_fork_child(const char *id, uint32_t private_regions)
+{
+    struct io_shm *shm;
+    int i, ret;
+
+    if (role == ROLE_NONE)
+        return -EINVAL;
+
+    qemu_io_set_instance(id);
+
+    /*
+     * Queues still belong to the forking instance and our reader thread did
+     * not survive fork(), so open fresh queues under the new name.
+     */
+    mq_close(_iob.parent.mqdes);
+    mq_close(_iob.child.mqdes);
+
+    for (i = 0; i < QEMU_IO_MAX_SHM_REGIONS; i++) {
+        shm = &_iob.shm[i];
+        if (shm->fd == 0)
+            continue;
+
+        if (private_regions & (1U << i))
+            ret = shm_remap_private(shm);
+        else
+            ret = shm_remap_copy(shm);
+        if (ret < 0)
+            return ret;
+    }
+
+    /* control socket belongs to the old instance, reconnect under new name */
+    ctl_reset(&_iob.ctl);
+    ctl_start(&_iob.ctl);
+
+    return mq_init(_name, &_iob);
+}
+
+static socklen_t ctl_addr(struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    /* abstract namespace, so nothing is left behind on exit */
+    snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1,
+        "qemu-io-ctl-%s%s", _name, _instance);
+
+    return offsetof(struct sockaddr_un, sun_path) + 1 +
+        strlen(addr->sun_path + 1);
+}
+
+static int sock_send(int sock, struct qemu_io_sock_msg *msg, int *fds,
+    int nfds)
+{
+    char cbuf[CMSG_SPACE(sizeof(int) * QEMU_IO_SOCK_MAX_FDS)];
+    struct msghdr mh;
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = msg;
+    iov.iov_len = sizeof(*msg);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+
+    if (nfds) {
+        memset(cbuf, 0, sizeof(cbuf));
+        mh.msg_control = cbuf;
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+    }
+
+    if (sendmsg(sock, &mh, MSG_NOSIGNAL) < 0)
+        return -errno;
+    return 0;
+}
+
+/* returns number of fds received or -errno, -EPIPE when peer has gone */
+static int sock_recv(int sock, struct qemu_io_sock_msg *msg, int *fds)
+{
+    char cbuf[CMSG_SPACE(sizeof(int) * QEMU_IO_SOCK_MAX_FDS)];
+    struct msghdr mh;
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    ssize_t bytes;
+    int nfds = 0;
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = msg;
+    iov.iov_len = sizeof(*msg);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof(cbuf);
+
+    do {
+        bytes = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    } while (bytes < 0 && errno == EINTR);
+
+    if (bytes == 0)
+        return -EPIPE;
+    if (bytes < 0)
+        return -errno;
+
+    for (cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * nfds);
+    }
+
+    if (bytes != sizeof(*msg)) {
+        while (nfds)
+            close(fds[--nfds]);
+        return -EIO;
+    }
+
+    return nfds;
+}
+
+static int ctl_send_map(int sock, struct io_dma_map *map)
+{
+    struct qemu_io_sock_msg msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.request = QEMU_IO_SOCK_DMA_MAP;
+    msg.addr = map->addr;
+    msg.size = map->size;
+    msg.offset = map->offset;
+
+    return sock_send(sock, &msg, &map->fd, 1);
+}
+
+/* called with ctl lock held, everything the child needs to run */
+static int ctl_send_setup(struct io_ctl *ctl, int sock)
+{
+    struct qemu_io_sock_msg msg;
+    struct io_shm *shm;
+    int i, ret;
+
+    for (i = 0; i < QEMU_IO_MAX_SHM_REGIONS; i++) {
+        shm = &_iob.shm[i];
+        if (shm->fd == 0)
+            continue;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.request = QEMU_IO_SOCK_SHM;
+        msg.region = i;
+        msg.size = shm->size;
+        ret = sock_send(sock, &msg, &shm->fd, 1);
+        if (ret < 0)
+            return ret;
+    }
+
+    for (i = 0; i < QEMU_IO_MAX_DMA_MAPS; i++) {
+        if (ctl->map[i].size == 0)
+            continue;
+
+        ret = ctl_send_map(sock, &ctl->map[i]);
+        if (ret < 0)
+            return ret;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.request = QEMU_IO_SOCK_DOORBELL;
+    ret = sock_send(sock, &msg, ctl->fd, 2);
+    if (ret < 0)
+        return ret;
+
+    msg.request = QEMU_IO_SOCK_READY;
+    return sock_send(sock, &msg, NULL, 0);
+}
+
+/* parent serves the latest child that connects */
+static gpointer ctl_parent_thread(gpointer data)
+{
+    struct io_ctl *ctl = data;
+    struct sockaddr_un addr;
+    socklen_t len;
+    int sock, conn, old;
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        fprintf(stderr, "bridge-io: cant create control socket %d\n", errno);
+        return 0;
+    }
+
+    len = ctl_addr(&addr);
+    if (bind(sock, (struct sockaddr *)&addr, len) < 0 || listen(sock, 1) < 0) {
+        fprintf(stderr, "bridge-io: cant bind control socket %d\n", errno);
+        close(sock);
+        return 0;
+    }
+
+    while ((conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+
+        g_mutex_lock(&ctl->lock);
+        if (ctl_send_setup(ctl, conn) < 0) {
+            g_mutex_unlock(&ctl->lock);
+            close(conn);
+            continue;
+        }
+
+        /* any previous child is gone, it will see EOF */
+        old = ctl->peer;
+        ctl->peer = conn;
+        g_mutex_unlock(&ctl->lock);
+
+        if (old >= 0)
+            close(old);
+
+        if (io_bridge_debug)
+            fprintf(stdout, "bridge-io: child connected to control socket\n");
+    }
+
+    close(sock);
+    return 0;
+}
+
+/* bind our region to the parent memory if it is a different object */
+static void ctl_child_shm(struct qemu_io_sock_msg *msg, int fd)
+{
+    struct io_shm *shm;
+    struct stat a, b;
+    void *ptr;
+
+    if (msg->region >= QEMU_IO_MAX_SHM_REGIONS)
+        goto out;
+
+    shm = &_iob.shm[msg->region];
+    if (shm->fd == 0 || shm->size != msg->size)
+        goto out;
+
+    /* both sides opened it by name, already shared */
+    if (fstat(shm->fd, &a) == 0 && fstat(fd, &b) == 0 &&
+        a.st_dev == b.st_dev && a.st_ino == b.st_ino)
+        goto out;
+
+    ptr = mmap(shm->addr, shm->size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_FIXED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "bridge-io: cant bind %s to parent %d\n",
+            shm->name, errno);
+        goto out;
+    }
+
+    if (io_bridge_debug)
+        fprintf(stdout, "bridge-io: %s bound to parent region %d\n",
+            shm->name, msg->region);
+
+    close(shm->fd);
+    shm->fd = fd;
+    return;
+
+out:
+    close(fd);
+}
+
+static void ctl_child_map(struct io_ctl *ctl, struct qemu_io_sock_msg *msg,
+    int fd)
+{
+    struct io_dma_map *map = NULL;
+    uint64_t delta = msg->offset & (getpagesize() - 1);
+    size_t len = msg->size + delta;
+    void *base;
+    int i;
+
+    base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+        msg->offset - delta);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "bridge-io: cant map DMA 0x%" PRIx64 " size 0x%"
+            PRIx64 " %d\n", msg->addr, msg->size, errno);
+        return;
+    }
+
+    g_mutex_lock(&ctl->lock);
+    for (i = 0; i < QEMU_IO_MAX_DMA_MAPS; i++) {
+        if (ctl->map[i].size == 0) {
+            map = &ctl->map[i];
+            break;
+        }
+    }
+
+    if (map == NULL) {
+        g_mutex_unlock(&ctl->lock);
+        fprintf(stderr, "bridge-io: DMA map table full\n");
+        munmap(base, len);
+        return;
+    }
+
+    map->addr = msg->addr;
+    map->size = msg->size;
+    map->offset = msg->offset;
+    map->fd = -1;
+    map->base = base;
+    map->len = len;
+    map->ptr = base + delta;
+    g_mutex_unlock(&ctl->lock);
+
+    if (io_bridge_debug)
+        fprintf(stdout, "bridge-io: DMA map 0x%" PRIx64 " size 0x%" PRIx64
+            "\n", msg->addr, msg->size);
+}
+
+/* called with ctl lock held */
+static void ctl_child_unmap(struct io_dma_map *map)
+{
+    if (map->base)
+        munmap(map->base, map->len);
+    memset(map, 0, sizeof(*map));
+}
+
+/* called with ctl lock held, DMA engines may still be copying through it */
+static void ctl_child_release(struct io_dma_map *map)
+{
+    if (map->refs) {
+        map->dead = true;
+        return;
+    }
+
+    ctl_child_unmap(map);
+}
+
+static void ctl_child_unmap_addr(struct io_ctl *ctl, uint64_t addr)
+{
+    int i;
+
+    g_mutex_lock(&ctl->lock);
+    for (i = 0; i < QEMU_IO_MAX_DMA_MAPS; i++) {
+        if (ctl->map[i].size && !ctl->map[i].dead &&
+            ctl->map[i].addr == addr)
+            ctl_child_release(&ctl->map[i]);
+    }
+    g_mutex_unlock(&ctl->lock);
+}
+
+static void ctl_close_fds(int *fds, int nfds)
+{
+    while (nfds > 0)
+        close(fds[--nfds]);
+}
+
+/* handle one message from the parent, returns 1 when setup is complete */
+static int ctl_child_msg(struct io_ctl *ctl, struct qemu_io_sock_msg *msg,
+    int *fds, int nfds)
+{
+    switch (msg->request) {
+    case QEMU_IO_SOCK_SHM:
+        if (nfds == 1)
+            ctl_child_shm(msg, fds[0]);
+        else
+            ctl_close_fds(fds, nfds);
+        break;
+    case QEMU_IO_SOCK_DOORBELL:
+        if (nfds != 2) {
+            ctl_close_fds(fds, nfds);
+            break;
+        }
+        g_mutex_lock(&ctl->lock);
+        ctl->fd[DOORBELL_TO_CHILD] = fds[DOORBELL_TO_CHILD];
+        ctl->fd[DOORBELL_TO_PARENT] = fds[DOORBELL_TO_PARENT];
+        g_mutex_unlock(&ctl->lock);
+        break;
+    case QEMU_IO_SOCK_DMA_MAP:
+        if (nfds == 1)
+            ctl_child_map(ctl, msg, fds[0]);
+        else
+            ctl_close_fds(fds, nfds);
+        break;
+    case QEMU_IO_SOCK_DMA_UNMAP:
+        ctl_close_fds(fds, nfds);
+        ctl_child_unmap_addr(ctl, msg->addr);
+        break;
+    case QEMU_IO_SOCK_READY:
+        ctl_close_fds(fds, nfds);
+        return 1;
+    default:
+        ctl_close_fds(fds, nfds);
+        break;
+    }
+
+    return 0;
+}
+
+/* drop everything the parent gave us, lock not held */
+static void ctl_child_disconnect(struct io_ctl *ctl)
+{
+    int i, peer;
+
+    if (ctl->cb)
+        ctl->cb(ctl->data, -1);
+
+    g_mutex_lock(&ctl->lock);
+    for (i = 0; i < QEMU_IO_MAX_DMA_MAPS; i++) {
+        if (ctl->map[i].size && !ctl->map[i].dead)
+            ctl_child_release(&ctl->map[i]);
+    }
+    if (ctl->fd[DOORBELL_TO_CHILD] >= 0)
+        close(ctl->fd[DOORBELL_TO_CHILD]);
+    if (ctl->fd[DOORBELL_TO_PARENT] >= 0)
+        close(ctl->fd[DOORBELL_TO_PARENT]);
+    ctl->fd[DOORBELL_TO_CHILD] = -1;
+    ctl->fd[DOORBELL_TO_PARENT] = -1;
+    peer = ctl->peer;
+    ctl->peer = -1;
+    g_mutex_unlock(&ctl->lock);
+
+    if (peer >= 0)
+        close(peer);
+}
+
+/* child keeps trying to reach the parent and rebinds if the parent restarts */
+static gpointer ctl_child_thread(gpointer data)
+{
+    struct io_ctl *ctl = data;
+    struct qemu_io_sock_msg msg;
+    struct sockaddr_un addr;
+    socklen_t len;
+    int sock, nfds, rx, ready;
+    int fds[QEMU_IO_SOCK_MAX_FDS];
+
+    while (1) {
+
+        sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (sock < 0)
+            return 0;
+
+        len = ctl_addr(&addr);
+        if (connect(sock, (struct sockaddr *)&addr, len) < 0) {
+            close(sock);
+            g_usleep(100000);
+            continue;
+        }
+
+        /* setup from parent */
+        ready = 0;
+        while (!ready && (nfds = sock_recv(sock, &msg, fds)) >= 0)
+            ready = ctl_child_msg(ctl, &msg, fds, nfds);
+
+        g_mutex_lock(&ctl->lock);
+        ctl->peer = sock;
+        rx = ctl->fd[DOORBELL_TO_CHILD];
+        rx = ready && ctl->cb && rx >= 0 ? dup(rx) : -1;
+        g_mutex_unlock(&ctl->lock);
+
+        if (ready) {
+            if (io_bridge_debug)
+                fprintf(stdout, "bridge-io: connected to parent\n");
+
+            if (rx >= 0)
+                ctl->cb(ctl->data, rx);
+
+            /* DMA map updates until the parent goes away */
+            while ((nfds = sock_recv(sock, &msg, fds)) >= 0)
+                ctl_child_msg(ctl, &msg, fds, nfds);
+        }
+
+        ctl_child_disconnect(ctl);
+        g_usleep(100000);
+    }
+
+    return 0;
+}
+
+static void ctl_start(struct io_ctl *ctl)
+{
+    g_mutex_init(&ctl->lock);
+    ctl->peer = -1;
+    ctl->fd[DOORBELL_TO_CHILD] = -1;
+    ctl->fd[DOORBELL_TO_PARENT] = -1;
+
+    if (role == ROLE_PARENT) {
+        ctl->fd[DOORBELL_TO_CHILD] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ctl->fd[DOORBELL_TO_PARENT] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ctl->fd[DOORBELL_TO_CHILD] < 0 ||
+            ctl->fd[DOORBELL_TO_PARENT] < 0)
+            fprintf(stderr, "bridge-io: cant create doorbells %d\n", errno);
+
+        ctl->thread = g_thread_new("io-bridge-ctl", ctl_parent_thread, ctl);
+    } else {
+        ctl->thread = g_thread_new("io-bridge-ctl", ctl_child_thread, ctl);
+    }
+}
+
+/* forked child, parent state and our old thread are gone */
+static void ctl_reset(struct io_ctl *ctl)
+{
+    int i;
+
+    if (ctl->cb)
+        ctl->cb(ctl->data, -1);
+
+    for (i = 0; i < QEMU_IO_MAX_DMA_MAPS; i++)
+        ctl_child_unmap(&ctl->map[i]);
+    if (ctl->peer >= 0)
+        close(ctl->peer);
+    if (ctl->fd[DOORBELL_TO_CHILD] >= 0)
+        close(ctl->fd[DOORBELL_TO_CHILD]);
+    if (ctl->fd[DOORBELL_TO_PARENT] >= 0)
+        close(ctl->fd[DOORBELL_TO_PARENT]);
+}
+
+int qemu_io_register_doorbell(void (*cb)(void *data, int fd), void *data)
+{
+    struct io_ctl *ctl = &_iob.ctl;
+    int rx;
+
+    if (role == ROLE_NONE || ctl->cb)
+        return -EINVAL;
+
+    g_mutex_lock(&ctl->lock);
+    ctl->cb = cb;
+    ctl->data = data;
+    if (role == ROLE_PARENT)
+        rx = ctl->fd[DOORBELL_TO_PARENT];
+    else
+        rx = ctl->peer >= 0 ? ctl->fd[DOORBELL_TO_CHILD] : -1;
+    rx = rx >= 0 ? dup(rx) : -1;
+    g_mutex_unlock(&ctl->lock);
+
+    if (rx >= 0)
+        cb(data, rx);
+
+    return 0;
+}
+
+int qemu_io_ring_doorbell(void)
+{
+    struct io_ctl *ctl = &_iob.ctl;
+    uint64_t val = 1;
+    int fd, ret = -ENODEV;
+
+    if (role == ROLE_NONE)
+        return -ENODEV;
+
+    g_mutex_lock(&ctl->lock);
+    fd = role == ROLE_PARENT ?
+        ctl->fd[DOORBELL_TO_CHILD] : ctl->fd[DOORBELL_TO_PARENT];
+    if (ctl->peer >= 0 && fd >= 0)
+        ret = write(fd, &val, sizeof(val)) == sizeof(val) ? 0 : -errno;
+    g_mutex_unlock(&ctl->lock);
+
+    return ret;
+}
+
+int qemu_io_send_irq(uint32_t irq)
+{
+    struct qemu_io_msg_irq msg;
+
+    /* doorbell carries no payload, the peer reads status from SHM */
+    if (irq == 0 && qemu_io_ring_doorbell() == 0)
+        return 0;
+
+    msg.hdr.type = QEMU_IO_TYPE_IRQ;
+    msg.hdr.msg = QEMU_IO_MSG_IRQ;
+    msg.hdr.size = sizeof(msg);
+    msg.irq = irq;
+
+    return qemu_io_send_msg(&msg.hdr);
+}
+
+bool qemu_io_peer_connected(void)
+{
+    struct io_ctl *ctl = &_iob.ctl;
+    bool connected;
+
+    if (role == ROLE_NONE)
+        return false;
+
+    g_mutex_lock(&ctl->lock);
+    connected = ctl->peer >= 0;
+    g_mutex_unlock(&ctl->lock);
+
+    return connected;
+}
+
+int qemu_io_add_dma_map(uint64_t addr, uint64_t size, int fd,
+    uint64_t offset)
+{
+    struct io_ctl *ctl = &_iob.ctl;
+    struct io_dma_map *map = NULL;
+    int i, ret = 0;
+
+    if (role != ROLE_PARENT || size == 0 || fd < 0)
+        return -EINVAL;
+
+    g_mutex_lock(&ctl->lock);
+    for (i = 0; i < QEMU_IO_MAX_DMA_MAPS; i++) {
+        if (ctl->map[i].size == 0) {
+            map = &ctl->map[i];
+            break;
+        }
+    }
+
+    if (map == NULL) {
+        g_mutex_unlock(&ctl->lock);
+        return -ENOMEM;
+    }
+
+    map->addr = addr;
+    map->size = size;
+    map->offset = offset;
+    map->fd = fd;
+
+    if (ctl->peer >= 0)
+        ret = ctl_send_map(ctl->peer, map);
+    g_mutex_unlock(&ctl->lock);
+
+    return ret;
+}
+
+void qemu_io_del_dma_map(uint64_t addr)
+{
+    struct io_ctl *ctl = &_iob.ctl;
+    struct qemu_io_sock_msg msg;
+    int i;
+
+    if (role != ROLE_PARENT)
+        return;
+
+    g_mutex_lock(&ctl->lock);
+    for (i = 0; i < QEMU_IO_MAX_DMA_MAPS; i++) {
+        if (ctl->map[i].size == 0 || ctl->map[i].addr != addr)
+            continue;
+
+        memset(&ctl->map[i], 0, sizeof(ctl->map[i]));
+        if (ctl->peer >= 0) {
+            memset(&msg, 0, sizeof(msg));
+            msg.request = QEMU_IO_SOCK_DMA_UNMAP;
+            msg.addr = addr;
+            sock_send(ctl->peer, &msg, NULL, 0);
+        }
+    }
+    g_mutex_unlock(&ctl->lock);
+}
+
+/*
+ * The returned pointer stays mapped until it is passed to qemu_io_dma_put(),
+ * even if the parent unmaps the guest RAM or goes away meanwhile.
+ */
+void *qemu_io_dma_map(uint64_t addr, uint64_t size)
+{
+    struct io_ctl *ctl = &_iob.ctl;
+    struct io_dma_map *map;
+    void *ptr = NULL;
+    int i;
+
+    if (role != ROLE_CHILD)
+        return NULL;
+
+    g_mutex_lock(&ctl->lock);
+    for (i = 0; i < QEMU_IO_MAX_DMA_MAPS; i++) {
+        map = &ctl->map[i];
+
+        if (map->size && !map->dead && addr >= map->addr &&
+            addr - map->addr + size <= map->size) {
+            ptr = map->ptr + (addr - map->addr);
+            map->refs++;
+            break;
+        }
+    }
+    g_mutex_unlock(&ctl->lock);
+
+    return ptr;
+}
+
+/* drop a pointer from qemu_io_dma_map(), NULL is ignored */
+void qemu_io_dma_put(void *ptr)
+{
+    struct io_ctl *ctl = &_iob.ctl;
+    struct io_dma_map *map;
+    int i;
+
+    if (ptr == NULL || role != ROLE_CHILD)
+        return;
+
+    g_mutex_lock(&ctl->lock);
+    for (i = 0; i < QEMU_IO_MAX_DMA_MAPS; i++) {
+        map = &ctl->map[i];
+
+        if (map->refs && ptr >= map->base && ptr < map->base + map->len) {
+            if (--map->refs == 0 && map->dead)
+                ctl_child_unmap(map);
+            break;
+        }
+    }
+    g_mutex_unlock(&ctl->lock);
+}